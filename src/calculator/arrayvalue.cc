@@ -0,0 +1,378 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/language.h>
+#include <lax/misc.h>
+#include "arrayvalue.h"
+#include "../core/binaryattribute.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+
+using namespace Laxkit;
+
+
+namespace Laidout {
+
+
+/*! \class NumericArrayValue
+ * Dense 1-D or 2-D array of doubles, floats, or ints in one contiguous block of memory.
+ *
+ * This is for large amounts of numbers, where a SetValue of separately allocated DoubleValues
+ * is far too slow. Elements are stored row by row, width elements per row.
+ * Use ToSet() and FromSet() to convert to and from sets.
+ */
+
+
+int NewArrayObject(ValueHash *context, ValueHash *parameters, Value **value_ret, ErrorLog &log)
+{
+	NumericArrayValue *v = nullptr;
+
+	SetValue *set = (parameters ? dynamic_cast<SetValue*>(parameters->find("set")) : nullptr);
+	if (set) {
+		v = NumericArrayValue::FromSet(set);
+		if (!v) {
+			log.AddError(_("Set must contain only numbers, or sets of numbers of the same size"));
+			return 1;
+		}
+	} else v = new NumericArrayValue();
+
+	*value_ret = v;
+	return 0;
+}
+
+int NumericArrayValue::array_value_type = VALUE_MaxBuiltIn + getUniqueNumber();
+
+
+NumericArrayValue::NumericArrayValue(ElementType ntype, int nwidth, int nheight)
+{
+	data = nullptr;
+	capacity = 0;
+	element_type = ntype;
+	width = height = 0;
+	Resize(ntype, nwidth, nheight);
+}
+
+NumericArrayValue::~NumericArrayValue()
+{
+	delete[] data;
+}
+
+/*! Set to the new size. Contents are undefined after. Memory is only reallocated when
+ * the new size needs more than is already allocated.
+ */
+void NumericArrayValue::Resize(ElementType ntype, int nwidth, int nheight)
+{
+	if (nwidth < 0) nwidth = 0;
+	if (nheight < 1) nheight = 1;
+
+	long bytes = (long)nwidth * nheight * (ntype == Double ? sizeof(double) : ntype == Float ? sizeof(float) : sizeof(int));
+	if (bytes > capacity) {
+		delete[] data;
+		data = new double[(bytes + sizeof(double)-1) / sizeof(double)];
+		capacity = bytes;
+	}
+	element_type = ntype;
+	width  = nwidth;
+	height = nheight;
+}
+
+double NumericArrayValue::Get(long i)
+{
+	if (element_type == Double) return data[i];
+	if (element_type == Float)  return reinterpret_cast<float*>(data)[i];
+	return reinterpret_cast<int*>(data)[i];
+}
+
+void NumericArrayValue::Set(long i, double value)
+{
+	if      (element_type == Double) data[i] = value;
+	else if (element_type == Float)  reinterpret_cast<float*>(data)[i] = value;
+	else                             reinterpret_cast<int*>(data)[i] = value;
+}
+
+/*! Return the elements as doubles. For Double arrays, this is the array's own memory.
+ * Otherwise, elements are converted into scratch, and scratch's memory is returned.
+ */
+const double *NumericArrayValue::AsDoubles(std::vector<double> &scratch)
+{
+	if (element_type == Double) return data;
+
+	long num = n();
+	scratch.resize(num);
+	double *d = scratch.data();
+	if (element_type == Float) {
+		const float *f = Floats();
+		for (long c = 0; c < num; c++) d[c] = f[c];
+	} else {
+		const int *i = Ints();
+		for (long c = 0; c < num; c++) d[c] = i[c];
+	}
+	return d;
+}
+
+/*! Return a new set of DoubleValue or IntValue, or for 2-D arrays, a set of rows.
+ */
+SetValue *NumericArrayValue::ToSet()
+{
+	SetValue *set = new SetValue();
+	for (int r = 0; r < height; r++) {
+		SetValue *row = set;
+		if (height > 1) {
+			row = new SetValue();
+			set->Push(row, 1);
+		}
+		for (int c = 0; c < width; c++) {
+			long i = (long)r * width + c;
+			if (element_type == Int) row->Push(new IntValue(Ints()[i]), 1);
+			else row->Push(new DoubleValue(Get(i)), 1);
+		}
+	}
+	return set;
+}
+
+/*! Return a new array from a set of numbers, or a set of sets of numbers all the same size.
+ * Returns nullptr if set contains anything else.
+ */
+NumericArrayValue *NumericArrayValue::FromSet(SetValue *set, ElementType ntype)
+{
+	if (!set) return nullptr;
+
+	int rows = 1, cols = set->n();
+	bool nested = (cols && set->e(0)->type() == VALUE_Set);
+	if (nested) {
+		rows = set->n();
+		cols = dynamic_cast<SetValue*>(set->e(0))->n();
+	}
+
+	NumericArrayValue *array = new NumericArrayValue(ntype, cols, rows);
+	for (int r = 0; r < rows; r++) {
+		SetValue *row = set;
+		if (nested) {
+			row = dynamic_cast<SetValue*>(set->e(r));
+			if (!row || row->n() != cols) {
+				delete array;
+				return nullptr;
+			}
+		}
+		for (int c = 0; c < cols; c++) {
+			int isnum = 0;
+			double d = getNumberValue(row->e(c), &isnum);
+			if (!isnum) {
+				delete array;
+				return nullptr;
+			}
+			array->Set((long)r * cols + c, d);
+		}
+	}
+	return array;
+}
+
+ObjectDef *NumericArrayValue::makeObjectDef()
+{
+	objectdef = stylemanager.FindDef("NumericArray");
+
+	if (objectdef) {
+		objectdef->inc_count();
+		return objectdef;
+	}
+
+	objectdef = new ObjectDef(NULL,"NumericArray",
+			_("Numeric array"),
+			_("Dense 1 or 2 dimensional array of numbers"),
+			"class",
+			NULL,NULL, //range, default value
+			NULL,0, //fields, flags
+			NULL, NewArrayObject);
+
+	objectdef->pushFunction("ToSet", _("To set"), _("Return a set of the numbers in the array"),
+					 NULL, //evaluator
+					 NULL);
+	objectdef->pushFunction("Width", _("Width"), _("Number of columns"),
+					 NULL,
+					 NULL);
+	objectdef->pushFunction("Height", _("Height"), _("Number of rows"),
+					 NULL,
+					 NULL);
+
+	stylemanager.AddObjectDef(objectdef,0);
+
+	return objectdef;
+}
+
+int NumericArrayValue::getValueStr(char *buffer,int len)
+{
+	long needed = n() * 20 + height * 3 + 3;
+	if (!buffer || len < needed) return needed;
+
+	char *s = buffer;
+	if (height > 1) *s++ = '[';
+	for (int r = 0; r < height; r++) {
+		*s++ = '[';
+		for (int c = 0; c < width; c++) {
+			long i = (long)r * width + c;
+			if (element_type == Int) s += sprintf(s, "%d", Ints()[i]);
+			else s += sprintf(s, "%.10g", Get(i));
+			if (c < width-1) *s++ = ',';
+		}
+		*s++ = ']';
+		if (r < height-1) *s++ = ',';
+	}
+	if (height > 1) *s++ = ']';
+	*s = '\0';
+
+	modified = 0;
+	return 0;
+}
+
+Value *NumericArrayValue::duplicateValue()
+{
+	NumericArrayValue *dup = new NumericArrayValue(element_type, width, height);
+	if (n()) memcpy(dup->data, data, n() * (element_type == Double ? sizeof(double) : element_type == Float ? sizeof(float) : sizeof(int)));
+	return dup;
+}
+
+/*! Return a new number for 1-D arrays, or a new array of row index for 2-D arrays.
+ */
+Value *NumericArrayValue::dereference(int index)
+{
+	if (height > 1) {
+		if (index < 0 || index >= height) return nullptr;
+		NumericArrayValue *row = new NumericArrayValue(element_type, width, 1);
+		for (int c = 0; c < width; c++) row->Set(c, Get((long)index * width + c));
+		return row;
+	}
+
+	if (index < 0 || index >= width) return nullptr;
+	if (element_type == Int) return new IntValue(Ints()[index]);
+	return new DoubleValue(Get(index));
+}
+
+int NumericArrayValue::Evaluate(const char *func,int len, ValueHash *context, ValueHash *pp, CalcSettings *settings,
+						 Value **value_ret, Laxkit::ErrorLog *log)
+{
+	if (isName(func,len, "ToSet")) {
+		*value_ret = ToSet();
+		return 0;
+
+	} else if (isName(func,len, "Width")) {
+		*value_ret = new IntValue(width);
+		return 0;
+
+	} else if (isName(func,len, "Height")) {
+		*value_ret = new IntValue(height);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*! Dump type, width, height, and the numbers. When saving to a binary file, the numbers are
+ * passed to the BinaryDumpContext as is, instead of being printed.
+ */
+Laxkit::Attribute *NumericArrayValue::dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context)
+{
+	if (!att) att = new Attribute;
+
+	if (what == -1) {
+		att->push("type",   "double", "or float, or int");
+		att->push("width",  "3",      "Number of columns");
+		att->push("height", "2",      "Number of rows, 1 for 1 dimensional arrays");
+		att->push("values", "[[1,2,3],[4,5,6]]");
+		return att;
+	}
+
+	att->push("type", element_type == Double ? "double" : element_type == Float ? "float" : "int");
+	att->push("width",  width);
+	att->push("height", height);
+
+	Attribute *vatt = att->pushSubAtt("values");
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	if (bcontext) {
+		std::vector<double> scratch;
+		bcontext->PutNumbers(vatt, AsDoubles(scratch), n());
+	} else {
+		int len = getValueStr(nullptr, 0);
+		char *buffer = new char[len];
+		getValueStr(buffer, len);
+		makestr(vatt->value, buffer);
+		delete[] buffer;
+	}
+
+	return att;
+}
+
+/*! Read what dump_out_atts() writes. Numbers from a binary file are copied straight from
+ * the BinaryDumpContext. Otherwise, brackets and commas in values are skipped.
+ */
+void NumericArrayValue::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context)
+{
+	if (!att) return;
+
+	ElementType ntype = Double;
+	int nwidth = 0, nheight = 1;
+	const char *values = nullptr;
+
+	for (int c=0; c<att->attributes.n; c++) {
+		const char *name  = att->attributes.e[c]->name;
+		const char *value = att->attributes.e[c]->value;
+
+		if (!strcmp(name, "type")) {
+			if (value && !strcmp(value, "float")) ntype = Float;
+			else if (value && !strcmp(value, "int")) ntype = Int;
+			else ntype = Double;
+
+		} else if (!strcmp(name, "width")) {
+			IntAttribute(value, &nwidth);
+
+		} else if (!strcmp(name, "height")) {
+			IntAttribute(value, &nheight);
+
+		} else if (!strcmp(name, "values")) {
+			values = value;
+		}
+	}
+
+	Resize(ntype, nwidth, nheight);
+	long num = n();
+
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	long nnums = 0;
+	const double *nums = (bcontext ? bcontext->GetNumbers(values, &nnums) : nullptr);
+	if (nums) {
+		for (long c = 0; c < num; c++) Set(c, c < nnums ? nums[c] : 0);
+		return;
+	}
+
+	const char *p = values;
+	char *end;
+	for (long c = 0; c < num; c++) {
+		double d = 0;
+		while (p && *p && (*p == '[' || *p == ']' || *p == ',' || isspace((unsigned char)*p))) p++;
+		if (p && *p) {
+			d = strtod(p, &end);
+			if (end == p) p = nullptr;
+			else p = end;
+		}
+		Set(c, d);
+	}
+}
+
+
+} //namespace Laidout
+
@@ -0,0 +1,81 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef ARRAYVALUE_H
+#define ARRAYVALUE_H
+
+
+#include "../core/stylemanager.h"
+#include "values.h"
+
+#include <vector>
+
+
+namespace Laidout {
+
+
+//------------------------ NumericArrayValue ------------------------
+
+class NumericArrayValue : public Value, virtual public FunctionEvaluator
+{
+	static int array_value_type;
+
+  protected:
+	double *data; //storage for any element type, aligned for doubles
+	long capacity; //in bytes
+
+  public:
+	enum ElementType { Double, Float, Int };
+
+	ElementType element_type;
+	int width;  //number of columns
+	int height; //number of rows, 1 for 1-D arrays
+
+	static int TypeNumber() { return array_value_type; }
+
+	NumericArrayValue(ElementType ntype = Double, int nwidth = 0, int nheight = 1);
+	virtual ~NumericArrayValue();
+	virtual const char *whattype() { return "NumericArrayValue"; }
+	virtual int type() { return array_value_type; }
+	virtual ObjectDef *makeObjectDef();
+	virtual int getValueStr(char *buffer,int len);
+	virtual Value *duplicateValue();
+	virtual Value *dereference(int index);
+	virtual int getNumFields() { return height > 1 ? height : width; }
+	virtual int Evaluate(const char *func,int len, ValueHash *context, ValueHash *parameters, CalcSettings *settings,
+						 Value **value_ret, Laxkit::ErrorLog *log);
+	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context);
+	virtual void dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
+
+	long n() { return (long)width * height; }
+	int Dimensions() { return height > 1 ? 2 : 1; }
+	virtual void Resize(ElementType ntype, int nwidth, int nheight = 1);
+
+	double *Doubles() { return element_type == Double ? data : nullptr; }
+	float  *Floats()  { return element_type == Float  ? reinterpret_cast<float*>(data) : nullptr; }
+	int    *Ints()    { return element_type == Int    ? reinterpret_cast<int*>(data) : nullptr; }
+	virtual const double *AsDoubles(std::vector<double> &scratch);
+	double Get(long i);
+	void Set(long i, double value);
+
+	virtual SetValue *ToSet();
+	static NumericArrayValue *FromSet(SetValue *set, ElementType ntype = Double);
+};
+
+
+} //namespace Laidout
+
+
+#endif
+
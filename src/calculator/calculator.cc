@@ -1052,6 +1052,134 @@ Value *LValue::Resolve()
 }
 
 
+//------------------------------------ CalculatorCode -----------------------------
+
+/*! \class CalculatorInstruction
+ * One step of a CalculatorCode. What the fields mean depends on code.
+ */
+
+CalculatorInstruction::CalculatorInstruction(CalculatorCodeOps ncode, int narg, int npos)
+{
+	code    = ncode;
+	arg     = narg;
+	pos     = npos;
+	name    = nullptr;
+	len     = 0;
+	opfunc  = nullptr;
+	oplevel = nullptr;
+	opindex = -1;
+	dir     = 0;
+}
+
+CalculatorInstruction::~CalculatorInstruction()
+{
+	delete[] name;
+}
+
+
+/*! \class CalculatorCall
+ * Function call info for CODE_Call instructions. The function names are resolved
+ * when the statement is compiled, so only the parameter values are computed per call.
+ */
+
+CalculatorCall::CalculatorCall(const char *nname, int nlen)
+  : param_names(LISTS_DELETE_Array)
+{
+	name        = newnstr(nname, nlen);
+	len         = nlen;
+	has_params  = false;
+	constructor = false;
+	mapdef      = nullptr;
+	containing  = nullptr;
+}
+
+CalculatorCall::~CalculatorCall()
+{
+	delete[] name;
+	if (containing) containing->dec_count();
+}
+
+
+/*! \class CalculatorCode
+ * A single compiled expression of a script, for the small stack machine in
+ * LaidoutCalculator::runCode().
+ *
+ * Only plain expressions are compiled: numbers, strings, variables, sets, left hand
+ * and binary operators, and function calls. Anything else (assignments, blocks, member access of
+ * values, etc) has interpret==true, and is parsed from the source every time as usual.
+ */
+
+CalculatorCode::CalculatorCode(int nstart)
+{
+	start     = end = nstart;
+	lines     = 0;
+	interpret = false;
+	max_stack = 0;
+}
+
+
+/*! \class CompiledScript
+ * Cache of CalculatorCode objects for each statement of a script, keyed by position in the source.
+ * Statements are added as they are first encountered, so loop bodies get compiled
+ * once, and are reused for each iteration, and for later evaluation of the same script.
+ */
+
+CompiledScript::CompiledScript(const char *nsource, int nlen, const char *nsignature, int ngeneration)
+{
+	source     = newnstr(nsource, nlen);
+	len        = nlen;
+	signature  = newstr(nsignature);
+	generation = ngeneration;
+}
+
+CompiledScript::~CompiledScript()
+{
+	delete[] source;
+	delete[] signature;
+}
+
+/*! Return 1 if this is the same source, compiled against parameters with the same names.
+ */
+int CompiledScript::Matches(const char *nsource, int nlen, const char *nsignature)
+{
+	if (nlen != len) return 0;
+	if (strncmp(nsource, source, len)) return 0;
+	if (!nsignature) nsignature = "";
+	return !strcmp(nsignature, signature ? signature : "");
+}
+
+/*! Return the statement beginning at start, or nullptr if not compiled yet.
+ */
+CalculatorCode *CompiledScript::Find(int start)
+{
+	int s = 0, e = statements.n-1, m;
+	while (s <= e) {
+		m = (s+e)/2;
+		if (statements.e[m]->start == start) return statements.e[m];
+		if (statements.e[m]->start < start) s = m+1;
+		else e = m-1;
+	}
+	return nullptr;
+}
+
+/*! Insert keeping statements sorted by start. Incs count of statement.
+ */
+void CompiledScript::Add(CalculatorCode *statement)
+{
+	int c = statements.n;
+	while (c > 0 && statements.e[c-1]->start > statement->start) c--;
+	statements.push(statement, -1, c);
+}
+
+/*! Throw out all compiled statements, for instance when names they refer to might have changed.
+ */
+void CompiledScript::Flush(int ngeneration)
+{
+	statements.flush();
+	generation = ngeneration;
+}
+
+
 //------------------------------------ LaidoutCalculator -----------------------------
 /*! \class LaidoutCalculator
  * \brief Command processing backbone.
@@ -1106,6 +1234,13 @@ LaidoutCalculator::LaidoutCalculator()
 	errorlog=&default_errorlog;
 	last_answer = nullptr;
 
+	current_script = nullptr;
+	max_compiled_scripts = 100;
+	names_generation = 0;
+	param_scope = -1;
+	cur_context = nullptr;
+	cur_parameters = nullptr;
+
 	global_scope.scope_namespace=new ObjectDef(nullptr, "Global", _("Global"), _("Global namespace"), "namespace",nullptr,nullptr);
 	scopes.push(&global_scope,0); //push so as to not delete global scope
 
@@ -1178,6 +1313,7 @@ int LaidoutCalculator::InstallVariables(ValueHash *values)
 			ve->SetVariable(nullptr,values->value(c),0);
 		} else {
 			global_scope.AddValue(values->key(c),values->value(c));
+			namesChanged();
 		}
 	}
 	return 0;
@@ -1202,6 +1338,7 @@ CalculatorModule *LaidoutCalculator::FindModule(const char *module)
 int LaidoutCalculator::InstallModule(CalculatorModule *module, int autoimport)
 {
 	modules.push(module);
+	namesChanged();
 	//global_scope.AddName(module,module,nullptr);
 	if (autoimport) currentLevel()->AddName(module,module,nullptr);
 	if (autoimport==2) importAllNames(module);
@@ -1245,6 +1382,7 @@ int LaidoutCalculator::ImportModule(const char *name, int allnames)
 	}
 	if (!entry) {
 		 //module is not accessible at any scope, so add it to current
+		namesChanged();
 		currentLevel()->AddName(module,module,nullptr);
 		importOperators(module);
 	}
@@ -1261,6 +1399,7 @@ int LaidoutCalculator::RemoveModule(const char *modulename)
 		if (!strcmp(modulename, modules.e[c]->name)) {
 			cerr << " *** WARNING! need to implement removing all name and dependencies to module from all namespaces when remove module"<<endl;
 			modules.remove(c);
+			namesChanged();
 		}
 	}
 	if (c==modules.n) return 1;
@@ -1457,6 +1596,9 @@ int LaidoutCalculator::Evaluate(const char *in, int len, Value **value_ret, Erro
 
 	if (curexprslen > len) curexprslen = len;
 
+	CompiledScript *oldscript = current_script;
+	current_script = findCompiledScript(curexprs, curexprslen);
+
 	skipwscomment();
 	int curscope = scopes.n;
 
@@ -1470,25 +1612,27 @@ int LaidoutCalculator::Evaluate(const char *in, int len, Value **value_ret, Erro
 		if (answer) { answer->dec_count(); answer = nullptr; }
 
 
-		if (sessioncommand()) { //  checks for session commands 
+		if (!compiledStatementAt()) { //compiled statements are known to be plain expressions
+			if (sessioncommand()) { //  checks for session commands 
+				if (calcerror) break;
+				//if (!messagebuffer) messageOut(_("Ok."));
+				skipwscomment();
+				if (from >= curexprslen) break;
+				if (nextchar(';')) ; //advance past a ;
+				continue;
+			}
+
 			if (calcerror) break;
-			//if (!messagebuffer) messageOut(_("Ok."));
+
 			skipwscomment();
-			if (from >= curexprslen) break;
-			if (nextchar(';')) ; //advance past a ;
-			continue;
+			if (checkBlock(&answer)) continue;
+			//if (scopes.n>1 && (nextchar('}') || nextword("break"))) {
+			//	popScope();
+			//	continue;
+			//}
 		}
 
-		if (calcerror) break;
-
-		skipwscomment();
-		if (checkBlock(&answer)) continue;
-		//if (scopes.n>1 && (nextchar('}') || nextword("break"))) {
-		//	popScope();
-		//	continue;
-		//}
-
-		answer = evalLevel(0);
+		answer = evalStatement();
 		if (calcerror) break;
 
 		if (run_mode != RUN_NameCatalog && answer && answer->type() == VALUE_LValue) {
@@ -1514,8 +1658,12 @@ int LaidoutCalculator::Evaluate(const char *in, int len, Value **value_ret, Erro
 		if (answer) { answer->dec_count(); answer = nullptr; }
 	}
 
+	if (scopes.n != curscope) namesChanged();
 	while (scopes.n != curscope) scopes.remove(scopes.n-1);
 
+	if (current_script) current_script->dec_count();
+	current_script = oldscript;
+
 	if (value_ret) { *value_ret = answer; if (answer) answer->inc_count(); }
 	if (last_answer) last_answer->dec_count();
 	last_answer = answer; //last_answer takes the reference
@@ -1559,23 +1707,38 @@ int LaidoutCalculator::evaluate(const char *in, int len, ValueHash *context, Val
 	int oldlen=curexprslen;
 	int oldline=curline;
 	char *texprs=newnstr(curexprs,curexprslen);
+	int oldparamscope=param_scope;
+	ValueHash *oldcontext=cur_context;
+	ValueHash *oldparameters=cur_parameters;
+	std::vector<Entry*> oldparameter_entries;
+	oldparameter_entries.swap(cur_parameter_entries);
 
 
 	 //2. establish parameters and process the call
 	if (context || parameters) {
 		pushScope(BLOCK_function, 0,0,nullptr,nullptr,nullptr);
 		BlockInfo *evalscope=currentLevel();
+		param_scope=scopes.n-1;
+		cur_context=context;
+		cur_parameters=parameters;
 	
 		if (context) {
 			evalscope->AddValue("context",context);
 		}
 
 		if (parameters && parameters->n()) {
+			 //compiled reads of parameters go through these entries, so they see assignments
+			cur_parameter_entries.resize(parameters->n(), nullptr);
 			for (int c=0; c<parameters->n(); c++) {
 				if (!parameters->key(c)) continue; //skip unnamed parameters
 				evalscope->AddValue(parameters->key(c),parameters->value(c));
+				cur_parameter_entries[c] = evalscope->FindName(parameters->key(c), strlen(parameters->key(c)));
 			}
 		}
+	} else {
+		param_scope=-1;
+		cur_context=nullptr;
+		cur_parameters=nullptr;
 	}
 
 	int status = Evaluate(in,len, value_ret,log);
@@ -1584,6 +1747,10 @@ int LaidoutCalculator::evaluate(const char *in, int len, ValueHash *context, Val
 
 
 	 //3. restore state
+	param_scope   =oldparamscope;
+	cur_context   =oldcontext;
+	cur_parameters=oldparameters;
+	cur_parameter_entries.swap(oldparameter_entries);
 	makestr(curexprs,texprs);
 	curexprslen=oldlen;
 	from       =oldfrom;
@@ -1639,6 +1806,7 @@ int LaidoutCalculator::importAllNames(CalculatorModule *module)
 int LaidoutCalculator::importName(CalculatorModule *module, ObjectDef *def)
 {
 	currentLevel()->AddName(module,def,nullptr);
+	namesChanged();
 	return 0;
 }
 
@@ -1946,7 +2114,7 @@ BlockTypes LaidoutCalculator::popScope()
 
 	} else if (scope->type==BLOCK_namespace || scope->type==BLOCK_function || scope->type==BLOCK_class) {
 		 //close out namespace addition
-		 //nothing special to do
+		if (scope->type!=BLOCK_function) namesChanged(); //names defined in there are going away
 
 	} else if (scope->type==BLOCK_for) {
 		 //for: evaluate final functions, evaluate condition, jump back to start of block
@@ -1954,7 +2122,7 @@ BlockTypes LaidoutCalculator::popScope()
 		int tfrom=from;
 		from=scope->start_of_advance;
 		while (!calcerror) {
-			Value *v=evalLevel(0);
+			Value *v=evalStatement();
 			if (v) v->dec_count();
 			if (!nextchar(',')) break;
 		}
@@ -2003,7 +2171,11 @@ BlockTypes LaidoutCalculator::popScope()
 
 int LaidoutCalculator::evalcondition()
 {
-	Value *v=evalLevel(0);
+	Value *v=evalStatement();
+	if (!v) {
+		if (!calcerror) calcerr(_("Bad condition"));
+		return 0;
+	}
 	if (v->type()!=VALUE_Int && v->type()!=VALUE_Real && v->type()!=VALUE_Boolean) {
 		calcerr(_("Bad condition"));
 		return 0;
@@ -2627,6 +2799,12 @@ int LaidoutCalculator::sessioncommand() //  done before eval
 			}
 		}
 
+		 //compiled statements look up variables when run, so only need recompiling if this hides
+		 //a function, namespace, or parameter
+		int oldscope=-1, oldmodule=-1;
+		Entry *old=(run_mode==RUN_Normal ? findNameEntry(name,strlen(name), &oldscope,&oldmodule,nullptr) : nullptr);
+		if (old && (oldscope==param_scope || !dynamic_cast<ValueEntry*>(old))) namesChanged();
+
 		def->pushVariable(name,name,nullptr, type,0, value,1);
 		currentLevel()->AddName(def,def->fields->e[def->fields->n-1],nullptr);
 
@@ -2721,6 +2899,7 @@ int LaidoutCalculator::sessioncommand() //  done before eval
 		 //add to current scope
 		currentLevel()->scope_namespace->push(def,1);
 		currentLevel()->AddName(currentLevel()->scope_namespace, def, nullptr);
+		namesChanged();
 
 		return 1;
 	} //"function"
@@ -2878,6 +3057,7 @@ int LaidoutCalculator::sessioncommand() //  done before eval
 		}
 		currentLevel()->scope_namespace->push(def,1);
 		currentLevel()->AddName(currentLevel()->scope_namespace, def, nullptr);
+		namesChanged();
 		pushScope(BLOCK_class, 0, 0, nullptr, nullptr, def);
 
 		DBG cerr<<"start class definition:"<<endl;
@@ -3172,6 +3352,635 @@ Value *LaidoutCalculator::eval(const char *exprs)
 	return num;
 }
 
+//------------- Compiled statements
+
+/*! Find or create the CompiledScript for source in, compiled against the current parameter names.
+ * Returns an inc counted object, or nullptr when not compiling, such as in RUN_NameCatalog mode.
+ */
+CompiledScript *LaidoutCalculator::findCompiledScript(const char *in, int len)
+{
+	if (run_mode != RUN_Normal || max_compiled_scripts <= 0) return nullptr;
+
+	char *signature = nullptr;
+	if (cur_context) appendstr(signature, "context,");
+	if (cur_parameters) {
+		for (int c=0; c<cur_parameters->n(); c++) {
+			if (!cur_parameters->key(c)) continue;
+			appendstr(signature, cur_parameters->key(c));
+			appendstr(signature, ",");
+		}
+	}
+
+	CompiledScript *script = nullptr;
+	for (int c = compiled_scripts.n-1; c >= 0; c--) {
+		if (compiled_scripts.e[c]->Matches(in, len, signature)) {
+			script = compiled_scripts.e[c];
+			if (c != compiled_scripts.n-1) compiled_scripts.slide(c, compiled_scripts.n-1); //most recently used at the end
+			break;
+		}
+	}
+
+	if (!script) {
+		script = new CompiledScript(in, len, signature, names_generation);
+		compiled_scripts.push(script);
+		script->dec_count();
+		while (compiled_scripts.n > max_compiled_scripts) compiled_scripts.remove(0);
+	}
+
+	delete[] signature;
+	script->inc_count();
+	return script;
+}
+
+/*! Return true if there is a compiled statement in current_script starting at from.
+ * Skips whitespace and comments.
+ */
+bool LaidoutCalculator::compiledStatementAt()
+{
+	skipwscomment();
+	if (!current_script || run_mode != RUN_Normal) return false;
+	if (current_script->generation != names_generation) return false;
+	CalculatorCode *code = current_script->Find(from);
+	return code && !code->interpret;
+}
+
+/*! Like evalLevel(0), but use a compiled version of the expression at from when possible.
+ * The first time a statement is encountered it is compiled. If it cannot be compiled,
+ * it is remembered as such, and evalLevel(0) is used.
+ */
+Value *LaidoutCalculator::evalStatement()
+{
+	if (!current_script || run_mode != RUN_Normal) return evalLevel(0);
+
+	if (current_script->generation != names_generation) current_script->Flush(names_generation);
+
+	skipwscomment();
+	CalculatorCode *code = current_script->Find(from);
+	if (!code) {
+		code = compileStatement();
+		current_script->Add(code);
+		code->dec_count();
+	}
+
+	if (code->interpret) return evalLevel(0);
+	return runCode(code);
+}
+
+/*! Compile the expression at from, the same way evalLevel(0) would parse it.
+ * If there is anything we cannot compile, the returned code has interpret==true.
+ * from, curline, and error state are restored before returning.
+ */
+CalculatorCode *LaidoutCalculator::compileStatement()
+{
+	CalculatorCode *code = new CalculatorCode(from);
+
+	int oldfrom  = from;
+	int oldline  = curline;
+	int olderror = calcerror;
+	char *oldmes = calcmes;
+	ErrorLog *oldlog = errorlog;
+	ErrorLog scratch; //any errors will be found again by the interpreter
+	calcmes  = nullptr;
+	errorlog = &scratch;
+
+	int depth = 0;
+	int status = compileLevel(code, 0, depth);
+
+	if (status != 0 || calcerror || depth != 1) {
+		code->interpret = true;
+		code->code.flush();
+		code->constants.flush();
+		code->calls.flush();
+	} else {
+		code->end   = from;
+		code->lines = curline - oldline;
+	}
+
+	delete[] calcmes;
+	calcmes   = oldmes;
+	calcerror = olderror;
+	errorlog  = oldlog;
+	from      = oldfrom;
+	curline   = oldline;
+	return code;
+}
+
+CalculatorInstruction *LaidoutCalculator::emit(CalculatorCode *code, CalculatorCodeOps op, int arg, int pos, int &depth, int stack_change)
+{
+	CalculatorInstruction *ins = new CalculatorInstruction(op, arg, pos);
+	code->code.push(ins);
+	depth += stack_change;
+	if (depth > code->max_stack) code->max_stack = depth;
+	return ins;
+}
+
+/*! Compile counterpart of evalLevel(). Return 0 for success or nonzero for cannot compile.
+ *
+ * Assignment operators and right hand operators are not compiled.
+ */
+int LaidoutCalculator::compileLevel(CalculatorCode *code, int level, int &depth)
+{
+	int n = 0;
+	int index = -1;
+	int pos;
+	const char *op;
+	OperatorFunction *opfunc = nullptr;
+	CalculatorInstruction *ins;
+
+	if (level >= oplevels.n) {
+		op = getopstring(&n);
+		if (n) {
+			opfunc = leftops.hasOp(op,n,OPS_Left, &index,-1);
+			if (!opfunc || !opfunc->function) return 1;
+			if (opfunc->def && (opfunc->def->flags&OPS_Assignment)) return 1;
+
+			pos = from;
+			from += n;
+			if (compileLevel(code, level, depth) != 0) return 1;
+
+			ins = emit(code, CODE_LeftOp, 0, pos, depth, 0);
+			ins->opfunc  = opfunc;
+			ins->oplevel = &leftops;
+			ins->opindex = index;
+			ins->dir     = OPS_Left;
+			ins->len     = n;
+
+		} else if (compileNumber(code, depth) != 0) return 1;
+
+		op = getopstring(&n);
+		if (n && rightops.hasOp(op,n,OPS_Right, &index,-1)) return 1;
+		return 0;
+	}
+
+	int dir = oplevels.e[level]->direction;
+	if (compileLevel(code, level+1, depth) != 0) return 1;
+
+	op = getopstring(&n);
+	while (n) {
+		opfunc = oplevels.e[level]->hasOp(op,n,dir, &index,-1);
+		if (!opfunc) break;
+		if (!opfunc->function || (n == 1 && *op == '=')) return 1;
+		if (opfunc->def && (opfunc->def->flags&OPS_Assignment)) return 1;
+
+		pos = from;
+		from += n;
+		if (compileLevel(code, dir == OPS_LtoR ? level+1 : level, depth) != 0) return 1;
+
+		ins = emit(code, CODE_BinaryOp, 0, pos, depth, -1);
+		ins->opfunc  = opfunc;
+		ins->oplevel = oplevels.e[level];
+		ins->opindex = index;
+		ins->dir     = dir;
+		ins->len     = n;
+
+		op = getopstring(&n);
+	}
+
+	return 0;
+}
+
+/*! Compile counterpart of number(). Dereferencing of values is not compiled.
+ */
+int LaidoutCalculator::compileNumber(CalculatorCode *code, int &depth)
+{
+	skipwscomment();
+	int pos = from;
+	Value *snum = nullptr;
+
+	if (curexprs[from] == '{') {
+		return 1;
+
+	} else if (nextchar('(') || nextchar('[')) {
+		char closing = (curexprs[from-1] == '(' ? ')' : ']');
+		int n = 0;
+		do {
+			if (compileLevel(code, 0, depth) != 0) return 1;
+			n++;
+		} while (nextchar(','));
+		if (!nextchar(closing)) return 1;
+
+		emit(code, closing == ')' ? CODE_ParenSet : CODE_Set, n, pos, depth, 1-n);
+
+	} else if (curexprs[from]=='\'' || curexprs[from]=='"') {
+		snum = getstring();
+		if (!snum) return 1;
+
+	} else if (isdigit(curexprs[from]) || curexprs[from]=='.') {
+		int tfrom = from;
+		int base = -1;
+		if (isdigit(curexprs[from])) snum = new IntValue(intnumber(&base));
+		if (curexprs[from]=='.' || curexprs[from]=='e') {
+			from = tfrom;
+			if (snum) snum->dec_count();
+			snum = new DoubleValue(realnumber());
+		}
+		if (calcerror) { snum->dec_count(); return 1; }
+
+		int units = getunits();
+		if (units) {
+			if (dynamic_cast<IntValue*>(snum)) dynamic_cast<IntValue*>(snum)->units=units;
+			else if (dynamic_cast<DoubleValue*>(snum)) dynamic_cast<DoubleValue*>(snum)->units=units;
+		}
+
+	} else if (isalpha(curexprs[from]) || curexprs[from]=='_') {
+		if (compileName(code, depth) != 0) return 1;
+
+	} else return 1;
+
+	if (snum) {
+		emit(code, CODE_Constant, code->constants.n, pos, depth, 1);
+		code->constants.push(snum);
+		snum->dec_count();
+	}
+
+	skipwscomment();
+	if (curexprs[from] == '.' || curexprs[from] == '[') return 1;
+	return 0;
+}
+
+/*! Compile counterpart of evalname(). Names are resolved now: functions and classes to their defs,
+ * namespace members to their values, and parameters to their index in the parameter list. Other
+ * variables are looked up when run, since scripts may change them.
+ */
+int LaidoutCalculator::compileName(CalculatorCode *code, int &depth)
+{
+	int pos = from;
+	int n = 0;
+	const char *word = getnamestringc(&n);
+	if (!word) return 1;
+
+	if (   (n==4 && !strncmp(word,"true",4))
+		|| (n==5 && !strncmp(word,"false",5))
+		|| (n==6 && !strncmp(word,"typeof",6))
+		|| (n==7 && !strncmp(word,"typesof",7))
+		|| (n==6 && !strncmp(word,"string",6))
+		|| (n==3 && !strncmp(word,"int",3))) return 1;
+
+	int scope = -1;
+	int module = -1;
+	Entry *entry = findNameEntry(word,n, &scope, &module, nullptr);
+	if (!entry) return 1;
+	OverloadedEntry *oo = dynamic_cast<OverloadedEntry*>(entry);
+	if (oo) {
+		if (!oo->entries.n) return 1;
+		entry = oo->entries.e[oo->entries.n-1];
+	}
+
+	CalculatorCall *call = nullptr;
+	int callindex = -1;
+
+	if (entry->type() == VALUE_Dummy) {
+		return 1;
+
+	} else if (entry->type() == VALUE_Function) {
+		call = new CalculatorCall(word,n);
+		callindex = code->calls.n;
+		code->calls.push(call);
+		call->mapdef = dynamic_cast<FunctionEntry*>(entry)->def;
+
+		 //overloads are tried from most recent
+		if (oo) {
+			for (int c = oo->entries.n-1; c >= 0; c--) {
+				Entry *e = oo->entries.e[c];
+				ObjectDef *def = nullptr;
+				if (e->type() == VALUE_Function) def = dynamic_cast<FunctionEntry*>(e)->def;
+				else if (e->type() == VALUE_Class) def = dynamic_cast<ObjectDefEntry*>(e)->module;
+				if (def) call->defs.push(def);
+			}
+		} else if (call->mapdef) call->defs.push(call->mapdef);
+		if (!call->defs.n) return 1;
+
+		from += n;
+		skipwscomment();
+
+	} else if (entry->type() == VALUE_Class) {
+		from += n;
+		if (nextchar('.')) return 1;
+
+		ObjectDef *classdef = dynamic_cast<NamespaceEntry*>(entry)->module;
+		call = new CalculatorCall(word,n);
+		callindex = code->calls.n;
+		code->calls.push(call);
+		call->constructor = true;
+		call->mapdef = classdef->FindDef(classdef->name);
+		call->defs.push(classdef);
+
+	} else if (entry->type() == VALUE_Namespace) {
+		from += n;
+		Value *ns = new NamespaceValue(dynamic_cast<NamespaceEntry*>(entry)->module);
+		Value *member = nullptr;
+
+		 //resolve things like "Math.pi" and "Math.sin" now
+		while (!member && nextchar('.')) {
+			skipwscomment();
+			pos = from;
+			const char *name = getnamestringc(&n);
+			ObjectDef *def = (n ? ns->GetObjectDef()->FindDef(name,n) : nullptr);
+			if (!def) { ns->dec_count(); return 1; }
+			from += n;
+
+			if (def->format == VALUE_Namespace) {
+				ns->dec_count();
+				ns = new NamespaceValue(def);
+
+			} else if (def->format == VALUE_Variable && def->defaultValue) {
+				member = def->defaultValue;
+				member->inc_count();
+
+			} else if (def->format == VALUE_Function) {
+				call = new CalculatorCall(name,n);
+				callindex = code->calls.n;
+				code->calls.push(call);
+				call->mapdef = def;
+				call->defs.push(def);
+				call->containing = ns;
+				ns = nullptr;
+				skipwscomment();
+				break;
+
+			} else {
+				ns->dec_count();
+				return 1;
+			}
+		}
+
+		if (!call) {
+			if (!member) member = ns;
+			else ns->dec_count();
+			emit(code, CODE_Constant, code->constants.n, pos, depth, 1);
+			code->constants.push(member);
+			member->dec_count();
+			return 0;
+		}
+
+	} else if (dynamic_cast<ValueEntry*>(entry)) {
+		from += n;
+		int i = -1;
+		if (scope == param_scope && cur_parameters) i = cur_parameters->findIndex(word,n);
+		if (i >= 0) {
+			emit(code, CODE_Parameter, i, pos, depth, 1);
+
+		} else if (scope == param_scope && cur_context && n == 7 && !strncmp(word,"context",7)) {
+			emit(code, CODE_Context, 0, pos, depth, 1);
+
+		} else {
+			CalculatorInstruction *ins = emit(code, CODE_Variable, 0, pos, depth, 1);
+			ins->name = newnstr(word,n);
+			ins->len  = n;
+		}
+		return 0;
+
+	} else return 1;
+
+	if (compileParameters(code, call, depth) != 0) return 1;
+	emit(code, CODE_Call, callindex, pos, depth, 1 - call->param_names.n);
+	return 0;
+}
+
+/*! Compile counterpart of parseParameters(). Parameter values are left on the stack in order,
+ * and their names are put in call->param_names, mapped now against call->mapdef.
+ */
+int LaidoutCalculator::compileParameters(CalculatorCode *code, CalculatorCall *call, int &depth)
+{
+	ObjectDef *def = call->mapdef;
+	if (!nextchar('(')) return 0; //call with null parameters
+	call->has_params = true;
+	if (nextchar(')')) return 0;
+
+	int tfrom;
+	int namel;
+	int enumcheck;
+	int pnum = 0;
+	bool unnamed = true;
+	bool have_value;
+	char *pname = nullptr;
+	char *ename = nullptr;
+
+	do {
+		enumcheck = -1;
+		have_value = false;
+		pnum++;
+
+		 //check for parameter name given
+		skipwscomment();
+		tfrom = from;
+		pname = getnamestring(&namel);
+		if (pname) {
+			from += namel;
+			if (nextchar('=')) {
+				if (def) enumcheck = def->findfield(pname, nullptr);
+				tfrom = from;
+			} else {
+				ename = pname;
+				pname = nullptr;
+				if (def) enumcheck = pnum;
+			}
+		}
+
+		 //enum values become constants
+		if (def && enumcheck >= 0) {
+			ValueTypes t;
+			if (def->getInfo(enumcheck, nullptr,nullptr,nullptr,nullptr,nullptr,&t,nullptr)==0 && t==VALUE_Enum) {
+				if (!ename) {
+					skipwscomment();
+					int len;
+					ename = getnamestring(&len);
+					if (ename) from += len;
+				}
+				ObjectDef *ev = (ename ? def->getField(enumcheck) : nullptr);
+				if (ev && ev->fields) for (int c=0; c<ev->fields->n; c++) {
+					if (strcmp(ev->fields->e[c]->name,ename)==0) {
+						skipwscomment();
+						if (curexprs[from]!=',' && curexprs[from]!=')') break;
+						emit(code, CODE_Constant, code->constants.n, tfrom, depth, 1);
+						Value *v = new IntValue(c);
+						code->constants.push(v);
+						v->dec_count();
+						have_value = true;
+						break;
+					}
+				}
+				if (!have_value) {
+					 //the interpreter continues from an odd spot here, so leave it to that
+					delete[] pname;
+					delete[] ename;
+					return 1;
+				}
+			} else {
+				enumcheck = -1;
+				from = tfrom;
+			}
+			if (ename) { delete[] ename; ename = nullptr; }
+		}
+		if (ename) {
+			delete[] ename;
+			ename = nullptr;
+			from = tfrom;
+		}
+
+		if (!have_value && compileLevel(code, 0, depth) != 0) {
+			delete[] pname;
+			return 1;
+		}
+
+		if (pname) unnamed = false;
+		else {
+			 //find name of positional parameter now
+			const char *param = nullptr;
+			if (!unnamed || !def || def->getInfo(pnum-1, &param, nullptr,nullptr,nullptr,nullptr,nullptr,nullptr)!=0)
+				return 1;
+			pname = newstr(param);
+		}
+		call->param_names.push(pname);
+		pname = nullptr;
+
+	} while (from != tfrom && nextchar(','));
+
+	if (!nextchar(')')) return 1;
+	return 0;
+}
+
+/*! Run a statement compiled with compileStatement(). On success, from and curline are
+ * advanced to the end of the statement, and the value is returned.
+ */
+Value *LaidoutCalculator::runCode(CalculatorCode *code)
+{
+	code->inc_count(); //in case a nested evaluation flushes it
+
+	Value *local[16];
+	Value **stack = (code->max_stack <= 16 ? local : new Value*[code->max_stack]);
+	int sp = 0;
+	int status;
+	Value *v, *num_ret;
+	CalculatorInstruction *ins;
+
+	for (int c=0; c<code->code.n && !calcerror; c++) {
+		ins  = code->code.e[c];
+		from = ins->pos;
+		v    = nullptr;
+
+		switch (ins->code) {
+			case CODE_Constant:
+				v = code->constants.e[ins->arg];
+				v->inc_count();
+				stack[sp++] = v;
+				break;
+
+			case CODE_Parameter: {
+				ValueEntry *entry = nullptr;
+				if (ins->arg < (int)cur_parameter_entries.size()) entry = dynamic_cast<ValueEntry*>(cur_parameter_entries[ins->arg]);
+				if (entry) v = entry->GetValue();
+				if (!v) { calcerr(_("Unable to dereference!")); break; }
+				v->inc_count();
+				stack[sp++] = v;
+				break;
+			}
+
+			case CODE_Context:
+				if (!cur_context) { calcerr(_("Unknown name!")); break; }
+				cur_context->inc_count();
+				stack[sp++] = cur_context;
+				break;
+
+			case CODE_Variable: {
+				int scope = -1, module = -1;
+				Entry *entry = findNameEntry(ins->name,ins->len, &scope, &module, nullptr);
+				OverloadedEntry *oo = dynamic_cast<OverloadedEntry*>(entry);
+				if (oo) entry = (oo->entries.n ? oo->entries.e[oo->entries.n-1] : nullptr);
+				ValueEntry *ve = dynamic_cast<ValueEntry*>(entry);
+				if (!ve) { calcerr(_("Unknown name!")); break; }
+				v = ve->GetValue();
+				if (!v) { calcerr(_("Unable to dereference!")); break; }
+				v->inc_count();
+				stack[sp++] = v;
+			  } break;
+
+			case CODE_LeftOp:
+				num_ret = nullptr;
+				status = ins->opfunc->function->Op(ins->opfunc->op,ins->len,OPS_Left, stack[sp-1],nullptr, &calcsettings, &num_ret, nullptr);
+				if (status == -1) num_ret = opCall(ins->opfunc->op,ins->len,OPS_Left, stack[sp-1],nullptr, ins->oplevel, ins->opindex);
+				if (calcerror) { if (num_ret) num_ret->dec_count(); break; }
+				if (num_ret) {
+					stack[sp-1]->dec_count();
+					stack[sp-1] = num_ret;
+				}
+				break;
+
+			case CODE_BinaryOp:
+				num_ret = nullptr;
+				status = ins->opfunc->function->Op(ins->opfunc->op,ins->len,ins->dir, stack[sp-2],stack[sp-1], &calcsettings, &num_ret, nullptr);
+				if (status == -1) num_ret = opCall(ins->opfunc->op,ins->len,ins->dir, stack[sp-2],stack[sp-1], ins->oplevel, ins->opindex);
+				if (!calcerror && !num_ret) calcerr(_("Cannot compute with given values."));
+				stack[--sp]->dec_count();
+				stack[sp-1]->dec_count();
+				if (calcerror) {
+					sp--;
+					if (num_ret) num_ret->dec_count();
+					break;
+				}
+				stack[sp-1] = num_ret;
+				break;
+
+			case CODE_Call: {
+				CalculatorCall *call = code->calls.e[ins->arg];
+				int nargs = call->param_names.n;
+				ValueHash *pp = nullptr;
+				if (call->has_params) {
+					pp = new ValueHash;
+					for (int c2=0; c2<nargs; c2++) pp->push(call->param_names.e[c2], stack[sp-nargs+c2]);
+					if (call->mapdef) MapParameters(call->mapdef,pp);
+				}
+				for (int c2=0; c2<nargs; c2++) stack[sp-nargs+c2]->dec_count();
+				sp -= nargs;
+
+				ValueHash *context = build_context();
+				status = -1;
+				for (int c2=0; c2<call->defs.n; c2++) {
+					status = functionCall(call->name,call->len, &v, call->containing, call->defs.e[c2], context,pp);
+					if (calcerror || status != -1) break;
+				}
+				context->dec_count();
+				if (pp) delete pp;
+
+				if (!calcerror && status == -1 && !call->constructor) calcerr(_("Cannot compute with given values."));
+				if (!calcerror && !v && c < code->code.n-1) calcerr(_("Expected number!"));
+				if (calcerror) { if (v) v->dec_count(); break; }
+				stack[sp++] = v;
+			  } break;
+
+			case CODE_Set:
+			case CODE_ParenSet: {
+				SetValue *set = new SetValue;
+				for (int c2 = sp - ins->arg; c2 < sp; c2++) set->Push(stack[c2],1);
+				sp -= ins->arg;
+				v = set;
+				if (ins->code == CODE_ParenSet) {
+					Value *defaulted = ApplyDefaultSets(set);
+					if (defaulted) { set->dec_count(); v = defaulted; }
+				}
+				stack[sp++] = v;
+			  } break;
+
+			default:
+				calcerr(_("Bad compiled code!"));
+				break;
+		}
+	}
+
+	Value *answer = nullptr;
+	if (calcerror) {
+		for (int c=0; c<sp; c++) if (stack[c]) stack[c]->dec_count();
+	} else {
+		answer   = stack[0];
+		from     = code->end;
+		curline += code->lines;
+	}
+
+	if (stack != local) delete[] stack;
+	code->dec_count();
+	return answer;
+}
+
 // *** Value *LaidoutCalculator::eval()
 //{ return evalLevel(0); }
 
@@ -4387,6 +5196,7 @@ int LaidoutCalculator::functionCall(const char *word,int n, Value **v_ret,
 int LaidoutCalculator::removeOperators(int module_id)
 {
 	int n=0;
+	namesChanged();
 	for (int c=leftops.ops.n-1; c>=0; c--) {
 		if (leftops.ops.e[c]->module_id==module_id) { leftops.ops.remove(c); n++; }
 	}
@@ -4408,6 +5218,7 @@ int LaidoutCalculator::removeOperators(int module_id)
 
 int LaidoutCalculator::addOperator(const char *op,int dir,int priority, int module_id, OpFuncEvaluator *opfunc,ObjectDef *def)
 {
+	namesChanged();
 	if (dir==OPS_Left) leftops.pushOp(op, dir, opfunc, def, module_id);
 	else if (dir==OPS_Right) rightops.pushOp(op, dir, opfunc, def, module_id);
 	else {
@@ -17,6 +17,7 @@
 #define CALCULATOR_H
 
 #include <lax/refptrstack.h>
+#include <vector>
 #include "interpreter.h"
 #include "values.h"
 
@@ -147,6 +148,86 @@ class BlockInfo
 	virtual int isSameEntry(ObjectDef *item, Entry *entry);
 };
 
+//---------------------------CalculatorCode
+enum CalculatorCodeOps {
+	CODE_None,
+	CODE_Constant,  //!< push constants[arg]
+	CODE_Parameter, //!< push current value of parameter arg passed to EvaluateWithParams(), see cur_parameter_entries
+	CODE_Context,   //!< push the context passed to EvaluateWithParams()
+	CODE_Variable,  //!< push value of variable name, looked up at run time
+	CODE_LeftOp,    //!< apply left hand opfunc to top of stack
+	CODE_BinaryOp,  //!< apply opfunc to top 2 values of stack
+	CODE_Call,      //!< call calls[arg] with its parameters from the top of the stack
+	CODE_Set,       //!< pop arg values into a set
+	CODE_ParenSet,  //!< pop arg values into a set, then apply default sets, as for "(1,2)"
+	CODE_MAX
+};
+
+class CalculatorInstruction
+{
+  public:
+	CalculatorCodeOps code;
+	int arg;
+	int pos; //position in source, for error messages
+	char *name;
+	int len;
+	OperatorFunction *opfunc;
+	OperatorLevel *oplevel;
+	int opindex;
+	int dir;
+
+	CalculatorInstruction(CalculatorCodeOps ncode, int narg, int npos);
+	~CalculatorInstruction();
+};
+
+class CalculatorCall
+{
+  public:
+	char *name;
+	int len;
+	bool has_params;  //false means call with null parameters, as for "func" instead of "func()"
+	bool constructor; //return whatever the class def gives, do not try overloads
+	ObjectDef *mapdef; //parameters are mapped to the fields of this def
+	Value *containing; //containing value, such as the namespace of "Math.sin(x)"
+	Laxkit::RefPtrStack<ObjectDef> defs; //try these in order for overloaded names
+	Laxkit::PtrStack<char> param_names;
+
+	CalculatorCall(const char *nname, int nlen);
+	~CalculatorCall();
+};
+
+class CalculatorCode : public Laxkit::anObject
+{
+  public:
+	int start, end;  //range in source
+	int lines;       //number of newlines between start and end
+	bool interpret;  //true if statement could not be compiled
+	int max_stack;
+	Laxkit::PtrStack<CalculatorInstruction> code;
+	Laxkit::RefPtrStack<Value> constants;
+	Laxkit::PtrStack<CalculatorCall> calls;
+
+	CalculatorCode(int nstart);
+	virtual ~CalculatorCode() {}
+};
+
+class CompiledScript : public Laxkit::anObject
+{
+  public:
+	char *source;
+	int len;
+	char *signature; //names of parameters the script was compiled against
+	int generation;
+	Laxkit::RefPtrStack<CalculatorCode> statements; //sorted by start
+
+	CompiledScript(const char *nsource, int nlen, const char *nsignature, int ngeneration);
+	virtual ~CompiledScript();
+	virtual int Matches(const char *nsource, int nlen, const char *nsignature);
+	virtual CalculatorCode *Find(int start);
+	virtual void Add(CalculatorCode *statement);
+	virtual void Flush(int ngeneration);
+};
+
 //---------------------------LaidoutCalculator
 class LaidoutCalculator : public Interpreter,
 						  public OpFuncEvaluator,
@@ -185,6 +266,27 @@ class LaidoutCalculator : public Interpreter,
 	OperatorLevel leftops, rightops;
 	BlockInfo *currentLevel() { return scopes.e[scopes.n-1]; }
 
+	 //compiled statements
+	Laxkit::RefPtrStack<CompiledScript> compiled_scripts;
+	CompiledScript *current_script;
+	int max_compiled_scripts;
+	int names_generation;
+	int param_scope;
+	ValueHash *cur_context;
+	ValueHash *cur_parameters;
+	std::vector<Entry*> cur_parameter_entries; //entry in param_scope of each of cur_parameters, what CODE_Parameter reads
+	void namesChanged() { names_generation++; }
+	CompiledScript *findCompiledScript(const char *in, int len);
+	bool compiledStatementAt();
+	Value *evalStatement();
+	CalculatorCode *compileStatement();
+	int compileLevel(CalculatorCode *code, int level, int &depth);
+	int compileNumber(CalculatorCode *code, int &depth);
+	int compileName(CalculatorCode *code, int &depth);
+	int compileParameters(CalculatorCode *code, CalculatorCall *call, int &depth);
+	CalculatorInstruction *emit(CalculatorCode *code, CalculatorCodeOps op, int arg, int pos, int &depth, int stack_change);
+	Value *runCode(CalculatorCode *code);
+
 	Laxkit::ErrorLog default_errorlog;
 	Laxkit::ErrorLog *errorlog;
 	int calcerror;
@@ -0,0 +1,200 @@
+//
+//
+//  Check that ValueHash's key index finds the same things as a plain linear
+//  search, and time both for calculator style lookups and a style cascade.
+//
+//  Build with "make valuehashbench" in src/calculator. Returns nonzero if any check fails.
+//
+//
+
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+
+#include "values.h"
+
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+using namespace Laxkit;
+using namespace Laidout;
+
+
+//! How findIndex() worked before the key index: first key that matches.
+static int linear_find(ValueHash *hash, const char *name)
+{
+	for (int c=0; c<hash->n(); c++) {
+		if (!strcmp(hash->key(c), name)) return c;
+	}
+	return -1;
+}
+
+static int failures = 0;
+
+//! Every key, and a few missing ones, must be found where linear_find() finds them.
+static void check(ValueHash *hash, const char *what)
+{
+	char name[30];
+	for (int c=0; c<hash->n(); c++) {
+		int i = hash->findIndex(hash->key(c));
+		if (i != linear_find(hash, hash->key(c))) {
+			cerr << what <<": key "<<hash->key(c)<<" found at "<<i<<", expected "<<linear_find(hash, hash->key(c))<<endl;
+			failures++;
+			return;
+		}
+	}
+	for (int c=0; c<10; c++) {
+		sprintf(name, "missing%d", c);
+		if (hash->findIndex(name) != -1 || hash->HasKey(name)) {
+			cerr << what <<": found missing key "<<name<<endl;
+			failures++;
+			return;
+		}
+	}
+}
+
+static void fill(ValueHash *hash, const char *prefix, int n)
+{
+	char name[30];
+	for (int c=0; c<n; c++) {
+		sprintf(name, "%s%d", prefix, c);
+		hash->push(name, c);
+	}
+}
+
+static double seconds_since(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//! Like a calculator looking names up in its context: every key, many times over.
+static void time_lookups(int n)
+{
+	ValueHash hash;
+	fill(&hash, "name", n);
+
+	int rounds = 2000000 / n + 1;
+	long sum = 0;
+
+	auto start = chrono::steady_clock::now();
+	for (int r=0; r<rounds; r++) {
+		for (int c=0; c<n; c++) sum += linear_find(&hash, hash.key(c));
+	}
+	double linear = seconds_since(start);
+
+	start = chrono::steady_clock::now();
+	for (int r=0; r<rounds; r++) {
+		for (int c=0; c<n; c++) sum -= hash.findIndex(hash.key(c));
+	}
+	double indexed = seconds_since(start);
+
+	if (sum != 0) { cerr << "lookups: indexed and linear disagree"<<endl; failures++; }
+
+	printf("lookup   %6d keys, %8d finds:  linear %9.4fs  indexed %9.4fs  speedup %7.1fx\n",
+			n, rounds*n, linear, indexed, indexed > 0 ? linear/indexed : 0.);
+}
+
+//! Like Style::MergeFromMissing(): add whatever base has that the style does not.
+static void time_cascade(int n)
+{
+	ValueHash base;
+	fill(&base, "prop", n);
+
+	int rounds = 200000 / n + 1;
+	double linear = 0, indexed = 0;
+
+	for (int r=0; r<rounds; r++) {
+		ValueHash old_style, style;
+		fill(&old_style, "prop", n/2);
+		fill(&style, "prop", n/2);
+
+		 //both push the same, so only the finds differ
+		auto start = chrono::steady_clock::now();
+		for (int c=0; c<base.n(); c++) {
+			if (linear_find(&old_style, base.key(c)) >= 0) continue;
+			old_style.push(base.key(c), base.e(c));
+		}
+		linear += seconds_since(start);
+
+		start = chrono::steady_clock::now();
+		for (int c=0; c<base.n(); c++) {
+			if (style.findIndex(base.key(c)) >= 0) continue;
+			style.push(base.key(c), base.e(c));
+		}
+		indexed += seconds_since(start);
+
+		if (r == 0) {
+			if (style.n() != n || old_style.n() != n) { cerr << "cascade: merged "<<style.n()<<" keys, expected "<<n<<endl; failures++; }
+			check(&style, "cascade");
+		}
+	}
+
+	printf("cascade  %6d keys, %8d merges: linear %9.4fs  indexed %9.4fs  speedup %7.1fx\n",
+			n, rounds, linear, indexed, indexed > 0 ? linear/indexed : 0.);
+}
+
+//! Edits that change key positions must not leave lookups stale.
+static void check_edits()
+{
+	ValueHash hash;
+	fill(&hash, "k", 100);
+	check(&hash, "push");
+
+	hash.push("dup", 1);
+	hash.push("dup", 2);
+	if (hash.findIndex("dup") != 100) { cerr << "duplicate keys must resolve to the first"<<endl; failures++; }
+
+	hash.push("inserted", 5, 3);
+	check(&hash, "insert in the middle");
+	if (hash.findIndex("inserted") != 3) { cerr << "insert in the middle: wrong index"<<endl; failures++; }
+
+	hash.remove(0);
+	hash.remove(50);
+	check(&hash, "remove");
+
+	hash.swap(1, 60);
+	check(&hash, "swap");
+
+	hash.renameKey(10, "renamed");
+	check(&hash, "rename");
+	if (hash.findIndex("renamed") != 10) { cerr << "rename: wrong index"<<endl; failures++; }
+
+	ValueHash copy;
+	copy.CopyFrom(&hash, false);
+	check(&copy, "copy");
+
+	hash.flush();
+	if (hash.n() != 0 || hash.findIndex("k20") != -1) { cerr << "flush left keys behind"<<endl; failures++; }
+	fill(&hash, "again", 20);
+	check(&hash, "refill");
+}
+
+
+int main(int argc, char **argv)
+{
+	check_edits();
+
+	int sizes[] = { 4, 16, 64, 256, 1024, 4096 };
+	for (int n : sizes) time_lookups(n);
+	for (int n : sizes) time_cascade(n);
+
+	if (failures) {
+		cerr << failures << " check(s) failed!"<<endl;
+		return 1;
+	}
+	cout << "All checks passed."<<endl;
+	return 0;
+}
@@ -1531,18 +1531,77 @@ int ObjectDef::findFieldOfThis(const char *fname,char **next) // next=NULL
  * \brief Class to aid parsing of functions.
  *
  * Used in LaidoutCalculator.
+ *
+ * Keys are kept in order in a PtrStack. Once there are more than a few keys, lookups
+ * go through a hash table of indices into that stack, which is rebuilt as needed
+ * whenever keys get moved around.
  */
 
 
+//! Hashes with fewer keys than this just do a linear search.
+#define VALUEHASH_MIN_INDEX 8
+
+//! FNV-1a hash of the first len chars of str.
+static unsigned int HashKey(const char *str, int len)
+{
+	unsigned int h = 2166136261u;
+	for (int c=0; c<len; c++) {
+		h ^= (unsigned char)str[c];
+		h *= 16777619u;
+	}
+	return h;
+}
+
 ValueHash::ValueHash()
 	: keys(2)
 {
 	sorted=0;
+	key_index = nullptr;
+	key_index_size = 0;
+	key_index_valid = false;
+	modcount = 0;
 }
 
 ValueHash::~ValueHash()
 {
 	DBG values.flush(); //this should happen automatically anyway
+	delete[] key_index;
+}
+
+/*! Rebuild key_index from scratch. If there are duplicate keys, the first one wins,
+ * same as a linear search.
+ */
+void ValueHash::RebuildIndex()
+{
+	int size = 16;
+	while (size < keys.n*2) size *= 2;
+	if (size != key_index_size) {
+		delete[] key_index;
+		key_index = new int[size];
+		key_index_size = size;
+	}
+	for (int c=0; c<key_index_size; c++) key_index[c] = -1;
+
+	key_index_valid = true;
+	for (int c=0; c<keys.n; c++) IndexKey(c);
+}
+
+/*! Add keys.e[i] to an already valid key_index, growing if necessary.
+ */
+void ValueHash::IndexKey(int i)
+{
+	if (!key_index_valid) return;
+	if (keys.n*2 > key_index_size) { RebuildIndex(); return; }
+
+	const char *key = keys.e[i];
+	int len = strlen(key);
+	unsigned int mask = key_index_size-1;
+	unsigned int h = HashKey(key, len) & mask;
+	while (key_index[h] >= 0) {
+		if (!strcmp(keys.e[key_index[h]], key)) return; //keep first
+		h = (h+1) & mask;
+	}
+	key_index[h] = i;
 }
 
 int ValueHash::type()
@@ -1853,9 +1912,8 @@ int ValueHash::Evaluate(const char *func,int len, ValueHash *context, ValueHash
 
 			SetValue *set=new SetValue();
 			set->Push(new StringValue(keys.e[pos]),1);
-			keys.remove(pos);
 			set->Push(values.e[pos],0);
-			values.remove(pos);
+			remove(pos);
 			*value_ret=set;
 			return 0;
 		}
@@ -1879,11 +1937,16 @@ int ValueHash::Evaluate(const char *func,int len, ValueHash *context, ValueHash
 			if (pos<0  || pos>=keys.n)  throw 2; //index out of range!
 			if (pos2<0 || pos2>=keys.n) throw 2; //index out of range!
 
-			 //push(pop(p1),p2)
-			char *key=keys.pop(pos);
-			Value *value=values.pop(pos);
-			push(key,value);
+			 //push(pop(p1),p2), through remove() and push() so the key index stays valid
+			char *key=newstr(keys.e[pos]);
+			Value *value=values.e[pos];
+			value->inc_count();
+			remove(pos);
+			push(key,value,pos2);
 			value->dec_count();
+			delete[] key;
+			*value_ret=NULL;
+			return 0;
 		}
 	} catch (int e) {
 		if (log) {
@@ -1921,6 +1984,7 @@ int ValueHash::flush()
 {
 	keys.flush();
 	values.flush();
+	InvalidateIndex();
 	return 0;
 }
 
@@ -1997,6 +2061,8 @@ int ValueHash::push(const char *name,Value *v,int where, bool absorb)
 	keys.push(newstr(name),-1,where);
 	int status = values.push(v,-1,where);
 	if (absorb) v->dec_count();
+	if (where == keys.n-1) { IndexKey(where); modcount++; }
+	else InvalidateIndex(); //later keys were shifted
 	return status;
 }
 
@@ -2016,6 +2082,7 @@ int ValueHash::remove(int i)
 	if (i<0 || i>=keys.n) return 1;
 	keys.remove(i);
 	values.remove(i);
+	InvalidateIndex();
 	return 0;
 }
 
@@ -2034,6 +2101,7 @@ void ValueHash::swap(int i1, int i2)
 	if (i1<0 || i1>keys.n || i2<0 || i2>keys.n) return;
 	keys.swap(i1,i2);
 	values.swap(i1,i2);
+	InvalidateIndex();
 }
 
 //! Return name of key at index i.
@@ -2055,6 +2123,7 @@ void ValueHash::renameKey(int i,const char *newname)
 {
 	if (i<0 || i>=keys.n) return;
 	makestr(keys.e[i],newname);
+	InvalidateIndex();
 }
 
 /*! Set value of an existing key. Return 0 for success, or nonzero for error such as key not found.
@@ -2076,6 +2145,7 @@ int ValueHash::set(int which, Value *newv, bool absorb)
 	if (newv && !absorb) newv->inc_count();
 	if (values.e[which]) values.e[which]->dec_count();
 	values.e[which]=newv;
+	modcount++;
 	return 0;
 }
 
@@ -2109,6 +2179,22 @@ int ValueHash::findIndex(const char *name,int len)
 {
 	if (!name) return -1;
 	if (len<0) len = strlen(name);
+	if (len<=0) return -1;
+
+	if (keys.n >= VALUEHASH_MIN_INDEX) {
+		if (!key_index_valid) RebuildIndex();
+
+		unsigned int mask = key_index_size-1;
+		unsigned int h = HashKey(name, len) & mask;
+		const char *key;
+		while (key_index[h] >= 0) {
+			key = keys.e[key_index[h]];
+			if (!strncmp(name,key,len) && key[len] == '\0') return key_index[h];
+			h = (h+1) & mask;
+		}
+		return -1;
+	}
+
 	for (int c=0; c<keys.n; c++) {
 		// if (len<0 && !strcmp(name,keys.e[c])) return c;
 		if (len>0 && (int)strlen(keys.e[c]) == len && !strncmp(name,keys.e[c],len)) return c;
@@ -2120,10 +2206,9 @@ int ValueHash::findIndex(const char *name,int len)
  */
 Value *ValueHash::find(const char *name)
 {
-	for (int c=0; c<keys.n; c++) {
-		if (!strcmp(name,keys.e[c])) return values.e[c];
-	}
-	return NULL;
+	int i = findIndex(name);
+	if (i<0) return NULL;
+	return values.e[i];
 }
 
 /*! If which>=0 then interpret that Value and ignore name.
@@ -342,12 +342,21 @@ class ValueHash : virtual public Laxkit::anObject, virtual public Value, virtual
 	Laxkit::PtrStack<char> keys;
 	Laxkit::RefPtrStack<Value> values;
 
+	int *key_index; //open addressing table of indices into keys, -1 for empty
+	int key_index_size;
+	bool key_index_valid;
+	unsigned long modcount; //incremented whenever keys or values change, see ModCount()
+	void InvalidateIndex() { key_index_valid = false; modcount++; } //any change to keys must call this
+	void RebuildIndex();
+	void IndexKey(int i);
+
   public:
 	ValueHash();
 	virtual ~ValueHash();
 	virtual const char *whattype() { return "ValueHash"; }
 	int sorted;
 
+	unsigned long ModCount() { return modcount; }
 	const char *key(int i);
 	Value *value(int i);
 	int flush();
@@ -0,0 +1,406 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/strmanip.h>
+#include <lax/fileutils.h>
+
+#include "autosaver.h"
+#include "workerpool.h"
+#include "utils.h"
+#include "../laidout.h"
+#include "../language.h"
+
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- Autosaver ---------------------------------------
+
+/*! \class Autosaver
+ * Writes autosave copies of documents without blocking the UI for the whole save.
+ *
+ * Save() makes a text snapshot of a document on the main thread, then a WorkerPool::Shared()
+ * thread writes it to a temporary file, fsyncs, and renames it over the autosave file.
+ * Documents whose DocumentSignature() is the same as when last written to the same file are
+ * skipped without dumping anything. Otherwise, the text of each page is kept between
+ * autosaves, and only pages whose PageSignature() changed are dumped out again. The rest of
+ * the document is small and always dumped. If the snapshot is the same as the last one
+ * written to the same file, nothing is written.
+ *
+ * Signatures come from modtimes, which touching an object propagates up to its page, and
+ * from Document::edits and Page::edits, which LaidoutViewport bumps for changes that do not
+ * touch anything, so no object trees are walked to find out whether anything changed.
+ *
+ * Everything but RunJob() must be called from the main thread. Collect() picks up
+ * finished writes.
+ */
+
+
+/*! Cached dump of one page.
+ */
+class PageText
+{
+  public:
+	unsigned long signature;
+	int indent;
+	std::string text;
+	unsigned long round;
+	PageText() { signature = 0; indent = -1; round = 0; }
+};
+
+class Autosaver::DocState
+{
+  public:
+	unsigned long doc_id;
+	unsigned long round;
+	char *file;          //where saved_hash was written
+	size_t saved_hash;   //hash of the document part of the last snapshot written
+	unsigned long saved_signature; //DocumentSignature() of the last snapshot written
+	bool busy;           //a write is in progress
+	std::unordered_map<unsigned long, PageText> pages; //keyed by page object_id
+
+	DocState(unsigned long id) { doc_id = id; round = 0; file = nullptr; saved_hash = 0; saved_signature = 0; busy = false; }
+	~DocState() { delete[] file; }
+};
+
+class Autosaver::SaveJob
+{
+  public:
+	unsigned long doc_id;
+	char *file;
+	std::string text;
+	size_t hash;
+	unsigned long signature;
+	int error;
+
+	SaveJob(unsigned long id, const char *nfile) { doc_id = id; file = newstr(nfile); hash = 0; signature = 0; error = 0; }
+	~SaveJob() { delete[] file; }
+};
+
+/*! Supplies cached page text to Document::dump_out().
+ */
+class Autosaver::SnapshotContext : public PageDumpContext
+{
+  public:
+	DocState *state;
+	unsigned long round;
+	int num_dumped;
+
+	SnapshotContext(const char *nbasedir, unsigned long doc_id, DocState *nstate, unsigned long nround)
+		: PageDumpContext(nbasedir, 1, doc_id)
+	{
+		state = nstate;
+		round = nround;
+		num_dumped = 0;
+	}
+
+	virtual void DumpPage(FILE *f, Page *page, int indent)
+	{
+		PageText &cached = state->pages[page->object_id];
+		unsigned long signature = PageSignature(page);
+
+		if (cached.indent != indent || cached.signature != signature || cached.text.empty()) {
+			char *buffer = nullptr;
+			size_t size = 0;
+			FILE *mf = open_memstream(&buffer, &size);
+			if (mf) {
+				page->dump_out(mf, indent, PAGE_DUMP_Standalone, this);
+				fclose(mf);
+				cached.text.assign(buffer, size);
+				free(buffer);
+			}
+			cached.signature = signature;
+			cached.indent = indent;
+			num_dumped++;
+		}
+
+		cached.round = round;
+		fwrite(cached.text.data(), 1, cached.text.size(), f);
+	}
+};
+
+
+static unsigned long hash_bytes(unsigned long hash, const void *data, size_t n)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t c=0; c<n; c++) {
+		hash ^= bytes[c];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+/*! Return a hash of what Page::dump_out() would write, based on Page::ContentModTime(),
+ * Page::edits, and the page's own settings, instead of the full contents.
+ */
+unsigned long Autosaver::PageSignature(Page *page)
+{
+	unsigned long hash = 14695981039346656037UL;
+	clock_t modtime = page->ContentModTime();
+	hash = hash_bytes(hash, &modtime, sizeof(modtime));
+	hash = hash_bytes(hash, &page->edits, sizeof(page->edits));
+	hash = hash_bytes(hash, &page->labeltype, sizeof(page->labeltype));
+	hash = hash_bytes(hash, &page->labelcolor.red,   sizeof(page->labelcolor.red));
+	hash = hash_bytes(hash, &page->labelcolor.green, sizeof(page->labelcolor.green));
+	hash = hash_bytes(hash, &page->labelcolor.blue,  sizeof(page->labelcolor.blue));
+	hash = hash_bytes(hash, &page->pagestyle, sizeof(page->pagestyle));
+	if (page->pagestyle) {
+		double dims[4] = { page->pagestyle->min_x, page->pagestyle->min_y, page->pagestyle->width, page->pagestyle->height };
+		hash = hash_bytes(hash, dims, sizeof(dims));
+		hash = hash_bytes(hash, &page->pagestyle->flags, sizeof(page->pagestyle->flags));
+	}
+	int n = page->properties.n();
+	hash = hash_bytes(hash, &n, sizeof(n));
+	hash = hash_bytes(hash, &page->page_loaded, sizeof(page->page_loaded));
+	hash = hash_bytes(hash, &page->external_page_file, sizeof(page->external_page_file));
+	return hash;
+}
+
+/*! Return a hash that changes whenever anything Save() would write for doc does, based on
+ * Document::ContentModTime(), Document::edits, each page's Page::edits, and the modtimes of
+ * the project's limbos. This only looks at the pages, not at any objects.
+ */
+unsigned long Autosaver::DocumentSignature(Document *doc)
+{
+	unsigned long hash = 14695981039346656037UL;
+	clock_t modtime = doc->ContentModTime();
+	hash = hash_bytes(hash, &modtime, sizeof(modtime));
+	hash = hash_bytes(hash, &doc->edits, sizeof(doc->edits));
+	hash = hash_bytes(hash, &doc->pages.n, sizeof(doc->pages.n));
+	for (int c=0; c<doc->pages.n; c++) {
+		Page *page = doc->pages.e[c];
+		hash = hash_bytes(hash, &page->object_id, sizeof(page->object_id));
+		hash = hash_bytes(hash, &page->edits, sizeof(page->edits));
+	}
+
+	if (laidout->project) {
+		Group *limbos = &laidout->project->limbos;
+		hash = hash_bytes(hash, &limbos->modtime, sizeof(limbos->modtime));
+		int n = limbos->n();
+		hash = hash_bytes(hash, &n, sizeof(n));
+		for (int c=0; c<n; c++) hash = hash_bytes(hash, &limbos->e(c)->modtime, sizeof(clock_t));
+	}
+	return hash;
+}
+
+
+Autosaver::Autosaver()
+{
+	round = 0;
+}
+
+/*! Waits for any writes in progress.
+ */
+Autosaver::~Autosaver()
+{
+	Finish();
+}
+
+Autosaver::DocState *Autosaver::FindState(Document *doc)
+{
+	for (int c=0; c<states.n; c++) {
+		if (states.e[c]->doc_id == doc->object_id) return states.e[c];
+	}
+	DocState *state = new DocState(doc->object_id);
+	states.push(state);
+	return state;
+}
+
+/*! Call before a round of Save() calls for all documents. See EndRound().
+ */
+void Autosaver::BeginRound()
+{
+	round++;
+}
+
+/*! Forget cached text of documents and pages that were not saved since BeginRound().
+ */
+void Autosaver::EndRound()
+{
+	for (int c=states.n-1; c>=0; c--) {
+		DocState *state = states.e[c];
+		if (state->round != round && !state->busy) {
+			states.remove(c);
+			continue;
+		}
+
+		for (auto it = state->pages.begin(); it != state->pages.end(); ) {
+			if (it->second.round != round) it = state->pages.erase(it);
+			else ++it;
+		}
+	}
+}
+
+/*! Snapshot doc and start writing it to file in the background. Limbos and windows are
+ * included, as for a normal save.
+ *
+ * Returns 1 if a write was started, 0 if doc is unchanged since last written to file,
+ * or is still being written, or -1 for error.
+ */
+int Autosaver::Save(Document *doc, const char *file, Laxkit::ErrorLog &log)
+{
+	if (!doc || isblank(file)) return -1;
+
+	DocState *state = FindState(doc);
+	state->round = round;
+	unsigned long signature = DocumentSignature(doc);
+	if (state->busy || (strEquals(file, state->file) && signature == state->saved_signature)) {
+		 //keep cached pages while the previous write finishes, or until something changes
+		for (auto &entry : state->pages) entry.second.round = round;
+		return 0;
+	}
+
+	char *buffer = nullptr;
+	size_t size = 0;
+	FILE *f = open_memstream(&buffer, &size);
+	if (!f) {
+		log.AddMessage(_("Could not autosave!"),ERROR_Fail);
+		return -1;
+	}
+
+	char *dir = lax_dirname(laidout->project->filename, 0);
+	SnapshotContext context(dir, doc->object_id, state, round);
+	delete[] dir;
+
+	UseCLocale(true);
+	doc->DumpFile(f, true, false, &context);
+	fflush(f);
+	size_t docsize = size;
+	laidout->DumpWindows(f, 0, doc);
+	fclose(f);
+	UseCLocale(false);
+
+	 //windows are left out of the comparison, so merely scrolling around doesn't cause saves
+	size_t hash = std::hash<std::string>()(std::string(buffer, docsize));
+	if (strEquals(file, state->file) && hash == state->saved_hash) {
+		DBG cerr << "Autosaver: "<<doc->Name(1)<<" unchanged, skipping"<<endl;
+		state->saved_signature = signature;
+		free(buffer);
+		return 0;
+	}
+
+	SaveJob *job = new SaveJob(doc->object_id, file);
+	job->text.assign(buffer, size);
+	job->hash = hash;
+	job->signature = signature;
+	free(buffer);
+
+	DBG cerr << "Autosaver: "<<doc->Name(1)<<" snapshot, "<<context.num_dumped<<" pages dumped"<<endl;
+
+	state->busy = true;
+	pending.push(job);
+	WorkerPool::Shared()->Add([this, job]() { RunJob(job); });
+	return 1;
+}
+
+/*! Called on a worker thread. Write job->text to a temporary file next to job->file,
+ * make sure it is on disk, then replace job->file with it.
+ */
+void Autosaver::RunJob(SaveJob *job)
+{
+	char *tmp = newstr(job->file);
+	appendstr(tmp, ".autosave-tmp");
+
+	FILE *f = fopen(tmp, "w");
+	if (!f) job->error = 1;
+	else {
+		if (fwrite(job->text.data(), 1, job->text.size(), f) != job->text.size()) job->error = 2;
+		if (fflush(f) != 0 || fsync(fileno(f)) != 0) job->error = 2;
+		if (fclose(f) != 0) job->error = 2;
+
+		if (job->error) unlink(tmp);
+		else if (rename(tmp, job->file) != 0) {
+			job->error = 3;
+			unlink(tmp);
+		}
+	}
+	delete[] tmp;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.push_back(job);
+	job_finished.notify_all(); //notify while locked, since Finish() may return, and the Autosaver go away, as soon as it sees the job
+}
+
+/*! Finish up completed writes. Returns the number of documents successfully autosaved.
+ * Failures are added to log.
+ */
+int Autosaver::Collect(Laxkit::ErrorLog &log)
+{
+	std::deque<SaveJob*> done;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done.swap(finished);
+	}
+
+	int n = 0;
+	for (SaveJob *job : done) {
+		DocState *state = nullptr;
+		for (int c=0; c<states.n; c++) if (states.e[c]->doc_id == job->doc_id) { state = states.e[c]; break; }
+
+		if (state) {
+			state->busy = false;
+			if (job->error == 0) {
+				makestr(state->file, job->file);
+				state->saved_hash = job->hash;
+				state->saved_signature = job->signature;
+			}
+		}
+
+		if (job->error) {
+			DBG cerr <<" .... ERROR trying to autosave to: "<<job->file<<endl;
+			log.AddMessage(_("Could not autosave!"),ERROR_Warning);
+		} else {
+			DBG cerr <<" .... autosaved to: "<<job->file<<endl;
+			n++;
+		}
+
+		pending.remove(pending.findindex(job)); //deletes job
+	}
+
+	return n;
+}
+
+/*! Wait for this Autosaver's writes in progress, then Collect() them. Failures are ignored.
+ */
+void Autosaver::Finish()
+{
+	if (!pending.n) return;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_finished.wait(lock, [this]{ return (int)finished.size() >= pending.n; });
+	}
+	ErrorLog log;
+	Collect(log);
+}
+
+
+} //namespace Laidout
+
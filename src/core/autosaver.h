@@ -0,0 +1,67 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include <lax/errorlog.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "document.h"
+
+
+namespace Laidout {
+
+
+//------------------------------------- Autosaver ---------------------------------------
+
+class Autosaver
+{
+  protected:
+	class DocState;
+	class SaveJob;
+	class SnapshotContext;
+
+	Laxkit::PtrStack<DocState> states;
+	Laxkit::PtrStack<SaveJob> pending; //only touched on the main thread
+	std::deque<SaveJob*> finished;     //guarded by mutex
+	std::mutex mutex;
+	std::condition_variable job_finished;
+	unsigned long round;
+
+	virtual DocState *FindState(Document *doc);
+	virtual void RunJob(SaveJob *job);
+
+  public:
+	static unsigned long PageSignature(Page *page);
+	static unsigned long DocumentSignature(Document *doc);
+
+	Autosaver();
+	virtual ~Autosaver();
+
+	virtual void BeginRound();
+	virtual int Save(Document *doc, const char *file, Laxkit::ErrorLog &log);
+	virtual void EndRound();
+	virtual int Collect(Laxkit::ErrorLog &log);
+	virtual void Finish();
+	virtual int NumPending() { return pending.n; }
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -0,0 +1,554 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/strmanip.h>
+
+#include "binaryattribute.h"
+#include "../language.h"
+#include "../version.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace std;
+
+
+namespace Laidout {
+
+
+/*! \file
+ * Compact binary container for Attribute trees, as an alternative to the indented text
+ * format for saving documents.
+ *
+ * Layout, all integers little endian:
+ * <pre>
+ *   "LAIDOUTB"  u32 format version  u32 number of sections
+ *   sections:   u32 tag  u32 0  u64 data length  data, padded to 8 bytes
+ * </pre>
+ *
+ * Sections are:
+ * - HEAD: what the file is, such as "Document", and the Laidout version that wrote it, as strings
+ * - STRS: u32 count, then each string as u32 length and bytes. Every attribute name and value
+ *   text is stored once here.
+ * - NUMS: u64 count, then that many raw doubles.
+ * - TREE: u32 number of top attributes, then each attribute depth first as
+ *   u32 name, u32 value kind, u32 value string, u32 number count, u32 number of subattributes.
+ *
+ * Objects with arrays of numbers hand them straight to NUMS with BinaryDumpContext::PutNumbers()
+ * while dumping, and get them straight back with BinaryDumpContext::GetNumbers() while loading,
+ * so those numbers are never printed or parsed. Everything else is stored as the text
+ * the object dumped.
+ *
+ * Version 1 files instead had numbers taken back out of value text, which are printed
+ * back into the text when read.
+ */
+
+
+#define BINARY_MAGIC    "LAIDOUTB"
+#define BINARY_VERSION  2
+#define NO_STRING       0xffffffff
+#define NUMBER_MARK     '\x01' //version 1 only
+#define NUMBERS_MARK    "\x02numbers "
+
+#define SECTION_HEAD    0x44414548 // "HEAD"
+#define SECTION_STRS    0x53525453 // "STRS"
+#define SECTION_NUMS    0x534d554e // "NUMS"
+#define SECTION_TREE    0x45455254 // "TREE"
+
+enum BinaryValueKind {
+	VALUE_None   = 0,
+	VALUE_String = 1,
+	VALUE_Numbers = 2 //version 1: string has NUMBER_MARK where numbers go
+};
+
+
+//------------------------------------- BinaryDumpContext ---------------------------------------
+
+/*! \class BinaryDumpContext
+ * Context for dumping to and from the binary format of save_binary_attribute().
+ *
+ * Objects with many numbers can check for this context in their dump_out_atts(), and pass
+ * their numbers to PutNumbers() instead of printing them, and in dump_in_atts() use
+ * GetNumbers() on the value they find instead of parsing it.
+ */
+
+/*! Append n numbers to the number section, and set att's value to a marker for them.
+ */
+void BinaryDumpContext::PutNumbers(Laxkit::Attribute *att, const double *d, long n)
+{
+	char scratch[60];
+	snprintf(scratch, sizeof(scratch), NUMBERS_MARK "%lu %ld", (unsigned long)numbers.size(), n);
+	makestr(att->value, scratch);
+	numbers.insert(numbers.end(), d, d+n);
+}
+
+/*! If value is a marker from PutNumbers(), return a pointer to the numbers, and their
+ * count in n_ret. Otherwise return null. The numbers belong to this context.
+ */
+const double *BinaryDumpContext::GetNumbers(const char *value, long *n_ret)
+{
+	if (!value || strncmp(value, NUMBERS_MARK, strlen(NUMBERS_MARK))) return nullptr;
+
+	unsigned long start = 0;
+	long n = 0;
+	if (sscanf(value + strlen(NUMBERS_MARK), "%lu %ld", &start, &n) != 2) return nullptr;
+	if (n < 0 || start > numbers.size() || (unsigned long)n > numbers.size() - start) return nullptr;
+	if (n_ret) *n_ret = n;
+	return numbers.data() + start;
+}
+
+
+//------------------------------------- writing ---------------------------------------
+
+static void put_u32(string &out, uint32_t v)
+{
+	char b[4] = { (char)(v & 0xff), (char)((v>>8) & 0xff), (char)((v>>16) & 0xff), (char)((v>>24) & 0xff) };
+	out.append(b, 4);
+}
+
+static void put_u64(string &out, uint64_t v)
+{
+	put_u32(out, (uint32_t)(v & 0xffffffff));
+	put_u32(out, (uint32_t)(v >> 32));
+}
+
+static void put_string(string &out, const char *str, size_t len)
+{
+	put_u32(out, len);
+	out.append(str, len);
+}
+
+/*! Format a number the way version 1 files expect it in values.
+ */
+static int print_number(char *buffer, int size, double d)
+{
+	return snprintf(buffer, size, "%.10g", d);
+}
+
+class BinaryWriter
+{
+  public:
+	vector<string> strings;
+	unordered_map<string, uint32_t> string_index;
+	string tree;
+
+	uint32_t String(const char *str)
+	{
+		if (!str) return NO_STRING;
+		auto found = string_index.find(str);
+		if (found != string_index.end()) return found->second;
+		uint32_t i = strings.size();
+		strings.push_back(str);
+		string_index[str] = i;
+		return i;
+	}
+
+	void Add(Attribute *att)
+	{
+		put_u32(tree, String(att->name));
+		put_u32(tree, att->value ? VALUE_String : VALUE_None);
+		put_u32(tree, String(att->value));
+		put_u32(tree, 0);
+		put_u32(tree, att->attributes.n);
+		for (int c=0; c<att->attributes.n; c++) Add(att->attributes.e[c]);
+	}
+};
+
+static void put_section(string &out, uint32_t tag, const string &data)
+{
+	put_u32(out, tag);
+	put_u32(out, 0);
+	put_u64(out, data.size());
+	out += data;
+	while (out.size() % 8) out += '\0';
+}
+
+/*! Save the subattributes of att to file in the binary format. att's own name and value are ignored.
+ * what is the kind of file, like "Document". If context is not null, it should be what att was
+ * dumped with, and the numbers objects put in it are written to the file as is.
+ *
+ * Returns 0 for success, or nonzero for error.
+ */
+int save_binary_attribute(const char *file, Laxkit::Attribute *att, const char *what, Laxkit::ErrorLog *log, BinaryDumpContext *context)
+{
+	if (!file || !att || !what) return 1;
+
+	BinaryWriter writer;
+	put_u32(writer.tree, att->attributes.n);
+	for (int c=0; c<att->attributes.n; c++) writer.Add(att->attributes.e[c]);
+
+	string head;
+	put_string(head, what, strlen(what));
+	put_string(head, LAIDOUT_VERSION, strlen(LAIDOUT_VERSION));
+
+	string strs;
+	put_u32(strs, writer.strings.size());
+	for (string &str : writer.strings) put_string(strs, str.c_str(), str.size());
+
+	string nums;
+	size_t num_numbers = (context ? context->numbers.size() : 0);
+	put_u64(nums, num_numbers);
+	for (size_t c=0; c<num_numbers; c++) {
+		uint64_t bits;
+		memcpy(&bits, &context->numbers[c], 8);
+		put_u64(nums, bits);
+	}
+
+	string out(BINARY_MAGIC);
+	put_u32(out, BINARY_VERSION);
+	put_u32(out, 4);
+	put_section(out, SECTION_HEAD, head);
+	put_section(out, SECTION_STRS, strs);
+	put_section(out, SECTION_NUMS, nums);
+	put_section(out, SECTION_TREE, writer.tree);
+
+	FILE *f = fopen(file, "wb");
+	if (!f) {
+		if (log) log->AddMessage(_("File cannot be opened for writing"),ERROR_Fail);
+		return 2;
+	}
+	size_t written = fwrite(out.data(), 1, out.size(), f);
+	fclose(f);
+
+	if (written != out.size()) {
+		if (log) log->AddMessage(_("Could not write file!"),ERROR_Fail);
+		return 3;
+	}
+
+	DBG cerr << "save_binary_attribute: "<<writer.strings.size()<<" strings, "<<num_numbers<<" numbers, "<<out.size()<<" bytes"<<endl;
+	return 0;
+}
+
+/*! For parts of a document that can only dump_out() to a FILE, not dump_out_atts(), call dump
+ * with a temporary in memory file, and read what it writes into att's subattributes.
+ * Any BinaryDumpContext passed along inside dump still collects numbers as usual.
+ *
+ * Returns 0 for success, or nonzero for error.
+ */
+int dump_text_to_attribute(Laxkit::Attribute *att, std::function<void(FILE*)> dump)
+{
+	if (!att) return 1;
+
+	char *buffer = nullptr;
+	size_t size = 0;
+	FILE *f = open_memstream(&buffer, &size);
+	if (!f) return 2;
+	dump(f);
+	fclose(f);
+
+	int err = 0;
+	if (size) {
+		FILE *mf = fmemopen(buffer, size, "r");
+		if (mf) {
+			att->dump_in(mf, 0, nullptr);
+			fclose(mf);
+		} else err = 3;
+	}
+	free(buffer);
+	return err;
+}
+
+
+
+//------------------------------------- reading ---------------------------------------
+
+class BinaryReader
+{
+  public:
+	const unsigned char *data;
+	size_t size;
+	uint32_t version;
+
+	const unsigned char *head, *strs, *nums, *tree;
+	size_t head_size, strs_size, nums_size, tree_size;
+
+	vector<string> strings;
+	uint64_t num_numbers;
+	uint64_t next_number;
+	size_t pos; //in tree
+	bool error;
+
+	BinaryReader(const unsigned char *ndata, size_t nsize)
+	{
+		data = ndata;
+		size = nsize;
+		version = 0;
+		head = strs = nums = tree = nullptr;
+		head_size = strs_size = nums_size = tree_size = 0;
+		num_numbers = next_number = 0;
+		pos = 0;
+		error = false;
+	}
+
+	static uint32_t U32(const unsigned char *p) { return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24); }
+	static uint64_t U64(const unsigned char *p) { return U32(p) | ((uint64_t)U32(p+4) << 32); }
+
+	/*! Find sections. Return true if the file looks ok.
+	 */
+	bool Sections()
+	{
+		if (size < 16 || memcmp(data, BINARY_MAGIC, 8)) return false;
+		version = U32(data+8);
+		if (version < 1 || version > BINARY_VERSION) return false;
+
+		uint32_t n = U32(data+12);
+		size_t p = 16;
+		for (uint32_t c=0; c<n; c++) {
+			if (p + 16 > size) return false;
+			uint32_t tag = U32(data+p);
+			uint64_t len = U64(data+p+8);
+			p += 16;
+			if (len > size - p) return false;
+
+			if      (tag == SECTION_HEAD) { head = data+p; head_size = len; }
+			else if (tag == SECTION_STRS) { strs = data+p; strs_size = len; }
+			else if (tag == SECTION_NUMS) { nums = data+p; nums_size = len; }
+			else if (tag == SECTION_TREE) { tree = data+p; tree_size = len; }
+
+			p += len;
+			while (p % 8) p++;
+		}
+		return head != nullptr;
+	}
+
+	/*! Read the index'th string of the HEAD section.
+	 */
+	bool Head(int index, string &str)
+	{
+		size_t p = 0;
+		for (int c=0; c<=index; c++) {
+			if (p + 4 > head_size) return false;
+			uint32_t len = U32(head+p);
+			p += 4;
+			if (len > head_size - p) return false;
+			if (c == index) str.assign((const char*)head+p, len);
+			p += len;
+		}
+		return true;
+	}
+
+	bool Strings()
+	{
+		if (!strs || strs_size < 4) return false;
+		uint32_t n = U32(strs);
+		if (n > strs_size / 4) return false;
+		strings.reserve(n);
+		size_t p = 4;
+		for (uint32_t c=0; c<n; c++) {
+			if (p + 4 > strs_size) return false;
+			uint32_t len = U32(strs+p);
+			p += 4;
+			if (len > strs_size - p) return false;
+			strings.emplace_back((const char*)strs+p, len);
+			p += len;
+		}
+		return true;
+	}
+
+	bool Numbers()
+	{
+		if (!nums || nums_size < 8) return false;
+		num_numbers = U64(nums);
+		return num_numbers <= (nums_size - 8) / 8;
+	}
+
+	double Number()
+	{
+		if (next_number >= num_numbers) { error = true; return 0; }
+		uint64_t bits = U64(nums + 8 + 8*next_number);
+		next_number++;
+		double d;
+		memcpy(&d, &bits, 8);
+		return d;
+	}
+
+	uint32_t TreeU32()
+	{
+		if (pos + 4 > tree_size) { error = true; return 0; }
+		uint32_t v = U32(tree+pos);
+		pos += 4;
+		return v;
+	}
+
+	const char *String(uint32_t i)
+	{
+		if (i == NO_STRING) return nullptr;
+		if (i >= strings.size()) { error = true; return nullptr; }
+		return strings[i].c_str();
+	}
+
+	/*! Read count attributes from the tree into parent.
+	 */
+	void Read(Attribute *parent, uint32_t count, int depth)
+	{
+		if (depth > 1000) { error = true; return; }
+
+		string value;
+		char scratch[40];
+
+		for (uint32_t c=0; c<count && !error; c++) {
+			const char *name = String(TreeU32());
+			uint32_t kind    = TreeU32();
+			const char *str  = String(TreeU32());
+			uint32_t nnums   = TreeU32();
+			uint32_t nkids   = TreeU32();
+			if (error) return;
+
+			const char *v = str;
+			if (kind == VALUE_None) v = nullptr;
+			else if (kind == VALUE_Numbers) {
+				if (!str || version > 1) { error = true; return; }
+				value.clear();
+				uint32_t used = 0;
+				for (const char *p = str; *p; p++) {
+					if (*p == NUMBER_MARK) {
+						print_number(scratch, sizeof(scratch), Number());
+						value += scratch;
+						used++;
+					} else value += *p;
+				}
+				if (used != nnums) { error = true; return; }
+				v = value.c_str();
+			}
+
+			Attribute *att = new Attribute(name, v);
+			parent->push(att, -1);
+			if (nkids) Read(att, nkids, depth+1);
+		}
+	}
+};
+
+/*! If file is a binary laidout file, return true, and return in what_ret what it contains,
+ * like "Document", and in version_ret the Laidout version that wrote it, as new char[].
+ * Either may be null. If file is not a binary laidout file, return false.
+ */
+bool binary_laidout_file_type(const char *file, char **version_ret, char **what_ret)
+{
+	if (!file) return false;
+
+	FILE *f = fopen(file, "rb");
+	if (!f) return false;
+	unsigned char buffer[256];
+	size_t n = fread(buffer, 1, sizeof(buffer), f);
+	fclose(f);
+
+	 //HEAD is written first, so should be in the first block
+	if (n < 32 || memcmp(buffer, BINARY_MAGIC, 8) || BinaryReader::U32(buffer+16) != SECTION_HEAD) return false;
+
+	BinaryReader reader(buffer, n);
+	reader.head = buffer + 32;
+	reader.head_size = BinaryReader::U64(buffer+24);
+	if (reader.head_size > n - 32) reader.head_size = n - 32;
+
+	string what, version;
+	if (!reader.Head(0, what) || !reader.Head(1, version)) return false;
+	if (what_ret) *what_ret = newstr(what.c_str());
+	if (version_ret) *version_ret = newstr(version.c_str());
+	return true;
+}
+
+/*! Return true if file is a binary laidout file that says it contains what, like "Document".
+ */
+bool is_binary_laidout_file(const char *file, const char *what)
+{
+	char *type = nullptr;
+	if (!binary_laidout_file_type(file, nullptr, &type)) return false;
+	bool match = what && !strcmp(type, what);
+	delete[] type;
+	return match;
+}
+
+/*! True if file has the extension used for binary documents, ".laidoutb".
+ */
+bool is_binary_laidout_filename(const char *file)
+{
+	if (!file) return false;
+	const char *ext = strrchr(file, '.');
+	return ext && !strcasecmp(ext, ".laidoutb");
+}
+
+/*! Read a file written by save_binary_attribute() into att, appending to att's subattributes.
+ * The file is memory mapped while reading. The file's numbers are copied to context, which
+ * should then be used to dump_in_atts() from att, so objects can find them with
+ * BinaryDumpContext::GetNumbers().
+ *
+ * Returns 0 for success, or nonzero for error. On error, att may have been partially filled.
+ */
+int load_binary_attribute(const char *file, Laxkit::Attribute *att, const char *what, Laxkit::ErrorLog *log, BinaryDumpContext *context)
+{
+	if (!file || !att) return 1;
+
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		if (log) log->AddMessage(_("Could not open file!"),ERROR_Fail);
+		return 2;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < 16) {
+		close(fd);
+		if (log) log->AddMessage(_("Bad file!"),ERROR_Fail);
+		return 3;
+	}
+
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		if (log) log->AddMessage(_("Could not open file!"),ERROR_Fail);
+		return 2;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	BinaryReader reader((const unsigned char*)map, st.st_size);
+	string kind;
+	bool ok = reader.Sections() && reader.Head(0, kind) && (!what || kind == what)
+			&& reader.Strings() && reader.Numbers() && reader.tree;
+
+	if (ok) {
+		uint32_t count = reader.TreeU32();
+		reader.Read(att, count, 0);
+		ok = !reader.error;
+	}
+
+	if (ok && context && reader.version > 1) {
+		context->numbers.resize(reader.num_numbers);
+		for (uint64_t c=0; c<reader.num_numbers; c++) context->numbers[c] = reader.Number();
+	}
+
+	munmap(map, st.st_size);
+
+	if (!ok) {
+		if (log) log->AddMessage(_("Bad file!"),ERROR_Fail);
+		return 4;
+	}
+	return 0;
+}
+
+
+} //namespace Laidout
+
@@ -0,0 +1,54 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef BINARYATTRIBUTE_H
+#define BINARYATTRIBUTE_H
+
+#include <lax/attributes.h>
+#include <lax/errorlog.h>
+#include <lax/dump.h>
+
+#include <vector>
+#include <functional>
+
+
+namespace Laidout {
+
+
+//------------------------------------- BinaryDumpContext ---------------------------------------
+
+class BinaryDumpContext : public Laxkit::DumpContext
+{
+  public:
+	std::vector<double> numbers; //contents of the file's number section
+
+	BinaryDumpContext(const char *nbasedir, char nsubs_only, unsigned long nobject_id)
+		: Laxkit::DumpContext(nbasedir, nsubs_only, nobject_id) {}
+
+	virtual void PutNumbers(Laxkit::Attribute *att, const double *d, long n);
+	virtual const double *GetNumbers(const char *value, long *n_ret);
+};
+
+
+bool binary_laidout_file_type(const char *file, char **version_ret, char **what_ret);
+bool is_binary_laidout_file(const char *file, const char *what);
+bool is_binary_laidout_filename(const char *file);
+int save_binary_attribute(const char *file, Laxkit::Attribute *att, const char *what, Laxkit::ErrorLog *log, BinaryDumpContext *context = nullptr);
+int dump_text_to_attribute(Laxkit::Attribute *att, std::function<void(FILE*)> dump);
+int load_binary_attribute(const char *file, Laxkit::Attribute *att, const char *what, Laxkit::ErrorLog *log, BinaryDumpContext *context = nullptr);
+
+
+} //namespace Laidout
+
+#endif
+
@@ -22,6 +22,11 @@
 #include <lax/gradientstrip.h>
 #include <lax/interfaces/interfacemanager.h>
 
+#include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "document.h"
 #include "../filetypes/scribus.h"
 #include "../filetypes/svg.h"
@@ -30,6 +35,7 @@
 #include "../laidout.h"
 #include "../ui/headwindow.h"
 #include "utils.h"
+#include "binaryattribute.h"
 #include "../nodes/nodeinterface.h"
 #include "stylemanager.h"
 #include "../language.h"
@@ -413,9 +419,12 @@ Document::Document(const char *filename)
 	makestr(saveas,filename);
 	tms tms_;
 	modtime=times(&tms_);
+	edits=0;
 	curpage=-1;
 	imposition=NULL;
 	metadata = nullptr;
+	page_use_counter=0;
+	save_binary=false;
 	
 	ErrorLog log;
 	Load(filename,log);
@@ -435,10 +444,13 @@ Document::Document(Imposition *imp,const char *filename)
 	tms tms_;
 
 	modtime  = times(&tms_);
+	edits    = 0;
 	curpage  = -1;
 	saveas   = newstr(filename);
 	name     = nullptr;
 	metadata = nullptr;
+	page_use_counter = 0;
+	save_binary = false;
 	
 	imposition = imp;
 	if (imposition) imposition->inc_count();
@@ -586,6 +598,7 @@ int Document::NewPages(int starting,int np)
 	// sync up with the imposition
 	imposition->NumPages(pages.n);
 	SyncPages(starting, -1, true);
+	Touch();
 
 	laidout->notifyDocTreeChanged(nullptr, TreePagesAdded, starting,-1);
 	return np;
@@ -747,6 +760,7 @@ int Document::ApplyPageRange(const char *name, int type, const char *base, int s
 		pages.e[c]->label=label;
 	}
 
+	Touch();
 	return 0;
 }
 
@@ -765,6 +779,7 @@ int Document::RemovePages(int start,int n)
 	}
 	imposition->NumPages(pages.n);
 	SyncPages(start,-1, true);
+	Touch();
 	laidout->notifyDocTreeChanged(NULL,TreePagesDeleted, start,-1);
 	return n;
 }
@@ -888,6 +903,9 @@ int Document::SaveACopy(const char *filename, int includelimbos,int includewindo
  *
  * If includelimbos, then also save laidout->project->limbos.
  *
+ * If saveas ends with ".laidoutb", or save_binary is set and saveas doesn't end with ".laidout",
+ * the document is saved in a binary format instead of text. See save_binary_attribute().
+ *
  * \todo *** only checks for saveas existence, does no sanity checking on it...
  * \todo  need to work out saving Specific project/no proj but many docs/single doc
  */
@@ -926,22 +944,72 @@ int Document::Save(int includelimbos,int includewindows,ErrorLog &log, bool add_
 		}
 	}
 
-	f=fopen(saveas,"w");
-	if (!f) {
-		DBG cerr <<"**** cannot save, file \""<<saveas<<"\" cannot be opened for writing."<<endl;
-		log.AddMessage(_("File cannot be opened for writing"),ERROR_Fail);
-		return 3;
-	}
+	 //large documents keep page contents in files next to the document
+	bool external = (laidout->prefs.external_pages_threshold > 0 && pages.n >= laidout->prefs.external_pages_threshold);
+	for (int c=0; c<pages.n && !external; c++) if (pages.e[c]->external_page_file) external = true;
 
-	setlocale(LC_ALL,"C");
-	DBG cerr <<"....Saving document to "<<saveas<<endl;
-//	f=stdout;//***
-	fprintf(f,"#Laidout %s Document\n",LAIDOUT_VERSION);
-	
+	const char *ext = strrchr(saveas, '.');
+	bool binary = is_binary_laidout_filename(saveas) || (save_binary && !(ext && !strcasecmp(ext, ".laidout")));
+
+	 //page content files are always text
 	char *dir=lax_dirname(laidout->project->filename,0);
 	DumpContext context(dir,1, object_id);
+	BinaryDumpContext bincontext(dir,1, object_id);
 	if (dir) delete[] dir;
-	dump_out(f,0,0,&context);
+
+	UseCLocale(true);
+	int perr = SavePages(external, &context, log);
+	UseCLocale(false);
+	if (perr) return 4;
+
+	 //binary documents are dumped straight to an Attribute tree. Objects with many numbers
+	 //put them in bincontext instead of the tree.
+	if (binary) {
+		Attribute att;
+		UseCLocale(true);
+		DBG cerr <<"....Saving binary document to "<<saveas<<endl;
+		DumpFile(&att, includelimbos, includewindows, &bincontext);
+		int err = save_binary_attribute(saveas, &att, "Document", &log, &bincontext);
+		UseCLocale(false);
+		if (err) return 3;
+
+	} else {
+		f = fopen(saveas,"w");
+		if (!f) {
+			DBG cerr <<"**** cannot save, file \""<<saveas<<"\" cannot be opened for writing."<<endl;
+			log.AddMessage(_("File cannot be opened for writing"),ERROR_Fail);
+			return 3;
+		}
+
+		UseCLocale(true);
+		DBG cerr <<"....Saving document to "<<saveas<<endl;
+		DumpFile(f, includelimbos, includewindows, &context);
+		fclose(f);
+		UseCLocale(false);
+	}
+
+	 //remember what inline pages were saved as, so their cached thumbnails can be found by file
+	for (int c=0; c<pages.n; c++) if (!pages.e[c]->external_page_file) pages.e[c]->savedmodtime = pages.e[c]->ContentModTime();
+
+	if (add_to_recent) touch_recently_used_xbel(saveas,"application/x-laidout-doc",
+							"Laidout","laidout", //application
+							"Laidout", //group
+							true, //visited
+							true, //modified
+							NULL); //recent file
+	return 0;
+}
+
+/*! Write out the whole text document file to f, as Save() does. Call with UseCLocale(true).
+ * If context is a PageDumpContext, it is asked to write out each page.
+ * Images still loading in the background are not waited for. They are saved with the
+ * file they are loading, see ImageImportQueue.
+ */
+void Document::DumpFile(FILE *f, int includelimbos, int includewindows, Laxkit::DumpContext *context)
+{
+	fprintf(f,"#Laidout %s Document\n",LAIDOUT_VERSION);
+	
+	dump_out(f,0,0,context);
 
 	Group *g,*gg;
 	if (includelimbos) {
@@ -955,23 +1023,33 @@ int Document::Save(int includelimbos,int includewindows,ErrorLog &log, bool add_
 	}
 
 	if (includewindows) laidout->DumpWindows(f,0,this);
-	
-	fclose(f);
-	setlocale(LC_ALL,"");
+}
 
-	if (add_to_recent) touch_recently_used_xbel(saveas,"application/x-laidout-doc",
-							"Laidout","laidout", //application
-							"Laidout", //group
-							true, //visited
-							true, //modified
-							NULL); //recent file
-	return 0;
+/*! Same as DumpFile(FILE*,...), but into att, for binary files. Call with UseCLocale(true).
+ */
+void Document::DumpFile(Laxkit::Attribute *att, int includelimbos, int includewindows, Laxkit::DumpContext *context)
+{
+	dump_out_atts(att, 0, context);
+
+	if (includelimbos) {
+		Group *g = &laidout->project->limbos;
+		for (int c=0; c<g->n(); c++) {
+			Group *gg = dynamic_cast<Group *>(g->e(c));
+			Attribute *att2 = att->pushSubAtt("limbo", gg->id ? gg->id : "");
+			gg->dump_out_atts(att2, 0, context);
+		}
+	}
+
+	if (includewindows) dump_text_to_attribute(att, [this](FILE *f) { laidout->DumpWindows(f,0,this); });
 }
 
 //! Load a document, completely replacing what's here already.
 /*! This only clears the current variables when the file can be loaded (but
  * not necessarily read correctly).
  *
+ * Files in the binary format written by save_binary_attribute() are detected by their
+ * contents, not their extension.
+ *
  * Return 0 for not loaded, positive for loaded. Note that no new window is created
  * here unless there is a window attribute in the file. (should probably separate
  * window creation from base Document class).
@@ -985,8 +1063,24 @@ int Document::Load(const char *file,ErrorLog &log)
 	DBG cerr <<"----Document::Load read file "<<(file?file:"**** AH! null file!")<<" into a new Document"<<endl;
 	if (!file) return 0;
 	
-	FILE *f=open_laidout_file_to_read(file,"Document",&log);
-	if (!f) {
+	char *dir=lax_dirname(file,0);
+	BinaryDumpContext context(dir,1, object_id);
+	context.log = &log;
+	if (dir) delete[] dir;
+
+	 //binary documents are read entirely here, before anything is cleared
+	Attribute binatt;
+	bool binary = is_binary_laidout_file(file, "Document");
+	if (binary) {
+		UseCLocale(true);
+		int err = load_binary_attribute(file, &binatt, "Document", &log, &context);
+		UseCLocale(false);
+		if (err) return 0;
+	}
+
+	FILE *f = nullptr;
+	if (!binary) f = open_laidout_file_to_read(file,"Document",&log);
+	if (!f && !binary) {
 		bool found_special = false;
 		if (isScribusFile(file)) {
 			int c=addScribusDocument(file,this); //0 success, 1 failure
@@ -1010,16 +1104,15 @@ int Document::Load(const char *file,ErrorLog &log)
 	
 	 //so now, assume ok to load attribute styled Document file
 
-	char *dir=lax_dirname(file,0);
-	DumpContext context(dir,1, object_id);
-	context.log = &log;
-	if (dir) delete[] dir;
-
 	clear();
-	setlocale(LC_ALL,"C");
-	dump_in(f,0,0,&context,NULL);
-	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(true);
+	if (binary) dump_in_atts(&binatt,0,&context);
+	else {
+		dump_in(f,0,0,&context,NULL);
+		fclose(f);
+	}
+	UseCLocale(false);
+	save_binary = binary;
 	
 	makestr(saveas,file);
 	if (saveas[0]!='/') convert_to_full_path(saveas,NULL);
@@ -1048,10 +1141,12 @@ int Document::Load(const char *file,ErrorLog &log)
 	imposition->NumPages(pages.n);
 	SyncPages(0,-1, false);
 
-	laidout->project->ClarifyRefs(log);
+	 //clones of objects on pages not loaded yet are resolved when those pages are loaded
+	laidout->project->ClarifyRefs(log, NumUnloadedPages() == 0);
 
 	ForceFilterUpdates(-1,-1);
-	DBG cerr<<" *** Document::Load should probably have a load context storing refs that need to be sorted, to save time loading..."<<endl;
+	 //remember what inline pages were loaded as, so their cached thumbnails can be found by file
+	for (int c=0; c<pages.n; c++) if (!pages.e[c]->external_page_file) pages.e[c]->savedmodtime = pages.e[c]->ContentModTime();
 
 	if (!(strstr(file,"/laidout/") && strstr(file,"/templates/"))) {
 		//***bit of a hack to not make templates show up as recent files
@@ -1084,6 +1179,208 @@ void Document::ForceFilterUpdates(int frompage, int topage)
 	}
 }
 
+/*! Return a new char[] with the file that page number pagei is saved to when
+ * page contents are kept in separate files.
+ */
+static char *external_page_file_name(const char *pagedir, int pagei)
+{
+	char scratch[30];
+	sprintf(scratch, "page%d.laidoutpage", pagei);
+	char *file = newstr(pagedir);
+	appendstr(file, scratch);
+	return file;
+}
+
+/*! Called from Save() to arrange page contents before dumping out the document.
+ *
+ * If external, page contents go in separate files in the directory "(saveas).pages/",
+ * and pages then dump out only a reference to their file. Pages that are not loaded and
+ * already have their file at the right place are left alone, as are pages whose contents
+ * haven't changed since last saved there.
+ *
+ * If !external, all pages are loaded so they can be saved inline.
+ *
+ * Return 0 for success, or nonzero for error, in which case the document should not be saved.
+ */
+int Document::SavePages(bool external, Laxkit::DumpContext *context, Laxkit::ErrorLog &log)
+{
+	if (!external) {
+		for (int c=0; c<pages.n; c++) {
+			if (pages.e[c]->page_loaded == 0 && LoadPage(c, &log) != 0) {
+				log.AddMessage(_("Could not load page contents!"),ERROR_Fail);
+				return 1;
+			}
+		}
+		for (int c=0; c<pages.n; c++) {
+			makestr(pages.e[c]->external_page_file, nullptr);
+			pages.e[c]->page_loaded = -1;
+		}
+		return 0;
+	}
+
+	char *pagedir = newstr(saveas);
+	appendstr(pagedir, ".pages/");
+	if (check_dirs(pagedir, true) != -1) {
+		log.AddMessage(_("Could not create directory for pages!"),ERROR_Fail);
+		delete[] pagedir;
+		return 1;
+	}
+
+	 //unloaded pages whose file is not where they now belong must be read in first,
+	 //so writing other pages cannot clobber them
+	NumStack<int> toload;
+	char *file;
+	for (int c=0; c<pages.n; c++) {
+		if (pages.e[c]->page_loaded != 0) continue;
+		file = external_page_file_name(pagedir, c);
+		if (!strEquals(file, pages.e[c]->external_page_file)) toload.push(c);
+		delete[] file;
+	}
+	if (toload.n && LoadPages(toload, &log) != toload.n) {
+		log.AddMessage(_("Could not load page contents!"),ERROR_Fail);
+		delete[] pagedir;
+		return 1;
+	}
+
+	int err = 0;
+	for (int c=0; c<pages.n && !err; c++) {
+		Page *page = pages.e[c];
+		if (page->page_loaded == 0) continue; //file is already in the right place
+
+		file = external_page_file_name(pagedir, c);
+		if (!(strEquals(file, page->external_page_file) && page->ContentIsClean()
+				&& file_exists(file, 1, nullptr) == S_IFREG)) {
+			err = page->SaveContent(file, context, log);
+		}
+		delete[] file;
+	}
+
+	 //remove files of pages that no longer exist
+	for (int c=pages.n; !err; c++) {
+		file = external_page_file_name(pagedir, c);
+		bool exists = (file_exists(file, 1, nullptr) == S_IFREG);
+		if (exists) {
+			unlink(file);
+			appendstr(file, ".png");
+			unlink(file);
+		}
+		delete[] file;
+		if (!exists) break;
+	}
+
+	delete[] pagedir;
+	return err;
+}
+
+/*! Read in contents of any pages in which that are kept in separate files and not loaded yet,
+ * then resolve clones in the whole project. Pages in which are marked as most recently used,
+ * for EvictPages().
+ *
+ * Returns the number of pages in which that are now loaded, or not kept in separate files.
+ */
+int Document::LoadPages(Laxkit::NumStack<int> &which, Laxkit::ErrorLog *log)
+{
+	ErrorLog scratch;
+	if (!log) log = &scratch;
+
+	char *dir = lax_dirname(saveas, 0);
+	DumpContext context(dir, 1, object_id);
+	context.log = log;
+	delete[] dir;
+
+	int numok = 0, numloaded = 0;
+	for (int c=0; c<which.n; c++) {
+		int i = which.e[c];
+		if (i < 0 || i >= pages.n) continue;
+
+		Page *page = pages.e[i];
+		page->lastused = ++page_use_counter;
+		if (page->page_loaded != 0) { numok++; continue; }
+
+		if (page->LoadContent(&context, log) == 0) {
+			ForceFilterUpdates(i, i);
+			laidout->project->ObjectAdded(&page->layers);
+			numok++;
+			numloaded++;
+		}
+	}
+
+	if (numloaded) laidout->project->ClarifyRefs(*log);
+	return numok;
+}
+
+/*! Convenience for loading a single page. See LoadPages().
+ * Returns 0 if the page is now loaded, or nonzero for error.
+ */
+int Document::LoadPage(int pagei, Laxkit::ErrorLog *log)
+{
+	NumStack<int> which;
+	which.push(pagei);
+	return LoadPages(which, log) == 1 ? 0 : 1;
+}
+
+/*! Append to which the indices of pages shown by spread, including pages that bleed onto them.
+ * Returns which.n.
+ */
+int Document::SpreadPages(Spread *spread, Laxkit::NumStack<int> &which)
+{
+	if (!spread) return which.n;
+
+	for (int c=0; c<spread->pagestack.n(); c++) {
+		int i = spread->pagestack.e[c]->index;
+		if (i < 0 || i >= pages.n) continue;
+		which.pushnodup(i);
+
+		for (int c2=0; c2<pages.e[i]->pagebleeds.n; c2++) {
+			int bi = pages.e[i]->pagebleeds.e[c2]->index;
+			if (bi >= 0 && bi < pages.n) which.pushnodup(bi);
+		}
+	}
+	return which.n;
+}
+
+/*! Unload least recently used pages kept in separate files, until at most max_loaded of them
+ * remain loaded. Pages that have changed, or have objects used elsewhere, are skipped.
+ * See Page::UnloadContent(). If max_loaded<=0, nothing is done.
+ *
+ * Returns the number of pages unloaded.
+ */
+int Document::EvictPages(int max_loaded)
+{
+	if (max_loaded <= 0) return 0;
+
+	std::vector<int> loaded;
+	for (int c=0; c<pages.n; c++) {
+		if (pages.e[c]->page_loaded == 1) loaded.push_back(c);
+	}
+	if ((int)loaded.size() <= max_loaded) return 0;
+
+	std::sort(loaded.begin(), loaded.end(),
+			[this](int a, int b) { return pages.e[a]->lastused < pages.e[b]->lastused; });
+
+	int num = 0;
+	int toevict = loaded.size() - max_loaded;
+	for (unsigned int c=0; c<loaded.size() && num < toevict; c++) {
+		 //the object index holds references to what it indexes
+		Page *page = pages.e[loaded[c]];
+		laidout->project->ObjectRemoved(&page->layers);
+		if (page->UnloadContent() == 0) num++;
+		else laidout->project->ObjectAdded(&page->layers);
+	}
+
+	DBG cerr << "Document::EvictPages unloaded "<<num<<" of "<<toevict<<endl;
+	return num;
+}
+
+/*! Return how many pages have contents in separate files that are not read in yet.
+ */
+int Document::NumUnloadedPages()
+{
+	int n = 0;
+	for (int c=0; c<pages.n; c++) if (pages.e[c]->page_loaded == 0) n++;
+	return n;
+}
+
 //! Make sure each page has the correct PageStyle and page label.
 /*! Calls Imposition::SyncPageStyles() then figures out the
  * labels.
@@ -1228,7 +1525,7 @@ int Document::ReImpose(Imposition *newimp,int scale_page_contents_to_fit)
 		SyncPages(0,-1, true);
 	}
 
-
+	Touch();
 	laidout->notifyDocTreeChanged(NULL,TreePagesMoved, 0,-1);
 	return 0;
 }
@@ -1530,9 +1827,11 @@ void Document::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context
 	}
 	
 	 // dump objects
+	PageDumpContext *pagecontext = dynamic_cast<PageDumpContext*>(context);
 	for (int c=0; c<pages.n; c++) {
 		fprintf(f,"%spage %d\n",spc,c);
-		pages.e[c]->dump_out(f,indent+2,0,context);
+		if (pagecontext) pagecontext->DumpPage(f, pages.e[c], indent+2);
+		else pages.e[c]->dump_out(f,indent+2,0,context);
 	}
 
 	 // dump views
@@ -1562,6 +1861,71 @@ void Document::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context
 	}
 }
 
+/*! Same as dump_out(), but straight to att, so that pages and objects can use dump_out_atts()
+ * with context. Parts that only dump_out() to a FILE are read back in with dump_text_to_attribute().
+ * what==-1 is not handled here.
+ */
+Laxkit::Attribute *Document::dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context)
+{
+	if (!att) att = new Attribute;
+	if (what == -1) return att;
+
+	att->push("id", Id());
+	if (name) att->push("name", name);
+	if (saveas) att->push("saveas", saveas);
+
+	Attribute *att2;
+
+	 //resources
+	ResourceManager *resources=InterfaceManager::GetDefault(true)->GetResourceManager();
+	att2 = att->pushSubAtt("resources");
+	dump_text_to_attribute(att2, [resources, context](FILE *f) { resources->dump_out(f,0,0,context); });
+
+	 //imposition
+	if (imposition) {
+		att2 = att->pushSubAtt("imposition", imposition->whattype());
+		dump_text_to_attribute(att2, [this, context](FILE *f) { imposition->dump_out(f,0,0,context); });
+	}
+
+	 //page ranges
+	for (int c=0; c<pageranges.n; c++) {
+		att2 = att->pushSubAtt("pagerange");
+		pageranges.e[c]->dump_out_atts(att2, 0, context);
+	}
+
+	 //pages
+	char scratch[30];
+	for (int c=0; c<pages.n; c++) {
+		sprintf(scratch, "%d", c);
+		att2 = att->pushSubAtt("page", scratch);
+		pages.e[c]->dump_out_atts(att2, 0, context);
+	}
+
+	 //views
+	for (int c=0; c<spreadviews.n; c++) {
+		att2 = att->pushSubAtt("view");
+		SpreadView *view = spreadviews.e[c];
+		dump_text_to_attribute(att2, [view, context](FILE *f) { view->dump_out(f,0,0,context); });
+	}
+
+	if (metadata && metadata->attributes.n) {
+		att2 = att->pushSubAtt("metadata");
+		for (int c=0; c<metadata->attributes.n; c++) att2->push(metadata->attributes.e[c]->duplicateAtt(), -1);
+	}
+
+	if (iohints.attributes.n) {
+		att2 = att->pushSubAtt("iohints");
+		for (int c=0; c<iohints.attributes.n; c++) att2->push(iohints.attributes.e[c]->duplicateAtt(), -1);
+	}
+
+	if (properties.n()) {
+		att2 = att->pushSubAtt("properties");
+		properties.dump_out_atts(att2, 0, nullptr);
+	}
+
+	return att;
+}
+
 const char *Document::Id(const char *newid)
 {
 	return anObject::Id(newid);
@@ -1597,6 +1961,7 @@ int Document::Name(const char *nname)
 		name=newstr(Untitled_name());
 	}
 	makestr(name,nname);
+	Touch();
 
 	if (!metadata) metadata = new AttributeObject();
 	Attribute *att = metadata->find("Name");
@@ -1661,6 +2026,34 @@ Page *Document::Curpage()
 	return pages.e[curpage];
 }
 
+//! Update modtime to now, for changes to the document outside of its pages.
+void Document::Touch()
+{
+	tms tms_;
+	modtime = times(&tms_);
+}
+
+/*! For changes to the document or its limbo that did not touch anything, such as moving objects,
+ * applying colors, or undo. See Page::Edited().
+ */
+void Document::Edited()
+{
+	edits++;
+}
+
+/*! Return the most recent of modtime and each page's Page::ContentModTime().
+ * Together with edits and each page's edits, this changes whenever anything in the document does.
+ */
+clock_t Document::ContentModTime()
+{
+	clock_t t = modtime;
+	for (int c=0; c<pages.n; c++) {
+		clock_t pt = pages.e[c]->ContentModTime();
+		if (pt > t) t = pt;
+	}
+	return t;
+}
+
 
 const char *Document::object_e_name(int i)
 {
@@ -78,6 +78,16 @@ class PageRange : public Laxkit::DumpUtility
 	virtual void dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
 };
 
+//------------------------- PageDumpContext ------------------------------------
+
+class PageDumpContext : public Laxkit::DumpContext
+{
+ public:
+	PageDumpContext(const char *nbasedir, char nsubs_only, unsigned long nobject_id)
+		: Laxkit::DumpContext(nbasedir, nsubs_only, nobject_id) {}
+	virtual void DumpPage(FILE *f, Page *page, int indent) = 0;
+};
+
 //------------------------- Document ------------------------------------
 
 class Document : public ObjectContainer, public Value
@@ -98,6 +108,9 @@ class Document : public ObjectContainer, public Value
 	ValueHash properties;
 
 	clock_t modtime;
+	unsigned long edits; //see Edited()
+	unsigned long page_use_counter; //for Page::lastused
+	bool save_binary; //save in the binary format even without a .laidoutb extension
 
 	// ***********TEMP!!!
 	// virtual int inc_count();
@@ -124,6 +137,9 @@ class Document : public ObjectContainer, public Value
 
 	 //page and imposition management
 	virtual Page *Curpage();
+	virtual void Touch();
+	virtual void Edited();
+	virtual clock_t ContentModTime();
 	virtual int NewPages(int starting,int n);
 	virtual int RemovePages(int start,int n);
 	virtual int SyncPages(int start,int n, bool shift_within_margins);
@@ -136,14 +152,25 @@ class Document : public ObjectContainer, public Value
 	
 	 //i/o
 	virtual void dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context);
+	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context);
 	virtual void dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
 	virtual int Load(const char *file,Laxkit::ErrorLog &log);
 	virtual int Save(int includelimbos,int includewindows,Laxkit::ErrorLog &log, bool add_to_recent=true);
+	virtual void DumpFile(FILE *f, int includelimbos, int includewindows, Laxkit::DumpContext *context);
+	virtual void DumpFile(Laxkit::Attribute *att, int includelimbos, int includewindows, Laxkit::DumpContext *context);
 	virtual int SaveACopy(const char *filename, int includelimbos,int includewindows,Laxkit::ErrorLog &log, bool add_to_recent);
 	virtual int SaveAsTemplate(const char *tname, const char *tfile,
 						int includelimbos,int includewindows,Laxkit::ErrorLog &log,
 						bool clobber, char **tfilename_attempt);
 	virtual void ForceFilterUpdates(int frompage, int topage);
+
+	 //pages kept in separate files
+	virtual int SavePages(bool external, Laxkit::DumpContext *context, Laxkit::ErrorLog &log);
+	virtual int LoadPages(Laxkit::NumStack<int> &which, Laxkit::ErrorLog *log);
+	virtual int LoadPage(int pagei, Laxkit::ErrorLog *log = nullptr);
+	virtual int SpreadPages(Spread *spread, Laxkit::NumStack<int> &which);
+	virtual int EvictPages(int max_loaded);
+	virtual int NumUnloadedPages();
 	
 	
 	 //object content
@@ -34,7 +34,10 @@
 #include <lax/interfaces/somedatafactory.h>
 
 #include "drawdata.h"
+#include "workerpool.h"
 #include "../dataobjects/mysterydata.h"
+#include "../dataobjects/spatialindex.h"
+#include "../dataobjects/pdfpageproxy.h"
 #include "../laidout.h"
 #include "../language.h"
 
@@ -54,6 +57,84 @@ using namespace std;
 namespace Laidout {
 
 
+//! Copies of laidout->interfacepool, for drawing from worker threads.
+class WorkerInterfaces
+{
+  public:
+	RefPtrStack<anInterface> interfaces;
+	WorkerInterfaces();
+};
+
+WorkerInterfaces::WorkerInterfaces()
+{
+	for (int c=0; c<laidout->interfacepool.n; c++) {
+		anInterface *interf = laidout->interfacepool.e[c]->duplicateInterface(nullptr);
+		if (!interf) continue;
+		interfaces.push(interf);
+		interf->dec_count();
+	}
+}
+
+static std::mutex worker_interfaces_mutex;
+static PtrStack<WorkerInterfaces> free_worker_interfaces; //made by PrepareWorkerDrawing(), claimed by worker threads
+static int num_worker_interfaces = 0;
+
+/*! Make one copy of laidout->interfacepool for each thread of WorkerPool::Shared().
+ * Copying interfaces changes reference counts of resources they share with the originals,
+ * so this must be called on the main thread, after the interface pool is set up and
+ * before anything is drawn on a worker thread.
+ */
+void PrepareWorkerDrawing()
+{
+	if (WorkerPool::IsWorkerThread()) return;
+
+	int needed = WorkerPool::Shared()->NumThreads();
+	std::lock_guard<std::mutex> lock(worker_interfaces_mutex);
+	while (num_worker_interfaces < needed) {
+		free_worker_interfaces.push(new WorkerInterfaces);
+		num_worker_interfaces++;
+	}
+}
+
+/*! Return an interface that can draw objects of type whattype, or null if none found.
+ *
+ * anInterface::DrawDataDp() temporarily swaps the interface's displayer and data, so
+ * threads must not share interfaces. On WorkerPool threads, this returns one from a
+ * copy of laidout->interfacepool that PrepareWorkerDrawing() made for that thread.
+ */
+static anInterface *DrawingInterface(const char *whattype)
+{
+	RefPtrStack<anInterface> *pool = &laidout->interfacepool;
+	if (WorkerPool::IsWorkerThread()) {
+		static thread_local WorkerInterfaces *worker_interfaces = nullptr;
+		if (!worker_interfaces) {
+			std::lock_guard<std::mutex> lock(worker_interfaces_mutex);
+			if (free_worker_interfaces.n) worker_interfaces = free_worker_interfaces.pop();
+		}
+		if (!worker_interfaces) {
+			DBG cerr << " *** warning: no drawing interfaces for worker thread, call PrepareWorkerDrawing()!"<<endl;
+			return nullptr;
+		}
+		pool = &worker_interfaces->interfaces;
+	}
+
+	for (int c=0; c<pool->n; c++) {
+		if (pool->e[c]->draws(whattype)) return pool->e[c];
+	}
+	return nullptr;
+}
+
+/*! Set box to the area of dp's window, padded by pad screen pixels, in dp's current coordinates.
+ */
+void VisibleBounds(Displayer *dp, DoubleBBox &box, int pad)
+{
+	box.ClearBBox();
+	box.addtobounds(dp->screentoreal(dp->Minx - pad, dp->Miny - pad));
+	box.addtobounds(dp->screentoreal(dp->Maxx + pad, dp->Miny - pad));
+	box.addtobounds(dp->screentoreal(dp->Maxx + pad, dp->Maxy + pad));
+	box.addtobounds(dp->screentoreal(dp->Minx - pad, dp->Maxy + pad));
+}
+
 //! Just like DrawData(), but don't push data matrix.
 void DrawDataStraight(Displayer *dp,SomeData *data,anObject *a1,anObject *a2,unsigned int flags)
 {
@@ -103,7 +184,16 @@ void DrawDataStraight(Displayer *dp,SomeData *data,anObject *a1,anObject *a2,uns
 			}
 		}
 
-		for (int c=0; c<ddata->n(); c++) DrawData(dp,ddata->e(c),a1,a2,flags);
+		if ((flags & DRAW_CULL) && ddata->n() >= SpatialIndex::MinKids) {
+			DoubleBBox visible;
+			VisibleBounds(dp, visible);
+			NumStack<int> which;
+			ddata->KidsInBox(visible, which);
+			for (int c=0; c<which.n; c++) DrawData(dp,ddata->e(which.e[c]),a1,a2,flags);
+
+		} else {
+			for (int c=0; c<ddata->n(); c++) DrawData(dp,ddata->e(c),a1,a2,flags);
+		}
 
 		//if (!strcmp(data->whattype(),"Group")) {
 		//	// Is explicitly a layer or a group, so we are done drawing when there are kids.
@@ -132,17 +222,14 @@ void DrawDataStraight(Displayer *dp,SomeData *data,anObject *a1,anObject *a2,uns
 
 	} else {
 
+		 //pdf page previews are only rendered once something wants to see them
+		PdfPageProxy *proxy = dynamic_cast<PdfPageProxy*>(data);
+		if (proxy && !proxy->GetPreview() && !WorkerPool::IsWorkerThread()) PdfPreviewCache::Shared()->Request(proxy);
+
 		 // find interface in interfacepool
-		int c;
-		anInterface *interf=NULL;
 		//if (dp->GetXw()) ...
 		// else:
-		for (c=0; c<laidout->interfacepool.n; c++) {
-			if (laidout->interfacepool.e[c]->draws(data->whattype())) {
-				interf=laidout->interfacepool.e[c];
-				break;
-			}
-		}
+		anInterface *interf = DrawingInterface(data->whattype());
 
 		if (interf) {
 			 // draw it
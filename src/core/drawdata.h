@@ -27,6 +27,7 @@ enum ViewDrawFlags {
 	DRAW_BOX   = (1<<(LaxInterfaces::InterfaceManager::DRAW_MAX+2)),
 	DRAW_HIRES = (1<<(LaxInterfaces::InterfaceManager::DRAW_MAX+3)),
 	DRAW_NO_FILTER = (1<<(LaxInterfaces::InterfaceManager::DRAW_MAX+4)),
+	DRAW_CULL  = (1<<(LaxInterfaces::InterfaceManager::DRAW_MAX+5)), //skip kids off screen, main thread only
 };
 
 //void DrawData(Laxkit::Displayer *dp,double *m,LaxInterfaces::SomeData *data,
@@ -37,6 +38,8 @@ void DrawData(Laxkit::Displayer *dp,LaxInterfaces::SomeData *data,
 				Laxkit::anObject *a1=NULL,Laxkit::anObject *a2=NULL,unsigned int flags=0);
 LaxInterfaces::SomeData *newObject(const char *thetype);
 int boxisin(Laxkit::flatpoint *points, int n,Laxkit::DoubleBBox *bbox);
+void VisibleBounds(Laxkit::Displayer *dp, Laxkit::DoubleBBox &box, int pad=10);
+void PrepareWorkerDrawing();
 
 
 } // namespace Laidout
@@ -18,14 +18,18 @@
 #include <lax/fileutils.h>
 #include <lax/transformmath.h>
 #include <lax/utf8string.h>
+#include <lax/strmanip.h>
 #include <lax/interfaces/somedatafactory.h>
+#include <lax/laximages.h>
 #include <dirent.h>
 #include <unistd.h>
 
 #include "../version.h"
 #include "importimage.h"
 #include "../dataobjects/epsdata.h"
+#include "../dataobjects/limagedata.h"
 #include "utils.h"
+#include "workerpool.h"
 
 
 #include <iostream>
@@ -611,6 +615,10 @@ int dumpInImages(ImportImageSettings *settings, Document *doc, const char *patht
  * to dumpInImages(Document *doc, ImagePlopInfo *images, int startpage), 
  * where also their transform matrices are adjusted.
  * Any broken images are not inserted into the document as broken images. They are ignored.
+ *
+ * Bitmap images are laid out using only the dimensions in their file headers. The actual
+ * images are read in afterwards with ImageImportQueue::Shared(). If previewsizes is not null,
+ * then missing preview files with previewsizes[i] > 0 are generated at that size before loading.
  * 
  * perpage==-1 means insert until page is full. perpage==-2 means put them all on startpage.
  * 
@@ -631,7 +639,8 @@ int dumpInImages(ImportImageSettings *settings,
 				 Document *doc, 
 				 const char **imagefiles,
 				 const char **previewfiles,
-				 int nfiles)
+				 int nfiles,
+				 const int *previewsizes)
 {
 	int c, numonpage = 0;
 	ImagePlopInfo *images = nullptr;
@@ -702,12 +711,19 @@ int dumpInImages(ImportImageSettings *settings,
 		}
 
 
-		 //first check if it is recognized as image (the easiest check)
-		image = ImageLoader::LoadImage(imagefiles[c], (previewfiles ? previewfiles[c] : NULL),0,0,&pimage, 0,-1,NULL, true, 0);
-
-		if (image) {
+		 //first check if it is recognized as image (the easiest check), reading only the header
+		if (ImageLoader::Ping(imagefiles[c], &width, &height, &filesize, &subimages) == 0 && width > 0 && height > 0) {
 			DBG cerr << "dump image files: "<<imagefiles[c]<<endl;
 
+			 //lay out with an empty image of the right size, the real one is loaded in the background
+			imaged = dynamic_cast<ImageData*>(LaxInterfaces::somedatafactory()->NewObject("ImageData"));
+			imaged->minx = 0;  imaged->maxx = width;
+			imaged->miny = 0;  imaged->maxy = height;
+			ImageImportQueue::Shared()->Request(imaged, imagefiles[c], (previewfiles ? previewfiles[c] : nullptr), 0,
+												(previewsizes ? previewsizes[c] : 0));
+
+		} else if ((image = ImageLoader::LoadImage(imagefiles[c], (previewfiles ? previewfiles[c] : nullptr),0,0,&pimage, 0,-1,nullptr, true, 0))) {
+			 //loadable, but ping failed for some reason
 			imaged = dynamic_cast<ImageData*>(LaxInterfaces::somedatafactory()->NewObject("ImageData"));
 			imaged->SetImage(image,NULL);//incs count of image
 			image->dec_count();
@@ -1104,6 +1120,162 @@ ImagePlopInfo *GatherImages(Document *doc, int startpage, int endpage)
 }
 
 
+//------------------------------------- ImageImportQueue ------------------------------------
+
+/*! \class ImageImportQueue
+ * Reads in images for ImageData objects on WorkerPool::Shared() threads, so that many images
+ * can be placed in a document right away using only their pinged dimensions.
+ *
+ * Request() and Collect() must only be called from the main thread. Collect() installs finished
+ * images with ImageData::SetImage(), and touches the objects. Until then, the objects have no
+ * image, and are drawn as empty boxes. LImageData targets save the file they are waiting for,
+ * so saving does not need to wait. LaidoutApp collects on a timer while there are pending jobs.
+ * Call Finish() before anything that needs the images, like exporting.
+ *
+ * When not running the gui, Request() loads right away.
+ */
+
+class ImageImportQueue::ImportJob
+{
+  public:
+	ImageData *target;
+	char *file;
+	char *preview;
+	int subimage;
+	int previewsize;
+	LaxImage *image;
+	LaxImage *pimage;
+
+	ImportJob(ImageData *ntarget, const char *nfile, const char *npreview, int nsubimage, int npreviewsize)
+	{
+		target = ntarget;
+		target->inc_count();
+		file = newstr(nfile);
+		preview = newstr(npreview);
+		subimage = nsubimage;
+		previewsize = npreviewsize;
+		image = pimage = nullptr;
+	}
+
+	~ImportJob()
+	{
+		if (image) image->dec_count();
+		if (pimage) pimage->dec_count();
+		target->dec_count();
+		delete[] file;
+		delete[] preview;
+	}
+};
+
+
+static ImageImportQueue *shared_importqueue = nullptr;
+
+ImageImportQueue *ImageImportQueue::Shared()
+{
+	if (!shared_importqueue) shared_importqueue = new ImageImportQueue;
+	return shared_importqueue;
+}
+
+ImageImportQueue::ImageImportQueue()
+{
+}
+
+/*! Waits for any jobs in progress.
+ */
+ImageImportQueue::~ImageImportQueue()
+{
+	Finish();
+}
+
+/*! Read in file (and preview, if any) for image. Returns 1 if queued, or 0 if loaded immediately.
+ */
+int ImageImportQueue::Request(LaxInterfaces::ImageData *image, const char *file, const char *preview, int subimage, int previewsize)
+{
+	ImportJob *job = new ImportJob(image, file, preview, subimage, previewsize);
+	pending.push(job);
+
+	LImageData *limage = dynamic_cast<LImageData*>(image);
+	if (limage) {
+		makestr(limage->pending_file, file);
+		makestr(limage->pending_preview, preview);
+	}
+
+	if (!laidout || laidout->runmode != RUNMODE_Normal) {
+		RunJob(job);
+		Collect();
+		return 0;
+	}
+
+	WorkerPool::Shared()->Add([this, job]() { RunJob(job); });
+	laidout->BackgroundImportsStarted();
+	return 1;
+}
+
+/*! Called on a worker thread. Generate the preview file if necessary, then read in the image.
+ */
+void ImageImportQueue::RunJob(ImportJob *job)
+{
+	if (job->preview && job->previewsize > 0 && file_exists(job->preview, 1, nullptr) != S_IFREG) {
+		DBG cerr <<"-=-=-=--=-==-==-=-==-- Generate preview at: "<<job->preview<<endl;
+		if (GeneratePreviewFile(job->file, job->preview, "jpg", job->previewsize, job->previewsize, 1)) {
+			DBG cerr <<"              ***generate preview failed....."<<endl;
+		}
+	}
+
+	job->image = ImageLoader::LoadImage(job->file, job->preview, 0,0, &job->pimage, 0,-1,nullptr, true, job->subimage);
+
+	 //notify while locked, since Finish() may return, and the queue go away, as soon as it sees the job
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.push_back(job);
+	job_finished.notify_all();
+}
+
+/*! Install finished images. Returns the number of images installed.
+ */
+int ImageImportQueue::Collect()
+{
+	std::deque<ImportJob*> done;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done.swap(finished);
+	}
+
+	int n = 0;
+	for (ImportJob *job : done) {
+		LImageData *limage = dynamic_cast<LImageData*>(job->target);
+		if (limage && strEquals(limage->pending_file, job->file)) {
+			makestr(limage->pending_file, nullptr);
+			makestr(limage->pending_preview, nullptr);
+		}
+
+		if (job->image) {
+			job->target->SetImage(job->image, job->pimage); //incs counts
+			job->target->index = job->image->index;
+			job->target->touchContents();
+			n++;
+		} else {
+			DBG cerr << "Could not load image "<<job->file<<endl;
+		}
+		pending.remove(pending.findindex(job)); //deletes job
+	}
+
+	return n;
+}
+
+/*! Wait for all pending images, and install them. Only this queue's own jobs are waited on,
+ * not everything else in WorkerPool::Shared(). Must be called from the main thread.
+ */
+void ImageImportQueue::Finish()
+{
+	if (!pending.n) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_finished.wait(lock, [this] { return (int)finished.size() >= pending.n; });
+	}
+	Collect();
+}
+
+
 //------------------------------ Images for page numbers------------------------------------
 
 ////! Apply images of page numbers to the pages of the document.
@@ -18,6 +18,10 @@
 #include "../laidout.h"
 #include <lax/interfaces/imageinterface.h>
 
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 
 namespace Laidout {
 
@@ -78,13 +82,41 @@ int dumpInImageList(ImportImageSettings *settings, Document *doc,const char *fil
 int dumpInImageList(ImportImageSettings *settings, Document *doc,Laxkit::Attribute *att);
 int dumpInImages(ImportImageSettings *settings, Document *doc, const char *pathtoimagedir);
 int dumpInImages(ImportImageSettings *settings, Document *doc,
-				 const char **imagefiles, const char **previewfiles, int nimages);
+				 const char **imagefiles, const char **previewfiles, int nimages,
+				 const int *previewsizes = nullptr);
 
 int dumpInImages(ImportImageSettings *settings, Document *doc, ImagePlopInfo *images, int startpage);
 
 int dumpOutImageList(FILE *f, ImportImageSettings *settings, ImagePlopInfo *images);
 ImagePlopInfo *GatherImages(Document *doc, int startpage, int endpage);
 
+
+//------------------------------------- ImageImportQueue ------------------------------------
+
+class ImageImportQueue
+{
+  protected:
+	class ImportJob;
+
+	Laxkit::PtrStack<ImportJob> pending; //only touched on the main thread
+	std::deque<ImportJob*> finished;     //guarded by mutex
+	std::mutex mutex;
+	std::condition_variable job_finished;
+
+	virtual void RunJob(ImportJob *job);
+
+  public:
+	static ImageImportQueue *Shared();
+
+	ImageImportQueue();
+	virtual ~ImageImportQueue();
+
+	virtual int Request(LaxInterfaces::ImageData *image, const char *file, const char *preview, int subimage, int previewsize);
+	virtual int Collect();
+	virtual void Finish();
+	virtual int NumPending() { return pending.n; }
+};
+
 } // namespace Laidout
 
 #endif
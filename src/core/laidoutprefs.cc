@@ -24,6 +24,7 @@
 #include "stylemanager.h"
 #include "utils.h"
 #include "../ui/externaltoolwindow.h"
+#include "../nodes/nodeinterface.h"
 
 #include <sys/file.h>
 #include <clocale>
@@ -112,6 +113,11 @@ LaidoutPreferences::LaidoutPreferences()
 	//autosave_num=0; //0 is no limit
 
 	experimental = false;
+	max_threads  = 0;
+	threaded_node_updates = false;
+	background_render = false;
+	external_pages_threshold = 0;
+	max_loaded_pages = 0;
 
 	exportfilename = newstr("%f-exported.whatever");
 
@@ -160,6 +166,11 @@ Value *LaidoutPreferences::duplicateValue()
 	makestr(p->exportfilename, exportfilename);
 	p->start_with_last = start_with_last;
 	p->experimental = experimental;
+	p->max_threads = max_threads;
+	p->threaded_node_updates = threaded_node_updates;
+	p->background_render = background_render;
+	p->external_pages_threshold = external_pages_threshold;
+	p->max_loaded_pages = max_loaded_pages;
 	p->uiscale = uiscale;
 	p->dont_scale_icons = dont_scale_icons;
 
@@ -365,6 +376,41 @@ ObjectDef *LaidoutPreferences::makeObjectDef()
 			0,
 			nullptr);
 
+	def->push("max_threads",
+			_("Max threads"),
+			_("Number of worker threads for background work. 0 means one per processor core. Requires restart."),
+			"int", "[0,256]","0",
+			0,
+			nullptr);
+
+	def->push("threaded_node_updates",
+			_("Threaded node updates"),
+			_("Update independent thread safe nodes in parallel."),
+			"boolean", nullptr,"false",
+			0,
+			nullptr);
+
+	def->push("background_render",
+			_("Background rendering"),
+			_("Render page contents in edit windows on worker threads, showing a rough version until done."),
+			"boolean", nullptr,"false",
+			0,
+			nullptr);
+
+	def->push("external_pages_threshold",
+			_("External pages threshold"),
+			_("Documents with at least this many pages are saved with page contents in separate files, which are loaded only as needed. 0 means never."),
+			"int", "[0,1000000]","0",
+			0,
+			nullptr);
+
+	def->push("max_loaded_pages",
+			_("Max loaded pages"),
+			_("When page contents are in separate files, unload unchanged pages not recently used beyond this many. 0 means no limit."),
+			"int", "[0,1000000]","0",
+			0,
+			nullptr);
+
 	def->pushFunction("edit_external_tools",
 			_("Edit external tools..."),
 			_("Bring up window to configure external tools"),
@@ -514,6 +560,52 @@ int LaidoutPreferences::assign(FieldExtPlace *ext,Value *v)
 		return 1;
 	}
 
+	if (!strcmp(extstring, "max_threads")) {
+		double d;
+		if (!isNumberType(v, &d)) return 0;
+		if (d < 0) return 0;
+		max_threads = d;
+		if (autosave_prefs) UpdatePreference(extstring, max_threads, nullptr);
+		return 1;
+	}
+
+	if (!strcmp(extstring, "threaded_node_updates")) {
+		int e = 0;
+		bool b = getBooleanValue(v, &e);
+		if (e == 0) return 0;
+		threaded_node_updates = b;
+		NodeGroup::threaded_updates = b;
+		if (autosave_prefs) UpdatePreference(extstring, threaded_node_updates, nullptr);
+		return 1;
+	}
+
+	if (!strcmp(extstring, "background_render")) {
+		int e = 0;
+		bool b = getBooleanValue(v, &e);
+		if (e == 0) return 0;
+		background_render = b;
+		if (autosave_prefs) UpdatePreference(extstring, background_render, nullptr);
+		return 1;
+	}
+
+	if (!strcmp(extstring, "external_pages_threshold")) {
+		double d;
+		if (!isNumberType(v, &d)) return 0;
+		if (d < 0) return 0;
+		external_pages_threshold = d;
+		if (autosave_prefs) UpdatePreference(extstring, external_pages_threshold, nullptr);
+		return 1;
+	}
+
+	if (!strcmp(extstring, "max_loaded_pages")) {
+		double d;
+		if (!isNumberType(v, &d)) return 0;
+		if (d < 0) return 0;
+		max_loaded_pages = d;
+		if (autosave_prefs) UpdatePreference(extstring, max_loaded_pages, nullptr);
+		return 1;
+	}
+
 	if (!strcmp(extstring, "start_with_last")) {
 		double d;
 		if (!isNumberType(v, &d)) return 0;
@@ -689,6 +781,26 @@ Value *LaidoutPreferences::dereference(const char *extstring, int len)
 		return new BooleanValue(experimental);
 	}
 
+	if (!strcmp(extstring, "max_threads")) {
+		return new IntValue(max_threads);
+	}
+
+	if (!strcmp(extstring, "threaded_node_updates")) {
+		return new BooleanValue(threaded_node_updates);
+	}
+
+	if (!strcmp(extstring, "background_render")) {
+		return new BooleanValue(background_render);
+	}
+
+	if (!strcmp(extstring, "external_pages_threshold")) {
+		return new IntValue(external_pages_threshold);
+	}
+
+	if (!strcmp(extstring, "max_loaded_pages")) {
+		return new IntValue(max_loaded_pages);
+	}
+
 	if (!strcmp(extstring, "start_with_last")) {
 		return new BooleanValue(start_with_last);
 	}
@@ -765,10 +877,10 @@ int LaidoutPreferences::SavePrefs(const char *file)
 
 	FILE *f=fopen(file,"w");
 	if (f) {
-		setlocale(LC_ALL,"C");
+		UseCLocale(true);
 		dump_out(f,0,0,nullptr);
 		fclose(f);
-		setlocale(LC_ALL,"");
+		UseCLocale(false);
 		return 0;
 	}
 
@@ -920,7 +1032,7 @@ int LaidoutPreferences::UpdatePreference(const char *which, const char *value, c
 		return 3;
 	}
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	//read each line, if "^which ..." is found, replace with "which value"
 	//If not found, but there is a "^#which ...", then replace that line
@@ -968,7 +1080,7 @@ int LaidoutPreferences::UpdatePreference(const char *which, const char *value, c
 	fclose(out);
 	flock(fd,LOCK_UN);
 	fclose(f); //also closes the fd	
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	 //finally move temp file to real file
 	unlink(laidoutrc);
@@ -1042,7 +1154,7 @@ int LaidoutPreferences::UpdatePreference(const char *which, PtrStack<char> &stac
 		return 3;
 	}
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	//read each line, if "^which ..." is found, replace with "which value"
 
@@ -1084,7 +1196,7 @@ int LaidoutPreferences::UpdatePreference(const char *which, PtrStack<char> &stac
 	fclose(out);
 	flock(fd,LOCK_UN);
 	fclose(f); //also closes the fd	
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	 //finally move temp file to real file
 	unlink(laidoutrc);
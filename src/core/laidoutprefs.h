@@ -57,6 +57,11 @@ class LaidoutPreferences : public Value
 	Laxkit::PtrStack<char> icon_dirs;
 	Laxkit::PtrStack<char> plugin_dirs;
 	bool experimental;
+	int max_threads; // worker threads for background work, 0 means number of cores
+	bool threaded_node_updates;
+	bool background_render; // render viewport page contents on worker threads
+	int external_pages_threshold; // save documents with at least this many pages with page contents in separate files, 0 for never
+	int max_loaded_pages; // most pages kept in separate files to hold in memory at once, 0 for no limit
 
 	bool autosave_prefs; //immediately on any change
 
@@ -0,0 +1,253 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/interfaces/engraverfillinterface.h>
+
+#include "objectindex.h"
+#include "../dataobjects/drawableobject.h"
+
+#include <cstring>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- ObjectIndex ---------------------------------------
+
+/*! \class ObjectIndex
+ * Hash of object id to object over everything reachable from some ObjectContainer,
+ * to replace walking the whole tree for each id lookup.
+ *
+ * Rebuild() is a single walk, which also collects clones that are not yet linked
+ * to anything, including those used as engraver trace objects, so they can all be
+ * resolved with Find() without walking again.
+ *
+ * After that, the index is kept up to date in place. Owners Add() new objects, Remove()
+ * objects they take out, and Rename() objects whose id changed. Removals nobody reported
+ * are caught by Prune(), which drops objects nothing but the index holds, so removed
+ * objects are not kept alive. Additions nobody reported are covered by MarkIncomplete(),
+ * after which a Find() that misses means the caller should Rebuild() and look again.
+ * See Project::FindObject(). None of this is thread safe, and is only done on the main thread.
+ *
+ * Objects are held counted, so a stale entry never points to freed memory.
+ * When there are duplicate ids, the first one indexed wins.
+ */
+
+
+ObjectIndex::ObjectIndex()
+{
+	built = false;
+	incomplete = false;
+}
+
+ObjectIndex::~ObjectIndex()
+{
+	Clear();
+}
+
+/*! Release all objects. IsBuilt() is false until the next Rebuild().
+ */
+void ObjectIndex::Clear()
+{
+	for (auto &entry : ids) entry.second->dec_count();
+	ids.clear();
+	unresolved.flush();
+	built = false;
+	incomplete = false;
+}
+
+/*! True if data is only alive because of this index, which means it was removed from
+ * wherever it was without telling us.
+ */
+bool ObjectIndex::OnlyHeldHere(SomeData *data)
+{
+	int held = 0;
+	const char *id = data->Id();
+	if (id && *id) {
+		auto found = ids.find(std::string(id));
+		if (found != ids.end() && found->second == data) held++;
+	}
+	SomeDataRef *ref = dynamic_cast<SomeDataRef*>(data);
+	if (ref && unresolved.findindex(ref) >= 0) held++;
+	return data->the_count() <= held;
+}
+
+/*! Index just obj, not its kids.
+ */
+void ObjectIndex::AddOne(anObject *obj)
+{
+	SomeData *data = dynamic_cast<SomeData*>(obj);
+	if (!data) return;
+
+	const char *id = data->Id();
+	if (id && *id) {
+		auto result = ids.insert(std::make_pair(std::string(id), data));
+		if (result.second) data->inc_count();
+	}
+
+	SomeDataRef *ref = dynamic_cast<SomeDataRef*>(data);
+	if (ref && !ref->thedata && unresolved.findindex(ref) < 0) unresolved.push(ref);
+
+	if (!strcmp(data->whattype(), "EngraverFillData")) {
+		EngraverFillData *edata = dynamic_cast<EngraverFillData*>(data);
+		for (int c=0; edata && c<edata->groups.n; c++) {
+			if (edata->groups.e[c]->trace
+					&& edata->groups.e[c]->trace->traceobject
+					&& edata->groups.e[c]->trace->traceobject->type == TraceObject::TRACE_Object) {
+				ref = dynamic_cast<SomeDataRef*>(edata->groups.e[c]->trace->traceobject->object);
+				if (ref && !ref->thedata && unresolved.findindex(ref) < 0) unresolved.push(ref);
+			}
+		}
+	}
+}
+
+/*! Index data and all its descendents, for when data has been put somewhere in the indexed tree.
+ */
+void ObjectIndex::Add(SomeData *data)
+{
+	if (!data) return;
+	AddOne(data);
+
+	DrawableObject *group = dynamic_cast<DrawableObject*>(data);
+	for (int c=0; group && c<group->n(); c++) Add(group->e(c));
+}
+
+/*! Drop data and all its descendents, for when data has been taken out of the indexed tree.
+ */
+void ObjectIndex::Remove(SomeData *data)
+{
+	if (!data) return;
+
+	DrawableObject *group = dynamic_cast<DrawableObject*>(data);
+	for (int c=0; group && c<group->n(); c++) Remove(group->e(c));
+
+	SomeDataRef *ref = dynamic_cast<SomeDataRef*>(data);
+	if (ref) {
+		int i = unresolved.findindex(ref);
+		if (i >= 0) unresolved.remove(i);
+	}
+
+	const char *id = data->Id();
+	if (!id || !*id) return;
+	auto found = ids.find(std::string(id));
+	if (found == ids.end() || found->second != data) return;
+	ids.erase(found);
+	data->dec_count();
+}
+
+/*! data's id has changed from oldid. If data was indexed as oldid, it is indexed under its new id.
+ */
+void ObjectIndex::Rename(SomeData *data, const char *oldid)
+{
+	if (!data || !oldid || !*oldid) return;
+
+	auto found = ids.find(std::string(oldid));
+	if (found == ids.end() || found->second != data) return;
+	ids.erase(found);
+
+	const char *id = data->Id();
+	if (id && *id) {
+		auto result = ids.insert(std::make_pair(std::string(id), data));
+		if (result.second) return; //keep the reference we already had
+	}
+	data->dec_count();
+}
+
+/*! Drop objects that nothing but the index holds, because they were removed from the tree
+ * without a Remove(). This does not walk any object trees. Returns the number dropped.
+ */
+int ObjectIndex::Prune()
+{
+	int n = 0;
+	for (int c=unresolved.n-1; c>=0; c--) {
+		if (OnlyHeldHere(unresolved.e[c])) {
+			unresolved.remove(c);
+			n++;
+		}
+	}
+	for (auto it = ids.begin(); it != ids.end(); ) {
+		if (OnlyHeldHere(it->second)) {
+			it->second->dec_count();
+			it = ids.erase(it);
+			n++;
+		} else ++it;
+	}
+	DBG if (n) cerr << "ObjectIndex pruned "<<n<<" removed objects"<<endl;
+	return n;
+}
+
+/*! Forget refs in the unresolved list that have since been linked.
+ */
+void ObjectIndex::DropResolved()
+{
+	for (int c=unresolved.n-1; c>=0; c--) {
+		if (unresolved.e[c]->thedata) unresolved.remove(c);
+	}
+}
+
+/*! Index everything top->nextObject() steps through. Returns the number of ids indexed.
+ */
+int ObjectIndex::Rebuild(ObjectContainer *top)
+{
+	Clear();
+
+	FieldPlace first; first.push(0);
+	FieldPlace place(first);
+	anObject *obj = nullptr;
+
+	while (1) {
+		if (obj) AddOne(obj);
+
+		obj = nullptr;
+		int c = top->nextObject(place,0,Next_Increment, &obj);
+		if (c == Next_Error) break;
+		if (first == place) break;
+	}
+
+	built = true;
+	DBG cerr << "ObjectIndex rebuilt: "<<ids.size()<<" ids, "<<unresolved.n<<" unresolved refs"<<endl;
+	return ids.size();
+}
+
+/*! Return the object with id, or null. Returns null also if that object has since been
+ * renamed without a Rename(), or removed without a Remove(), in which case it is dropped.
+ */
+SomeData *ObjectIndex::Find(const char *id)
+{
+	if (!id) return nullptr;
+
+	auto found = ids.find(std::string(id));
+	if (found == ids.end()) return nullptr;
+
+	SomeData *data = found->second;
+	if (OnlyHeldHere(data)) {
+		ids.erase(found);
+		data->dec_count();
+		return nullptr;
+	}
+	if (!data->Id() || strcmp(data->Id(), id)) return nullptr;
+	return data;
+}
+
+
+} //namespace Laidout
+
@@ -0,0 +1,67 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef OBJECTINDEX_H
+#define OBJECTINDEX_H
+
+#include <lax/refptrstack.h>
+#include <lax/interfaces/somedataref.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "../dataobjects/objectcontainer.h"
+
+
+namespace Laidout {
+
+
+//------------------------------------- ObjectIndex ---------------------------------------
+
+class ObjectIndex
+{
+  protected:
+	std::unordered_map<std::string, LaxInterfaces::SomeData*> ids; //values are counted
+	Laxkit::RefPtrStack<LaxInterfaces::SomeDataRef> unresolved;
+	bool built;
+	bool incomplete;
+
+	virtual void AddOne(Laxkit::anObject *obj);
+	virtual bool OnlyHeldHere(LaxInterfaces::SomeData *data);
+
+  public:
+	ObjectIndex();
+	virtual ~ObjectIndex();
+
+	virtual bool IsBuilt() { return built; }
+	virtual bool IsIncomplete() { return incomplete; }
+	virtual void MarkIncomplete() { incomplete = true; }
+	virtual void Clear();
+	virtual int Rebuild(ObjectContainer *top);
+	virtual LaxInterfaces::SomeData *Find(const char *id);
+
+	virtual void Add(LaxInterfaces::SomeData *data);
+	virtual void Remove(LaxInterfaces::SomeData *data);
+	virtual void Rename(LaxInterfaces::SomeData *data, const char *oldid);
+	virtual int Prune();
+	virtual void DropResolved();
+
+	virtual int NumUnresolved() { return unresolved.n; }
+	virtual LaxInterfaces::SomeDataRef *Unresolved(int i) { return i >= 0 && i < unresolved.n ? unresolved.e[i] : nullptr; }
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -17,12 +17,22 @@
 
 #include <lax/transformmath.h>
 #include <lax/laxutils.h>
+#include <lax/fileutils.h>
+#include <lax/laximages.h>
 #include <lax/interfaces/somedatafactory.h>
 
 #include "page.h"
 #include "drawdata.h"
 #include "stylemanager.h"
+#include "workerpool.h"
+#include "binaryattribute.h"
+#include "../dataobjects/pdfpageproxy.h"
+#include "utils.h"
 #include "../language.h"
+#include "../version.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 #include <iostream>
@@ -615,6 +625,7 @@ Page::Page(PageStyle *npagestyle,int num)
 	thumbmodtime = 0;
 	tms tms_;
 	modtime      = times(&tms_);
+	edits        = 0;
 	pagestyle    = npagestyle;
 	if (pagestyle) pagestyle->inc_count();
 	labeltype = MARKER_Circle;
@@ -623,6 +634,11 @@ Page::Page(PageStyle *npagestyle,int num)
 	pagenumber = num;
 	// properties = nullptr;
 
+	external_page_file = nullptr;
+	page_loaded  = -1;
+	savedmodtime = 0;
+	lastused     = 0;
+
 	// initialize page contents to 1 empty layer.
 	Group *g = new Group;
 	g->Id("pagelayer");
@@ -643,6 +659,7 @@ Page::~Page()
 {
 	DBG cerr <<"  Page destructor"<<endl;
 	if (label) delete[] label;
+	delete[] external_page_file;
 	if (thumbnail) thumbnail->dec_count();
 	if (pagestyle) pagestyle->dec_count();
 	layers.flush();
@@ -729,6 +746,31 @@ int Page::InstallPageStyle(PageStyle *pstyle, bool shift_within_margins)
 	return 0;
 }
 
+/*! Return a new char[] with the file name for the saved thumbnail of contentfile.
+ */
+static char *page_thumbnail_file(const char *contentfile)
+{
+	char *file = newstr(contentfile);
+	appendstr(file, ".png");
+	return file;
+}
+
+/*! True if any of g's descendents, or g itself if check_self, are held by something
+ * other than their parent.
+ */
+static bool has_outside_refs(DrawableObject *g, bool check_self)
+{
+	if (check_self && g->the_count() > 1) return true;
+
+	for (int c=0; c<g->n(); c++) {
+		SomeData *obj = g->e(c);
+		if (obj->the_count() > 1) return true;
+		DrawableObject *dobj = dynamic_cast<DrawableObject*>(obj);
+		if (dobj && dobj->n() && has_outside_refs(dobj, false)) return true;
+	}
+	return false;
+}
+
 //! Dump in page.
 /*! Layers should have been flushed before coming here, and
  * pagestyle should have been set to the default page style for this page.
@@ -779,6 +821,24 @@ void Page::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *con
 			layers.push(g);
 			g->dec_count();
 
+		} else if (!strcmp(name,"contentfile")) {
+			 //layers are in another file, to be read in only when needed
+			if (isblank(value)) continue;
+			delete[] external_page_file;
+			if (value[0] != '/' && context && context->basedir) external_page_file = full_path_for_file(value, context->basedir);
+			else external_page_file = newstr(value);
+			page_loaded = 0;
+
+			char *thumbfile = page_thumbnail_file(external_page_file);
+			if (file_exists(thumbfile, 1, nullptr) == S_IFREG) {
+				LaxImage *img = ImageLoader::LoadImage(thumbfile);
+				if (img) {
+					SetThumbnail(img);
+					img->dec_count();
+				}
+			}
+			delete[] thumbfile;
+
 		} else if (!strcmp(name,"labeltype")) {
 			if (!isblank(value)) {
 				if (!strcasecmp(value,"circle"))        labeltype=MARKER_Circle;
@@ -804,6 +864,9 @@ void Page::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *con
 
 //! Write out pagestyle and layers. Ignore pagenumber.
 /*!
+ * Pages with contents in a separate file write out a reference to it relative to the document,
+ * unless what==PAGE_DUMP_Standalone, in which case loaded contents are written out here,
+ * and unloaded contents are referred to by absolute path.
  * 
  * If what==-1, then output pseudocode mockup of file format.
  */
@@ -819,6 +882,10 @@ void Page::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context)
 		fprintf(f,"%s#Each drawable object has a number of common options, then has object\n",spc);
 		fprintf(f,"%s#specific values under \"config\".\n",spc);
 
+		fprintf(f,"\n%s#Instead of layers, a page may have a contentfile, which is read in only when\n",spc);
+		fprintf(f,"%s#the page is used. It is relative to the document's directory.\n",spc);
+		fprintf(f,"%s#contentfile doc.laidout.pages/page0.laidoutpage\n",spc);
+
 		fprintf(f,"\n%slayer\n",spc);
 		Group g;
 		g.dump_out(f,indent+2,-1,context);
@@ -864,9 +931,20 @@ void Page::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context)
 		pagestyle->dump_out(f,indent+2,0,context);
 	}
 
-	for (int c=0; c<layers.n(); c++) {
-		fprintf(f,"%slayer %d\n",spc,c);
-		layers.e(c)->dump_out(f,indent+2,0,context);
+	if (external_page_file && what == PAGE_DUMP_Standalone && page_loaded == 0) {
+		fprintf(f,"%scontentfile %s\n",spc, external_page_file);
+
+	} else if (external_page_file && what != PAGE_DUMP_Standalone) {
+		 //content files are always in a directory next to the document
+		char *dir = lax_dirname(external_page_file, 0);
+		fprintf(f,"%scontentfile %s/%s\n",spc, lax_basename(dir), lax_basename(external_page_file));
+		delete[] dir;
+
+	} else {
+		for (int c=0; c<layers.n(); c++) {
+			fprintf(f,"%slayer %d\n",spc,c);
+			layers.e(c)->dump_out(f,indent+2,0,context);
+		}
 	}
 
 	 // dump out properties if any
@@ -876,6 +954,160 @@ void Page::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context)
 	}
 }
 
+/*! Same as dump_out(), but straight to att, so layer objects can use
+ * dump_out_atts() with context. what==-1 is not handled here.
+ */
+Laxkit::Attribute *Page::dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context)
+{
+	if (!att) att = new Attribute;
+	if (what == -1) return att;
+
+	if (labeltype==MARKER_Circle)            att->push("labeltype", "circle");
+	else if (labeltype==MARKER_Square)       att->push("labeltype", "square");
+	else if (labeltype==MARKER_Diamond)      att->push("labeltype", "diamond");
+	else if (labeltype==MARKER_TriangleUp)   att->push("labeltype", "triangle");
+	else if (labeltype==MARKER_Octagon)      att->push("labeltype", "octagon");
+	else att->push("labeltype", labeltype);
+
+	char scratch[100];
+	sprintf(scratch, "rgbf(%.10g,%.10g,%.10g)",
+				labelcolor.red/65535., labelcolor.green/65535., labelcolor.blue/65535.);
+	att->push("labelcolor", scratch);
+
+	if (pagestyle && (pagestyle->flags&PAGESTYLE_AUTONOMOUS)) {
+		Attribute *att2 = att->pushSubAtt("pagestyle", pagestyle->whattype());
+		dump_text_to_attribute(att2, [this, context](FILE *f) { pagestyle->dump_out(f, 0, 0, context); });
+	}
+
+	if (external_page_file && what == PAGE_DUMP_Standalone && page_loaded == 0) {
+		att->push("contentfile", external_page_file);
+
+	} else if (external_page_file && what != PAGE_DUMP_Standalone) {
+		 //content files are always in a directory next to the document
+		char *dir = lax_dirname(external_page_file, 0);
+		char *file = newstr(lax_basename(dir));
+		appendstr(file, "/");
+		appendstr(file, lax_basename(external_page_file));
+		att->push("contentfile", file);
+		delete[] file;
+		delete[] dir;
+
+	} else {
+		for (int c=0; c<layers.n(); c++) {
+			sprintf(scratch, "%d", c);
+			Attribute *att2 = att->pushSubAtt("layer", scratch);
+			layers.e(c)->dump_out_atts(att2, 0, context);
+		}
+	}
+
+	if (properties.n()) {
+		Attribute *att2 = att->pushSubAtt("properties");
+		properties.dump_out_atts(att2, 0, nullptr);
+	}
+
+	return att;
+}
+
+/*! If page_loaded==0, read in layers from external_page_file, replacing any current layers.
+ * context should have the document's directory and id. Clones are not resolved here.
+ * Use Document::LoadPages() instead, which does that.
+ *
+ * Returns 0 for success or already loaded, or nonzero for error.
+ */
+int Page::LoadContent(Laxkit::DumpContext *context, Laxkit::ErrorLog *log)
+{
+	if (page_loaded != 0) return 0;
+	if (!external_page_file) return 1;
+
+	FILE *f = open_laidout_file_to_read(external_page_file, "Page", log);
+	if (!f) return 2;
+
+	DBG cerr << "Page::LoadContent from "<<external_page_file<<endl;
+
+	Attribute att;
+	UseCLocale(true);
+	att.dump_in(f, 0, nullptr);
+	UseCLocale(false);
+	fclose(f);
+
+	layers.flush();
+	dump_in_atts(&att, 0, context);
+	if (!layers.n()) PushLayer(nullptr);
+
+	page_loaded = 1;
+	savedmodtime = ContentModTime();
+	if (thumbnail) thumbmodtime = savedmodtime + 1; //was saved along with these contents
+	return 0;
+}
+
+/*! Write layers to file as a standalone page file, and remember it as external_page_file.
+ * If the thumbnail is current, it is saved beside it, otherwise any old saved thumbnail is removed.
+ *
+ * Returns 0 for success, or nonzero for error.
+ */
+int Page::SaveContent(const char *file, Laxkit::DumpContext *context, Laxkit::ErrorLog &log)
+{
+	if (isblank(file) || page_loaded == 0) return 1;
+
+	FILE *f = fopen(file, "w");
+	if (!f) {
+		log.AddMessage(_("File cannot be opened for writing"),ERROR_Fail);
+		return 2;
+	}
+
+	fprintf(f,"#Laidout %s Page\n",LAIDOUT_VERSION);
+	for (int c=0; c<layers.n(); c++) {
+		fprintf(f,"layer %d\n",c);
+		layers.e(c)->dump_out(f,2,0,context);
+	}
+	fclose(f);
+
+	if (file != external_page_file) makestr(external_page_file, file);
+	page_loaded = 1;
+	savedmodtime = ContentModTime();
+
+	char *thumbfile = page_thumbnail_file(file);
+	if (!ThumbnailIsCurrent() || !thumbnail->image || thumbnail->image->Save(thumbfile, "png") != 0) unlink(thumbfile);
+	delete[] thumbfile;
+
+	return 0;
+}
+
+/*! True if page contents are the same as in external_page_file.
+ */
+bool Page::ContentIsClean()
+{
+	if (!external_page_file) return false;
+	if (page_loaded == 0) return true;
+	return ContentModTime() == savedmodtime;
+}
+
+/*! Free the layers of a page whose contents can be read back in from external_page_file.
+ * This is not done if the contents have changed since loading or saving, or if anything
+ * outside the page holds a reference to any of the page's objects, such as a clone, a tool,
+ * or an object with a filter, as those would then refer to objects no longer on the page.
+ *
+ * Returns 0 for unloaded, or nonzero for not.
+ */
+int Page::UnloadContent()
+{
+	if (page_loaded != 1 || !ContentIsClean()) return 1;
+
+	for (int c=0; c<layers.n(); c++) {
+		DrawableObject *layer = dynamic_cast<DrawableObject*>(layers.e(c));
+		if (!layer || has_outside_refs(layer, true)) return 2;
+	}
+
+	DBG cerr << "Page::UnloadContent "<<external_page_file<<endl;
+
+	bool thumb_current = ThumbnailIsCurrent();
+	layers.flush();
+	page_loaded = 0;
+	savedmodtime = ContentModTime();
+	if (thumb_current) thumbmodtime = savedmodtime + 1;
+	return 0;
+}
+
 //! Update modtime to at_time. If at_time==0, then use current time.
 void Page::Touch(clock_t at_time)
 {
@@ -884,87 +1116,98 @@ void Page::Touch(clock_t at_time)
 	else modtime=times(&tms_);
 }
 
-/*! Update thumbnail if necessary.
+/*! For changes to the page's contents that did not touch anything, such as moving objects,
+ * applying colors, or undo. This does not make the page look modified for ContentIsClean()
+ * or thumbnails, it only tells things like Autosaver to look again.
  */
-ImageData *Page::Thumbnail()
+void Page::Edited()
 {
-	if (!pagestyle) return NULL;
-	if (thumbmodtime > modtime && thumbmodtime > layers.modtime) return thumbnail;
+	edits++;
+}
+
+/*! Return the most recent of modtime and layers.modtime.
+ */
+clock_t Page::ContentModTime()
+{
+	return modtime > layers.modtime ? modtime : layers.modtime;
+}
+
+/*! True if thumbnail exists, and is newer than any change to the page.
+ */
+bool Page::ThumbnailIsCurrent()
+{
+	return thumbnail && thumbmodtime > ContentModTime();
+}
+
+/*! Find the page bounds a thumbnail covers, and the pixel size of the thumbnail.
+ * Thumbnails are always 200 pixels wide.
+ * Return 0 for success, or 1 if there is no pagestyle to get bounds from.
+ */
+int Page::ThumbnailSize(DoubleBBox *bbox_ret, int *width_ret, int *height_ret)
+{
+	if (!pagestyle) return 1;
 
 	DoubleBBox bbox;
 	if (pagestyle->outline) bbox=*(pagestyle->outline);
 	else { bbox.maxx=pagestyle->w(); bbox.maxy=pagestyle->h(); }
 
-	
 	double w=bbox.maxx-bbox.minx,
 		   h=bbox.maxy-bbox.miny;
 	h=h*200./w;
 	w=200.;
-	DBG cerr <<"..----making thumbnail "<<w<<" x "<<h<<"  pgW,H:"<<pagestyle->w()<<','<<pagestyle->h()
-	DBG 	<<"  bbox:"<<bbox.minx<<','<<bbox.maxx<<' '<<bbox.miny<<','<<bbox.maxy<<endl;
+
+	if (bbox_ret) *bbox_ret = bbox;
+	if (width_ret)  *width_ret  = (int)w;
+	if (height_ret) *height_ret = (int)h;
+	return 0;
+}
+
+/*! Install img as the page's thumbnail, and mark the thumbnail as current.
+ * img should have been rendered to the bounds from ThumbnailSize(). Its count is incremented.
+ */
+void Page::SetThumbnail(LaxImage *img)
+{
+	DoubleBBox bbox;
+	int w, h;
+	if (!img || ThumbnailSize(&bbox, &w, &h) != 0) return;
 
 	if (!thumbnail) thumbnail=new ImageData(); 
 	thumbnail->xaxis(flatpoint((bbox.maxx-bbox.minx)/w,0));
 	thumbnail->yaxis(flatpoint(0,(bbox.maxx-bbox.minx)/w));
 	thumbnail->origin(flatpoint(bbox.minx,bbox.miny));
+	thumbnail->SetImage(img,NULL); //*** must implement using diff size image than is in maxx,y
 
-	Displayer *dp=newDisplayer(NULL);
-	dp->defaultRighthanded(true);
-	dp->CreateSurface((int)w,(int)h);
-
-	 // setup dp to have proper scaling...
-	dp->NewTransform(1.,0.,0.,-1.,0.,0.);
-	//dp->NewTransform(1.,0.,0.,1.,0.,0.);
-	dp->SetSpace(bbox.minx,bbox.maxx, bbox.miny,bbox.maxy);
-	dp->Center  (bbox.minx,bbox.maxx, bbox.miny,bbox.maxy);
-
-	dp->NewBG(255,255,255); // *** this should be the paper color for paper the page is on...
-	dp->NewFG(0,0,0,255);
-	dp->ClearWindow();
-
-	for (int c=0; c<pagebleeds.n; c++) {
-		PageBleed *bleed = pagebleeds[c];
-        //Page *otherpage = doc->pages[bleed->index];
-        Page *otherpage = bleed->page;
-		if (!otherpage) continue;
-
-        dp->PushAndNewTransform(bleed->matrix);
+	tms tms_;
+	thumbmodtime = times(&tms_);
+}
 
-        for (int c2 = 0; c2 < otherpage->layers.n(); c2++) {
-            DrawData(dp,otherpage->e(c2),NULL,NULL,0);
-        }
+/*! Update thumbnail if necessary. This renders right away on the calling thread.
+ * See PageThumbnailer for rendering in the background.
+ */
+ImageData *Page::Thumbnail()
+{
+	if (!pagestyle) return NULL;
+	if (ThumbnailIsCurrent()) return thumbnail;
+	if (page_loaded == 0) return thumbnail; //don't render contents that aren't loaded
 
-        dp->PopAxes();
-	}
+	DoubleBBox bbox;
+	int w, h;
+	ThumbnailSize(&bbox, &w, &h);
+	DBG cerr <<"..----making thumbnail "<<w<<" x "<<h<<"  pgW,H:"<<pagestyle->w()<<','<<pagestyle->h()
+	DBG 	<<"  bbox:"<<bbox.minx<<','<<bbox.maxx<<' '<<bbox.miny<<','<<bbox.maxy<<endl;
 
-	for (int c=0; c<layers.n(); c++) {
-		//dp->PushAndNewTransform(layers.e[c]->m());
-		DrawData(dp,layers.e(c));
-		//dp->PopAxes();
-	}
-		
-	LaxImage *img=dp->GetSurface();
+	LaxImage *img = RenderPage(w, h, nullptr, false);
 	if (img) {
-		thumbnail->SetImage(img,NULL); //*** must implement using diff size image than is in maxx,y
+		SetThumbnail(img);
 		img->dec_count();
 	}
 	
-	DBG cerr <<"Thumbnail dump_out:"<<endl;
-	DBG thumbnail->dump_out(stderr,2,0,NULL);
-	DBG cerr <<"  minx "<<thumbnail->minx<<endl;
-	DBG cerr <<"  maxx "<<thumbnail->maxx<<endl;
-	DBG cerr <<"  miny "<<thumbnail->miny<<endl;
-	DBG cerr <<"  maxy "<<thumbnail->maxy<<endl;
-	//DBG save_image(img, "DBG.png", "png");
+	DBG if (thumbnail) {
+	DBG 	cerr <<"Thumbnail dump_out:"<<endl;
+	DBG 	thumbnail->dump_out(stderr,2,0,NULL);
+	DBG }
 
 	DBG cerr <<"==--- Done Page::updating thumbnail.."<<endl;
-	tms tms_;
-	thumbmodtime = times(&tms_);
-
-
-	dp->EndDrawing();
-	dp->dec_count();
-
 	return thumbnail;
 }
 
@@ -995,6 +1238,9 @@ Laxkit::LaxImage *Page::RenderPage(int width, int height, LaxImage *existing, bo
 		height = width * bbox.boxheight() / (double) bbox.boxwidth();
 	}
 
+	 //off screen rendering does not wait for previews requested while drawing
+	if (!WorkerPool::IsWorkerThread() && RequestPreviews()) PdfPreviewCache::Shared()->Finish();
+
 	DBG cerr <<"..----rendering page "<<width<<" x "<<height<<"  pgW,H:"<<pagestyle->w()<<','<<pagestyle->h()
 	DBG 	<<"  bbox:"<<bbox.minx<<','<<bbox.maxx<<' '<<bbox.miny<<','<<bbox.maxy<<endl;
 
@@ -1050,6 +1296,20 @@ Laxkit::LaxImage *Page::RenderPage(int width, int height, LaxImage *existing, bo
 	return img;
 }
 
+/*! Ask PdfPreviewCache::Shared() for previews of any pdf pages on this page, or bleeding onto it.
+ * Returns the number still pending. Must be called from the main thread.
+ */
+int Page::RequestPreviews()
+{
+	PdfPreviewCache *previews = PdfPreviewCache::Shared();
+	int n = 0;
+	for (int c=0; c<pagebleeds.n; c++) {
+		if (pagebleeds[c]->page) n += previews->RequestAll(&pagebleeds[c]->page->layers);
+	}
+	n += previews->RequestAll(&layers);
+	return n;
+}
+
 /*! Perform any AlignmentRule things in any object on the page.
  * Each is performed once in order the objects exist on the page.
  */
@@ -16,6 +16,7 @@
 #define PAGE_H
 
 #include <lax/anobject.h>
+#include <lax/errorlog.h>
 #include <lax/interfaces/imageinterface.h>
 #include <lax/interfaces/pathinterface.h>
 
@@ -118,6 +119,9 @@ enum PageMarkerType {
 	MARKER_MAX
 };
 
+ //for Page::dump_out()
+#define PAGE_DUMP_Standalone 1
+
 class Page : public ObjectContainer
 {
  public:
@@ -132,27 +136,42 @@ class Page : public ObjectContainer
 	 //page preview thumbnail
 	LaxInterfaces::ImageData *thumbnail;
 	clock_t thumbmodtime,modtime;
+	unsigned long edits; //see Edited()
 
 	 //page contents
 	DrawableObject anchors;
 	Group layers;
 	Laxkit::PtrStack<PageBleed> pagebleeds;
 
-	//char *external_page_file;
-	//int page_loaded; //-1 for not applicable, 0 for no, 1 for yes
+	 //page contents kept in a separate file, see LoadContent()
+	char *external_page_file;
+	int page_loaded; //-1 for not applicable, 0 for no, 1 for yes
+	clock_t savedmodtime; //ContentModTime() when last loaded from or saved to external_page_file, or the document file
+	unsigned long lastused; //see Document::LoadPages()
 
 	Page(PageStyle *npagestyle = nullptr, int num = -1); 
 	virtual ~Page(); 
 	virtual const char *whattype() { return "Page"; }
 	virtual void dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *context);
+	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context);
 	virtual void dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
 	virtual LaxInterfaces::ImageData *Thumbnail();
+	virtual bool ThumbnailIsCurrent();
+	virtual clock_t ContentModTime();
+	virtual int ThumbnailSize(Laxkit::DoubleBBox *bbox_ret, int *width_ret, int *height_ret);
+	virtual void SetThumbnail(Laxkit::LaxImage *img);
 	virtual Laxkit::LaxImage *RenderPage(int width, int height, Laxkit::LaxImage *existing, bool transparent);
+	virtual int RequestPreviews();
 	virtual int InstallPageStyle(PageStyle *pstyle, bool shift_within_margins);
 	virtual const char *Label();
 
 	virtual int PushLayer(const char *layername, int where=-1);
 
+	virtual int LoadContent(Laxkit::DumpContext *context, Laxkit::ErrorLog *log);
+	virtual int SaveContent(const char *file, Laxkit::DumpContext *context, Laxkit::ErrorLog &log);
+	virtual int UnloadContent();
+	virtual bool ContentIsClean();
+
 	virtual int n() { return layers.n(); }
 	virtual Group *e(int i) { return dynamic_cast<Group *>(layers.e(i)); }
 	virtual Laxkit::anObject *object_e(int i) { return layers.object_e(i); }
@@ -160,6 +179,7 @@ class Page : public ObjectContainer
 	virtual const char *object_e_name(int i);
 
 	virtual void Touch(clock_t at_time=0);
+	virtual void Edited();
 	virtual void UpdateAnchored(Group *g);
 	virtual int HasObjects();
 };
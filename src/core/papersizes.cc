@@ -28,6 +28,7 @@
 #include "stylemanager.h"
 #include "../language.h"
 #include "../laidout.h"
+#include "utils.h"
 
 //template implementation:
 //#include <lax/refptrstack.cc>
@@ -136,7 +137,7 @@ PtrStack<PaperStyle> *GetBuiltinPaperSizes(PtrStack<PaperStyle> *papers)
 	double x,y; 
 	double dpi;
 
-	setlocale(LC_ALL,"C"); //because "8.5" in the list above is not the same as "8,5" for some locales
+	UseCLocale(true); //because "8.5" in the list above is not the same as "8,5" for some locales
 	for (int c=0; BuiltinPaperSizes[c]; c += 5) {
 		x = atof(BuiltinPaperSizes[c+1]);
 		y = atof(BuiltinPaperSizes[c+2]);
@@ -145,7 +146,7 @@ PtrStack<PaperStyle> *GetBuiltinPaperSizes(PtrStack<PaperStyle> *papers)
 
 		papers->push(new PaperStyle(BuiltinPaperSizes[c],x,y,0,dpi,BuiltinPaperSizes[c+3]));
 	}
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	return papers;
 }
@@ -209,7 +210,7 @@ int InstallPaperResources()
 	const char *menu, *name, *units;
 	int num_added = 0;
 
-	setlocale(LC_ALL,"C"); //because "8.5" in the list above is not the same as "8,5" for some locales
+	UseCLocale(true); //because "8.5" in the list above is not the same as "8,5" for some locales
 	for (int c=0; BuiltinPaperSizes[c]; c += 5) {
 		name  = BuiltinPaperSizes[c];
 		units = BuiltinPaperSizes[c+3];
@@ -225,7 +226,7 @@ int InstallPaperResources()
 		objs->AddResource(newpaper, nullptr, name, name, nullptr, nullptr, nullptr, true, menu);
 		num_added++;
 	}
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	return num_added;
 }
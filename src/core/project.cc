@@ -16,10 +16,10 @@
 #include <iostream>
 
 #include <lax/interfaces/somedataref.h>
-#include <lax/interfaces/engraverfillinterface.h>
 #include <lax/fileutils.h>
 #include "project.h"
 #include "utils.h"
+#include "workerpool.h"
 #include "../version.h"
 #include "../ui/headwindow.h"
 #include "../laidout.h"
@@ -102,6 +102,7 @@ Project::Project()
  */
 Project::~Project()
 {
+	objectindex.Clear();
 	docs.flush();
 	if (name) delete[] name;
 	if (dir) delete[] dir;
@@ -123,6 +124,7 @@ int Project::Push(Document *doc)
 {
 	if (!doc) return 1;
 	docs.push(new ProjDocument(doc,NULL,NULL));
+	InvalidateObjectIndex();
 	return 0;
 }
 
@@ -176,6 +178,7 @@ int Project::Pop(Document *doc)
 	if (!doc) {
 		if (docs.n) {
 			docs.remove(-1);
+			InvalidateObjectIndex();
 			laidout->notifyDocTreeChanged(NULL,TreeDocGone,0,0);
 			return 0;
 		}
@@ -186,6 +189,7 @@ int Project::Pop(Document *doc)
 	for (c=0; c<docs.n; c++) if (doc==docs.e[c]->doc) break;
 	if (c==docs.n) return 1;
 	if (docs.remove(c)) {
+		InvalidateObjectIndex();
 		laidout->notifyDocTreeChanged(NULL,TreeDocGone,0,0);
 		return 0;
 	}
@@ -358,7 +362,7 @@ int Project::Load(const char *file,ErrorLog &log)
 	
 	clear();
 	makestr(filename,file);
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	char *dir=lax_dirname(filename,0);
 	DumpContext context(dir,1, object_id);
@@ -366,7 +370,7 @@ int Project::Load(const char *file,ErrorLog &log)
 	if (!name) makestr(name,filename);
 
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	ClarifyRefs(log);
 	return 0;
@@ -390,7 +394,7 @@ int Project::Save(ErrorLog &log)
 	}
 
 	DBG cerr <<"....Saving project to "<<filename<<endl;
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 //	f=stdout;//***
 	fprintf(f,"#Laidout %s Project\n",LAIDOUT_VERSION);
 
@@ -400,7 +404,7 @@ int Project::Save(ErrorLog &log)
 	delete[] dir;
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	return 0;
 }
 
@@ -465,116 +469,107 @@ int Project::ClarifyAnchors(ErrorLog &log)
 	return adjusted;
 }
 
-/*! Step through all drawable objects looking for unresolved SomeDataRefs.
+/*! Resolve unlinked SomeDataRefs, including engraver trace objects, against
+ * objects anywhere in the project, using objectindex, which is rebuilt first only if
+ * things were added that it was not told about.
  * Also calls ClarifyAnchors after sorting out clones.
- * If found, find matching reference and install object. If not found,
- * issue a warning.
+ * If a ref's object is not found, issue a warning.
  *
  * This will be called after loading a document to resolve unlinked clones.
+ * If !warn_missing, refs whose object is not found are left for later without a warning,
+ * such as when their objects may be on pages not loaded yet.
+ * Returns the number of refs linked.
  */
-int Project::ClarifyRefs(ErrorLog &log)
+int Project::ClarifyRefs(ErrorLog &log, bool warn_missing)
 {
-	//need to search in docs->pages, limbos, and papergroup->objs
-	FieldPlace first; first.push(0);
-	FieldPlace place; place=first;
-	anObject *obj=NULL;
+	if (!objectindex.IsBuilt() || objectindex.IsIncomplete()) objectindex.Rebuild(this);
+
 	SomeDataRef *ref;
 	SomeData *o;
-	int c;
 	int numrefs=0;
 
-	while (1) {
-		DBG cerr <<"refs: "<<(obj?obj->whattype():"(no obj)")<<endl;
-
-		if (obj && !strcmp(obj->whattype(),"EngraverFillData")) {
-			EngraverFillData *edata=dynamic_cast<EngraverFillData*>(obj);
-			for (int c=0; c<edata->groups.n; c++) {
-				if (edata->groups.e[c]->trace
-						&& edata->groups.e[c]->trace->traceobject
-						&& edata->groups.e[c]->trace->traceobject->type==TraceObject::TRACE_Object) {
-					ref=dynamic_cast<SomeDataRef*>(edata->groups.e[c]->trace->traceobject->object);
-
-					if (ref->thedata) {
-						//already linked
-
-					} if (!ref->thedata_id) {
-						log.AddMessage(_("Missing clone id!"),ERROR_Warning);
-
-					} else {
-						o=FindObject(ref->thedata_id);
-						if (o) {
-							ref->Set(o,1);
-							numrefs++;
-						} else {
-							log.AddMessage(_("Missing clone object!"),ERROR_Warning);
-						}
-					}
-				}
-			}
-			obj=NULL;
-		}
-
-		if (obj && !strcmp(obj->whattype(),"SomeDataRef")) {
-			ref=dynamic_cast<SomeDataRef*>(obj);
+	for (int c=0; c<objectindex.NumUnresolved(); c++) {
+		ref=objectindex.Unresolved(c);
 
-			if (ref->thedata) {
-				//already linked
+		if (ref->thedata) {
+			//already linked
 
-			} if (!ref->thedata_id) {
-				log.AddMessage(_("Missing clone id!"),ERROR_Warning);
+		} else if (!ref->thedata_id) {
+			log.AddMessage(_("Missing clone id!"),ERROR_Warning);
 
-			} else {
-				o=FindObject(ref->thedata_id);
-				if (o) {
-					ref->Set(o,1);
-					numrefs++;
-				} else {
-					log.AddMessage(_("Missing clone object!"),ERROR_Warning);
-				}
+		} else {
+			o=objectindex.Find(ref->thedata_id);
+			if (o) {
+				ref->Set(o,1);
+				numrefs++;
+			} else if (warn_missing) {
+				log.AddMessage(_("Missing clone object!"),ERROR_Warning);
 			}
 		}
-
-		obj=NULL;
-		c=nextObject(place,0,Next_Increment, &obj);
-		if (c==Next_Error) break;
-		if (first==place) break;
 	}
 
+	objectindex.DropResolved();
 	ClarifyAnchors(log);
 
 	return numrefs;
 }
 
-/*! This is to aid in mapping unresolved references. For arbitrary
+/*! Return the object with id anywhere in the project, or NULL.
+ * This is to aid in mapping unresolved references. For arbitrary
  * object location, use the other find.
+ *
+ * Lookups go through objectindex. It is only rebuilt when it was never built, or when
+ * the id is not found after objects were added without ObjectAdded().
  */
 LaxInterfaces::SomeData *Project::FindObject(const char *id)
 {
-	//need to search in docs->pages, limbos, and papergroup->objs
-	FieldPlace first; first.push(0);
-	FieldPlace place(first);
-	anObject *obj=NULL;
-	SomeData *o;
-	int c;
+	if (!id) return NULL;
+	if (!objectindex.IsBuilt()) objectindex.Rebuild(this);
+	SomeData *obj = objectindex.Find(id);
+	if (!obj && objectindex.IsIncomplete() && !WorkerPool::IsWorkerThread()) {
+		objectindex.Rebuild(this);
+		obj = objectindex.Find(id);
+	}
+	return obj;
+}
 
-	while (1) {
-		if (obj && dynamic_cast<SomeData*>(obj)) {
-			o=dynamic_cast<SomeData*>(obj);
+/*! For changes to the project that may have added or removed any number of objects.
+ * Objects nothing else holds are dropped from objectindex, and the next FindObject() that
+ * misses rebuilds it. Does nothing when called off the main thread.
+ * LaidoutApp::notifyDocTreeChanged() calls this.
+ */
+void Project::InvalidateObjectIndex()
+{
+	if (WorkerPool::IsWorkerThread()) return;
+	objectindex.Prune();
+	objectindex.MarkIncomplete();
+}
 
-			if (!o || !o->Id()) {
-				//skip if no id to match!
-			} else if (!strcmp(o->Id(),id)) {
-				return o;
-			}
-		}
+/*! Index data and its descendents, which were just put somewhere in the project.
+ * Does nothing when called off the main thread.
+ */
+void Project::ObjectAdded(LaxInterfaces::SomeData *data)
+{
+	if (WorkerPool::IsWorkerThread() || !objectindex.IsBuilt()) return;
+	objectindex.Add(data);
+}
 
-		obj=NULL;
-		c=nextObject(place,0,Next_Increment, &obj);
-		if (c==Next_Error) break;
-		if (first==place) break;
-	}
+/*! Stop indexing data and its descendents, which were just taken out of the project.
+ * Does nothing when called off the main thread.
+ */
+void Project::ObjectRemoved(LaxInterfaces::SomeData *data)
+{
+	if (WorkerPool::IsWorkerThread()) return;
+	objectindex.Remove(data);
+}
 
-	return NULL;
+/*! data's id just changed from oldid. Does nothing when called off the main thread,
+ * which is only ever done on private copies, which are not indexed.
+ */
+void Project::ObjectRenamed(LaxInterfaces::SomeData *data, const char *oldid)
+{
+	if (WorkerPool::IsWorkerThread()) return;
+	objectindex.Rename(data, oldid);
 }
 
 /*! Find an object, and put its path in found.
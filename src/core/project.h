@@ -18,6 +18,7 @@
 #include <lax/refptrstack.h>
 #include "document.h"
 #include "papersizes.h"
+#include "objectindex.h"
 
 
 namespace Laidout {
@@ -48,6 +49,7 @@ class Project : public Laxkit::DumpUtility, public ObjectContainer
 	Group limbos;
 
 	Laxkit::Attribute iohints;
+	ObjectIndex objectindex;
 
 	Project();
 	virtual ~Project();
@@ -65,10 +67,14 @@ class Project : public Laxkit::DumpUtility, public ObjectContainer
 	virtual Document *Find(const char *name, int howmatch);
 	virtual int LocatePage(Page *page, Document **doc_ret);
 	virtual int valid();
-	virtual int ClarifyRefs(Laxkit::ErrorLog &log);
+	virtual int ClarifyRefs(Laxkit::ErrorLog &log, bool warn_missing = true);
 	virtual int ClarifyAnchors(Laxkit::ErrorLog &log);
 	virtual LaxInterfaces::SomeData *FindObject(const char *id);
 	virtual int FindObject(LaxInterfaces::SomeData *data, FieldPlace &found);
+	virtual void InvalidateObjectIndex();
+	virtual void ObjectAdded(LaxInterfaces::SomeData *data);
+	virtual void ObjectRemoved(LaxInterfaces::SomeData *data);
+	virtual void ObjectRenamed(LaxInterfaces::SomeData *data, const char *oldid);
 
 	 //from ObjectContainer:
 	virtual int n();
@@ -0,0 +1,416 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/fileutils.h>
+#include <lax/laximages.h>
+#include <lax/laxutils.h>
+
+#include "thumbnailer.h"
+#include "workerpool.h"
+#include "drawdata.h"
+#include "document.h"
+#include "../dataobjects/pdfpageproxy.h"
+#include "utils.h"
+#include "../version.h"
+
+#include <openssl/evp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <string>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- PageThumbnailer ---------------------------------------
+
+/*! \class PageThumbnailer
+ * Renders page thumbnails on WorkerPool::Shared() threads, and keeps them on disk,
+ * so unchanged pages are not rendered again in later sessions.
+ *
+ * Request() and Collect() must only be called from the main thread. Cached thumbnails are
+ * keyed by the file a page was read from and that file's modification time (see CacheKey()),
+ * so looking one up costs a stat, not a pass over the page contents. Only when there is no
+ * cached thumbnail is a copy of the page made to render from, so the page can keep being
+ * edited while the job runs. Collect() installs finished thumbnails with Page::SetThumbnail().
+ * Until then, callers should draw a placeholder, or the old thumbnail if any.
+ *
+ * The disk cache is kept under MaxCacheBytes() by dropping the least recently used files.
+ *
+ * Note that clones still read their live source objects while rendering, and are not part of the key.
+ */
+
+
+#define THUMBNAIL_CACHE_BYTES  (64*1024*1024)
+#define THUMBNAIL_PRUNE_EVERY  20
+
+
+/*! Holds a copy of what to draw for a page, and the result.
+ * Everything in here except result is only touched on the main thread.
+ *
+ * A job with a key and no content only checks the disk cache. If that misses, Collect()
+ * makes the content and sends it out again to render.
+ */
+class PageThumbnailer::ThumbnailJob
+{
+  public:
+	Page *page;
+	clock_t stamp; //page->ContentModTime() when requested
+	char *key;
+	Group *content; //copy of page layers, and layers bleeding from other pages
+	DoubleBBox bbox;
+	int width, height;
+	LaxImage *result;
+
+	ThumbnailJob(Page *npage)
+	{
+		page = npage;
+		page->inc_count();
+		stamp = page->ContentModTime();
+		key = nullptr;
+		content = nullptr;
+		width = height = 0;
+		result = nullptr;
+	}
+
+	~ThumbnailJob()
+	{
+		page->dec_count();
+		delete[] key;
+		if (content) content->dec_count();
+		if (result) result->dec_count();
+	}
+};
+
+
+static PageThumbnailer *shared_thumbnailer = nullptr;
+
+/*! Return a process wide thumbnailer. This is never deleted before exit.
+ * Only call from the main thread.
+ */
+PageThumbnailer *PageThumbnailer::Shared()
+{
+	if (!shared_thumbnailer) shared_thumbnailer = new PageThumbnailer;
+	return shared_thumbnailer;
+}
+
+/*! Default cache dir is "$XDG_CACHE_HOME/laidout/(version)/pagethumbs/", with XDG_CACHE_HOME
+ * defaulting to "~/.cache".
+ */
+PageThumbnailer::PageThumbnailer()
+{
+	cache_dir = nullptr;
+	closing = false;
+	max_cache_bytes = THUMBNAIL_CACHE_BYTES;
+	writes_since_prune = THUMBNAIL_PRUNE_EVERY; //so the first write of a session prunes
+
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	char *dir = nullptr;
+	if (xdg && *xdg) dir = newstr(xdg);
+	else {
+		dir = newstr(getenv("HOME"));
+		appendstr(dir, "/.cache");
+	}
+	appendstr(dir, "/laidout/");
+	appendstr(dir, LAIDOUT_VERSION);
+	appendstr(dir, "/pagethumbs/");
+	CacheDir(dir);
+	delete[] dir;
+}
+
+/*! Waits for this thumbnailer's own running jobs first, since they refer to this.
+ */
+PageThumbnailer::~PageThumbnailer()
+{
+	closing = true;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_finished.wait(lock, [this] { return (int)finished.size() >= pending.n; });
+	}
+	Collect();
+	delete[] cache_dir;
+}
+
+/*! Set where thumbnails are cached on disk, creating the directory if necessary.
+ * If dir is null, or it cannot be created, then thumbnails are not cached on disk.
+ */
+void PageThumbnailer::CacheDir(const char *dir)
+{
+	makestr(cache_dir, dir);
+	if (cache_dir && check_dirs(cache_dir, true) != -1) {
+		DBG cerr << " *** warning: could not create thumbnail cache dir "<<cache_dir<<endl;
+		makestr(cache_dir, nullptr);
+	}
+}
+
+/*! Set the most the disk cache may use. The next write prunes the cache to this size.
+ */
+void PageThumbnailer::MaxCacheBytes(long bytes)
+{
+	max_cache_bytes = (bytes > 0 ? bytes : THUMBNAIL_CACHE_BYTES);
+	writes_since_prune = THUMBNAIL_PRUNE_EVERY;
+}
+
+/*! Return new char[] of the cache file name for key, or null if not caching to disk.
+ */
+char *PageThumbnailer::CacheFile(const char *key)
+{
+	if (!cache_dir || !key) return nullptr;
+	char *file = newstr(cache_dir);
+	if (file[strlen(file)-1] != '/') appendstr(file, "/");
+	appendstr(file, key);
+	appendstr(file, ".png");
+	return file;
+}
+
+/*! Append to key where page's contents come from on disk. Return false if page has changed since
+ * it was read or written, or it has no file.
+ */
+static bool page_file_key(std::string &key, Page *page, Document *doc, int pagei)
+{
+	const char *file = nullptr;
+	if (page->external_page_file) {
+		if (page->page_loaded != 0 && !page->ContentIsClean()) return false;
+		file = page->external_page_file;
+		pagei = 0;
+	} else {
+		if (!doc || isblank(doc->saveas) || pagei < 0) return false;
+		if (page->savedmodtime == 0 || page->savedmodtime != page->ContentModTime()) return false;
+		file = doc->saveas;
+	}
+
+	struct stat st;
+	if (stat(file, &st) != 0) return false;
+
+	char scratch[100];
+	sprintf(scratch, "\n%ld %ld %d\n", (long)st.st_mtime, (long)st.st_size, pagei);
+	key += file;
+	key += scratch;
+	return true;
+}
+
+/*! Return a new char[] with a hex md5 digest of the files that page and any pages bleeding onto it
+ * were read from, those files' modification times and sizes, and the thumbnail size and bounds.
+ *
+ * Returns null if any of those pages have changed since they were read or saved, or were never saved.
+ * Those are rendered without the disk cache.
+ */
+char *PageThumbnailer::CacheKey(Page *page, Document *doc, int pagei, int width, int height)
+{
+	if (doc && pagei < 0) pagei = doc->pages.findindex(page);
+
+	std::string key;
+	if (!page_file_key(key, page, doc, pagei)) return nullptr;
+
+	char scratch[200];
+	DoubleBBox bbox;
+	page->ThumbnailSize(&bbox, nullptr, nullptr);
+	sprintf(scratch, "%dx%d %.10g %.10g %.10g %.10g\n", width, height, bbox.minx, bbox.maxx, bbox.miny, bbox.maxy);
+	key += scratch;
+
+	for (int c=0; c<page->pagebleeds.n; c++) {
+		PageBleed *bleed = page->pagebleeds[c];
+		if (!bleed->page) continue;
+		sprintf(scratch, "bleed %.10g %.10g %.10g %.10g %.10g %.10g\n",
+				bleed->matrix[0], bleed->matrix[1], bleed->matrix[2], bleed->matrix[3], bleed->matrix[4], bleed->matrix[5]);
+		key += scratch;
+		if (!page_file_key(key, bleed->page, doc, bleed->index)) return nullptr;
+	}
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestlen = 0;
+	EVP_Digest(key.c_str(), key.size(), digest, &digestlen, EVP_md5(), nullptr);
+
+	char *hash = new char[2*digestlen+1];
+	for (unsigned int c=0; c<digestlen; c++) sprintf(hash+2*c, "%02x", digest[c]);
+	hash[2*digestlen] = '\0';
+	return hash;
+}
+
+/*! Make sure page's thumbnail is current, or on its way.
+ * doc and pagei are where page is, and are used to find cached thumbnails of pages whose contents
+ * are in the document file. If pagei < 0, it is looked up in doc.
+ *
+ * Return 1 if page->thumbnail is already current, or 0 if a job is pending.
+ * -1 is returned if page has no thumbnail bounds, or if its contents are not loaded
+ * and there is no saved thumbnail.
+ */
+int PageThumbnailer::Request(Page *page, Document *doc, int pagei)
+{
+	if (!page) return -1;
+	if (page->ThumbnailIsCurrent()) return 1;
+	if (page->page_loaded == 0) return page->thumbnail ? 1 : -1;
+
+	clock_t stamp = page->ContentModTime();
+	for (int c=0; c<pending.n; c++) {
+		if (pending.e[c]->page == page && pending.e[c]->stamp == stamp) return 0;
+	}
+
+	ThumbnailJob *job = new ThumbnailJob(page);
+	if (page->ThumbnailSize(&job->bbox, &job->width, &job->height) != 0 || job->width <= 0 || job->height <= 0) {
+		delete job;
+		return -1;
+	}
+	if (cache_dir) job->key = CacheKey(page, doc, pagei, job->width, job->height);
+
+	pending.push(job);
+	if (job->key) WorkerPool::Shared()->Add([this, job]() { RunJob(job); }); //contents are copied only on a cache miss
+	else StartRender(job);
+	return 0;
+}
+
+/*! Copy what to render for job, and queue it to be rendered. Must be called from the main thread.
+ */
+void PageThumbnailer::StartRender(ThumbnailJob *job)
+{
+	Page *page = job->page;
+
+	 //pdf previews are normally requested only when drawn on screen, so have them in place before copying
+	if (page->RequestPreviews()) PdfPreviewCache::Shared()->Finish();
+
+	 //copy what to render, so the worker never sees objects being edited
+	job->content = new Group;
+	for (int c=0; c<page->pagebleeds.n; c++) {
+		PageBleed *bleed = page->pagebleeds[c];
+		if (!bleed->page) continue;
+
+		Group *bleedgroup = new Group;
+		bleedgroup->m(bleed->matrix);
+		for (int c2=0; c2<bleed->page->layers.n(); c2++) {
+			SomeData *layer = bleed->page->layers.e(c2)->duplicateData(nullptr);
+			bleedgroup->push(layer);
+			layer->dec_count();
+		}
+		job->content->push(bleedgroup);
+		bleedgroup->dec_count();
+	}
+	for (int c=0; c<page->layers.n(); c++) {
+		SomeData *layer = page->layers.e(c)->duplicateData(nullptr);
+		job->content->push(layer);
+		layer->dec_count();
+	}
+
+	WorkerPool::Shared()->Add([this, job]() { RunJob(job); });
+}
+
+/*! Called on a worker thread. Jobs without content look for their thumbnail in the disk cache.
+ * Jobs with content render it, and save it to the cache if they have a key. Either way, the job is
+ * then passed back for Collect().
+ */
+void PageThumbnailer::RunJob(ThumbnailJob *job)
+{
+	char *file = CacheFile(job->key);
+
+	if (!job->content) {
+		if (file && file_exists(file, 1, nullptr) == S_IFREG) {
+			job->result = ImageLoader::LoadImage(file);
+			if (job->result && (job->result->w() != job->width || job->result->h() != job->height)) {
+				job->result->dec_count();
+				job->result = nullptr;
+			}
+			if (job->result) utime(file, nullptr); //mark as recently used, for prune_cache_dir()
+		}
+
+	} else {
+		Displayer *dp = newDisplayer(nullptr);
+		dp->defaultRighthanded(true);
+		dp->CreateSurface(job->width, job->height);
+
+		DoubleBBox &bbox = job->bbox;
+		dp->NewTransform(1.,0.,0.,-1.,0.,0.);
+		dp->SetSpace(bbox.minx,bbox.maxx, bbox.miny,bbox.maxy);
+		dp->Center  (bbox.minx,bbox.maxx, bbox.miny,bbox.maxy);
+
+		dp->NewBG(255,255,255); // *** this should be the paper color for paper the page is on...
+		dp->NewFG(0,0,0,255);
+		dp->ClearWindow();
+
+		for (int c=0; c<job->content->n(); c++) {
+			DrawData(dp, job->content->e(c), nullptr, nullptr, 0);
+		}
+
+		job->result = dp->GetSurface();
+		dp->EndDrawing();
+		dp->dec_count();
+
+		if (job->result && file) {
+			 //write to a temp file first, so other instances never see a partial png
+			char *tmp = newstr(file);
+			char scratch[30];
+			sprintf(scratch, ".%lx.tmp", (unsigned long)(size_t)job);
+			appendstr(tmp, scratch);
+			if (job->result->Save(tmp, "png") == 0) rename(tmp, file);
+			else unlink(tmp);
+			delete[] tmp;
+
+			if (++writes_since_prune >= THUMBNAIL_PRUNE_EVERY) {
+				writes_since_prune = 0;
+				prune_cache_dir(cache_dir, ".png", max_cache_bytes);
+			}
+		}
+	}
+
+	delete[] file;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.push_back(job);
+	job_finished.notify_all();
+}
+
+/*! Install any finished thumbnails into their pages. Must be called from the main thread.
+ * Pages not found in the disk cache are sent out to be rendered.
+ * Results for pages that changed after they were requested are discarded.
+ * Returns the number of thumbnails installed.
+ */
+int PageThumbnailer::Collect()
+{
+	std::deque<ThumbnailJob*> done;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done.swap(finished);
+	}
+
+	int n = 0;
+	for (ThumbnailJob *job : done) {
+		bool current = (job->page->ContentModTime() == job->stamp);
+		if (job->result && current) {
+			job->page->SetThumbnail(job->result);
+			n++;
+
+		} else if (!job->result && !job->content && current && job->page->page_loaded != 0 && !closing) {
+			 //missed the disk cache, so now render it
+			StartRender(job);
+			continue;
+		}
+		pending.remove(pending.findindex(job)); //deletes job
+	}
+
+	return n;
+}
+
+
+} //namespace Laidout
+
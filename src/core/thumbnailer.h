@@ -0,0 +1,71 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <deque>
+
+#include "page.h"
+
+
+namespace Laidout {
+
+
+//------------------------------------- PageThumbnailer ---------------------------------------
+
+class Document;
+
+class PageThumbnailer
+{
+  protected:
+	class ThumbnailJob;
+
+	Laxkit::PtrStack<ThumbnailJob> pending; //only touched on the main thread
+	std::deque<ThumbnailJob*> finished;     //guarded by mutex
+	std::mutex mutex;
+	std::condition_variable job_finished;
+	bool closing;
+	char *cache_dir;
+	long max_cache_bytes;
+	std::atomic<int> writes_since_prune;
+
+	virtual void RunJob(ThumbnailJob *job);
+	virtual void StartRender(ThumbnailJob *job);
+	virtual char *CacheFile(const char *key);
+
+  public:
+	static PageThumbnailer *Shared();
+	static char *CacheKey(Page *page, Document *doc, int pagei, int width, int height);
+
+	PageThumbnailer();
+	virtual ~PageThumbnailer();
+
+	virtual const char *CacheDir() { return cache_dir; }
+	virtual void CacheDir(const char *dir);
+	virtual long MaxCacheBytes() { return max_cache_bytes; }
+	virtual void MaxCacheBytes(long bytes);
+
+	virtual int Request(Page *page, Document *doc = nullptr, int pagei = -1);
+	virtual int Collect();
+	virtual int NumPending() { return pending.n; }
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -16,6 +16,7 @@
 #include "../language.h"
 #include "../version.h"
 #include "utils.h"
+#include "binaryattribute.h"
 #include <lax/strmanip.h>
 #include <lax/fileutils.h>
 #include <lax/laximages.h>
@@ -24,7 +25,15 @@
 #include <lax/messagebox.h>
 
 #include <cctype>
+#include <cstring>
 #include <cstdlib>
+#include <locale.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
 
  //for freedesktop thumbnail md5 names:
 #include <openssl/evp.h>
@@ -189,6 +198,23 @@ long time_to_ms(const char *v, const char **end_ret)
 	return t;
 }
 
+//----------------------------------- Locale helpers ---------------------------------------------
+
+/*! Switch the calling thread to the "C" locale when c_locale is true, so that numbers are
+ * written and read with '.' as the decimal point. Pass false to go back to the process wide
+ * locale, which is what translated messages should be made with.
+ *
+ * Unlike setlocale(), this only affects the current thread, so exports running on
+ * worker threads do not step on each other or on the ui.
+ */
+void UseCLocale(bool c_locale)
+{
+	static locale_t clocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+
+	if (c_locale && clocale) uselocale(clocale);
+	else uselocale(LC_GLOBAL_LOCALE);
+}
+
 //----------------------------------- File i/o helpers ---------------------------------------------
 
 
@@ -210,6 +236,48 @@ char *ConfigDir(const char *what)
 	return config_dir;
 }
 
+/*! Delete the least recently modified files in dir that end with suffix, until those
+ * files take up no more than max_bytes. Subdirectories are ignored.
+ * Caches should touch files when they are used, so that this drops the least recently used.
+ *
+ * Returns the number of bytes remaining, or -1 if dir can't be read.
+ */
+long prune_cache_dir(const char *dir, const char *suffix, long max_bytes)
+{
+	DIR *d = dir ? opendir(dir) : nullptr;
+	if (!d) return -1;
+
+	struct CacheFile { std::string path; time_t mtime; long size; };
+	std::vector<CacheFile> files;
+	long total = 0;
+	int suffixlen = suffix ? strlen(suffix) : 0;
+
+	std::string base = dir;
+	if (base.size() && base.back() != '/') base += '/';
+
+	struct dirent *entry;
+	while ((entry = readdir(d))) {
+		int len = strlen(entry->d_name);
+		if (len < suffixlen || (suffixlen && strcmp(entry->d_name + len - suffixlen, suffix))) continue;
+
+		struct stat st;
+		std::string path = base + entry->d_name;
+		if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		files.push_back(CacheFile{ path, st.st_mtime, (long)st.st_size });
+		total += st.st_size;
+	}
+	closedir(d);
+
+	if (total <= max_bytes) return total;
+
+	std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b) { return a.mtime < b.mtime; });
+	for (auto &file : files) {
+		if (total <= max_bytes) break;
+		if (unlink(file.path.c_str()) == 0) total -= file.size;
+	}
+	return total;
+}
+
 /*! Prep a save file, but write to a temporary file so if there is a bug or other error
  * you do not obliterate your original file.
  * Use in conjunction with close_and_copy_temp_file().
@@ -453,6 +521,15 @@ int laidout_file_type(const char *file,
 {
 	if (file_exists(file,1,NULL)!=S_IFREG) return 1;
 
+	 //binary files have type and version in their header
+	char *btype=NULL;
+	if (binary_laidout_file_type(file, actual_version, &btype)) {
+		int err = (!typ || !strcmp(typ,btype)) ? 0 : 1;
+		if (actual_type) *actual_type=btype;
+		else delete[] btype;
+		return err;
+	}
+
 	FILE *f=fopen(file,"r");
 	if (!f) return 2;
 	
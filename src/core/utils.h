@@ -35,12 +35,16 @@ char *roman_numeral(int i,char cap);
 //--------------------------------- misc number helpers --------------------------
 long time_to_ms(const char *v, const char **end_ret);
 
+//----------------------------------- Locale helpers ---------------------------------------------
+void UseCLocale(bool c_locale);
+
 //----------------------------------- File i/o helpers ---------------------------------------------
 char *ConfigDir(const char *what = nullptr);
 FILE *open_laidout_file_to_read(const char *file,const char *what,Laxkit::ErrorLog *log, bool warn_if_fail=true);
 FILE *open_file_for_reading(const char *file,Laxkit::ErrorLog *log);
 FILE *open_file_for_writing(const char *file,int nooverwrite,Laxkit::ErrorLog *log);
 int resource_name_and_desc(FILE *f,char **name, char **desc);
+long prune_cache_dir(const char *dir, const char *suffix, long max_bytes);
 
 int laidout_file_type(const char *file, const char *minversion, const char *maxversion, char **actual_version,
 					  const char *typ, char **actual_type);
@@ -0,0 +1,218 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include "workerpool.h"
+
+#include <atomic>
+#include <memory>
+
+
+#include <iostream>
+#define DBG
+
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- WorkerPool ---------------------------------------
+
+/*! \class WorkerPool
+ * Simple fixed size pool of worker threads.
+ *
+ * Jobs pushed with Add() are run in the order they are added on whichever thread is free.
+ * Run() is for fork-join style loops, where the calling thread also participates, and
+ * does not return until all its jobs are done.
+ *
+ * Jobs must not touch anything in the ui (windows, displayers, the event loop), and must
+ * not change reference counts of objects shared with other threads, since anObject counts
+ * are not atomic.
+ */
+
+
+static thread_local bool is_worker_thread = false;
+
+static WorkerPool *shared_pool = nullptr;
+static int shared_pool_threads = 0;
+static std::mutex shared_pool_mutex;
+
+
+/*! Return the number of hardware threads, or 1 if that can't be determined.
+ */
+int WorkerPool::DefaultNumThreads()
+{
+	int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+/*! Return true if the current thread is one of any WorkerPool's worker threads.
+ */
+bool WorkerPool::IsWorkerThread()
+{
+	return is_worker_thread;
+}
+
+/*! Return a process wide pool, created on first use with SetSharedThreads() number of threads.
+ * This is never deleted before exit.
+ */
+WorkerPool *WorkerPool::Shared()
+{
+	std::lock_guard<std::mutex> lock(shared_pool_mutex);
+	if (!shared_pool) shared_pool = new WorkerPool(shared_pool_threads);
+	return shared_pool;
+}
+
+/*! Set the number of threads the Shared() pool is created with.
+ * 0 means use DefaultNumThreads(). This has no effect after Shared() has been called.
+ */
+void WorkerPool::SetSharedThreads(int num_threads)
+{
+	std::lock_guard<std::mutex> lock(shared_pool_mutex);
+	if (shared_pool) {
+		DBG cerr << " *** warning: SetSharedThreads() called after shared pool created"<<endl;
+		return;
+	}
+	shared_pool_threads = num_threads;
+}
+
+/*! If num_threads <= 0, then use DefaultNumThreads().
+ * Note that a pool of 1 thread is still a background thread.
+ */
+WorkerPool::WorkerPool(int num_threads)
+{
+	num_running = 0;
+	shutting_down = false;
+
+	if (num_threads <= 0) num_threads = DefaultNumThreads();
+	for (int c=0; c<num_threads; c++) {
+		workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+	}
+}
+
+/*! Jobs already queued are still run before the threads are joined.
+ */
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shutting_down = true;
+	}
+	job_available.notify_all();
+	for (auto &worker : workers) worker.join();
+}
+
+void WorkerPool::WorkerLoop()
+{
+	is_worker_thread = true;
+
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_available.wait(lock, [this] { return shutting_down || !jobs.empty(); });
+			if (jobs.empty()) return; //shutting down and nothing left to do
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			num_running++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			num_running--;
+			if (num_running == 0 && jobs.empty()) all_done.notify_all();
+		}
+	}
+}
+
+/*! Number of jobs queued or currently running.
+ */
+int WorkerPool::NumPending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return jobs.size() + num_running;
+}
+
+/*! Queue a job to be run on the next free worker thread.
+ */
+void WorkerPool::Add(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	job_available.notify_one();
+}
+
+/*! Block until there are no queued or running jobs.
+ * Note this waits for ALL jobs, not just the ones the caller added.
+ */
+void WorkerPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	all_done.wait(lock, [this] { return num_running == 0 && jobs.empty(); });
+}
+
+/*! Call job(0) through job(num_jobs-1), spread over the workers and the calling thread.
+ * Returns only when all are done. Jobs are claimed in increasing index order.
+ *
+ * If called from a worker thread, or there are no workers, jobs are run serially on the
+ * calling thread, so that nested use cannot deadlock the pool.
+ */
+void WorkerPool::Run(int num_jobs, std::function<void(int)> job)
+{
+	if (num_jobs <= 0) return;
+	if (num_jobs == 1 || workers.empty() || is_worker_thread) {
+		for (int c=0; c<num_jobs; c++) job(c);
+		return;
+	}
+
+	struct Batch {
+		std::atomic<int> next;
+		std::atomic<int> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::function<void(int)> job;
+	};
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->next = 0;
+	batch->done = 0;
+	batch->job  = job;
+
+	auto runner = [batch, num_jobs]() {
+		int i;
+		while ((i = batch->next++) < num_jobs) {
+			batch->job(i);
+			if (++batch->done == num_jobs) {
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->finished.notify_all();
+			}
+		}
+	};
+
+	int num_helpers = num_jobs - 1;
+	if (num_helpers > (int)workers.size()) num_helpers = workers.size();
+	for (int c=0; c<num_helpers; c++) Add(runner);
+
+	runner();
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished.wait(lock, [&batch, num_jobs] { return batch->done == num_jobs; });
+}
+
+
+} //namespace Laidout
+
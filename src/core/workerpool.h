@@ -0,0 +1,62 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+
+namespace Laidout {
+
+
+//------------------------------------- WorkerPool ---------------------------------------
+
+class WorkerPool
+{
+  protected:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable job_available;
+	std::condition_variable all_done;
+	int num_running;
+	bool shutting_down;
+
+	virtual void WorkerLoop();
+
+  public:
+	static int DefaultNumThreads();
+	static bool IsWorkerThread();
+	static WorkerPool *Shared();
+	static void SetSharedThreads(int num_threads);
+
+	WorkerPool(int num_threads = 0);
+	virtual ~WorkerPool();
+	virtual int NumThreads() { return workers.size(); }
+	virtual int NumPending();
+	virtual void Add(std::function<void()> job);
+	virtual void Wait();
+	virtual void Run(int num_jobs, std::function<void(int)> job);
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -28,6 +28,9 @@
 #include "lpathsdata.h"
 #include "affinevalue.h"
 #include "bboxvalue.h"
+#include "spatialindex.h"
+
+#include <string>
 
 
 #include <lax/debug.h>
@@ -212,6 +215,8 @@ DrawableObject::DrawableObject()
 	importer_data = nullptr;
 
 	metadata = nullptr;
+
+	kids_index = nullptr;
 }
 
 /*! Will detach this object from any object chain. It is assumed that other objects in
@@ -232,6 +237,8 @@ DrawableObject::~DrawableObject()
 	if (chains.n)   chains.flush();
 
 	if (parent_link) delete parent_link; //don't delete parent itself.. that is a one way reference
+
+	delete kids_index;
 }
 
 int DrawableObject::Selectable()
@@ -943,6 +950,16 @@ LaxInterfaces::SomeData *DrawableObject::FindObject(const char *id)
 	if (!id || !Id()) return nullptr;
 	if (!strcmp(Id(), id)) return this;
 
+	 //use the project's id index when current, checking the hit is actually under this
+	if (laidout && laidout->project && laidout->project->objectindex.IsBuilt()) {
+		SomeData *obj = laidout->project->objectindex.Find(id);
+		if (obj) {
+			for (SomeData *p = obj->GetParent(); p; p = p->GetParent()) {
+				if (p == this) return obj;
+			}
+		}
+	}
+
 	for (int c=0; c<n(); c++) {
 		SomeData *obj = e(c);
 		if (!strcmp(obj->Id(), id)) return obj;
@@ -984,6 +1001,49 @@ DrawableObject *DrawableObject::GetDrawableParent()
 	return dynamic_cast<DrawableObject*>(GetParent());
 }
 
+/*! Fill ret with the indices of kids that might touch box, which is in this object's
+ * coordinate space, in increasing order. For groups with many kids, this uses
+ * kids_index, which is created and brought up to date as necessary.
+ * See SpatialIndex::Update() for when kids are looked at again.
+ *
+ * Only call from the main thread, or on copies no other thread is using. Returns ret.n.
+ */
+int DrawableObject::KidsInBox(const DoubleBBox &box, NumStack<int> &ret)
+{
+	if (kids.n < SpatialIndex::MinKids) {
+		ret.flush();
+		for (int c=0; c<kids.n; c++) ret.push(c);
+		return ret.n;
+	}
+
+	if (!kids_index) kids_index = new SpatialIndex;
+	kids_index->Update(this);
+	return kids_index->Query(box, ret);
+}
+
+/*! Make kids_index look at all kids again next time it is used, for when kids have changed
+ * without being touched, such as when moved. If recurse, do the same for kids' kids.
+ */
+void DrawableObject::InvalidateKidsIndex(bool recurse)
+{
+	if (kids_index) kids_index->Invalidate();
+	if (!recurse) return;
+
+	for (int c=0; c<kids.n; c++) {
+		DrawableObject *kid = dynamic_cast<DrawableObject*>(kids.e[c]);
+		if (kid && kid->n()) kid->InvalidateKidsIndex(true);
+	}
+}
+
+/*! Quick reject test for picking, using whatever kids_index last knew.
+ * Returns false only if kid index definitely does not touch box, which is in this object's coordinate space.
+ */
+bool DrawableObject::KidMayIntersect(int index, const DoubleBBox &box)
+{
+	if (!kids_index || index < 0 || index >= kids.n) return true;
+	return kids_index->MayIntersect(index, kids.e[index], box);
+}
+
 //! Take all the elements in the list which, and put them in a new group at the smallest index.
 /*! If any of which are not in kids, then nothing is changed. If ne<=0 then the which list
  * is assumed to be terminated by a -1.
@@ -1030,8 +1090,15 @@ int DrawableObject::UnGroup(int n,const int *which)
 const char *DrawableObject::Id()
 { return SomeData::Id(); }
 
+/*! Also renames this in the project's object id index, if it is indexed there.
+ */
 const char *DrawableObject::Id(const char *newid)
-{ return SomeData::Id(newid); }
+{
+	std::string oldid = (SomeData::Id() ? SomeData::Id() : "");
+	const char *id = SomeData::Id(newid);
+	if (laidout && laidout->project) laidout->project->ObjectRenamed(this, oldid.c_str());
+	return id;
+}
 
 /*! Hook to deal with circular references with filter.
  */
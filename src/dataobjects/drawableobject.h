@@ -36,6 +36,7 @@ namespace Laidout {
 
 class StreamAttachment;
 class DrawableObject;
+class SpatialIndex;
 class PointAnchor;
 class Document;
 class Page;
@@ -260,6 +261,11 @@ class DrawableObject :  virtual public ObjectContainer,
 	//virtual LaxInterfaces::SomeData *getObject(FieldPlace &place,int offset=0);
 	//virtual int nextObject(FieldPlace &place, FieldPlace &first, int curlevel, LaxInterfaces::SomeData **d=NULL);
 
+	SpatialIndex *kids_index; //built on demand by KidsInBox()
+	virtual int KidsInBox(const Laxkit::DoubleBBox &box, Laxkit::NumStack<int> &ret);
+	virtual bool KidMayIntersect(int index, const Laxkit::DoubleBBox &box);
+	virtual void InvalidateKidsIndex(bool recurse);
+
 	virtual int GroupObjs(int n, int *which, int *newgroupindex);
 	virtual int UnGroup(int which);
 	virtual int UnGroup(int n,const int *which);
@@ -19,6 +19,7 @@
 #include "epsdata.h"
 #include "../laidout.h"
 #include "../printing/epsutils.h"
+#include "../core/utils.h"
 #include "../configured.h"
 #include "../language.h"
 
@@ -187,10 +188,10 @@ int EpsData::LoadImage(const char *fname, const char *npreview, int maxpw, int m
 	makestr(previewfile,npreview);
 
 	 // puts the eps BoundingBox into this::DoubleBBox
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	c = scaninEPS(f,this,&title,&creationdate,&preview,&depth,&width,&height);
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	
 	if (c != 0) return -2;
 	
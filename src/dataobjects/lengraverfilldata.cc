@@ -15,6 +15,7 @@
 
 #include <lax/interfaces/somedatafactory.h>
 #include "lengraverfilldata.h"
+#include "limagepatch.h"
 #include "../core/stylemanager.h"
 #include "../language.h"
 
@@ -173,6 +174,10 @@ Laxkit::Attribute *LEngraverFillData::dump_out_atts(Laxkit::Attribute *att,int w
 	att = DrawableObject::dump_out_atts(att, what,context);
 	Laxkit::Attribute *att2 = att->pushSubAtt("config");
 	EngraverFillData::dump_out_atts(att2, what,context);
+
+	 //binary files get the mesh points as raw numbers
+	Laxkit::Attribute *mesh = (what != -1 ? att2->find("mesh") : nullptr);
+	if (mesh) PutPatchNumbers(this, mesh, context);
 	return att;
 }
 
@@ -185,7 +190,12 @@ void LEngraverFillData::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::Dum
 	for (int c=0; c<att->attributes.n; c++) {
 		if (!strcmp(att->attributes.e[c]->name,"config")) {
 			foundconfig=1;
+			long n = 0;
+			const double *d = nullptr;
+			Laxkit::Attribute *mesh = att->attributes.e[c]->find("mesh");
+			if (mesh) d = TakePatchNumbers(mesh, context, &n);
 			EngraverFillData::dump_in_atts(att->attributes.e[c],flag,context);
+			SetPatchNumbers(this, d, n);
 		}
 	}
 	if (!foundconfig) EngraverFillData::dump_in_atts(att,flag,context);
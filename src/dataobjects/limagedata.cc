@@ -34,12 +34,16 @@ LImageData::LImageData(LaxInterfaces::SomeData *refobj)
 {
 	//importer=NULL;
 	//sourcefile=NULL;
+	pending_file = nullptr;
+	pending_preview = nullptr;
 }
 
 LImageData::~LImageData()
 {
 	//if (importer) importer->dec_count();
 	//if (sourcefile) delete[] sourcefile;
+	delete[] pending_file;
+	delete[] pending_preview;
 }
 
 	
@@ -73,6 +77,19 @@ Laxkit::Attribute *LImageData::dump_out_atts(Laxkit::Attribute *att,int what,Lax
 	att = DrawableObject::dump_out_atts(att, what,context);
 	Laxkit::Attribute *att2 = att->pushSubAtt("config");
 	ImageData::dump_out_atts(att2, what,context);
+
+	 //still being read in the background, so save the file it will have
+	if (!image && pending_file && what != -1) {
+		Laxkit::Attribute *fatt = att2->find("filename");
+		if (fatt) makestr(fatt->value, pending_file);
+		else att2->push("filename", pending_file);
+
+		if (pending_preview) {
+			fatt = att2->find("previewfile");
+			if (fatt) makestr(fatt->value, pending_preview);
+			else att2->push("previewfile", pending_preview);
+		}
+	}
 	return att;
 }
 
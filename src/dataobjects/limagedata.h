@@ -32,6 +32,9 @@ class LImageData : public DrawableObject,
 	//char *sourcefile;
 	//RefPtrStack<TextObject> sourcetext;
 
+	char *pending_file; //what ImageImportQueue is still reading in, saved in place of the image
+	char *pending_preview;
+
 	LImageData(LaxInterfaces::SomeData *refobj=NULL);
 	virtual ~LImageData();
 	virtual const char *whattype() { return "ImageData"; }
@@ -19,6 +19,9 @@
 #include "../language.h"
 #include "../core/stylemanager.h"
 #include "../calculator/shortcuttodef.h"
+#include "../core/binaryattribute.h"
+
+#include <vector>
 
 #include <iostream>
 using namespace std;
@@ -32,6 +35,96 @@ namespace Laidout {
 
 
 
+//------------------------------- binary file helpers ---------------------------------------
+
+/*! For binary files. Replace the "points" text that PatchData::dump_out_atts() put in att with
+ * raw numbers in context: xsize, ysize, number of colors, then x,y of each point, then for color
+ * patches, red, green, blue, alpha of each corner color. Does nothing unless context is a
+ * BinaryDumpContext.
+ */
+void PutPatchNumbers(LaxInterfaces::PatchData *patch, Laxkit::Attribute *att, Laxkit::DumpContext *context)
+{
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	if (!bcontext || !patch->points) return;
+	Attribute *patt = att->find("points");
+	if (!patt) return;
+
+	int np = patch->xsize * patch->ysize;
+	ColorPatchData *cpatch = dynamic_cast<ColorPatchData*>(patch);
+	int ncolors = (cpatch && cpatch->colors ? (patch->xsize/3+1) * (patch->ysize/3+1) : 0);
+
+	std::vector<double> d;
+	d.reserve(3 + 2*np + 4*ncolors);
+	d.push_back(patch->xsize);
+	d.push_back(patch->ysize);
+	d.push_back(ncolors);
+	for (int c=0; c<np; c++) {
+		d.push_back(patch->points[c].x);
+		d.push_back(patch->points[c].y);
+	}
+	for (int c=0; c<ncolors; c++) {
+		d.push_back(cpatch->colors[c].red);
+		d.push_back(cpatch->colors[c].green);
+		d.push_back(cpatch->colors[c].blue);
+		d.push_back(cpatch->colors[c].alpha);
+	}
+	bcontext->PutNumbers(patt, d.data(), d.size());
+}
+
+/*! For binary files. If att has "points" from PutPatchNumbers(), remove them from att, so
+ * PatchData::dump_in_atts() never sees them, and return the numbers for SetPatchNumbers().
+ * Otherwise return null.
+ */
+const double *TakePatchNumbers(Laxkit::Attribute *att, Laxkit::DumpContext *context, long *n_ret)
+{
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	if (!bcontext) return nullptr;
+	int i = -1;
+	Attribute *patt = att->find("points", &i);
+	if (!patt) return nullptr;
+
+	const double *d = bcontext->GetNumbers(patt->value, n_ret);
+	if (d) att->remove(i);
+	return d;
+}
+
+/*! Install numbers from TakePatchNumbers(), after the rest of patch is read in.
+ */
+void SetPatchNumbers(LaxInterfaces::PatchData *patch, const double *d, long n)
+{
+	if (!d || n < 3) return;
+	int xsize = d[0], ysize = d[1], ncolors = d[2];
+	int np = xsize * ysize;
+	if (xsize < 4 || ysize < 4 || ncolors < 0 || n < 3 + 2*(long)np + 4*(long)ncolors) return;
+	d += 3;
+
+	delete[] patch->points;
+	patch->points = new flatpoint[np];
+	patch->xsize = xsize;
+	patch->ysize = ysize;
+	for (int c=0; c<np; c++) {
+		patch->points[c].x = d[2*c];
+		patch->points[c].y = d[2*c+1];
+	}
+	d += 2*np;
+
+	ColorPatchData *cpatch = dynamic_cast<ColorPatchData*>(patch);
+	if (cpatch && ncolors == (xsize/3+1) * (ysize/3+1)) {
+		delete[] cpatch->colors;
+		cpatch->colors = new ScreenColor[ncolors];
+		for (int c=0; c<ncolors; c++) {
+			cpatch->colors[c].red   = d[4*c];
+			cpatch->colors[c].green = d[4*c+1];
+			cpatch->colors[c].blue  = d[4*c+2];
+			cpatch->colors[c].alpha = d[4*c+3];
+		}
+	}
+
+	patch->FindBBox();
+	patch->touchContents();
+}
+
+
 //------------------------------- LImagePatchData ---------------------------------------
 /*! \class LImagePatchData 
  * \brief Subclassing LaxInterfaces::ImagePatchData
@@ -80,6 +173,7 @@ Laxkit::Attribute *LImagePatchData::dump_out_atts(Laxkit::Attribute *att,int wha
 	att = DrawableObject::dump_out_atts(att, what,context);
 	Laxkit::Attribute *att2 = att->pushSubAtt("config");
 	ImagePatchData::dump_out_atts(att2, what,context);
+	if (what != -1) PutPatchNumbers(this, att2, context);
 	return att;
 }
 
@@ -90,7 +184,10 @@ void LImagePatchData::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpC
 	for (int c=0; c<att->attributes.n; c++) {
 		if (!strcmp(att->attributes.e[c]->name,"config")) {
 			foundconfig=1;
+			long n = 0;
+			const double *d = TakePatchNumbers(att->attributes.e[c], context, &n);
 			ImagePatchData::dump_in_atts(att->attributes.e[c],flag,context);
+			SetPatchNumbers(this, d, n);
 		}
 	}
 	if (!foundconfig) ImagePatchData::dump_in_atts(att,flag,context);
@@ -228,6 +325,7 @@ Laxkit::Attribute *LColorPatchData::dump_out_atts(Laxkit::Attribute *att,int wha
 	att = DrawableObject::dump_out_atts(att, what,context);
 	Laxkit::Attribute *att2 = att->pushSubAtt("config");
 	ColorPatchData::dump_out_atts(att2, what,context);
+	if (what != -1) PutPatchNumbers(this, att2, context);
 	return att;
 }
 
@@ -238,7 +336,10 @@ void LColorPatchData::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpC
 	for (int c=0; c<att->attributes.n; c++) {
 		if (!strcmp(att->attributes.e[c]->name,"config")) {
 			foundconfig=1;
+			long n = 0;
+			const double *d = TakePatchNumbers(att->attributes.e[c], context, &n);
 			ColorPatchData::dump_in_atts(att->attributes.e[c],flag,context);
+			SetPatchNumbers(this, d, n);
 		}
 	}
 	if (!foundconfig) ColorPatchData::dump_in_atts(att,flag,context);
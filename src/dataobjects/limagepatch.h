@@ -78,6 +78,13 @@ class LColorPatchData : public DrawableObject,
 
 
 
+//------------------------------- binary file helpers ---------------------------------------
+
+void PutPatchNumbers(LaxInterfaces::PatchData *patch, Laxkit::Attribute *att, Laxkit::DumpContext *context);
+const double *TakePatchNumbers(Laxkit::Attribute *att, Laxkit::DumpContext *context, long *n_ret);
+void SetPatchNumbers(LaxInterfaces::PatchData *patch, const double *d, long n);
+
+
 //------------------------------- LImagePatchInterface ---------------------------------------
 class LImagePatchInterface : public LaxInterfaces::ImagePatchInterface,
 							 public Value
@@ -21,6 +21,9 @@
 #include "helpertypes.h"
 #include "affinevalue.h"
 #include "objectfilter.h"
+#include "../core/binaryattribute.h"
+
+#include <vector>
 
 
 using namespace Laxkit;
@@ -94,14 +97,94 @@ void LPathsData::dump_out(FILE *f,int indent,int what,Laxkit::DumpContext *conte
 	// PathsData::dump_out(f,indent+2,what,context);
 }
 
+/*! For binary files, the "points" of each "path" in config are replaced with raw numbers:
+ * 1 if closed or 0, then x, y, and flags of each point. The outline "cache" is dropped,
+ * as it is rebuilt from the points. Paths with segment controls stay as text.
+ */
+static void PutPathNumbers(LaxInterfaces::PathsData *paths, Attribute *config, BinaryDumpContext *context)
+{
+	std::vector<double> d;
+	int pathi = 0;
+
+	for (int c=0; c<config->attributes.n && pathi < paths->paths.n; c++) {
+		Attribute *patt = config->attributes.e[c];
+		if (strcmp(patt->name, "path")) continue;
+		LaxInterfaces::Path *path = paths->paths.e[pathi++];
+
+		int i = -1;
+		Attribute *points = patt->find("points", &i);
+		if (!points || !path->path) continue;
+
+		d.clear();
+		d.push_back(0);
+		LaxInterfaces::Coordinate *start = path->path, *p = start;
+		do {
+			if (p->controls) break;
+			d.push_back(p->fp.x);
+			d.push_back(p->fp.y);
+			d.push_back(p->flags);
+			p = p->next;
+		} while (p && p != start);
+		if (p && p != start) continue; //has controls
+		if (p == start) d[0] = 1;
+
+		context->PutNumbers(points, d.data(), d.size());
+		if (patt->find("cache", &i)) patt->remove(i);
+	}
+}
+
 Laxkit::Attribute *LPathsData::dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context)
 {
 	att = DrawableObject::dump_out_atts(att, what,context);
 	Laxkit::Attribute *att2 = att->pushSubAtt("config");
 	PathsData::dump_out_atts(att2, what,context);
+
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	if (bcontext && what != -1) PutPathNumbers(this, att2, bcontext);
 	return att;
 }
 
+/*! Read config. For binary files, point numbers from PutPathNumbers() are taken out of config
+ * first, then appended to each path after PathsData::dump_in_atts() has made them.
+ */
+static void ReadPathsConfig(LaxInterfaces::PathsData *paths, Attribute *config, int flag, DumpContext *context)
+{
+	struct PathNumbers { int path; const double *d; long n; };
+	std::vector<PathNumbers> numbers;
+
+	BinaryDumpContext *bcontext = dynamic_cast<BinaryDumpContext*>(context);
+	if (bcontext) {
+		int pathi = 0;
+		for (int c=0; c<config->attributes.n; c++) {
+			Attribute *patt = config->attributes.e[c];
+			if (strcmp(patt->name, "path")) continue;
+
+			int i = -1;
+			Attribute *points = patt->find("points", &i);
+			long n = 0;
+			const double *d = (points ? bcontext->GetNumbers(points->value, &n) : nullptr);
+			if (d) {
+				numbers.push_back({ pathi, d, n });
+				patt->remove(i);
+			}
+			pathi++;
+		}
+	}
+
+	paths->LaxInterfaces::PathsData::dump_in_atts(config, flag, context);
+	if (numbers.empty()) return;
+
+	for (PathNumbers &nums : numbers) {
+		if (nums.path >= paths->paths.n || nums.n < 1) continue;
+		LaxInterfaces::Path *path = paths->paths.e[nums.path];
+		for (long c=1; c+2 < nums.n; c+=3) {
+			path->append(nums.d[c], nums.d[c+1], (unsigned long)nums.d[c+2]);
+		}
+		if (nums.d[0]) path->close();
+	}
+	paths->FindBBox();
+}
+
 void LPathsData::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context)
 {
 	DrawableObject::dump_in_atts(att,flag,context);
@@ -109,7 +192,7 @@ void LPathsData::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContex
 	for (int c=0; c<att->attributes.n; c++) {
 		if (!strcmp(att->attributes.e[c]->name,"config")) {
 			foundconfig=1;
-			PathsData::dump_in_atts(att->attributes.e[c],flag,context);
+			ReadPathsConfig(this, att->attributes.e[c], flag, context);
 		}
 	}
 	if (!foundconfig) PathsData::dump_in_atts(att,flag,context);
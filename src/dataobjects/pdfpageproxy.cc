@@ -12,11 +12,29 @@
 // Copyright (C) 2025 by Tom Lechner
 //
 
+#include <lax/fileutils.h>
+#include <lax/laximages.h>
+#include <lax/strmanip.h>
+
 #include "pdfpageproxy.h"
+#include "../core/workerpool.h"
+#include "../laidout.h"
+#include "../version.h"
+
+#include <openssl/evp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
 
+#include <iostream>
+#define DBG
 
 using namespace Laxkit;
 using namespace LaxInterfaces;
+using namespace std;
 
 
 namespace Laidout {
@@ -24,21 +42,29 @@ namespace Laidout {
 
 //------------------------- PdfPageProxy -----------------------------
 
+/*! \class PdfPageProxy
+ * Stands in for page pdf_page of pdf_file. The preview is not rendered until the proxy is
+ * first drawn, when DrawData() asks PdfPreviewCache::Shared() for it.
+ */
+
 
 PdfPageProxy::PdfPageProxy()
 {}
 
+/*! The bounds are set from style, in points, so nothing is rendered here.
+ */
 PdfPageProxy::PdfPageProxy(const char *file, int i, PaperStyle *style, int preview_size)
  : LImageData()
 {
-	// index = i;
+	pdf_page = i;
 	paperstyle = style;
 	if (paperstyle) paperstyle->inc_count();
 	if (preview_size > 0) preview_max_px = preview_size;
 
-	if (file) {
-		pdf_file = file;
-		LoadPreviewed(file, i, preview_max_px, nullptr, false); //sets maxx,miny to pixel size of full image
+	if (file) pdf_file = file;
+	if (paperstyle) {
+		minx = 0;  maxx = paperstyle->w() * 72;
+		miny = 0;  maxy = paperstyle->h() * 72;
 	}
 
 	if (paperstyle && maxx > minx && maxy > miny) {
@@ -57,11 +83,30 @@ PdfPageProxy::~PdfPageProxy()
 	if (paperstyle) paperstyle->dec_count();
 }
 
+/*! Use preview for drawing. Increments its count.
+ * If there are no bounds yet, they are set to the preview size.
+ */
+void PdfPageProxy::InstallPreview(Laxkit::LaxImage *preview)
+{
+	if (preview == previewimage) return;
+	if (previewimage) previewimage->dec_count();
+	previewimage = preview;
+	if (!preview) return;
+
+	preview->inc_count();
+	if (maxx <= minx || maxy <= miny) {
+		minx = 0;  maxx = preview->w();
+		miny = 0;  maxy = preview->h();
+	}
+	touchContents();
+}
+
 Laxkit::Attribute *PdfPageProxy::dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context)
 {
 	if (what == -1) {
 		if (!att) att = new Attribute();
 		att->push("pdf_file", "path_to_pdf_file.pdf");
+		att->push("pdf_page", "0", "Index of the page in pdf_file, starting at 0");
 		att->push("preview_max_px", "256", "Render previews to fit in a box this wide and tall");
 		att->push("paperstyle", nullptr, "Further information from the original pdf page");
 		return LImageData::dump_out_atts(att, what, context);
@@ -69,6 +114,7 @@ Laxkit::Attribute *PdfPageProxy::dump_out_atts(Laxkit::Attribute *att,int what,L
 
 	if (!att) att = new Attribute();
 	att->push("pdf_file", pdf_file.c_str());
+	att->push("pdf_page", pdf_page);
 	att->push("preview_max_px", preview_max_px);
 	if (paperstyle) {
 		Attribute *att2 = att->pushSubAtt("paperstyle");
@@ -87,6 +133,11 @@ void PdfPageProxy::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpCont
 		if (!strcmp(name, "pdf_file")) {
 			pdf_file = value;
 
+		} else if (!strcmp(name, "pdf_page")) {
+			int i = -1;
+			IntAttribute(value, &i, nullptr);
+			if (i >= 0) pdf_page = i;
+
 		} else if (!strcmp(name, "preview_max_px")) {
 			int i = -1;
 			IntAttribute(value, &i, nullptr);
@@ -103,4 +154,263 @@ void PdfPageProxy::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpCont
 	LImageData::dump_in_atts(att, flag, context);
 }
 
+
+//------------------------- PdfPreviewCache -----------------------------
+
+/*! \class PdfPreviewCache
+ * Renders previews of PdfPageProxy pages on WorkerPool::Shared() threads, and keeps them on
+ * disk keyed by pdf path, modification time, page and preview size, so importing the same
+ * pdf again, or reopening a document using it, does not render them again.
+ *
+ * Request() and Collect() must only be called from the main thread.
+ * Drawing on the main thread requests previews as needed. Anything rendering off screen,
+ * like exporting or page thumbnails, should RequestAll() then Finish() first.
+ */
+
+
+/*! What to render, and the result. Only result is touched on a worker thread.
+ */
+class PdfPreviewCache::PreviewJob
+{
+  public:
+	PdfPageProxy *proxy;
+	char *file;
+	int page;
+	int max_px;
+	char *cache_file;
+	LaxImage *result;
+
+	PreviewJob(PdfPageProxy *nproxy)
+	{
+		proxy = nproxy;
+		proxy->inc_count();
+		file = newstr(proxy->pdf_file.c_str());
+		page = proxy->pdf_page;
+		max_px = proxy->preview_max_px;
+		cache_file = nullptr;
+		result = nullptr;
+	}
+
+	~PreviewJob()
+	{
+		proxy->dec_count();
+		delete[] file;
+		delete[] cache_file;
+		if (result) result->dec_count();
+	}
+};
+
+
+static PdfPreviewCache *shared_pdfpreviews = nullptr;
+
+/*! Return a process wide preview cache. This is never deleted before exit.
+ * Only call from the main thread.
+ */
+PdfPreviewCache *PdfPreviewCache::Shared()
+{
+	if (!shared_pdfpreviews) shared_pdfpreviews = new PdfPreviewCache;
+	return shared_pdfpreviews;
+}
+
+/*! Default cache dir is "$XDG_CACHE_HOME/laidout/(version)/pdfpreviews/", with XDG_CACHE_HOME
+ * defaulting to "~/.cache".
+ */
+PdfPreviewCache::PdfPreviewCache()
+{
+	cache_dir = nullptr;
+
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	char *dir = nullptr;
+	if (xdg && *xdg) dir = newstr(xdg);
+	else {
+		dir = newstr(getenv("HOME"));
+		appendstr(dir, "/.cache");
+	}
+	appendstr(dir, "/laidout/");
+	appendstr(dir, LAIDOUT_VERSION);
+	appendstr(dir, "/pdfpreviews/");
+	CacheDir(dir);
+	delete[] dir;
+}
+
+/*! Waits for any of our own running jobs first, since they refer to this.
+ */
+PdfPreviewCache::~PdfPreviewCache()
+{
+	Finish();
+	delete[] cache_dir;
+}
+
+/*! Set where previews are cached on disk, creating the directory if necessary.
+ * If dir is null, or it cannot be created, then previews are not cached on disk.
+ */
+void PdfPreviewCache::CacheDir(const char *dir)
+{
+	makestr(cache_dir, dir);
+	if (cache_dir && check_dirs(cache_dir, true) != -1) {
+		DBG cerr << " *** warning: could not create pdf preview cache dir "<<cache_dir<<endl;
+		makestr(cache_dir, nullptr);
+	}
+}
+
+/*! Return new char[] of the cache file name for the given page, or null if not caching to disk
+ * or file cannot be read.
+ */
+char *PdfPreviewCache::CacheFile(const char *file, int page, int max_px)
+{
+	if (!cache_dir || !file) return nullptr;
+
+	struct stat info;
+	if (stat(file, &info) != 0) return nullptr;
+
+	char *path = realpath(file, nullptr);
+	char *key = newstr(path ? path : file);
+	if (path) free(path);
+	char scratch[100];
+	sprintf(scratch, "\n%ld.%09ld\n%d\n%d", (long)info.st_mtim.tv_sec, (long)info.st_mtim.tv_nsec, page, max_px);
+	appendstr(key, scratch);
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestlen = 0;
+	EVP_Digest(key, strlen(key), digest, &digestlen, EVP_md5(), nullptr);
+	delete[] key;
+
+	char *cfile = newstr(cache_dir);
+	if (cfile[strlen(cfile)-1] != '/') appendstr(cfile, "/");
+	for (unsigned int c=0; c<digestlen; c++) {
+		sprintf(scratch, "%02x", digest[c]);
+		appendstr(cfile, scratch);
+	}
+	appendstr(cfile, ".png");
+	return cfile;
+}
+
+/*! Make sure proxy's preview is installed, or on its way.
+ * Return 1 if proxy already has a preview, 0 if a job is pending, or -1 if there is nothing to render.
+ */
+int PdfPreviewCache::Request(PdfPageProxy *proxy)
+{
+	if (!proxy) return -1;
+	if (proxy->GetPreview()) return 1;
+	if (proxy->preview_failed || isblank(proxy->pdf_file.c_str())) return -1;
+
+	for (int c=0; c<pending.n; c++) {
+		if (pending.e[c]->proxy == proxy) return 0;
+	}
+
+	PreviewJob *job = new PreviewJob(proxy);
+	job->cache_file = CacheFile(job->file, job->page, job->max_px);
+	pending.push(job);
+
+	if (!laidout || laidout->runmode != RUNMODE_Normal) {
+		RunJob(job);
+		Collect();
+		return proxy->GetPreview() ? 1 : -1;
+	}
+
+	WorkerPool::Shared()->Add([this, job]() { RunJob(job); });
+	laidout->BackgroundImportsStarted();
+	return 0;
+}
+
+/*! Request() previews for any PdfPageProxy in data, or anything it contains.
+ * Returns the number of previews still pending from these requests. Call Finish()
+ * to wait for them, for instance before rendering somewhere other than the screen.
+ */
+int PdfPreviewCache::RequestAll(LaxInterfaces::SomeData *data)
+{
+	if (!data) return 0;
+
+	SomeDataRef *ref = dynamic_cast<SomeDataRef*>(data);
+	if (ref) return RequestAll(ref->thedata);
+
+	PdfPageProxy *proxy = dynamic_cast<PdfPageProxy*>(data);
+	if (proxy) return Request(proxy) == 0 ? 1 : 0;
+
+	int n = 0;
+	DrawableObject *dobj = dynamic_cast<DrawableObject*>(data);
+	if (dobj) {
+		for (int c=0; c<dobj->n(); c++) n += RequestAll(dobj->e(c));
+	}
+	return n;
+}
+
+/*! Called on a worker thread. Load the preview from the disk cache, or render it
+ * and save to the cache. Then pass it back for Collect().
+ */
+void PdfPreviewCache::RunJob(PreviewJob *job)
+{
+	if (job->cache_file && file_exists(job->cache_file, 1, nullptr) == S_IFREG) {
+		job->result = ImageLoader::LoadImage(job->cache_file);
+	}
+
+	if (!job->result) {
+		 //render with a throwaway proxy that nothing else sees
+		PdfPageProxy renderer;
+		renderer.LoadPreviewed(job->file, job->page, job->max_px, nullptr, false);
+		job->result = renderer.GetPreview();
+		if (job->result) job->result->inc_count();
+
+		if (job->result && job->cache_file) {
+			 //write to a temp file first, so other instances never see a partial png
+			char *tmp = newstr(job->cache_file);
+			char scratch[30];
+			sprintf(scratch, ".%lx.tmp", (unsigned long)(size_t)job);
+			appendstr(tmp, scratch);
+			if (job->result->Save(tmp, "png") == 0) rename(tmp, job->cache_file);
+			else unlink(tmp);
+			delete[] tmp;
+		}
+	}
+
+	 //notify while locked, since Finish() may return, and the cache go away, as soon as it sees the job
+	std::lock_guard<std::mutex> lock(mutex);
+	finished.push_back(job);
+	job_finished.notify_all();
+}
+
+/*! Install finished previews into their proxies. Must be called from the main thread.
+ * Results for proxies that were pointed elsewhere since the request are discarded.
+ * Returns the number of previews installed.
+ */
+int PdfPreviewCache::Collect()
+{
+	std::deque<PreviewJob*> done;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done.swap(finished);
+	}
+
+	int n = 0;
+	for (PreviewJob *job : done) {
+		PdfPageProxy *proxy = job->proxy;
+		if (proxy->pdf_page == job->page && proxy->preview_max_px == job->max_px && !strcmp(proxy->pdf_file.c_str(), job->file)) {
+			if (job->result) {
+				proxy->InstallPreview(job->result);
+				n++;
+			} else {
+				DBG cerr << "Could not render preview of page "<<job->page<<" of "<<job->file<<endl;
+				proxy->preview_failed = true;
+			}
+		}
+		pending.remove(pending.findindex(job)); //deletes job
+	}
+
+	return n;
+}
+
+/*! Wait for all pending previews, and install them. Only this cache's own jobs are waited on,
+ * not everything else in WorkerPool::Shared(). Must be called from the main thread.
+ */
+void PdfPreviewCache::Finish()
+{
+	if (!pending.n) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_finished.wait(lock, [this] { return (int)finished.size() >= pending.n; });
+	}
+	Collect();
+}
+
+
 } // namespace Laidout
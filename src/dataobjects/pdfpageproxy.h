@@ -11,10 +11,16 @@
 //
 // Copyright (C) 2025 by Tom Lechner
 //
+#ifndef PDFPAGEPROXY_H
+#define PDFPAGEPROXY_H
 
 #include "limagedata.h"
 #include "../core/papersizes.h"
 
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 
 namespace Laidout {
 
@@ -26,7 +32,9 @@ class PdfPageProxy : public LImageData
 {
   public:
   	Laxkit::Utf8String pdf_file;
+  	int pdf_page = 0;
   	int preview_max_px = 256;
+  	bool preview_failed = false;
   	PaperStyle *paperstyle = nullptr;
 
   	PdfPageProxy();
@@ -34,10 +42,46 @@ class PdfPageProxy : public LImageData
   	virtual ~PdfPageProxy();
   	virtual const char *whattype() { return "PdfPageProxy"; }
   	virtual Laxkit::LaxImage *GetPreview() { return previewimage; }
+  	virtual void InstallPreview(Laxkit::LaxImage *preview);
 	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context);
 	virtual void dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
 
 };
 
 
+//------------------------- PdfPreviewCache -----------------------------
+
+class PdfPreviewCache
+{
+  protected:
+	class PreviewJob;
+
+	Laxkit::PtrStack<PreviewJob> pending; //only touched on the main thread
+	std::deque<PreviewJob*> finished;     //guarded by mutex
+	std::mutex mutex;
+	std::condition_variable job_finished;
+	char *cache_dir;
+
+	virtual void RunJob(PreviewJob *job);
+	virtual char *CacheFile(const char *file, int page, int max_px);
+
+  public:
+	static PdfPreviewCache *Shared();
+
+	PdfPreviewCache();
+	virtual ~PdfPreviewCache();
+
+	virtual const char *CacheDir() { return cache_dir; }
+	virtual void CacheDir(const char *dir);
+
+	virtual int Request(PdfPageProxy *proxy);
+	virtual int RequestAll(LaxInterfaces::SomeData *data);
+	virtual int Collect();
+	virtual void Finish();
+	virtual int NumPending() { return pending.n; }
+};
+
+
 } // namespace Laidout
+
+#endif
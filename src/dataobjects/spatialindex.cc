@@ -0,0 +1,326 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/interfaces/pathinterface.h>
+
+#include "spatialindex.h"
+#include "drawableobject.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- SpatialIndex ---------------------------------------
+
+/*! \class SpatialIndex
+ * Uniform grid over the bounds of the kids of a DrawableObject, so that drawing and
+ * picking only need to look at kids near some area, instead of all of them.
+ *
+ * Only leaf objects with valid bounds and no filter are put in the grid. Groups,
+ * filtered objects, and anything else whose drawn extent is not simply its transformed
+ * bounding box are always returned as candidates. Bounds are padded a little, so strokes
+ * and small changes that don't touch the bounding box are still covered.
+ *
+ * Touching a kid also touches its parents, so Update() only looks at kids again when the
+ * group's modtime has changed since last time, or Invalidate() was called for changes that
+ * don't touch, such as moving objects around. Then it compares each kid against what was
+ * captured for it, and only re-bins the ones that moved. If the number or order of kids
+ * changed, the whole grid is rebuilt. Kids being edited should be drawn without culling,
+ * since they may change before anything is touched.
+ *
+ * Not thread safe. This is meant for on screen drawing from the main thread, or for
+ * drawing copies of objects that only one thread uses.
+ */
+
+
+/*! Groups with fewer kids than this are not worth indexing. See DrawableObject::KidsInBox().
+ */
+int SpatialIndex::MinKids = 32;
+
+
+SpatialIndex::SpatialIndex()
+{
+	cells = nullptr;
+	cols = rows = 0;
+	cellw = cellh = 1;
+	stamp = 0;
+	group_modtime = 0;
+	dirty = true;
+}
+
+SpatialIndex::~SpatialIndex()
+{
+	delete[] cells;
+}
+
+/*! Return whether obj's transform or bounds differ from what is in entry.
+ */
+bool SpatialIndex::Changed(Entry *entry, SomeData *obj)
+{
+	const double *m = obj->m();
+	for (int c=0; c<6; c++) if (m[c] != entry->m[c]) return true;
+	if (obj->minx != entry->minx || obj->maxx != entry->maxx
+			|| obj->miny != entry->miny || obj->maxy != entry->maxy) return true;
+
+	DrawableObject *dobj = dynamic_cast<DrawableObject*>(obj);
+	bool indexable = obj->validbounds() && !(dobj && (dobj->n() || dobj->filter));
+	return indexable != entry->indexed;
+}
+
+/*! Remember obj's current state in entry, and compute its padded bounds in parent space.
+ */
+void SpatialIndex::Capture(Entry *entry, SomeData *obj)
+{
+	entry->obj = obj;
+	entry->object_id = obj->object_id;
+	memcpy(entry->m, obj->m(), 6*sizeof(double));
+	entry->minx = obj->minx;
+	entry->maxx = obj->maxx;
+	entry->miny = obj->miny;
+	entry->maxy = obj->maxy;
+
+	DrawableObject *dobj = dynamic_cast<DrawableObject*>(obj);
+	entry->indexed = obj->validbounds() && !(dobj && (dobj->n() || dobj->filter));
+	entry->box.ClearBBox();
+	if (!entry->indexed) return;
+
+	DoubleBBox bounds(obj->minx, obj->maxx, obj->miny, obj->maxy);
+	PathsData *paths = dynamic_cast<PathsData*>(obj);
+	if (paths && paths->linestyle) {
+		double w = fabs(paths->linestyle->width)/2;
+		bounds.minx -= w; bounds.maxx += w;
+		bounds.miny -= w; bounds.maxy += w;
+	}
+	entry->box.addtobounds(obj->m(), &bounds);
+
+	double pad = .1 * max(entry->box.boxwidth(), entry->box.boxheight());
+	entry->box.minx -= pad; entry->box.maxx += pad;
+	entry->box.miny -= pad; entry->box.maxy += pad;
+}
+
+/*! Put entry index into the grid cells it touches, or in the always list.
+ */
+void SpatialIndex::Bin(int index)
+{
+	Entry *entry = entries.e[index];
+	entry->cellx1 = -1;
+
+	if (!entry->indexed || !cells
+			|| entry->box.minx < extent.minx || entry->box.maxx > extent.maxx
+			|| entry->box.miny < extent.miny || entry->box.maxy > extent.maxy) {
+		always.push(index);
+		return;
+	}
+
+	int x1 = (entry->box.minx - extent.minx) / cellw;
+	int x2 = (entry->box.maxx - extent.minx) / cellw;
+	int y1 = (entry->box.miny - extent.miny) / cellh;
+	int y2 = (entry->box.maxy - extent.miny) / cellh;
+	if (x2 >= cols) x2 = cols-1;
+	if (y2 >= rows) y2 = rows-1;
+
+	 //things covering much of the grid are cheaper to just always check
+	if ((x2-x1+1) * (y2-y1+1) > (cols*rows)/4 + 1) {
+		always.push(index);
+		return;
+	}
+
+	entry->cellx1 = x1;  entry->cellx2 = x2;
+	entry->celly1 = y1;  entry->celly2 = y2;
+	for (int y=y1; y<=y2; y++) {
+		for (int x=x1; x<=x2; x++) cells[y*cols + x].push(index);
+	}
+}
+
+/*! Remove entry index from wherever Bin() put it.
+ */
+void SpatialIndex::Unbin(int index)
+{
+	Entry *entry = entries.e[index];
+	if (entry->cellx1 < 0) {
+		always.remove(always.findindex(index));
+		return;
+	}
+
+	for (int y=entry->celly1; y<=entry->celly2; y++) {
+		for (int x=entry->cellx1; x<=entry->cellx2; x++) {
+			NumStack<int> &cell = cells[y*cols + x];
+			cell.remove(cell.findindex(index));
+		}
+	}
+	entry->cellx1 = -1;
+}
+
+/*! Recapture all of group's kids, and make a new grid sized for them.
+ */
+void SpatialIndex::Rebuild(DrawableObject *group)
+{
+	entries.flush();
+	always.flush();
+	delete[] cells;
+	cells = nullptr;
+	extent.ClearBBox();
+
+	for (int c=0; c<group->n(); c++) {
+		Entry *entry = new Entry;
+		Capture(entry, group->e(c));
+		entries.push(entry);
+		if (entry->indexed) extent.addtobounds(&entry->box);
+	}
+
+	if (extent.validbounds()) {
+		 //roughly 2 objects per cell
+		int num = sqrt(entries.n / 2.);
+		if (num < 1) num = 1;
+		if (num > 64) num = 64;
+		cols = rows = num;
+		cellw = extent.boxwidth()  / cols;
+		cellh = extent.boxheight() / rows;
+		if (cellw <= 0) cellw = 1;
+		if (cellh <= 0) cellh = 1;
+		cells = new NumStack<int>[cols*rows];
+	}
+
+	for (int c=0; c<entries.n; c++) Bin(c);
+	group_modtime = group->modtime;
+	dirty = false;
+
+	DBG cerr << "SpatialIndex rebuilt for "<<group->Id()<<": "<<entries.n<<" kids, "<<cols<<'x'<<rows<<" cells, "<<always.n<<" always"<<endl;
+}
+
+/*! Bring the index up to date with group's kids. Returns the number of entries that were updated.
+ *
+ * Kids are only compared to what was captured for them when the number of kids or group->modtime
+ * has changed, or after Invalidate(). Otherwise this returns right away.
+ */
+int SpatialIndex::Update(DrawableObject *group)
+{
+	if (group->n() != entries.n) {
+		Rebuild(group);
+		return entries.n;
+	}
+
+	if (!dirty && group->modtime == group_modtime) return 0;
+	group_modtime = group->modtime;
+	dirty = false;
+
+	int changed = 0;
+	int outside = 0; //indexed entries that no longer fit in the grid
+	for (int c=0; c<entries.n; c++) {
+		Entry *entry = entries.e[c];
+		SomeData *obj = group->e(c);
+
+		if (entry->obj != obj || entry->object_id != obj->object_id) {
+			 //kids were reordered or replaced
+			Rebuild(group);
+			return entries.n;
+		}
+
+		if (Changed(entry, obj)) {
+			Unbin(c);
+			Capture(entry, obj);
+			Bin(c);
+			changed++;
+		}
+		if (entry->indexed && entry->cellx1 < 0
+				&& (entry->box.minx < extent.minx || entry->box.maxx > extent.maxx
+				 || entry->box.miny < extent.miny || entry->box.maxy > extent.maxy)) outside++;
+	}
+
+	if (outside > 8 + entries.n/8) {
+		Rebuild(group);
+		return entries.n;
+	}
+
+	return changed;
+}
+
+/*! Fill ret with indices of kids that might intersect box, in increasing order, so
+ * drawing them in that order keeps the stacking order.
+ * Update() should be called first. Returns ret.n.
+ */
+int SpatialIndex::Query(const DoubleBBox &box, NumStack<int> &ret)
+{
+	ret.flush();
+
+	stamp++;
+	if (stamp == 0) {
+		for (int c=0; c<entries.n; c++) entries.e[c]->query_stamp = 0;
+		stamp = 1;
+	}
+
+	for (int c=0; c<always.n; c++) {
+		Entry *entry = entries.e[always.e[c]];
+		if (entry->indexed && (entry->box.minx > box.maxx || entry->box.maxx < box.minx
+				|| entry->box.miny > box.maxy || entry->box.maxy < box.miny)) continue;
+		ret.push(always.e[c]);
+	}
+
+	if (cells && box.minx <= extent.maxx && box.maxx >= extent.minx
+			  && box.miny <= extent.maxy && box.maxy >= extent.miny) {
+		int x1 = (max(box.minx, extent.minx) - extent.minx) / cellw;
+		int x2 = (min(box.maxx, extent.maxx) - extent.minx) / cellw;
+		int y1 = (max(box.miny, extent.miny) - extent.miny) / cellh;
+		int y2 = (min(box.maxy, extent.maxy) - extent.miny) / cellh;
+		if (x2 >= cols) x2 = cols-1;
+		if (y2 >= rows) y2 = rows-1;
+
+		for (int y=y1; y<=y2; y++) {
+			for (int x=x1; x<=x2; x++) {
+				NumStack<int> &cell = cells[y*cols + x];
+				for (int c=0; c<cell.n; c++) {
+					Entry *entry = entries.e[cell.e[c]];
+					if (entry->query_stamp == stamp) continue;
+					entry->query_stamp = stamp;
+					if (entry->box.minx > box.maxx || entry->box.maxx < box.minx
+							|| entry->box.miny > box.maxy || entry->box.maxy < box.miny) continue;
+					ret.push(cell.e[c]);
+				}
+			}
+		}
+	}
+
+	std::sort(ret.e, ret.e + ret.n);
+	return ret.n;
+}
+
+/*! Quick reject for picking. Return false only if kid number index is known to be obj,
+ * it has not changed since last captured, and its bounds miss box. Otherwise return true.
+ */
+bool SpatialIndex::MayIntersect(int index, SomeData *obj, const DoubleBBox &box)
+{
+	if (index < 0 || index >= entries.n) return true;
+	Entry *entry = entries.e[index];
+	if (entry->obj != obj || entry->object_id != obj->object_id || !entry->indexed) return true;
+	if (Changed(entry, obj)) return true;
+
+	return !(entry->box.minx > box.maxx || entry->box.maxx < box.minx
+			|| entry->box.miny > box.maxy || entry->box.maxy < box.miny);
+}
+
+
+} //namespace Laidout
+
@@ -0,0 +1,80 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <lax/doublebbox.h>
+#include <lax/lists.h>
+#include <lax/interfaces/somedata.h>
+
+
+namespace Laidout {
+
+
+class DrawableObject;
+
+
+//------------------------------------- SpatialIndex ---------------------------------------
+
+class SpatialIndex
+{
+  protected:
+	class Entry
+	{
+	  public:
+		LaxInterfaces::SomeData *obj; //not counted, only compared against
+		unsigned long object_id;
+		double m[6];
+		double minx,maxx,miny,maxy;
+		Laxkit::DoubleBBox box; //padded bounds in parent coordinates
+		bool indexed; //false means always a candidate
+		int cellx1,celly1, cellx2,celly2; //cellx1 < 0 means in always list
+		unsigned int query_stamp;
+		Entry() { obj = nullptr; object_id = 0; indexed = false; cellx1 = -1; query_stamp = 0; }
+	};
+
+	Laxkit::PtrStack<Entry> entries;
+	Laxkit::NumStack<int> always;
+	Laxkit::NumStack<int> *cells;
+	int cols, rows;
+	Laxkit::DoubleBBox extent;
+	double cellw, cellh;
+	unsigned int stamp;
+	clock_t group_modtime; //group->modtime when last checked
+	bool dirty;
+
+	virtual bool Changed(Entry *entry, LaxInterfaces::SomeData *obj);
+	virtual void Capture(Entry *entry, LaxInterfaces::SomeData *obj);
+	virtual void Bin(int index);
+	virtual void Unbin(int index);
+	virtual void Rebuild(DrawableObject *group);
+
+  public:
+	static int MinKids;
+
+	SpatialIndex();
+	virtual ~SpatialIndex();
+
+	virtual int Update(DrawableObject *group);
+	virtual void Invalidate() { dirty = true; }
+	virtual int Query(const Laxkit::DoubleBBox &box, Laxkit::NumStack<int> &ret);
+	virtual bool MayIntersect(int index, LaxInterfaces::SomeData *obj, const Laxkit::DoubleBBox &box);
+	virtual int n() { return entries.n; }
+};
+
+
+} //namespace Laidout
+
+#endif
+
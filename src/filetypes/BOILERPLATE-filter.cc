@@ -230,7 +230,7 @@ int BoilerPlateExportFilter::Out(const char *filename, Laxkit::anObject *context
 	}
 	
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	int     warning = 0;
 	Spread *spread  = NULL;
@@ -315,7 +315,7 @@ int BoilerPlateExportFilter::Out(const char *filename, Laxkit::anObject *context
 
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	DBG cerr <<"-----BoilerPlate export end success-------"<<endl;
 
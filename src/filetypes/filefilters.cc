@@ -19,6 +19,9 @@
 #include "../laidout.h"
 #include "../core/stylemanager.h"
 #include "../dataobjects/bboxvalue.h"
+#include "../core/workerpool.h"
+#include "../core/importimage.h"
+#include "../dataobjects/pdfpageproxy.h"
 
 #include <lax/strmanip.h>
 #include <lax/fileutils.h>
@@ -657,6 +660,15 @@ int import_document(ImportConfig *config, Laxkit::ErrorLog &log, const char *fil
  */
 	
 
+/*! \fn int ExportFilter::PrepareJob(DocumentExportConfig *config, Laxkit::ErrorLog &log)
+ * For FILTER_PARALLEL filters, export_document() calls this on the main thread for each file,
+ * before calling Out() with config on a worker thread. Filters should lay out and copy here
+ * whatever Out() draws, and keep it in config, so that worker threads never touch reference
+ * counts of objects in the document. config is released on the main thread.
+ *
+ * Return 0 for success, or nonzero for error, in which case Out() is not called.
+ */
+
 
 /*! Create a config object based on fromconfig.
  */
@@ -740,6 +752,14 @@ ObjectDef *makeExportConfigDef()
 			nullptr,  //defvalue
 			0,    //flags
 			nullptr);//newfunc
+	sd->push("jobs",
+			_("Jobs"),
+			_("How many files, or parts of large images, to export at the same time, if the format allows. 0 means one per processor core."),
+			"int",
+			nullptr, //range
+			"1",  //defvalue
+			0,    //flags
+			nullptr);//newfunc
 	sd->pushEnum("evenodd",
 			_("Even or odd"),
 			_("Whether to export even, odd, or all spread indices in range"),
@@ -917,6 +937,11 @@ int createExportConfig(ValueHash *context, ValueHash *parameters,
 		if (e==0) config->batches=i;
 		else if (e==2) { sprintf(error, _("Invalid format for %s!"),"batches"); throw error; }
 
+		 //---jobs
+		i=parameters->findInt("jobs",-1,&e);
+		if (e==0) config->jobs=i;
+		else if (e==2) { sprintf(error, _("Invalid format for %s!"),"jobs"); throw error; }
+
 		 //---evenodd
 		i=parameters->findInt("evenodd",-1,&e);
 		if (e==0) {
@@ -1074,6 +1099,12 @@ int createExportConfig(ValueHash *context, ValueHash *parameters,
  * for every 4 spreads, create one file (or export). Continue for the whole range of papers.
  * If batches<=0 then do not export in batches.
  */
+/*! \var int DocumentExportConfig::jobs
+ * For TARGET_Multi, the most files to export at the same time. This only has an effect
+ * for filters with FILTER_PARALLEL. 0 means use as many as there are worker threads, plus one.
+ * Filters may also use it for how much of one file to render at once, as ImageExportFilter
+ * does with bands of large images. Default is 1, which does everything one at a time.
+ */
 /*! \var EvenOdd DocumentExportConfig::evenodd
  * Whether to export all, only even indices, or only odd indices of spreads.
  */
@@ -1089,6 +1120,7 @@ DocumentExportConfig::DocumentExportConfig()
 	reverse_order     = 0;
 	evenodd           = All;
 	batches           = 0;
+	jobs              = 1;
 	filter            = nullptr;
 	target            = TARGET_Single;
 	send_to_command   = false;
@@ -1140,6 +1172,7 @@ DocumentExportConfig::DocumentExportConfig(DocumentExportConfig *config)
 	reverse_order  = config->reverse_order;
 	evenodd        = config->evenodd;
 	batches        = config->batches;
+	jobs           = config->jobs;
 	target         = config->target;
 	range          = config->range;
 	layout         = config->layout;
@@ -1242,6 +1275,7 @@ Value *DocumentExportConfig::dereference(const char *extstring, int len)
 	if (IsName("collect", extstring, len)) return new BooleanValue(collect_for_out);
 	if (IsName("range", extstring, len)) return new StringValue(range.ToString(true, false, false));
 	if (IsName("batches", extstring, len)) return new IntValue(batches);
+	if (IsName("jobs", extstring, len)) return new IntValue(jobs);
 	if (IsName("evenodd", extstring, len)) return new StringValue(evenodd==Odd ? "odd" : (evenodd == Even ? "even" : "all"));
 	if (IsName("rotate180", extstring, len)) return new BooleanValue(rotate180);
 	if (IsName("paperrotation", extstring, len)) return new DoubleValue(paperrotation);
@@ -1316,6 +1350,12 @@ int DocumentExportConfig::assign(FieldExtPlace *ext,Value *v)
 		batches = vv->i;
 		return 1;
 	}
+	if (!strcmp("jobs", str)) {
+		IntValue *vv = dynamic_cast<IntValue*>(v);
+		if (!vv) return 0;
+		jobs = vv->i;
+		return 1;
+	}
 	if (!strcmp("evenodd", str)) {
 		StringValue *sv = dynamic_cast<StringValue*>(v);
 		if (!sv || !sv->str) return 0;
@@ -1399,6 +1439,7 @@ Laxkit::Attribute *DocumentExportConfig::dump_out_atts(Laxkit::Attribute *att,in
 		att->push("layout","papers"        ,"this is particular to the imposition used by the document");
 		att->push("range","3-5,10-15"      ,"Spread index range(s) to export, counting from 0");
 		att->push("batches","4"            ,"for multi-page capable targets, the number of spreads to put in a single file, repeat for whole range");
+		att->push("jobs","4"               ,"how many files, or parts of large images, to export at once, if the format allows. 0 means one per core");
 		att->push("evenodd","odd"          ,"all|even|odd. Based on spread index, maybe export only even or odd spreads.");
 		att->push("paperrotation","0"      ,"0|90|180|270. Whether to rotate each exported (final) paper by that number of degrees");
 		att->push("rotate180","yes"        ,"or no. Whether to rotate every other paper by 180 degrees, in addition to paperrotation");
@@ -1437,6 +1478,7 @@ Laxkit::Attribute *DocumentExportConfig::dump_out_atts(Laxkit::Attribute *att,in
 	att->push("rotate180", rotate180 == 0 ? "no" : "yes"); 
 	att->push("reverse", reverse_order ? "yes" : "no");
 	att->push("batches", batches);
+	att->push("jobs", jobs);
 	if (evenodd==Odd) att->push("evenodd","odd");
 	else if (evenodd==Even) att->push("evenodd","even");
 	else att->push("evenodd","all");
@@ -1547,6 +1589,9 @@ void DocumentExportConfig::dump_in_atts(Attribute *att,int flag,Laxkit::DumpCont
 		} else if (!strcmp(name,"batches")) {
 			IntAttribute(value,&batches);
 
+		} else if (!strcmp(name,"jobs")) {
+			IntAttribute(value,&jobs);
+
 		} else if (!strcmp(name,"evenodd")) {
 			if (isblank(value)) evenodd=All;
 			else if (!strcmp(value,"odd")) evenodd=Odd;
@@ -1584,6 +1629,37 @@ ObjectDef *DocumentExportConfig::makeObjectDef()
 
 //------------------------------- export_document() ----------------------------------
 
+/*! Set up config to export only the given spread and paper, as one file of a many file export.
+ * filename must have room for filebase plus the numbers.
+ */
+static void setup_multi_export(DocumentExportConfig *config, int spread, int paper, bool has_multipaper,
+							   const char *filebase, char *filename)
+{
+	config->range.Clear();
+	config->range.AddRange(spread,spread);
+
+	config->curpaperrotation = config->paperrotation;
+	if (config->rotate180 && spread % 2 == 1) {
+		config->curpaperrotation += 180;
+		if (config->curpaperrotation >= 360) config->curpaperrotation -= 360;
+	}
+
+	if (has_multipaper)
+		sprintf(filename, filebase, spread);
+	else
+		sprintf(filename, filebase, spread, paper);
+}
+
+//! Copy all messages in from onto the end of to.
+static void append_log(ErrorLog &to, ErrorLog &from)
+{
+	for (int c=0; c<from.Total(); c++) {
+		ErrorLogNode *e = from.Message(c);
+		to.AddMessage(e->object_id, e->objectstr_id, nullptr, e->description, e->severity, e->info, e->pos, e->line);
+	}
+}
+
+
 //! Export a document from a file or a live Document.
 /*! Return 0 for export successful. -1 is returned If there are non-fatal errors, in which case
  * the warning messages get appended to log. If there are fatal errors, then log
@@ -1591,6 +1667,9 @@ ObjectDef *DocumentExportConfig::makeObjectDef()
  *
  * If the filter cannot support multiple file output, but there are multiple files to be output,
  * then this function will call filter->Out() with the correct data for each file.
+ * If the filter has FILTER_PARALLEL, up to config->jobs of those are exported at the same time
+ * on WorkerPool::Shared(), each with its own copy of config, prepared with ExportFilter::PrepareJob().
+ * Files are named and reported in the same order as they would be one at a time.
  *
  * If no config->papergroup, then filters should use the default papergroup of the spread.
  * If the spread does not have a papergroup, then filters should construct basic bounds for the spread.
@@ -1643,6 +1722,41 @@ int export_document(DocumentExportConfig *config, Laxkit::ErrorLog &log)
 		config->range.Clear();
 	} else {
 		config->range.Max(config->doc->imposition->NumSpreads(config->layout), true);
+
+		 //read in any pages kept in separate files that will be exported
+		if (config->doc->NumUnloadedPages()) {
+			NumStack<int> which;
+			for (int c = config->range.Start(); c >= 0; c = config->range.Next()) {
+				Spread *spread = config->doc->imposition->Layout(config->layout, c);
+				config->doc->SpreadPages(spread, which);
+				delete spread;
+			}
+			config->doc->LoadPages(which, &log);
+		}
+	}
+
+	 //images being imported in the background must be in place
+	ImageImportQueue::Shared()->Finish();
+
+	 //pdf page previews are only requested when drawn on screen, so make sure exported ones exist
+	{
+		PdfPreviewCache *previews = PdfPreviewCache::Shared();
+		int npending = 0;
+		if (config->limbo) npending += previews->RequestAll(config->limbo);
+		if (config->papergroup) npending += previews->RequestAll(&config->papergroup->objs);
+		if (config->doc) {
+			NumStack<int> which;
+			for (int c = config->range.Start(); c >= 0; c = config->range.Next()) {
+				Spread *spread = config->doc->imposition->Layout(config->layout, c);
+				config->doc->SpreadPages(spread, which);
+				delete spread;
+			}
+			for (int c=0; c<which.n; c++) {
+				Page *page = config->doc->pages.e[which.e[c]];
+				if (page) npending += page->RequestPreviews();
+			}
+		}
+		if (npending) previews->Finish();
 	}
 
 	int numoutput = 0; //number of output files
@@ -1689,6 +1803,8 @@ int export_document(DocumentExportConfig *config, Laxkit::ErrorLog &log)
 		IndexRange range_orig = config->range;
 		int filenum = 0;
 
+		 //figure out each spread and paper combination, in output order
+		NumStack<int> spreads, papers;
 		for (int c = (config->reverse_order ? range.End() : range.Start());
 				 c >= 0;
 			 	 c = (config->reverse_order ? range.Previous() : range.Next())) //loop over each spread
@@ -1701,19 +1817,73 @@ int export_document(DocumentExportConfig *config, Laxkit::ErrorLog &log)
 			if (config->doc) papers_in_spread = config->doc->imposition->GetNumInPaperGroupForSpread(config->layout, c);
 
 			for (int p=0; p<papers_in_spread; p++) { //loop over each paper in a spread
-				config->range.Clear();
-				config->range.AddRange(c,c);
+				spreads.push(c);
+				papers.push(p);
+			}
+		}
+
+		int jobs = config->jobs;
+		if (jobs <= 0) jobs = WorkerPool::Shared()->NumThreads() + 1;
+
+		if (jobs > 1 && spreads.n > 1 && (config->filter->flags & FILTER_PARALLEL)) {
+			 //render several files at once, each with its own config and log,
+			 //then report back in order as if they were done one at a time
+			int n = spreads.n;
+			DocumentExportConfig **configs = new DocumentExportConfig*[n];
+			ErrorLog *logs = new ErrorLog[n];
+			int *errs = new int[n];
+			char **filenames = new char*[n];
+
+			for (int c=0; c<n; c++) {
+				configs[c] = nullptr;
+				filenames[c] = new char[strlen(filebase)+20];
+				errs[c] = 0;
+			}
 
-				config->curpaperrotation = config->paperrotation;
-				if (config->rotate180 && c % 2 == 1) {
-					config->curpaperrotation += 180;
-					if (config->curpaperrotation >= 360) config->curpaperrotation -= 360;
+			 //prepare only a few files at a time, since each holds copies of what it draws
+			bool failed = false;
+			for (int start=0; start<n && !failed; start += jobs) {
+				int num = (n - start < jobs ? n - start : jobs);
+
+				for (int c=start; c<start+num; c++) {
+					configs[c] = config->filter->CreateConfig(config);
+					setup_multi_export(configs[c], spreads.e[c], papers.e[c], has_multipaper, filebase, filenames[c]);
+					errs[c] = config->filter->PrepareJob(configs[c], logs[c]);
+				}
+
+				WorkerPool::Shared()->Run(num, [&](int i) {
+					i += start;
+					if (errs[i] == 0) errs[i] = config->filter->Out(filenames[i], configs[i], logs[i]);
+				});
+
+				for (int c=start; c<start+num; c++) {
+					configs[c]->dec_count(); //copies are released here, on the main thread
+					configs[c] = nullptr;
+					if (errs[c] > 0) failed = true;
 				}
+			}
+
+			 //files are done a few at a time in order, so everything before a failure has been done
+			for (int c=0; c<n; c++) {
+				append_log(log, logs[c]);
+				err = errs[c];
+				if (err > 0) break;
 
-				if (has_multipaper)
-					sprintf(filename, filebase, c);
-				else
-					sprintf(filename, filebase, c, p);
+				if (err == 0 && config->send_to_command) files_outputted.push(newstr(filenames[c]));
+				filenum++;
+			}
+
+			for (int c=0; c<n; c++) {
+				delete[] filenames[c];
+			}
+			delete[] configs;
+			delete[] logs;
+			delete[] errs;
+			delete[] filenames;
+
+		} else {
+			for (int c=0; c<spreads.n; c++) {
+				setup_multi_export(config, spreads.e[c], papers.e[c], has_multipaper, filebase, filename);
 
 				// ***pg = new PaperGroup(papergroup->papers.e[p]);
 				// if (papergroup->objs.n()) {
@@ -1728,7 +1898,6 @@ int export_document(DocumentExportConfig *config, Laxkit::ErrorLog &log)
 				if (err == 0 && config->send_to_command) files_outputted.push(newstr(filename));
 				filenum++;
 			}
-			if (err > 0) break;
 		}
 
 		//restore config, since we messed with it
@@ -1815,6 +1984,7 @@ int export_document(DocumentExportConfig *config, Laxkit::ErrorLog &log)
 	}
 
 	DBG cerr << "export_document end."<<endl;
+	if (config->doc) config->doc->EvictPages(laidout->prefs.max_loaded_pages);
 
 	if (err>0) {
 		log.AddMessage(_("Export failed."),ERROR_Fail);
@@ -40,6 +40,7 @@ class DocumentExportConfig;
 #define FILTER_MULTIPAGE  (1<<0)
 #define FILTER_MANY_FILES (1<<1)
 #define FILTER_DIR_BASED  (1<<2)
+#define FILTER_PARALLEL   (1<<3)
 
 class FileFilter : virtual public Laxkit::anObject
 {
@@ -81,6 +82,7 @@ class ExportFilter : public FileFilter
  public:
 	virtual const char *whattype() { return "FileOutputFilter"; }
 	virtual int Out(const char *file, Laxkit::anObject *context,  Laxkit::ErrorLog &log) = 0;
+	virtual int PrepareJob(DocumentExportConfig *config, Laxkit::ErrorLog &log) { return 0; }
 	virtual int Verify(Laxkit::anObject *context) { return 1; } //= 0; //***preflight checker
 	virtual ObjectDef *makeObjectDef();
 	virtual DocumentExportConfig *CreateConfig(DocumentExportConfig *fromconfig);
@@ -109,6 +111,7 @@ class DocumentExportConfig : public Value
 	int layout;
 	enum EvenOdd { All,Even,Odd } evenodd;
 	int batches;
+	int jobs;
 	int reverse_order;
 	int paperrotation;
 	int rotate180; //0 or 1
@@ -14,6 +14,7 @@
 
 
 #include <sys/wait.h>
+#include <zlib.h>
 
 #include <lax/interfaces/interfacemanager.h>
 #include <lax/interfaces/imageinterface.h>
@@ -22,6 +23,7 @@
 #include <lax/transformmath.h>
 #include <lax/attributes.h>
 #include <lax/fileutils.h>
+#include <lax/laxutils.h>
 
 #include "../language.h"
 #include "../laidout.h"
@@ -30,6 +32,7 @@
 #include "image.h"
 #include "../impositions/singles.h"
 #include "../core/drawdata.h"
+#include "../core/workerpool.h"
 
 #include <iostream>
 #define DBG 
@@ -60,6 +63,9 @@ void installImageFilter()
  * \brief Holds extra config for image export.
  *
  * Extras include image format, whether to use a transparent background, pixel width and height.
+ *
+ * spread and copies are not settings. They are what to draw, laid out and copied by
+ * ImageExportFilter::PrepareJob(), and are not copied with the config.
  */
 
 
@@ -70,6 +76,7 @@ ImageExportConfig::ImageExportConfig()
 	background = ColorManager::newColor(LAX_COLOR_RGB, 4, 1.,1.,1.,1.);
 	use_transparent_bg = true;
 	width = height = 0;
+	spread = nullptr;
 
 	for (int c=0; c<laidout->exportfilters.n; c++) {
 		if (!strcmp(laidout->exportfilters.e[c]->Format(),"Image")) {
@@ -83,6 +90,7 @@ ImageExportConfig::ImageExportConfig(DocumentExportConfig *config)
   : DocumentExportConfig(config)
 {
 	background = nullptr;
+	spread = nullptr;
 
 	ImageExportConfig *conf = dynamic_cast<ImageExportConfig*>(config);
 	if (conf) {
@@ -109,6 +117,7 @@ Value* ImageExportConfig::duplicate()
 
 ImageExportConfig::~ImageExportConfig()
 {
+	delete spread;
 	if (background) background->dec_count();
 	delete[] image_format;
 }
@@ -325,18 +334,224 @@ int ImageExportConfig::assign(FieldExtPlace *ext,Value *v)
 }
 
 
+//! Most memory to use for surfaces when exporting large png images in bands.
+#define IMAGE_EXPORT_BAND_MEMORY (64*1024*1024)
+
+
+//------------------------------ PngRowWriter ---------------------------------
+
+/*! \class PngRowWriter
+ * Minimal png writer that takes rows a few at a time, so that a whole image never
+ * has to be in memory at once. Rows are compressed as they come in.
+ */
+class PngRowWriter
+{
+  protected:
+	FILE *f;
+	z_stream zs;
+	bool zs_ok;
+	int width, height, channels;
+	int rows_written;
+	unsigned char *row; //filter type byte + one row of pixels
+	unsigned char *zbuffer;
+
+	void Chunk(const char *type, const unsigned char *data, unsigned long len);
+	int Deflate(int flush);
+
+  public:
+	PngRowWriter();
+	virtual ~PngRowWriter();
+	virtual int Open(const char *file, int w, int h, bool alpha);
+	virtual int WriteRows(const unsigned char *bgra, int numrows);
+	virtual int Close();
+};
+
+#define PNG_ZBUFFER_SIZE 65536
+
+PngRowWriter::PngRowWriter()
+{
+	f = nullptr;
+	zs_ok = false;
+	width = height = channels = 0;
+	rows_written = 0;
+	row = nullptr;
+	zbuffer = nullptr;
+}
+
+PngRowWriter::~PngRowWriter()
+{
+	Close();
+}
+
+static void png_uint32(unsigned char *p, unsigned long v)
+{
+	p[0] = (v>>24) & 0xff;
+	p[1] = (v>>16) & 0xff;
+	p[2] = (v>> 8) & 0xff;
+	p[3] =  v      & 0xff;
+}
+
+void PngRowWriter::Chunk(const char *type, const unsigned char *data, unsigned long len)
+{
+	unsigned char buf[4];
+	png_uint32(buf, len);
+	fwrite(buf, 1, 4, f);
+	fwrite(type, 1, 4, f);
+	if (len) fwrite(data, 1, len, f);
+
+	unsigned long crc = crc32(0, (const Bytef*)type, 4);
+	if (len) crc = crc32(crc, data, len);
+	png_uint32(buf, crc);
+	fwrite(buf, 1, 4, f);
+}
+
+//! Compress whatever is in zs.next_in, writing any output as IDAT chunks.
+int PngRowWriter::Deflate(int flush)
+{
+	int status;
+	do {
+		zs.next_out  = zbuffer;
+		zs.avail_out = PNG_ZBUFFER_SIZE;
+		status = deflate(&zs, flush);
+		if (status == Z_STREAM_ERROR) return 1;
+
+		unsigned long have = PNG_ZBUFFER_SIZE - zs.avail_out;
+		if (have) Chunk("IDAT", zbuffer, have);
+	} while (zs.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+
+	return 0;
+}
+
+/*! Start a new 8 bit RGB or RGBA png. Return 0 for success, or nonzero for error.
+ */
+int PngRowWriter::Open(const char *file, int w, int h, bool alpha)
+{
+	if (f || w <= 0 || h <= 0) return 1;
+
+	f = fopen(file, "wb");
+	if (!f) return 1;
+
+	width    = w;
+	height   = h;
+	channels = (alpha ? 4 : 3);
+	rows_written = 0;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		fclose(f);
+		f = nullptr;
+		return 1;
+	}
+	zs_ok = true;
+
+	row = new unsigned char[1 + (long)width*channels];
+	zbuffer = new unsigned char[PNG_ZBUFFER_SIZE];
+
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	fwrite(signature, 1, 8, f);
+
+	unsigned char ihdr[13];
+	png_uint32(ihdr,   width);
+	png_uint32(ihdr+4, height);
+	ihdr[8]  = 8; //bit depth
+	ihdr[9]  = (alpha ? 6 : 2); //color type: RGBA or RGB
+	ihdr[10] = 0; //compression
+	ihdr[11] = 0; //filter method
+	ihdr[12] = 0; //no interlace
+	Chunk("IHDR", ihdr, 13);
+
+	return 0;
+}
+
+/*! Add numrows rows of premultiplied BGRA pixels, as found in Displayer surfaces,
+ * with a stride of 4*width. Return 0 for success, or nonzero for error.
+ */
+int PngRowWriter::WriteRows(const unsigned char *bgra, int numrows)
+{
+	if (!f) return 1;
+	if (rows_written + numrows > height) numrows = height - rows_written;
+
+	for (int r=0; r<numrows; r++) {
+		const unsigned char *in = bgra + (long)r*width*4;
+		unsigned char *out = row + 1;
+
+		for (int x=0; x<width; x++, in += 4, out += channels) {
+			int a = in[3];
+			if (channels == 3 || a == 255) {
+				out[0] = in[2];
+				out[1] = in[1];
+				out[2] = in[0];
+			} else if (a == 0) {
+				out[0] = out[1] = out[2] = 0;
+			} else {
+				out[0] = (in[2]*255 + a/2) / a;
+				out[1] = (in[1]*255 + a/2) / a;
+				out[2] = (in[0]*255 + a/2) / a;
+			}
+			if (channels == 4) out[3] = a;
+		}
+
+		 //"Sub" filter, each byte minus the same byte of the previous pixel, working backwards
+		long rowlen = (long)width*channels;
+		row[0] = 1;
+		for (long c = rowlen; c > channels; c--) row[c] -= row[c-channels];
+
+		zs.next_in  = row;
+		zs.avail_in = rowlen + 1;
+		if (Deflate(Z_NO_FLUSH) != 0) return 1;
+	}
+
+	rows_written += numrows;
+	return ferror(f) ? 1 : 0;
+}
+
+/*! Finish the file. Return 0 for success, or nonzero if anything went wrong,
+ * including not getting all the rows.
+ */
+int PngRowWriter::Close()
+{
+	if (!f) return 1;
+
+	int err = 0;
+	if (rows_written != height) err = 1;
+
+	zs.next_in  = nullptr;
+	zs.avail_in = 0;
+	if (Deflate(Z_FINISH) != 0) err = 1;
+	Chunk("IEND", nullptr, 0);
+
+	if (zs_ok) deflateEnd(&zs);
+	zs_ok = false;
+	if (ferror(f)) err = 1;
+	if (fclose(f) != 0) err = 1;
+	f = nullptr;
+
+	delete[] row;
+	delete[] zbuffer;
+	row = nullptr;
+	zbuffer = nullptr;
+
+	return err;
+}
+
+
 //------------------------------------ ImageExportFilter ----------------------------------
 	
 /*! \class ImageExportFilter
  * \brief Filter for exporting pages to images via a Displayer.
  *
  * Uses ImageExportConfig.
+ *
+ * Out() uses its own Displayer each call, so export_document() may run several at once
+ * on different configs (see FILTER_PARALLEL). Those configs are first given copies of what
+ * to draw by PrepareJob(), so worker threads never draw objects that are in the document.
  */
 
 
 ImageExportFilter::ImageExportFilter()
 {
 	//flags=FILTER_MANY_FILES;
+	flags = FILTER_PARALLEL;
 }
 
 /*! \todo if other image formats get implemented, then this would return
@@ -452,9 +667,233 @@ ObjectDef *ImageExportFilter::GetObjectDef()
 
 
 
+/*! Lay out the spread to export for out, and look up its pages.
+ * Must be called on the main thread.
+ */
+static Spread *ImageExportLayout(ImageExportConfig *out)
+{
+	Document *doc = out->doc;
+	if (!doc) return nullptr;
+
+	Spread *spread = doc->imposition->Layout(out->layout, out->range.Start());
+	if (!spread) return nullptr;
+
+	for (int c=0; c<spread->pagestack.n(); c++) {
+		PageLocation *pl = spread->pagestack.e[c];
+		if (!pl->page && pl->index >= 0 && pl->index < doc->pages.n) pl->page = doc->pages.e[pl->index];
+	}
+	return spread;
+}
+
+/*! Copy everything ImageExportBand() draws into copies: limbo, then papergroup objects,
+ * then one group per spread->pagestack entry, holding any bleeds then the page's layers.
+ *
+ * Drawing bumps reference counts, which are not atomic, so worker threads must only draw these
+ * copies, and no two threads may draw the same copies at once.
+ * Must be called on the main thread, and copies must be flushed there too.
+ * Note that copied clones still refer to their original source objects.
+ */
+static void ImageExportCopies(ImageExportConfig *out, RefPtrStack<DrawableObject> &copies, Spread *spread, PaperGroup *papergroup)
+{
+	copies.flush();
+
+	DrawableObject *group = new DrawableObject;
+	if (out->limbo) {
+		SomeData *d = out->limbo->duplicateData(nullptr);
+		group->push(d);
+		d->dec_count();
+	}
+	copies.push(group);
+	group->dec_count();
+
+	group = new DrawableObject;
+	if (papergroup) {
+		for (int c = 0; c < papergroup->objs.n(); c++) {
+			SomeData *d = papergroup->objs.e(c)->duplicateData(nullptr);
+			group->push(d);
+			d->dec_count();
+		}
+	}
+	copies.push(group);
+	group->dec_count();
+
+	for (int c = 0; spread && c < spread->pagestack.n(); c++) {
+		group = new DrawableObject;
+		Page *page = spread->pagestack.e[c]->page;
+
+		if (page && page->pagebleeds.n && (out->layout == PAPERLAYOUT || out->layout == SINGLELAYOUT)) {
+			 //assume PAGELAYOUT already renders bleeds properly, since that's where the bleed objects come from
+			for (int pb=0; pb<page->pagebleeds.n; pb++) {
+				PageBleed *bleed = page->pagebleeds[pb];
+				Page *otherpage = out->doc->pages[bleed->index];
+
+				DrawableObject *bleedgroup = new DrawableObject;
+				bleedgroup->m(bleed->matrix);
+				for (int c2 = 0; c2 < otherpage->layers.n(); c2++) {
+					SomeData *d = otherpage->e(c2)->duplicateData(nullptr);
+					bleedgroup->push(d);
+					d->dec_count();
+				}
+				group->push(bleedgroup);
+				bleedgroup->dec_count();
+			}
+		}
+
+		for (int c2=0; page && c2<page->layers.n(); c2++) {
+			SomeData *d = page->e(c2)->duplicateData(nullptr);
+			group->push(d);
+			d->dec_count();
+		}
+
+		copies.push(group);
+		group->dec_count();
+	}
+}
+
+/*! Render rows [y, y+rows) of an image export of size width x (whole height) into a new image.
+ * scale and offsets map real coordinates to pixels of the whole image.
+ * Each call uses its own Displayer, so bands can be rendered at the same time.
+ *
+ * If copies is not null, that is drawn instead of the objects in the document
+ * (see ImageExportCopies()). Off the main thread, it must be. Kids of groups that are outside
+ * the band are skipped (see DRAW_CULL), which is safe for copies that only one thread draws.
+ */
+static LaxImage *ImageExportBand(ImageExportConfig *out, RefPtrStack<DrawableObject> *copies, Spread *spread, PaperGroup *papergroup,
+								 int width, int rows, int y, double scale, double offsetx, double offsety)
+{
+	Document *doc = out->doc;
+	bool use_copies = (copies && copies->n > 0);
+	unsigned int flags = DRAW_HIRES | DRAW_CULL;
+
+	Displayer *dp = newDisplayer(nullptr);
+	dp->CreateSurface(width, rows);
+	dp->PushAxes();
+	dp->defaultRighthanded(true);
+	dp->NewTransform(scale,0.,0.,-scale, offsetx, offsety - y);
+
+	 //now output everything
+	if (!out->use_transparent_bg) {
+		 //fill output with an appropriate background color
+		 // *** this should really color papers according to their characteristics
+		 // *** and have a default for non-transparent limbo color
+		if (papergroup && papergroup->papers.n) {
+			dp->NewBG(&papergroup->papers.e[0]->color);
+		} else dp->NewBG(1.0, 1.0, 1.0);
+
+		dp->ClearWindow();
+	}
+
+	 //limbo objects
+	if (use_copies) {
+		for (int c = 0; c < copies->e[0]->n(); c++) DrawData(dp, copies->e[0]->e(c), NULL,NULL,flags);
+	} else if (out->limbo) DrawData(dp, out->limbo, NULL,NULL,flags);
+	
+	 //papergroup objects
+	DrawableObject *objs = (use_copies ? copies->e[1] : papergroup ? &papergroup->objs : nullptr);
+	if (objs && objs->n()) {
+		for (int c = 0; c < objs->n(); c++) {
+			  DrawData(dp, objs->e(c), NULL,NULL,flags);
+		}
+	}
+
+	 //spread objects
+	if (spread) {
+		dp->BlendMode(LAXOP_Over);
+
+		 // draw the page's objects and margins
+		Page *page=NULL;
+		SomeData *sd=NULL;
+
+		for (int c=0; c<spread->pagestack.n(); c++) {
+			DBG cerr <<" drawing from pagestack.e["<<c<<"], which has page "<<spread->pagestack.e[c]->index<<endl;
+			page=spread->pagestack.e[c]->page; //already looked up in ImageExportLayout()
+			if (!page) continue;
+
+			 //else we have a page, so draw it all
+			sd=spread->pagestack.e[c]->outline;
+			dp->PushAndNewTransform(sd->m()); // transform to page coords
+
+			bool clip = ((page->pagestyle->flags&PAGE_CLIPS) || out->layout == PAPERLAYOUT);
+			if (clip) {
+				 // setup clipping region to be the page
+				dp->PushClip(1);
+				SetClipFromPaths(dp,sd,NULL);
+			}
+
+			if (use_copies) {
+				 //bleeds and layers, as copied in ImageExportCopies()
+				DrawableObject *pagecopy = copies->e[2+c];
+				for (int c2=0; c2<pagecopy->n(); c2++) {
+					DrawData(dp, pagecopy->e(c2),NULL,NULL,flags);
+				}
+
+			} else {
+				if (page->pagebleeds.n && (out->layout == PAPERLAYOUT || out->layout == SINGLELAYOUT)) {
+					 //assume PAGELAYOUT already renders bleeds properly, since that's where the bleed objects come from
+					for (int pb=0; pb<page->pagebleeds.n; pb++) {
+						PageBleed *bleed = page->pagebleeds[pb];
+						Page *otherpage = doc->pages[bleed->index];
+
+						dp->PushAndNewTransform(bleed->matrix);
+
+						for (int c2 = 0; c2 < otherpage->layers.n(); c2++) {
+							DrawData(dp,otherpage->e(c2),NULL,NULL,DRAW_CULL);
+						}
+
+						dp->PopAxes();
+					}
+				}
+
+				 // Draw all the page's objects.
+				for (int c2=0; c2<page->layers.n(); c2++) {
+					DrawData(dp, page->e(c2),NULL,NULL,flags);
+				}
+			}
+			
+			if (clip) {
+				 //remove clipping region
+				dp->PopClip();
+			}
+
+			dp->PopAxes(); // remove page transform
+		} //foreach in pagestack
+	} //if spread
+
+	dp->PopAxes(); //initial dp protection
+
+	LaxImage *img = dp->GetSurface();
+	dp->EndDrawing();
+	dp->dec_count();
+	return img;
+}
+
+/*! Lay out and copy what to draw for config, so that Out() can be called with it on a worker
+ * thread. See ExportFilter::PrepareJob().
+ */
+int ImageExportFilter::PrepareJob(DocumentExportConfig *config, Laxkit::ErrorLog &log)
+{
+	ImageExportConfig *out = dynamic_cast<ImageExportConfig*>(config);
+	if (!out) {
+		log.AddMessage(_("Wrong type of output config!"),ERROR_Fail);
+		return 1;
+	}
+
+	if (!out->spread) out->spread = ImageExportLayout(out);
+
+	PaperGroup *papergroup = out->papergroup;
+	if (!papergroup && out->spread) papergroup = out->spread->papergroup;
+	ImageExportCopies(out, out->copies, out->spread, papergroup);
+	return 0;
+}
+
 /*! Save the document as image files with optional transparency.
  * 
  * Return 0 for success, or nonzero error.
+ *
+ * Large png images are rendered in horizontal bands, and written out a band at a time with
+ * PngRowWriter, so memory use stays around IMAGE_EXPORT_BAND_MEMORY no matter how big the output is.
+ * Each band only draws what is inside it. If out->jobs is not 1, up to that many bands are
+ * rendered at once on WorkerPool::Shared(), each from its own copy of the spread.
  * 
  * Currently uses an ImageExportConfig.
  */
@@ -494,20 +933,28 @@ int ImageExportFilter::Out(const char *filename, Laxkit::anObject *context, Erro
 	}
 	
 
-	InterfaceManager *imanager=InterfaceManager::GetDefault(true);
-	Displayer *dp = imanager->GetDisplayer(DRAWS_Hires);
 	DoubleBBox bounds;
 
 	int width  = out->width;
 	int height = out->height;
 
-	Spread *spread = nullptr;
-	if (doc) {
-		spread = doc->imposition->Layout(out->layout, out->range.Start());
+	 //off the main thread, only draw what PrepareJob() copied
+	bool main_thread = !WorkerPool::IsWorkerThread();
+	if (!main_thread && doc && !out->spread) {
+		log.AddMessage(_("Export was not prepared!"),ERROR_Fail);
+		delete[] file;
+		return 1;
+	}
+
+	Spread *spread = out->spread;
+	bool own_spread = false;
+	if (!spread && doc) {
+		spread = ImageExportLayout(out);
+		own_spread = true;
 	}
 	
 	PaperGroup *papergroup = out->papergroup;
-	if (!papergroup) papergroup = spread->papergroup;
+	if (!papergroup && spread) papergroup = spread->papergroup;
 
 	// determine content area
 	if (out->crop.validbounds()) {
@@ -527,6 +974,7 @@ int ImageExportFilter::Out(const char *filename, Laxkit::anObject *context, Erro
 
 	if (!bounds.validbounds()) {
 		log.AddMessage(_("Invalid output bounds! Either set crop or papergroup."),ERROR_Fail);
+		if (own_spread) delete spread;
 		delete[] file;
 		return 4;
 	}
@@ -556,148 +1004,82 @@ int ImageExportFilter::Out(const char *filename, Laxkit::anObject *context, Erro
 	if (width == 0 || height == 0) {
 		if (width  == 0) log.AddMessage(_( "Null width, nothing to output!"),ERROR_Fail);
 		if (height == 0) log.AddMessage(_("Null height, nothing to output!"),ERROR_Fail);
+		if (own_spread) delete spread;
 		delete[] file;
 		return 5;
 	}
 
-	 //set displayer port to the proper area.
-	 //The area in bounds must map to [0..width, 0..height]
-	dp->CreateSurface(width, height);
-	dp->PushAxes();
-	dp->defaultRighthanded(true);
-	dp->NewTransform(1,0,0,-1,0,-height);
-
-	//dp->SetSpace(0,width, 0,height);
-	dp->SetSpace(bounds.minx,bounds.maxx, bounds.miny,bounds.maxy);
-	dp->Center(bounds.minx,bounds.maxx, bounds.miny,bounds.maxy);
-	//dp->defaultRighthanded(false);
+	 //The area in bounds must map to [0..width, 0..height], centered like Displayer::Center()
+	double scale = width / bounds.boxwidth();
+	if (height / bounds.boxheight() < scale) scale = height / bounds.boxheight();
+	double offsetx = (width  - scale * bounds.boxwidth ()) / 2 - scale * bounds.minx;
+	double offsety = (height - scale * bounds.boxheight()) / 2 + scale * bounds.maxy;
+
+	 //bands are only used for png, since we write those ourselves a few rows at a time
+	bool is_png = isblank(out->image_format) || !strcasecmp(out->image_format, "png");
+	 //several bands at once only when asked for with jobs, since each needs its own copy of the spread
+	int numbands_at_once = 1;
+	if (main_thread && out->jobs != 1) numbands_at_once = (out->jobs <= 0 ? WorkerPool::Shared()->NumThreads() + 1 : out->jobs);
+	long band_rows = IMAGE_EXPORT_BAND_MEMORY / numbands_at_once / ((long)width * 4);
+	if (band_rows < 16) band_rows = 16;
+
+	int err = 0;
+	if (!is_png || band_rows >= height) {
+		 //render all at once, and let the image backend save it
+		LaxImage *img = ImageExportBand(out, out->copies.n ? &out->copies : nullptr, spread, papergroup, width, height, 0, scale, offsetx, offsety);
+		err = img->Save(filename, isblank(out->image_format) ? "png" : out->image_format);
+		img->dec_count();
 
-	 //now output everything
-	if (!out->use_transparent_bg) {
-		 //fill output with an appropriate background color
-		 // *** this should really color papers according to their characteristics
-		 // *** and have a default for non-transparent limbo color
-		if (papergroup && papergroup->papers.n) {
-			dp->NewBG(&papergroup->papers.e[0]->color);
-		} else dp->NewBG(1.0, 1.0, 1.0);
+	} else {
+		 //render several horizontal bands at once, then stream them in order to the file
+		DBG cerr << "Exporting "<<width<<"x"<<height<<" image in bands of "<<band_rows<<" rows"<<endl;
 
-		dp->ClearWindow();
-	}
+		PngRowWriter png;
+		err = png.Open(filename, width, height, out->use_transparent_bg);
 
-	//DBG dp->NewFG(.5,.5,.5);
-	//DBG dp->drawline(bounds.minx,bounds.miny, bounds.maxx,bounds.maxy);
-	//DBG dp->drawline(bounds.minx,bounds.maxy, bounds.maxx,bounds.miny);
+		int numbands = (height + band_rows - 1) / band_rows;
+		LaxImage **bands = new LaxImage*[numbands_at_once];
 
-	 //limbo objects
-	if (out->limbo) DrawData(dp, out->limbo, NULL,NULL,DRAW_HIRES);
-	//if (out->limbo) imanager->DrawData(dp, out->limbo, NULL,NULL,DRAW_HIRES);
-	
-	 //papergroup objects
-	if (papergroup && papergroup->objs.n()) {
-		for (int c = 0; c < papergroup->objs.n(); c++) {
-			  DrawData(dp, papergroup->objs.e(c), NULL,NULL,DRAW_HIRES);
+		 //bands drawn on workers must draw copies, not the document's objects, one set per band drawn at once
+		if (numbands_at_once > numbands) numbands_at_once = numbands;
+		RefPtrStack<DrawableObject> *slots = nullptr;
+		if (numbands_at_once > 1) {
+			slots = new RefPtrStack<DrawableObject>[numbands_at_once];
+			for (int i=0; i<numbands_at_once; i++) ImageExportCopies(out, slots[i], spread, papergroup);
 		}
-	}
-
-	 //spread objects
-	if (spread) {
-		dp->BlendMode(LAXOP_Over);
-
-		 // draw the page's objects and margins
-		Page *page=NULL;
-		int pagei=-1;
-		flatpoint p;
-		SomeData *sd=NULL;
-
-		for (int c=0; c<spread->pagestack.n(); c++) {
-			DBG cerr <<" drawing from pagestack.e["<<c<<"], which has page "<<spread->pagestack.e[c]->index<<endl;
-			page=spread->pagestack.e[c]->page;
-			pagei=spread->pagestack.e[c]->index;
 
-			if (!page) { // try to look up page in doc using pagestack->index
-				if (spread->pagestack.e[c]->index>=0 && spread->pagestack.e[c]->index<doc->pages.n) {
-					page = spread->pagestack.e[c]->page = doc->pages.e[pagei];
+		for (int band = 0; err == 0 && band < numbands; band += numbands_at_once) {
+			int n = numbands - band;
+			if (n > numbands_at_once) n = numbands_at_once;
+
+			WorkerPool::Shared()->Run(n, [&](int i) {
+				int y = (band + i) * band_rows;
+				int rows = height - y;
+				if (rows > band_rows) rows = band_rows;
+				RefPtrStack<DrawableObject> *copies = (slots ? &slots[i] : out->copies.n ? &out->copies : nullptr);
+				bands[i] = ImageExportBand(out, copies, spread, papergroup, width, rows, y, scale, offsetx, offsety);
+			});
+
+			for (int i=0; i<n; i++) {
+				if (err == 0) {
+					unsigned char *buffer = bands[i]->getImageBuffer();
+					err = png.WriteRows(buffer, bands[i]->h());
+					bands[i]->doneWithBuffer(buffer);
 				}
+				bands[i]->dec_count();
 			}
+		}
 
-			if (!page) continue;
-
-			 //else we have a page, so draw it all
-			sd=spread->pagestack.e[c]->outline;
-			dp->PushAndNewTransform(sd->m()); // transform to page coords
-			
-
-			if ((page->pagestyle->flags&PAGE_CLIPS) || out->layout == PAPERLAYOUT) {
-				 // setup clipping region to be the page
-				dp->PushClip(1);
-				//SetClipFromPaths(dp,sd,dp->Getctm());
-				SetClipFromPaths(dp,sd,NULL);
-			}
-
-            if (page->pagebleeds.n && (out->layout == PAPERLAYOUT || out->layout == SINGLELAYOUT)) {
-                 //assume PAGELAYOUT already renders bleeds properly, since that's where the bleed objects come from
-
-                //if (out->layout == PAPERLAYOUT) {
-                //    //only clip in paper view
-                //    dp->PushClip(1);
-                //    SetClipFromPaths(dp,sd,NULL);
-                //}
-
-                for (int pb=0; pb<page->pagebleeds.n; pb++) {
-                    PageBleed *bleed = page->pagebleeds[pb];
-                    Page *otherpage = doc->pages[bleed->index];
-
-                    dp->PushAndNewTransform(bleed->matrix);
-
-                    for (int c2 = 0; c2 < otherpage->layers.n(); c2++) {
-                        DrawData(dp,otherpage->e(c2),NULL,NULL,0);
-                    }
-
-                    dp->PopAxes();
-                }
-
-                //if (out->layout == PAPERLAYOUT) dp->PopClip();
-            }
-			
-
-			 //*** debuggging: draw X over whole page...
-	//		DBG dp->NewFG(255,0,0);
-	//		DBG dp->drawrline(flatpoint(sd->minx,sd->miny), flatpoint(sd->maxx,sd->miny));
-	//		DBG dp->drawrline(flatpoint(sd->maxx,sd->miny), flatpoint(sd->maxx,sd->maxy));
-	//		DBG dp->drawrline(flatpoint(sd->maxx,sd->maxy), flatpoint(sd->minx,sd->maxy));
-	//		DBG dp->drawrline(flatpoint(sd->minx,sd->maxy), flatpoint(sd->minx,sd->miny));
-	//		DBG dp->drawrline(flatpoint(sd->minx,sd->miny), flatpoint(sd->maxx,sd->maxy));
-	//		DBG dp->drawrline(flatpoint(sd->maxx,sd->miny), flatpoint(sd->minx,sd->maxy));
-	
-
-			 // Draw all the page's objects.
-			for (int c2=0; c2<page->layers.n(); c2++) {
-				DBG cerr <<"  num layers in page: "<<page->n()<<", num objs:"<<page->e(c2)->n()<<endl;
-				DBG cerr <<"  Layer "<<c2<<", objs.n="<<page->e(c2)->n()<<endl;
-				//imanager->DrawData(dp, page->e(c2), NULL,NULL,DRAW_HIRES);
-				DrawData(dp, page->e(c2),NULL,NULL,DRAW_HIRES);
-			}
-			
-			if (page->pagestyle->flags&PAGE_CLIPS) {
-				 //remove clipping region
-				dp->PopClip();
-			}
-
-			dp->PopAxes(); // remove page transform
-		} //foreach in pagestack
-	} //if spread
-
-
-	dp->PopAxes(); //initial dp protection
-
+		delete[] bands;
+		delete[] slots;
+		if (png.Close() != 0) err = 1;
+	}
 
-	 //Now save the page
-	LaxImage *img = dp->GetSurface();
-	int err = img->Save(filename, out->image_format);
 	if (err) {
 		log.AddMessage(_("Could not save the image"), ERROR_Fail);
 	}
-	img->dec_count();
+
+	if (own_spread) delete spread;
 
 	delete[] file;
 	if (log.Errors()) return -1;
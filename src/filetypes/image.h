@@ -36,6 +36,10 @@ class ImageExportConfig : public DocumentExportConfig
 	Laxkit::Color *background;
 	int width, height; //px of output
 
+	 //made by ImageExportFilter::PrepareJob() on the main thread, so Out() can draw from any thread
+	Spread *spread;
+	Laxkit::RefPtrStack<DrawableObject> copies;
+
 	ImageExportConfig();
 	ImageExportConfig(DocumentExportConfig *config);
 	virtual ~ImageExportConfig();
@@ -69,6 +73,7 @@ class ImageExportFilter : public ExportFilter
 	virtual DocumentExportConfig *CreateConfig(DocumentExportConfig *fromconfig);
 
 	virtual int Out(const char *filename, Laxkit::anObject *context, Laxkit::ErrorLog &log);
+	virtual int PrepareJob(DocumentExportConfig *config, Laxkit::ErrorLog &log);
 
 	//virtual Laxkit::anXWindow *ConfigDialog() { return NULL; }
 	//virtual int Verify(Laxkit::anObject *context); //preflight checker
@@ -752,7 +752,7 @@ int PageAtlasExportFilter::Out(const char *filename, Laxkit::anObject *context,
 	} //for each spread
 
 	
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	//clean up
 	wholeimg->dec_count();
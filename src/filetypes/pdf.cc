@@ -22,6 +22,7 @@
 #include <lax/transformmath.h>
 #include <lax/attributes.h>
 #include <lax/fileutils.h>
+#include <lax/utf8utils.h>
 
 #include "../language.h"
 #include "../laidout.h"
@@ -30,6 +31,22 @@
 #include "pdf.h"
 #include "../impositions/singles.h"
 #include "../core/utils.h"
+#include "../text/shapecache.h"
+
+#include <zlib.h>
+#include <cstdarg>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+#include FT_FONT_FORMATS_H
+#include <hb.h>
+#include <hb-subset.h>
 
 #include <iostream>
 #define DBG 
@@ -49,10 +66,148 @@ namespace Laidout {
 
 
 
+//------------------------- PdfStream -----------------------
+
+/*! \class PdfStream
+ * \brief Growable byte buffer that pdf content streams are built up in.
+ *
+ * Appending is amortized constant time, unlike appendstr() on a plain char*, which
+ * copies the whole string on every append. Number() writes decimals without going
+ * through printf, since paths produce huge numbers of them.
+ */
+class PdfStream
+{
+  public:
+	char *data;
+	long len;
+	long maxlen;
+
+	PdfStream() { data = NULL; len = maxlen = 0; }
+	~PdfStream() { delete[] data; }
+
+	void Reserve(long n);
+	void Clear() { len = 0; }
+	const char *Data() { return data; }
+	long Len() { return len; }
+
+	void Append(const char *str) { if (str) Append(str, strlen(str)); }
+	void Append(const char *str, long n);
+	void Byte(unsigned char ch) { if (len+1 > maxlen) Reserve(len+1); data[len++] = ch; }
+	void Printf(const char *fmt, ...);
+	void Number(double d);
+	void Point(flatpoint p) { Number(p.x); Byte(' '); Number(p.y); Byte(' '); }
+};
+
+/*! Make sure there is room for at least n bytes total.
+ */
+void PdfStream::Reserve(long n)
+{
+	if (n <= maxlen) return;
+	long newmax = (maxlen < 1024 ? 1024 : maxlen);
+	while (newmax < n) newmax *= 2;
+
+	char *ndata = new char[newmax];
+	if (len) memcpy(ndata, data, len);
+	delete[] data;
+	data = ndata;
+	maxlen = newmax;
+}
+
+void PdfStream::Append(const char *str, long n)
+{
+	if (n <= 0) return;
+	if (len+n > maxlen) Reserve(len+n);
+	memcpy(data+len, str, n);
+	len += n;
+}
+
+void PdfStream::Printf(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	char scratch[256];
+	int n = vsnprintf(scratch, sizeof(scratch), fmt, args);
+	va_end(args);
+	if (n < 0) return;
+
+	if (n < (int)sizeof(scratch)) {
+		Append(scratch, n);
+		return;
+	}
+
+	Reserve(len+n+1);
+	va_start(args, fmt);
+	vsnprintf(data+len, n+1, fmt, args);
+	va_end(args);
+	len += n;
+}
+
+/*! Append d with up to 10 decimal places, like "%.10f" but without trailing zeros.
+ * Always uses '.' for the decimal point, whatever the locale.
+ */
+void PdfStream::Number(double d)
+{
+	if (d != d) d = 0; //nan
+	double ad = fabs(d);
+	if (ad >= 1e8) { Printf("%.10f", d); return; }
+
+	unsigned long long v = (unsigned long long)(ad * 1e10 + .5);
+	if (v == 0) { Byte('0'); return; }
+
+	unsigned long long ipart = v / 10000000000ULL;
+	unsigned long long fpart = v % 10000000000ULL;
+
+	char buf[32];
+	int i = sizeof(buf);
+	if (fpart) {
+		int digits = 10;
+		while (fpart % 10 == 0) { fpart /= 10; digits--; }
+		while (digits--) { buf[--i] = '0' + fpart % 10; fpart /= 10; }
+		buf[--i] = '.';
+	}
+	do { buf[--i] = '0' + ipart % 10; ipart /= 10; } while (ipart);
+	if (d < 0) buf[--i] = '-';
+
+	Append(buf+i, sizeof(buf)-i);
+}
+
+
+//! Write the stream part of a stream object, finishing off its dict with /Filter and /Length.
+/*! If compress, then try to deflate data, falling back to raw data if that fails.
+ * Otherwise, data is written as is, with filter as its /Filter, if any.
+ */
+static void pdfStreamData(FILE *f, const unsigned char *data, unsigned long len, bool compress, const char *filter)
+{
+	unsigned char *zdata = NULL;
+	if (compress && len) {
+		uLongf zlen = compressBound(len);
+		zdata = new unsigned char[zlen];
+		if (compress2(zdata, &zlen, data, len, Z_DEFAULT_COMPRESSION) == Z_OK) {
+			data = zdata;
+			len = zlen;
+			filter = "/FlateDecode";
+		} else {
+			DBG cerr << " *** warning: stream compression failed, writing raw data"<<endl;
+			filter = NULL;
+		}
+	}
+
+	if (filter) fprintf(f,"  /Filter %s\n", filter);
+	fprintf(f,"  /Length %lu\n"
+			  ">>\n"
+			  "stream\n", len);
+	fwrite(data, 1, len, f);
+	fprintf(f,"\nendstream\n"
+			  "endobj\n");
+
+	delete[] zdata;
+}
+
+
 //------------------------- forward decs -----------------------
 
-int pdfSetClipToPath(char *&stream,LaxInterfaces::SomeData *outline,int iscontinuing, const double *extra_m);
-static int pdfaddpath(FILE *f,Coordinate *path, char *&stream, const double *extra_m=NULL);
+int pdfSetClipToPath(PdfStream &stream,LaxInterfaces::SomeData *outline,int iscontinuing, const double *extra_m);
+static int pdfaddpath(FILE *f,Coordinate *path, PdfStream &stream, const double *extra_m=NULL);
 
 
 //------------------------- PdfImportFilter -----------------------------
@@ -227,6 +382,8 @@ class PdfObjInfo
 	long len; //length of data, just in case data has bytes with 0 value
 	unsigned long lo_object_id;
 	anObject *lo_object;
+	char *image_key; //for image xobjects, see pdfImageKey()
+	unsigned long form_object_id; //for form xobjects, object_id of the object drawn in it
 
 	PdfObjInfo();
 	virtual ~PdfObjInfo();
@@ -238,11 +395,14 @@ PdfObjInfo::PdfObjInfo()
 	i = o++; 
 	lo_object_id=0;
 	lo_object=NULL;
+	image_key=NULL;
+	form_object_id=0;
 	DBG cerr<<"creating PdfObjInfo "<<i<<"..."<<endl;
 }
 PdfObjInfo::~PdfObjInfo()
 {
 	DBG cerr<<"delete PdfObjInfo i="<<i<<", number="<<number<<"..."<<endl;
+	if (image_key) delete[] image_key;
 	if (next) delete next; 
 
 }
@@ -272,22 +432,75 @@ PdfPageInfo::~PdfPageInfo()
 	if (pagelabel) delete[] pagelabel; 
 }
 
+//---------------------------- PdfFontInfo
+
+/*! \class PdfFontInfo
+ * \brief One font face used during export, shared by all text using that face.
+ *
+ * Its object number is reserved for the font dict when the face is first used, but it is
+ * written out by pdfWriteFonts() after all pages, when the set of glyphs used is known.
+ */
+class PdfFontInfo : public PdfObjInfo
+{
+ public:
+	char *file;    //null for stand in Helvetica, which is also used when file cannot be loaded
+	int face_index; //which face of file
+	char *psname;
+	FT_Face ft_face;
+	bool cid;      //sfnt fonts are written as Type0 with 2 byte glyph ids and a subsetted font program
+	std::map<unsigned int, std::vector<unsigned int>> glyphs; //glyph id -> unicode text when cid, else char code -> char code
+
+	PdfFontInfo() { file = psname = NULL; face_index = 0; ft_face = NULL; cid = false; }
+	virtual ~PdfFontInfo();
+};
+
+PdfFontInfo::~PdfFontInfo()
+{
+	delete[] file;
+	delete[] psname;
+	if (ft_face) FT_Done_Face(ft_face);
+}
+
 //----------------forward declarations
 
-static void pdfColorPatch(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount,
+static void pdfColorPatch(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount,
 				  Attribute &resources, ColorPatchData *g, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfImage(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfImage(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 					 LaxInterfaces::ImageData *img, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfImagePatch(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfImagePatch(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 					 LaxInterfaces::ImagePatchData *img, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfGradient(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfGradient(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 						LaxInterfaces::GradientData *g, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfPaths(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfPaths(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 						LaxInterfaces::PathsData *g, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfCaption(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfCaption(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 						LaxInterfaces::CaptionData *g, ErrorLog &log,int &warning, DocumentExportConfig *config);
-static void pdfTextOnPath(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&stream, int &objectcount, Attribute &resources,
+static void pdfTextOnPath(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, PdfStream &stream, int &objectcount, Attribute &resources,
 						LaxInterfaces::TextOnPath *g, ErrorLog &log,int &warning, DocumentExportConfig *config);
+static void pdfWriteFonts(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, int &objectcount, ErrorLog &log, int &warning);
+
+
+//-------------------------------- pdfResources
+
+//! Write out a /Resources entry for a page or form dict.
+static void pdfResources(FILE *f, Attribute &resources)
+{
+	if (resources.attributes.n) {
+		fprintf(f,"  /Resources <<\n");
+		for (int c2=0; c2<resources.attributes.n; c2++) {
+			fprintf(f,"    %s <<\n",resources.attributes.e[c2]->name);  //eg "/XObject << /X0 4 0 R"
+			fprintf(f,"      %s\n",resources.attributes.e[c2]->value);
+			fprintf(f,"    >>\n");
+		}
+		fprintf(f,"  >>\n");
+	} else fprintf(f,"  /Resources << >>\n");
+}
+
+static int pdfForm(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, int &objectcount, Attribute &resources,
+				   LaxInterfaces::SomeData *object, ErrorLog &log,int &warning, DocumentExportConfig *config);
+
+//! object_id of objects that have a form xobject in the current file -> pdf object number of the form.
+static std::unordered_map<unsigned long, long> pdfforms;
 
 
 //-------------------------------- pdfdumpobj
@@ -313,7 +526,7 @@ static void pdfTextOnPath(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, char *&st
 void pdfdumpobj(FILE *f,
 				PdfObjInfo *objs, 
 				PdfObjInfo *&obj,
-				char *&stream,
+				PdfStream &stream,
 				int &objectcount,
 				Attribute &resources,
 				LaxInterfaces::SomeData *object,
@@ -343,7 +556,7 @@ void pdfdumpobj(FILE *f,
 		//sprintf(scratch,"q\n"
 				  //"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 					//m[0], m[1], m[2], m[3], m[4], m[5]); 
-		appendstr(stream,scratch);
+		stream.Append(scratch);
 		//pdfSetClipToPath(stream, clip, 0, clip->m());
 		pdfSetClipToPath(stream, clip, 0, m);
 	}
@@ -355,7 +568,7 @@ void pdfdumpobj(FILE *f,
 		//remove clip
 		if (dobj && dobj->clip_path) {
 			//sprintf(scratch,"Q\n");
-			appendstr(stream,"Q\n");
+			stream.Append("Q\n");
 			psPopCtm();
 		}
         return; // *** this fails when children exist!!
@@ -369,7 +582,7 @@ void pdfdumpobj(FILE *f,
 		sprintf(scratch,"q\n"
 				  "%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 					object->m((int)0), object->m(1), object->m(2), object->m(3), object->m(4), object->m(5)); 
-		appendstr(stream,scratch);
+		stream.Append(scratch);
 	}
 	
 	if (!strcmp(object->whattype(),"Group")) {
@@ -415,10 +628,17 @@ void pdfdumpobj(FILE *f,
 
 	} else if (!strcmp(object->whattype(),"SomeDataRef")) {
 		//this can link to any object, in or out of the current page, but pdf pages are supposed to be self contained. vexing!
+		//Referenced objects are written once as a form xobject, which each ref then draws with Do.
 		SomeDataRef *ref = dynamic_cast<SomeDataRef*>(object);
 		SomeData *refed = ref->GetFinalObject();
-		if (refed != NULL) {
-			pdfdumpobj(f, objs, obj, stream, objectcount, resources, refed, log, warning, config, false, false);
+		if (refed != NULL && refed->Visible()) {
+			int form = pdfForm(f, objs, obj, objectcount, resources, refed, log, warning, config);
+			if (form > 0) {
+				sprintf(scratch, "/form%ld Do\n", refed->object_id);
+				stream.Append(scratch);
+			} else {
+				pdfdumpobj(f, objs, obj, stream, objectcount, resources, refed, log, warning, config, false, false);
+			}
 		}
 
 	} else {
@@ -428,7 +648,7 @@ void pdfdumpobj(FILE *f,
 
 		//remove object transform, since we use a totally different one
 		if (use_transform) {
-			appendstr(stream,"Q\n");
+			stream.Append("Q\n");
 			psPopCtm(); 
 		}
 
@@ -440,17 +660,17 @@ void pdfdumpobj(FILE *f,
             dobje->dec_count();
 
         } else { 
-            setlocale(LC_ALL,"");
+            UseCLocale(false);
             char buffer[strlen(_("Cannot export %s objects to pdf."))+strlen(object->whattype())+1];
             sprintf(buffer,_("Cannot export %s objects to pdf."),object->whattype());
             log.AddMessage(object->object_id,object->nameid,NULL, buffer,ERROR_Warning);
-            setlocale(LC_ALL,"C");
+            UseCLocale(true);
             warning++;
         }
 
 		//remove clipping
 		if (dobj && dobj->clip_path) {
-			appendstr(stream,"Q\n");
+			stream.Append("Q\n");
 			psPopCtm();
 		}
 		return;
@@ -459,17 +679,83 @@ void pdfdumpobj(FILE *f,
 	
 	 // pop object transform
 	if (use_transform) {
-		appendstr(stream,"Q\n");
+		stream.Append("Q\n");
 		psPopCtm();
 	}
 
 	//remove clipping
 	if (dobj && dobj->clip_path) {
-		appendstr(stream,"Q\n");
+		stream.Append("Q\n");
 		psPopCtm();
 	}
 }
 
+//-------------------------------- pdfForm
+
+//! Make sure there is a form xobject for object, and that resources refers to it as /form[object_id].
+/*! The form contains object drawn in its own coordinates, without its transform, the same
+ * as SomeDataRef needs. The form is written to f the first time object is encountered,
+ * and shared by all later uses in the file, on any page.
+ *
+ * Returns the pdf object number of the form, or -1 if object has no usable bounds, in which case
+ * it should be drawn inline instead.
+ */
+static int pdfForm(FILE *f,
+				   PdfObjInfo *objs, 
+				   PdfObjInfo *&obj,
+				   int &objectcount,
+				   Attribute &resources,
+				   LaxInterfaces::SomeData *object,
+				   ErrorLog &log,int &warning, DocumentExportConfig *config)
+{
+	if (!object->validbounds()) return -1;
+
+	auto existing = pdfforms.find(object->object_id);
+
+	int formobj = -1;
+	if (existing != pdfforms.end()) {
+		formobj = existing->second;
+
+	} else {
+		 //objects used within the form get written to f as the form stream is built,
+		 //so the form itself is written after
+		PdfStream formstream;
+		Attribute formresources;
+		pdfdumpobj(f, objs, obj, formstream, objectcount, formresources, object, log, warning, config, false, false);
+
+		obj->next = new PdfObjInfo;
+		obj = obj->next;
+		obj->byteoffset = ftell(f);
+		obj->number = objectcount++;
+		obj->form_object_id = object->object_id;
+		formobj = obj->number;
+		pdfforms[object->object_id] = formobj;
+
+		 //line widths and such may stick out of the object's bounds, so pad the form bbox generously
+		double pad = (object->boxwidth() > object->boxheight() ? object->boxwidth() : object->boxheight()) + 1;
+		fprintf(f,"%ld 0 obj\n",obj->number);
+		fprintf(f,"<<\n"
+				  "  /Type /XObject\n"
+				  "  /Subtype /Form\n"
+				  "  /BBox [%.10g %.10g %.10g %.10g]\n",
+				 object->minx-pad, object->miny-pad, object->maxx+pad, object->maxy+pad);
+		pdfResources(f, formresources);
+		pdfStreamData(f, (const unsigned char*)formstream.Data(), formstream.Len(), true, NULL);
+	}
+
+	 //Add form to resources
+	char scratch[100];
+	Attribute *xobject = resources.find("/XObject");
+	sprintf(scratch,"/form%ld %d 0 R\n", object->object_id, formobj);
+	if (xobject) {
+		if (!strstr(xobject->value, scratch)) appendstr(xobject->value,scratch);
+	} else {
+		resources.push("/XObject",scratch);
+	}
+
+	return formobj;
+}
+
 //! Output a pdf clipping path from outline.
 /*! 
  * outline can be a group of PathsData, a SomeDataRef to a PathsData, 
@@ -487,7 +773,7 @@ void pdfdumpobj(FILE *f,
  *   that PathsData are capable of. when pdf output of paths is 
  *   actually more implemented, this will change..
  */
-int pdfSetClipToPath(char *&stream,LaxInterfaces::SomeData *outline,int iscontinuing, const double *extra_m)
+int pdfSetClipToPath(PdfStream &stream,LaxInterfaces::SomeData *outline,int iscontinuing, const double *extra_m)
 {
 	PathsData *path=dynamic_cast<PathsData *>(outline);
 
@@ -516,13 +802,13 @@ int pdfSetClipToPath(char *&stream,LaxInterfaces::SomeData *outline,int iscontin
 			 //add transform of group element
 			sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 					d->m((int)0), d->m(1), d->m(2), d->m(3), d->m(4), d->m(5)); 
-			appendstr(stream,scratch);
+			stream.Append(scratch);
 			n += pdfSetClipToPath(stream,g->e(c),1, NULL);
 			transform_invert(m,d->m());
 			 //reverse the transform
-			sprintf(stream,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
+			sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 					m[0], m[1], m[2], m[3], m[4], m[5]); 
-			appendstr(stream,scratch);
+			stream.Append(scratch);
 		}
 	}
 	
@@ -545,18 +831,18 @@ int pdfSetClipToPath(char *&stream,LaxInterfaces::SomeData *outline,int iscontin
 			//	fp = (extra_m ? transform_point(extra_m, p->fp) : p->fp);
 			//	sprintf(scratch,"%.10f %.10f %s\n",
 			//			fp.x,fp.y, (p==start?"m":"l"));
-			//	appendstr(stream,scratch);
+			//	stream.Append(scratch);
 			//	p=p->next;	
 			//} while (p && p!=start);
 			//----
 
-			//appendstr(stream,"S\n");
-			appendstr(stream,"W n\n"); //define the clip
+			//stream.Append("S\n");
+			stream.Append("W n\n"); //define the clip
 		}
 	}
 	
 //	if (n && !iscontinuing) {
-//		appendstr(stream,"W n\n");
+//		stream.Append("W n\n");
 //	}
 	return n;
 }
@@ -613,7 +899,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	}
 
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	
 	DBG cerr <<"=================== start pdf out range "<<config->range.ToString(false, false, false)<<", paper override:"
 	DBG      <<(papergroup ? papergroup->papers.n : -1)<<" ====================\n";
@@ -637,6 +923,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	 // has generation number of 65535. Its number is the object number of
 	 // the next free object. Since this is a fresh pdf, there are no 
 	 // other free objects.
+	pdfforms.clear();
 	PdfObjInfo *objs= new PdfObjInfo; //head of all pdf objects
 	PdfObjInfo *obj = NULL;            //temp object pointer
 	obj             = objs;
@@ -661,7 +948,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	PdfPageInfo *pageobjs = NULL;  //points to first page dict
 	double m[6];
 	Page *page   = NULL;  // temp pointer
-	char *stream = NULL;  // page stream
+	PdfStream stream;     // page stream
 	char  scratch[300];   // temp buffer
 	int   pgindex;        // convenience variable
 	char *desc = NULL;
@@ -717,7 +1004,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 
 			 //set initial transform: convert from inches and map to paper in papergroup
 			//transform_set(m,1,0,0,1,0,0);
-			appendstr(stream,"q\n"
+			stream.Append("q\n"
 							 "72 0 0 72 0 0 cm\n"); // convert from inches
 			//transforms.Multiply(Affine(72.,0.,0.,72.,0.,0.));
 			psConcat(72.,0.,0.,72.,0.,0.);
@@ -729,7 +1016,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 				transform_invert(m, papergroup->papers.e[p]->m());
 				sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 						m[0], m[1], m[2], m[3], m[4], m[5]); 
-				appendstr(stream,scratch);
+				stream.Append(scratch);
 				psConcat(m);
 				transforms.PushAndNewAxes(m);
 			} else if (spread) {
@@ -738,7 +1025,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 				transform_set(m, 1,0,0,1, -spread->path->minx, -spread->path->miny);
 				sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 						m[0], m[1], m[2], m[3], m[4], m[5]); 
-				appendstr(stream,scratch);
+				stream.Append(scratch);
 				psConcat(m);
 				transforms.PushAndNewAxes(m);
 			}
@@ -771,14 +1058,14 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 					page = doc->pages.e[pgindex];
 					
 					 // transform to page
-					appendstr(stream,"q\n"); //save ctm
+					stream.Append("q\n"); //save ctm
 					//transforms.PushAxes();
 					psPushCtm();
 					transforms.PushAxes();
 					transform_copy(m,spread->pagestack.e[c2]->outline->m());
 					sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 							m[0], m[1], m[2], m[3], m[4], m[5]); 
-					appendstr(stream,scratch);
+					stream.Append(scratch);
 					transforms.Multiply(m);
 					psConcat(m);
 
@@ -801,8 +1088,8 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 
 							sprintf(scratch,"%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 									bleed->matrix[0], bleed->matrix[1], bleed->matrix[2], bleed->matrix[3], bleed->matrix[4], bleed->matrix[5]); 
-							appendstr(stream,"q\n"); //save ctm
-							appendstr(stream,scratch);
+							stream.Append("q\n"); //save ctm
+							stream.Append(scratch);
 							transforms.PushAndNewAxes(bleed->matrix);
 							psPushCtm();
 							psConcat(bleed->matrix);
@@ -811,7 +1098,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 								pdfdumpobj(f,objs,obj,stream,objcount,pageobj->resources,otherpage->layers.e(l),log,warning,config);
 							}
 
-							appendstr(stream,"Q\n"); //pop ctm, bleed transform
+							stream.Append("Q\n"); //pop ctm, bleed transform
 							transforms.PopAxes();
 							psPopCtm();
 						}
@@ -823,7 +1110,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 						pdfdumpobj(f,objs,obj,stream,objcount,pageobj->resources,page->layers.e(l),log,warning,config);
 					}
 
-					appendstr(stream,"Q\n"); //pop ctm, page transform
+					stream.Append("Q\n"); //pop ctm, page transform
 					transforms.PopAxes();
 					psPopCtm();
 				}
@@ -831,20 +1118,20 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 
 			 // print out paper footer
 			if (papergroup) {
-				appendstr(stream,"Q\n"); //pop papergroup transform
+				stream.Append("Q\n"); //pop papergroup transform
 				transforms.PopAxes();
 				psPopCtm();
 			} else if (spread) {
-				appendstr(stream,"Q\n"); //pop papergroup transform
+				stream.Append("Q\n"); //pop papergroup transform
 				transforms.PopAxes();
 				psPopCtm();
 			
 			}
 //			if (paperrotate>0) {
-//				appendstr(stream,"Q\n"); //pop paper rotation transform
+//				stream.Append("Q\n"); //pop paper rotation transform
 //				psPopCtm();
 //			}
-			//appendstr(stream,"Q\n"); //pop  pt to inches conversion (not really necessary
+			//stream.Append("Q\n"); //pop  pt to inches conversion (not really necessary
 			//transforms.PopAxes();
 			//psPopCtm();
 
@@ -857,13 +1144,10 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 			obj->number = objcount++;
 			obj->byteoffset = ftell(f);
 			fprintf(f,"%ld 0 obj\n"
-					  "<< /Length %lu >>\n"
-					  "stream\n",
-						obj->number, strlen(stream));
-			fwrite(stream,1,strlen(stream),f); //write(obj->data,1,obj->len,f);
-			fprintf(f,"\nendstream\n"
-					  "endobj\n");
-			delete[] stream; stream=NULL;
+					  "<<\n",
+						obj->number);
+			pdfStreamData(f, (const unsigned char*)stream.Data(), stream.Len(), true, NULL);
+			stream.Clear();
 
 			pageobj->contents = obj->number;
 			//pageobj gets its own number and byte offset later
@@ -872,6 +1156,8 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 		if (desc) delete[] desc;
 	}
 
+	 // fonts are shared by all pages, so they are written once all glyphs used are known
+	pdfWriteFonts(f, objs, obj, objcount, log, warning);
 	
 	
 	 // write out pdf /Page dicts, which do not have their object number or offsets yet.
@@ -892,15 +1178,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 		fprintf(f,"<<\n  /Type /Page\n");
 		fprintf(f,"  /Parent %d 0 R\n",pages);
 		 // would include referenced xobjects!!
-		if (pageobj->resources.attributes.n) {
-			fprintf(f,"  /Resources <<\n");
-			for (int c2=0; c2<pageobj->resources.attributes.n; c2++) {
-				fprintf(f,"    %s <<\n",pageobj->resources.attributes.e[c2]->name);  //eg "/XObject << /X0 4 0 R"
-				fprintf(f,"      %s\n",pageobj->resources.attributes.e[c2]->value);
-				fprintf(f,"    >>\n");
-			}
-			fprintf(f,"  >>\n");
-		} else fprintf(f,"  /Resources << >>\n");
+		pdfResources(f, pageobj->resources);
 		fprintf(f,"  /Contents %d 0 R\n",pageobj->contents); //not req, but of course necessary if stuff on page
 
 
@@ -1078,7 +1356,7 @@ int PdfExportFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	fprintf(f,"%%%%EOF\n");
 
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 
 	 //clean up
@@ -1113,12 +1391,12 @@ extern char ro[][16], co[][16];
  * to be scaled so that the range [0..65535] is scaled to the objects bounding box.
  * This writes out 2 bytes per val.
  */
-static void writeout(char *stream,int &len,int val)
+static void writeout(PdfStream &stream,int val)
 {
 	if (val<0) val=0;
 	else if (val>65535) val=65535;
-	stream[len++]=(val&0xff00)>>8;
-	stream[len++]=val&0xff;
+	stream.Byte((val&0xff00)>>8);
+	stream.Byte(val&0xff);
 }
 
 /*! Add to stream, using 16 bit coordintates, 8 bit color, and 8 bits for the flag.
@@ -1126,29 +1404,14 @@ static void writeout(char *stream,int &len,int val)
  *
  * \todo for transparency soft masks, need a version that only appends alpha, not the colors
  */
-static void pdfContinueColorPatch(char *&stream,
-								  int &len,
-								  int &maxlen,
+static void pdfContinueColorPatch(PdfStream &stream,
 								  ColorPatchData *g,
 								  char flag, //!< The edge flag
 								  int o,     //!< orientation of the section
 								  int r,     //!< Row of upper corner (patch index, not coord index)
 								  int c)     //!< Column of upper corner (patch index, not coord index)
 {
-	 //make sure stream has enough space allocated
-	if (!stream) {
-		stream=new char[1024];
-		maxlen=1024;
-		len=0;
-	} else if (len+400>maxlen) {
-		maxlen+=1024;
-		char *nstream=new char[maxlen];
-		memcpy(nstream,stream,len);
-		delete[] stream;
-		stream=nstream;
-	}
-
-	stream[len++]=flag;
+	stream.Byte(flag);
 
 	r*=3; 
 	c*=3;
@@ -1164,37 +1427,37 @@ static void pdfContinueColorPatch(char *&stream,
 		   ay=65535/(g->maxy-g->miny),
 		   by=ay*g->miny;
 	if (flag==0) {
-		writeout(stream,len,(int)(g->points[i+ro[o][ 0]*xs+co[o][ 0]].x*ax-bx));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 0]*xs+co[o][ 0]].y*ay-by));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 1]*xs+co[o][ 1]].x*ax-bx));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 1]*xs+co[o][ 1]].y*ay-by));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 2]*xs+co[o][ 2]].x*ax-bx));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 2]*xs+co[o][ 2]].y*ay-by));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 3]*xs+co[o][ 3]].x*ax-bx));
-		writeout(stream,len,(int)(g->points[i+ro[o][ 3]*xs+co[o][ 3]].y*ay-by));
+		writeout(stream,(int)(g->points[i+ro[o][ 0]*xs+co[o][ 0]].x*ax-bx));
+		writeout(stream,(int)(g->points[i+ro[o][ 0]*xs+co[o][ 0]].y*ay-by));
+		writeout(stream,(int)(g->points[i+ro[o][ 1]*xs+co[o][ 1]].x*ax-bx));
+		writeout(stream,(int)(g->points[i+ro[o][ 1]*xs+co[o][ 1]].y*ay-by));
+		writeout(stream,(int)(g->points[i+ro[o][ 2]*xs+co[o][ 2]].x*ax-bx));
+		writeout(stream,(int)(g->points[i+ro[o][ 2]*xs+co[o][ 2]].y*ay-by));
+		writeout(stream,(int)(g->points[i+ro[o][ 3]*xs+co[o][ 3]].x*ax-bx));
+		writeout(stream,(int)(g->points[i+ro[o][ 3]*xs+co[o][ 3]].y*ay-by));
 	}
 	for (int cc=4; cc<16; cc++) {
-		writeout(stream,len,(int)(g->points[i+ro[o][cc]*xs+co[o][cc]].x*ax-bx));
-		writeout(stream,len,(int)(g->points[i+ro[o][cc]*xs+co[o][cc]].y*ay-by));
+		writeout(stream,(int)(g->points[i+ro[o][cc]*xs+co[o][cc]].x*ax-bx));
+		writeout(stream,(int)(g->points[i+ro[o][cc]*xs+co[o][cc]].y*ay-by));
 	}
 
 	 //write out colors
 	if (flag==0) {
 		int c1=ci + (ro[o][0]?1:0)*cx + (co[o][0]?1:0),
 			c2=ci + (ro[o][3]?1:0)*cx + (co[o][3]?1:0);
-		stream[len++]=g->colors[c1].red/256;
-		stream[len++]=g->colors[c1].green/256;
-		stream[len++]=g->colors[c1].blue/256;
-		stream[len++]=g->colors[c2].red/256;
-		stream[len++]=g->colors[c2].green/256;
-		stream[len++]=g->colors[c2].blue/256;
+		stream.Byte(g->colors[c1].red/256);
+		stream.Byte(g->colors[c1].green/256);
+		stream.Byte(g->colors[c1].blue/256);
+		stream.Byte(g->colors[c2].red/256);
+		stream.Byte(g->colors[c2].green/256);
+		stream.Byte(g->colors[c2].blue/256);
 	}
-	stream[len++]=g->colors[c3].red/256;
-	stream[len++]=g->colors[c3].green/256;
-	stream[len++]=g->colors[c3].blue/256;
-	stream[len++]=g->colors[c4].red/256;
-	stream[len++]=g->colors[c4].green/256;
-	stream[len++]=g->colors[c4].blue/256;
+	stream.Byte(g->colors[c3].red/256);
+	stream.Byte(g->colors[c3].green/256);
+	stream.Byte(g->colors[c3].blue/256);
+	stream.Byte(g->colors[c4].red/256);
+	stream.Byte(g->colors[c4].green/256);
+	stream.Byte(g->colors[c4].blue/256);
 
 }
 
@@ -1210,7 +1473,7 @@ static void pdfContinueColorPatch(char *&stream,
 static void pdfColorPatch(FILE *f,
 				  PdfObjInfo *objs, 
 				  PdfObjInfo *&obj,
-				  char *&stream,
+				  PdfStream &stream,
 				  int &objectcount,
 				  Attribute &resources,
 				  ColorPatchData *g,
@@ -1226,22 +1489,21 @@ static void pdfColorPatch(FILE *f,
 	columns=g->xsize/3;
 	r=0;
 
-	int srcstreamlen=0, maxlen=0;
-	char *srcstream=NULL;
+	PdfStream srcstream;
 
 	 // install first patch
-	pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 0,LBLT, 0,0);
+	pdfContinueColorPatch(srcstream, g, 0,LBLT, 0,0);
 
 	 // handle single column case separately
 	if (columns==1) {
 		r=1;
 		c=0;
 		if (r<rows) {
-			pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 3,RTLT, r,c);
+			pdfContinueColorPatch(srcstream, g, 3,RTLT, r,c);
 			r++;
 			while (r<rows) {
-				if (r%2) pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,RTLT, r,c);
-					else pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,LTRT, r,c);
+				if (r%2) pdfContinueColorPatch(srcstream, g, 2,RTLT, r,c);
+					else pdfContinueColorPatch(srcstream, g, 2,LTRT, r,c);
 				r++;
 			}
 		}
@@ -1253,8 +1515,8 @@ static void pdfColorPatch(FILE *f,
 
 		 // add patches left to right
 		while (c<columns) {
-			if (c%2) pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,LTLB, r,c);
-				else pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,LBLT, r,c);
+			if (c%2) pdfContinueColorPatch(srcstream, g, 2,LTLB, r,c);
+				else pdfContinueColorPatch(srcstream, g, 2,LBLT, r,c);
 			c++;
 		}
 		r++;
@@ -1265,22 +1527,22 @@ static void pdfColorPatch(FILE *f,
 			 // add connection downward, and the patch immediately
 			 // to the left of it.
 			if (c%2) {
-				pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 1,LTRT, r,c);
+				pdfContinueColorPatch(srcstream, g, 1,LTRT, r,c);
 				c--;
-				if (c>=0) pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 3,RBRT, r,c);
+				if (c>=0) pdfContinueColorPatch(srcstream, g, 3,RBRT, r,c);
 				c--;
 			} else {
-				pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 3,RTLT, r,c);
+				pdfContinueColorPatch(srcstream, g, 3,RTLT, r,c);
 				c--;
-				if (c>=0) { pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 1,RTRB, r,c); }
+				if (c>=0) { pdfContinueColorPatch(srcstream, g, 1,RTRB, r,c); }
 				c--;
 			}
 
 			 // continue adding patches right to left
 			while (c>=0) {
 				  // add patches leftward
-				if (c%2) pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,RTRB, r,c);
-					else pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 2,RBRT, r,c);
+				if (c%2) pdfContinueColorPatch(srcstream, g, 2,RTRB, r,c);
+					else pdfContinueColorPatch(srcstream, g, 2,RBRT, r,c);
 				 c--;
 			}
 			r++;
@@ -1288,9 +1550,9 @@ static void pdfColorPatch(FILE *f,
 			if (r<rows) {
 				c++;
 				 // 0 is always even, so only one kind of extention here
-				pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 3,LTRT, r,c);
+				pdfContinueColorPatch(srcstream, g, 3,LTRT, r,c);
 				c++; // c will be 1 here, and columns we already know is > 1
-				pdfContinueColorPatch(srcstream,srcstreamlen,maxlen, g, 1,LTLB, r,c);
+				pdfContinueColorPatch(srcstream, g, 1,LTLB, r,c);
 				c++;
 			}
 		}
@@ -1312,18 +1574,12 @@ static void pdfColorPatch(FILE *f,
 			  "  /BitsPerFlag       8\n"
 			  "  /Decode     [%.10f %.10f %.10f %.10f 0 1 0 1 0 1]\n", //xxyy r g b
 			  	g->minx,g->maxx,g->miny,g->maxy);
-	fprintf(f,"  /Length      %d\n", srcstreamlen);
-	fprintf(f,">>\n"
-			  "stream\n");
-	
-	fwrite(srcstream,1,srcstreamlen,f);
-	fprintf(f,"\nendstream\n"
-			  "endobj\n");
+	pdfStreamData(f, (const unsigned char*)srcstream.Data(), srcstream.Len(), true, NULL);
 
 	 //attach to content stream
 	char scratch[50];
 	sprintf(scratch,"/colorpatch%ld sh\n\n",g->object_id);
-	appendstr(stream,scratch);
+	stream.Append(scratch);
 
 	 //Add shading function to resources
 	Attribute *shading=resources.find("/Shading");
@@ -1370,18 +1626,102 @@ void ascii_out(unsigned char *buf, int width, int height)
 	cerr <<endl;
 }
 
+//! 64 bit FNV-1a hash of some bytes, continuing from hash.
+static uint64_t pdfHashBytes(const unsigned char *data, long len, uint64_t hash = 14695981039346656037ULL)
+{
+	for (long c=0; c<len; c++) {
+		hash ^= data[c];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//! Return a new[]'d key to find identical images with, from the image's file and pixel contents.
+/*! buf is the argb image buffer. Images that are not from a file (like rendered image patches)
+ * are keyed only by content.
+ */
+static char *pdfImageKey(const char *filename, const unsigned char *buf, int width, int height)
+{
+	uint64_t hash = pdfHashBytes(buf, (long)width*height*4);
+	char scratch[100];
+	sprintf(scratch, "%dx%d %016llx ", width, height, (unsigned long long)hash);
+	char *key = newstr(scratch);
+	if (filename) appendstr(key, filename);
+	return key;
+}
+
+//! Read in a whole file. Return new[]'d data, or NULL if unreadable or empty.
+static unsigned char *pdfReadWholeFile(const char *filename, long &len)
+{
+	len = 0;
+	FILE *jf = fopen(filename, "rb");
+	if (!jf) return NULL;
+
+	fseek(jf, 0, SEEK_END);
+	long size = ftell(jf);
+	fseek(jf, 0, SEEK_SET);
+	if (size <= 0) { fclose(jf); return NULL; }
+
+	unsigned char *data = new unsigned char[size];
+	if (fread(data, 1, size, jf) != (size_t)size) {
+		delete[] data;
+		fclose(jf);
+		return NULL;
+	}
+	fclose(jf);
+	len = size;
+	return data;
+}
+
+//! Scan jpeg data for its frame header.
+/*! Returns 1 and sets width, height, and number of color components if found, else 0.
+ * Lossless and arithmetic coded frames return 0, since pdf readers can't be relied on for those.
+ */
+static int pdfJpegInfo(const unsigned char *data, long len, int &width, int &height, int &components)
+{
+	if (len < 4 || data[0] != 0xff || data[1] != 0xd8) return 0;
+
+	long i = 2;
+	while (i+3 < len) {
+		if (data[i] != 0xff) return 0;
+		unsigned char marker = data[i+1];
+		if (marker == 0xff) { i++; continue; } //fill byte
+		if (marker == 0xd8 || (marker >= 0xd0 && marker <= 0xd7) || marker == 0x01) { i += 2; continue; }
+		if (marker == 0xd9 || marker == 0xda) return 0; //end of image or start of scan before any frame
+
+		long seglen = (data[i+2]<<8) | data[i+3];
+		if (marker == 0xc0 || marker == 0xc1 || marker == 0xc2) {
+			 //baseline, extended sequential, or progressive huffman
+			if (i+9 >= len) return 0;
+			height     = (data[i+5]<<8) | data[i+6];
+			width      = (data[i+7]<<8) | data[i+8];
+			components = data[i+9];
+			return 1;
+		}
+		if (marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) return 0;
+
+		i += 2 + seglen;
+	}
+	return 0;
+}
+
 //! Append an image to pdf export. 
 /*! 
+ * Identical images are written only once per file, and shared between all the pages
+ * that use them. Identical means the same ImageData, or the same source file and pixel contents.
+ *
+ * Image and soft mask data are Flate compressed. If the image was loaded from a jpeg, and the
+ * pixel dimensions of the file match the image, then the jpeg data is copied straight in
+ * with DCTDecode instead.
+ *
  * \todo *** the output should be tailored to a specified dpi, otherwise the output
- *   file will sometimes be quite enormous. Also, repeat images are outputted for each
- *   instance, which also potentially increases size a lot
+ *   file will sometimes be quite enormous.
  * \todo image alternates?
- * \todo DCTDecode for jpgs
  */
 static void pdfImage(FILE *f,
 					 PdfObjInfo *objs, 
 					 PdfObjInfo *&obj,
-					 char *&stream,
+					 PdfStream &stream,
 					 int &objectcount,
 					 Attribute &resources,
 					 LaxInterfaces::ImageData *img,
@@ -1395,10 +1735,9 @@ static void pdfImage(FILE *f,
 
 
 
-	// *** search current PDfObjInfos for occurance of this image.
-	//     if found, add reference to that, rather than add duplicate.
-	//     WARNING! must be careful to include the found existing object
-	//     in resources! resources is fresh for each page.
+	 // Search current PdfObjInfos for this image. If found, add reference to that,
+	 // rather than add duplicate. Note the found object must still be added to
+	 // resources, since resources is fresh for each page.
 	PdfObjInfo *existing=objs;
 	while (existing) {
 		if (existing->lo_object_id==img->object_id) break;
@@ -1416,15 +1755,78 @@ static void pdfImage(FILE *f,
 		int height=image->h();
 		unsigned char *buf=image->getImageBuffer(); // ARGB
 
-		int softmask=-1;
-		if (image_has_alpha(buf,width*height)) { 
-			 // softmask image XObject dict
-			softmask=objectcount++;
+		char *key = pdfImageKey(img->filename, buf, width, height);
+		existing = objs;
+		while (existing) {
+			if (existing->image_key && !strcmp(existing->image_key, key)) break;
+			existing = existing->next;
+		}
+
+		if (existing) {
+			imagexobj = existing->number;
+			delete[] key;
+			image->doneWithBuffer(buf);
 
+		} else {
+			 //see if we can pass through jpeg data as is
+			unsigned char *jpeg = NULL;
+			long jpeglen = 0;
+			int jcomponents = 0;
+			if (img->filename) {
+				const char *ext = strrchr(img->filename, '.');
+				if (ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"))) {
+					jpeg = pdfReadWholeFile(img->filename, jpeglen);
+					int jwidth = 0, jheight = 0;
+					if (jpeg && (!pdfJpegInfo(jpeg, jpeglen, jwidth, jheight, jcomponents)
+								 || jwidth != width || jheight != height
+								 || (jcomponents != 1 && jcomponents != 3))) {
+						 //scaled preview, cmyk, or something else we can't pass through
+						delete[] jpeg;
+						jpeg = NULL;
+					}
+				}
+			}
+
+			int softmask=-1;
+			if (image_has_alpha(buf,width*height)) { 
+				 // softmask image XObject dict
+				softmask=objectcount++;
+
+				obj->next=new PdfObjInfo;
+				obj=obj->next;
+				obj->byteoffset=ftell(f);
+				obj->number=softmask;
+				fprintf(f,"%ld 0 obj\n",obj->number);
+				fprintf(f,"<<\n"
+						  "  /Type /XObject\n"
+						  "  /Subtype /Image\n"
+						  "  /Width  %d\n"
+						  "  /Height %d\n",
+						 width, height);
+				fprintf(f,"  /ColorSpace  /DeviceGray\n"
+						  "  /BitsPerComponent  8\n");
+						  //"  /Intent \n" (opt 1.1) ignored
+						  //"  /Decode     [0 1 0 1 0 1]\n", //(opt) r g b
+						  //"  /Interpolate false\n" //(opt)
+						  //"  /Matte *** \n" //(opt, 1.4), for use when img is pre-multiplied alpha
+
+				unsigned char *alpha = new unsigned char[width*height];
+				long n = (long)width*height;
+				for (long c=0; c<n; c++) alpha[c] = buf[4*c+3];
+				pdfStreamData(f, alpha, n, true, NULL);
+				delete[] alpha;
+			}
+			
+
+
+			 // image XObject dict
 			obj->next=new PdfObjInfo;
 			obj=obj->next;
 			obj->byteoffset=ftell(f);
-			obj->number=softmask;
+			obj->number=objectcount++;
+			obj->lo_object_id=img->object_id;
+			obj->image_key=key;
+			imagexobj=obj->number;
 			fprintf(f,"%ld 0 obj\n",obj->number);
 			fprintf(f,"<<\n"
 					  "  /Type /XObject\n"
@@ -1432,83 +1834,46 @@ static void pdfImage(FILE *f,
 					  "  /Width  %d\n"
 					  "  /Height %d\n",
 					 width, height);
-			fprintf(f,"  /ColorSpace  /DeviceGray\n"
-					  "  /BitsPerComponent  8\n"
-					  //"  /Intent \n" (opt 1.1) ignored
+			fprintf(f,"  /ColorSpace  %s\n"
+					  "  /BitsPerComponent  8\n",
+					 jpeg && jcomponents == 1 ? "/DeviceGray" : "/DeviceRGB");
+					  //"  /Intent \n" (opt 1.1)
+					  //"  /ImageMask false\n" // (opt)
+					  //"  /Mask  ***\n"  //(opt, 1.3) image mask, stream or array of color keys
+			if (softmask>0) 
+				fprintf(f,"  /SMask %d 0 R\n", //(opt, 1.4) soft mask for image, overrides mask and gstate mask
+						 softmask);
 					  //"  /Decode     [0 1 0 1 0 1]\n", //(opt) r g b
 					  //"  /Interpolate false\n" //(opt)
-					  //"  /Matte *** \n" //(opt, 1.4), for use when img is pre-multiplied alpha
-					  "  /Length %d\n",
-					 width*height);
-			fprintf(f,">>\n"
-					  "stream\n");
-
-			unsigned char a;
-			int i=3;
-			for (int y=0; y<height; y++) {
-				for (int x=0; x<width; x++) {
-					a=buf[i];
-					i+=4;
-					fprintf(f,"%c",a);
-				}
-			}
-			fprintf(f,"\nendstream\n"
-					  "endobj\n");
-		}
-		
+					  //"  /Alternates array\n"  //(opt 1.3) not allowed in imgs that are themselves alternates
+					  //"  /Name  str\n" //(req 1.0, else opt)
+					  //"  /StructParent ??\n"
+					  //"  /ID...(opt1.3) \n  /OPI(opt1.2)\n"
+					  //"  /Metadata stream\n"
 
+			if (jpeg) {
+				pdfStreamData(f, jpeg, jpeglen, false, "/DCTDecode");
+				delete[] jpeg;
 
-		 // image XObject dict
-		obj->next=new PdfObjInfo;
-		obj=obj->next;
-		obj->byteoffset=ftell(f);
-		obj->number=objectcount++;
-		obj->lo_object_id=img->object_id;
-		imagexobj=obj->number;
-		fprintf(f,"%ld 0 obj\n",obj->number);
-		fprintf(f,"<<\n"
-				  "  /Type /XObject\n"
-				  "  /Subtype /Image\n"
-				  "  /Width  %d\n"
-				  "  /Height %d\n",
-				 width, height);
-		fprintf(f,"  /ColorSpace  /DeviceRGB\n"
-				  "  /BitsPerComponent  8\n");
-				  //"  /Intent \n" (opt 1.1)
-				  //"  /ImageMask false\n" // (opt)
-				  //"  /Mask  ***\n"  //(opt, 1.3) image mask, stream or array of color keys
-		if (softmask>0) 
-			fprintf(f,"  /SMask %d 0 R\n", //(opt, 1.4) soft mask for image, overrides mask and gstate mask
-					 softmask);
-				  //"  /Decode     [0 1 0 1 0 1]\n", //(opt) r g b
-				  //"  /Interpolate false\n" //(opt)
-				  //"  /Alternates array\n"  //(opt 1.3) not allowed in imgs that are themselves alternates
-				  //"  /Name  str\n" //(req 1.0, else opt)
-				  //"  /StructParent ??\n"
-				  //"  /ID...(opt1.3) \n  /OPI(opt1.2)\n"
-				  //"  /Metadata stream\n"
-
-		fprintf(f,"  /Length %d\n", 3*width*height);
-		fprintf(f,">>\n"
-				  "stream\n");
-
-		unsigned char r,g,b;
-		int i=0;
-		for (int y=0; y<height; y++) {
-			for (int x=0; x<width; x++) {
-				b=buf[i++];
-				g=buf[i++];
-				r=buf[i++];
-				i++;
-				fprintf(f,"%c%c%c",r,g,b);
-
-				//DBG cerr <<(char)(32+(buf[i]/255.)*94);
+			} else {
+				 //buf is bgra, we need rgb
+				long n = (long)width*height;
+				unsigned char *rgb = new unsigned char[3*n];
+				const unsigned char *p = buf;
+				unsigned char *r = rgb;
+				for (long c=0; c<n; c++) {
+					r[0] = p[2];
+					r[1] = p[1];
+					r[2] = p[0];
+					r += 3;
+					p += 4;
+				}
+				pdfStreamData(f, rgb, 3*n, true, NULL);
+				delete[] rgb;
 			}
-		}
-		fprintf(f,"\nendstream\n"
-				  "endobj\n");
 
-		image->doneWithBuffer(buf);
+			image->doneWithBuffer(buf);
+		} //if no existing with same key
 	} //if !existing
 
 
@@ -1518,14 +1883,14 @@ static void pdfImage(FILE *f,
 					"/image%ld Do\n\n",
 				img->maxx,img->maxy,
 				img->object_id);
-	appendstr(stream,scratch);
+	stream.Append(scratch);
 
 
 	 //Add image XObject function to resources
 	Attribute *xobject=resources.find("/XObject");
 	sprintf(scratch,"/image%ld %d 0 R\n",img->object_id,imagexobj);
 	if (xobject) {
-		appendstr(xobject->value,scratch);
+		if (!strstr(xobject->value, scratch)) appendstr(xobject->value,scratch);
 	} else {
 		resources.push("/XObject",scratch);
 	}
@@ -1540,7 +1905,7 @@ static void pdfImage(FILE *f,
 static void pdfImagePatch(FILE *f,
 					 	  PdfObjInfo *objs, 
 						  PdfObjInfo *&obj,
-						  char *&stream,
+						  PdfStream &stream,
 						  int &objectcount,
 						  Attribute &resources,
 						  LaxInterfaces::ImagePatchData *i,
@@ -1598,22 +1963,22 @@ static void pdfImagePatch(FILE *f,
 	sprintf(scratch,"q\n"
 			  "%.10f %.10f %.10f %.10f %.10f %.10f cm\n ",
 				img.m((int)0), img.m(1), img.m(2), img.m(3), img.m(4), img.m(5)); 
-	appendstr(stream,scratch);
+	stream.Append(scratch);
 	
 	pdfImage(f,objs,obj,stream,objectcount,resources,&img, log,warning,config);
 
 	 // pop axes
-	appendstr(stream,"Q\n");
+	stream.Append("Q\n");
 	psPopCtm();
 }
 
-//--------------------------------------- pdfCaption() ----------------------------------------
+//--------------------------------------- pdfTextOnPath() ----------------------------------------
 
-//! Output pdf for a CaptionData. 
+//! Output pdf for a TextOnPath. 
 static void pdfTextOnPath(FILE *f,
 					 	PdfObjInfo *objs, 
 						PdfObjInfo *&obj,
-						char *&stream,
+						PdfStream &stream,
 						int &objectcount,
 						Attribute &resources,
 						LaxInterfaces::TextOnPath *text,
@@ -1621,267 +1986,505 @@ static void pdfTextOnPath(FILE *f,
 {
 	if (!text) return;
 
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	log.AddMessage(text->object_id, text->Id(), NULL, _("Unimplemented pdf textonpath out!"), ERROR_Warning);
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	warning++;
 }
 
 //--------------------------------------- pdfCaption() ----------------------------------------
 
+//! Return the PdfFontInfo for font's face, reserving a new font dict in the object list if necessary.
+/*! Faces are matched by font file and face index within the file, so every caption using the
+ * same face shares one font. Fonts whose file cannot be found all share one stand in Helvetica.
+ */
+static PdfFontInfo *pdfFindFont(PdfObjInfo *objs, PdfObjInfo *&obj, int &objectcount, LaxFont *font)
+{
+	const char *file = font->FontFile();
+	if (!S_ISREG(file_exists(file,1,NULL))) file = NULL;
+	int face_index = (file ? ShapeCache::FaceIndex(font) : 0);
+
+	for (PdfObjInfo *o = objs; o; o = o->next) {
+		PdfFontInfo *existing = dynamic_cast<PdfFontInfo*>(o);
+		if (!existing) continue;
+		if (!file && !existing->file) return existing;
+		if (file && existing->file && !strcmp(file, existing->file) && face_index == existing->face_index) return existing;
+	}
+
+	PdfFontInfo *info = new PdfFontInfo;
+	obj->next = info;
+	obj = info;
+	info->number = objectcount++; //written out in pdfWriteFonts(), once all glyphs are known
+	if (!file) return info;
+
+	info->file = newstr(file);
+	info->face_index = face_index;
+	FT_Library *ft_library = anXApp::app->fontmanager->GetFreetypeLibrary();
+	if (!ft_library || FT_New_Face(*ft_library, file, face_index, &info->ft_face)) {
+		DBG cerr <<" ERROR loading "<<file<<" with FT_New_Face"<<endl;
+		info->ft_face = NULL;
+		return info;
+	}
+
+	info->psname = newstr(FT_Get_Postscript_Name(info->ft_face));
+	if (!info->psname) info->psname = newstr(font->PostscriptName());
+	if (!info->psname) info->psname = newstr("Unknown");
+	info->cid = FT_IS_SFNT(info->ft_face);
+	return info;
+}
+
 //! Output pdf for a CaptionData. 
 static void pdfCaption(FILE *f,
 					 	PdfObjInfo *objs, 
 						PdfObjInfo *&obj,
-						char *&stream,
+						PdfStream &stream,
 						int &objectcount,
 						Attribute &resources,
 						LaxInterfaces::CaptionData *caption,
 						ErrorLog &log,int &warning, DocumentExportConfig *config)
 {
-	if (!caption) return;
-
-	LaxFont *font=caption->font;
+	if (!caption || !caption->font) return;
 
 	char scratch[100];
 
-
-	// search for existing font object 
-	int fontdict=0;
-	PdfObjInfo *existing=objs;
-	while (existing) {
-		if (existing->lo_object_id==font->object_id) break;
-		existing=existing->next;
+	PdfFontInfo *fontinfo = pdfFindFont(objs, obj, objectcount, caption->font);
+	if (!fontinfo->ft_face) {
+		UseCLocale(false);
+		char buffer[strlen(_("Using Helvetica in place of mystery font %s."))+strlen(caption->font->Family())+1];
+		sprintf(buffer,_("Using Helvetica in place of mystery font %s."), caption->font->Family());
+		log.AddMessage(caption->object_id, caption->Id(), NULL, buffer, ERROR_Warning);
+		UseCLocale(true);
+		warning++;
 	}
 
-	if (existing) {
-		 //found existing!
-		fontdict=obj->number;
 
-	} else {
-		 //Must create a new font object..
-		obj->next=new PdfObjInfo;
-		obj=obj->next;
-		obj->byteoffset = ftell(f);
-		obj->number = objectcount++;
-		obj->lo_object_id = font->object_id;
-		fontdict=obj->number;
+	 //append text object to stream
+	sprintf(scratch,"%.10g %.10g %.10g rg\n",  //set fill color
+				caption->red, caption->green, caption->blue);
+	stream.Append(scratch);
 
-		const char *file=font->FontFile();
-		if (!S_ISREG(file_exists(file,1,NULL))) {
-			 //can't find font file, just use Helvetica
-			fprintf(f,"%ld 0 obj\n",obj->number);
-			fprintf(f,"<<\n"
-					  "  /Type /Font\n"
-					  "  /Subtype /Type1\n");
-			fprintf(f,"  /BaseFont /Helvetica\n");
-			fprintf(f,">>\n");
-
-            setlocale(LC_ALL,"");
-            char buffer[strlen(_("Using Helvetica in place of mystery font %s."))+strlen(font->Family())+1];
-            sprintf(buffer,_("Using Helvetica in place of mystery font %s."), font->Family());
-            log.AddMessage(caption->object_id, caption->Id(), NULL, buffer, ERROR_Warning);
-            setlocale(LC_ALL,"C");
-            warning++;
+	stream.Append( "BT\n");
+	sprintf(scratch, " /font%ld %.10g Tf\n", fontinfo->number, caption->fontsize);
+	stream.Append( scratch);
+	sprintf(scratch, " 1 0 0 -1 0 %.10g Tm\n", -caption->fontsize);
+	stream.Append( scratch);
+	
+	double lastx = 0;
+	for (int c=0; c<caption->lines.n; c++) {
+		const char *line = caption->lines.e[c];
+		const char *end  = line + strlen(line);
+
+		std::shared_ptr<const ShapedRun> run;
+		if (fontinfo->cid && fontinfo->ft_face)
+			run = ShapeCache::Shared()->Shape(fontinfo->file, fontinfo->face_index, caption->fontsize, nullptr, nullptr, line, end - line);
+
+		 //align with the shaped width when there is one, since kerning and ligatures
+		 //can make it quite different from the unshaped linelengths
+		double width = (run ? run->Advance() : caption->linelengths[c]);
+		double x = -caption->xcentering/100 * width;
+		sprintf(scratch, "%.10g %.10g Td\n", x - lastx, -(c==0 ? 2 : 1)*caption->fontsize*caption->linespacing);
+		stream.Append( scratch);
+		lastx = x;
+
+		if (run) {
+			 //Identity-H: 2 byte glyph ids from the shaped run, with kerning and other
+			 //positioning as adjustments where it differs from the glyph's own width
+			stream.Append( "[<");
+			double scale = 1000. / run->units_per_em;
+			double rise = 0;
+
+			 //start of each cluster, to find the text each glyph came from
+			std::vector<unsigned int> clusters;
+			for (const ShapedGlyph &glyph : run->glyphs) clusters.push_back(glyph.cluster);
+			std::sort(clusters.begin(), clusters.end());
+
+			for (size_t g = 0; g < run->glyphs.size(); g++) {
+				const ShapedGlyph &glyph = run->glyphs[g];
+				if (glyph.glyph > 0xffff) continue;
+
+				 //The first glyph of a cluster maps to all of the cluster's text, so ligatures
+				 //and combining marks copy out whole. Other glyphs of the cluster map to nothing.
+				if (glyph.glyph != 0) {
+					std::vector<unsigned int> &text = fontinfo->glyphs[glyph.glyph];
+					if (text.empty() && (g == 0 || run->glyphs[g-1].cluster != glyph.cluster)) {
+						auto next = std::upper_bound(clusters.begin(), clusters.end(), glyph.cluster);
+						const char *p    = line + glyph.cluster;
+						const char *pend = (next == clusters.end() ? end : line + *next);
+						int len;
+						while (p < pend) {
+							unsigned int ch = utf8decode(p, pend, &len);
+							if (len <= 0) len = 1;
+							p += len;
+							text.push_back(ch);
+						}
+					}
+				}
 
-		} else {
-			 //need to create a font dict corresponding to font at that file
-			int widths = obj->number+1;
-			int fontdescriptor = obj->number+2;
+				 //vertical offsets with text rise, which can't change within one TJ
+				double grise = glyph.y_offset * caption->fontsize / run->units_per_em;
+				if (grise != rise) {
+					sprintf(scratch, ">] TJ\n%.10g Ts\n[<", grise);
+					stream.Append( scratch);
+					rise = grise;
+				}
 
-			FT_Library *ft_library=anXApp::app->fontmanager->GetFreetypeLibrary();
-			if (!ft_library) return; //this shouldn't happen!
+				 //horizontal offset moves just this glyph, not the ones after it
+				if (glyph.x_offset) {
+					sprintf(scratch, "> %d <", (int)(-glyph.x_offset * scale));
+					stream.Append( scratch);
+				}
 
+				sprintf(scratch, "%04x", glyph.glyph);
+				stream.Append( scratch);
 
-			 //scan in from a freetype face
-			FT_Face ft_face=NULL;
-			FT_Error ft_error = FT_New_Face(*ft_library, font->FontFile(), 0, &ft_face);
-			if (ft_error) {
-				DBG cerr <<" ERROR loading "<<font->FontFile()<<" with FT_New_Face"<<endl;
-				return;
+				FT_Load_Glyph(fontinfo->ft_face, glyph.glyph, FT_LOAD_NO_SCALE);
+				int adjust = glyph.x_advance - glyph.x_offset - fontinfo->ft_face->glyph->advance.x;
+				if (adjust) {
+					sprintf(scratch, "> %d <", (int)(-adjust * scale));
+					stream.Append( scratch);
+				}
+			}
+			stream.Append( ">] TJ\n");
+			if (rise) stream.Append( "0 Ts\n");
+
+		} else if (fontinfo->cid && fontinfo->ft_face) {
+			 //Identity-H: 2 byte glyph ids
+			stream.Append( "<");
+			int len;
+			while (line < end) {
+				unsigned int ch = utf8decode(line, end, &len);
+				if (len <= 0) len = 1;
+				line += len;
+
+				unsigned int gindex = FT_Get_Char_Index(fontinfo->ft_face, ch);
+				if (gindex == 0 || gindex > 0xffff) continue;
+				std::vector<unsigned int> &text = fontinfo->glyphs[gindex];
+				if (text.empty()) text.push_back(ch);
+				sprintf(scratch, "%04x", gindex);
+				stream.Append( scratch);
 			}
+			stream.Append( "> Tj\n");
 
-			 //find defined characters for font
-			int code;
-			int firstchar=0, lastchar=0;
-			FT_UInt gindex=0;
+		} else {
+			 //single byte codes, add a backslash to '(', ')', and '\'
+			stream.Append( "(");
+			int i2 = 0;
+			while (line < end) {
+				unsigned char ch = *line++;
+				fontinfo->glyphs[ch] = { ch };
+				if (ch == '(' || ch == ')' || ch == '\\') scratch[i2++] = '\\';
+				scratch[i2++] = ch;
+				if (i2 > 95 || line == end) {
+					scratch[i2] = '\0';
+					stream.Append( scratch);
+					i2 = 0;
+				} 
+			}
+			stream.Append( ") Tj\n");
+		}
+	}
+	stream.Append( "ET\n");
 
-			firstchar = lastchar = code = FT_Get_First_Char( ft_face, &gindex );
 
-			while (gindex != 0) {
-				//chars.push(code);
-				code = FT_Get_Next_Char( ft_face, code, &gindex );
-				if (gindex!=0) lastchar=code;
-			}
+	 //Add font to resources
+	Attribute *fonts=resources.find("/Font");
+	sprintf(scratch,"/font%ld %ld 0 R\n", fontinfo->number, fontinfo->number);
+	if (fonts) {
+		if (!strstr(fonts->value, scratch)) appendstr(fonts->value,scratch);
+	} else {
+		resources.push("/Font",scratch);
+	}
+}
 
-			const char *fonttype="Type1";
-			FontManager *fontmanager=GetDefaultFontManager();
-			FontDialogFont *fontinfo=fontmanager->FindFontFromFile(file);
-			if (fontinfo) {
-				if (     !strcmp(fontmanager->GetTagName(fontinfo->format),"Type 1")) fonttype="Type1";
-				else if (!strcmp(fontmanager->GetTagName(fontinfo->format),"TrueType")) fonttype="TrueType";
-				else if (!strcmp(fontmanager->GetTagName(fontinfo->format),"CFF")) fonttype="TrueType"; // *** big assumption!!
+//! Return a subset of fontinfo's font file with only the used glyphs, keeping glyph ids.
+/*! Returns new[]'d data, or NULL if the font cannot be subset.
+ */
+static unsigned char *pdfSubsetFont(PdfFontInfo *fontinfo, unsigned long &len)
+{
+	len = 0;
+	hb_blob_t *blob = hb_blob_create_from_file(fontinfo->file);
+	hb_face_t *face = hb_face_create(blob, fontinfo->face_index);
+	hb_blob_destroy(blob);
+
+	unsigned char *data = NULL;
+	hb_subset_input_t *input = hb_subset_input_create_or_fail();
+	if (input) {
+		hb_set_t *glyphset = hb_subset_input_glyph_set(input);
+		hb_set_add(glyphset, 0); //.notdef
+		for (auto &glyph : fontinfo->glyphs) hb_set_add(glyphset, glyph.first);
+		hb_subset_input_set_flags(input, HB_SUBSET_FLAGS_RETAIN_GIDS);
+
+		hb_face_t *subset = hb_subset_or_fail(face, input);
+		if (subset) {
+			hb_blob_t *out = hb_face_reference_blob(subset);
+			unsigned int outlen = 0;
+			const char *outdata = hb_blob_get_data(out, &outlen);
+			if (outlen) {
+				data = new unsigned char[outlen];
+				memcpy(data, outdata, outlen);
+				len = outlen;
 			}
+			hb_blob_destroy(out);
+			hb_face_destroy(subset);
+		}
+		hb_subset_input_destroy(input);
+	}
 
-			fprintf(f,"%ld 0 obj\n",obj->number);
-			fprintf(f,"<<\n"
-					  "  /Type /Font\n"
-					  "  /Subtype /%s\n", fonttype);
-			fprintf(f,"  /BaseFont /%s\n", font->PostscriptName());
+	hb_face_destroy(face);
+	return data;
+}
 
-			fprintf(f,"  /FirstChar %d\n", firstchar);
-			fprintf(f,"  /LastChar %d\n", lastchar);
-			fprintf(f,"  /Widths %d 0 R\n", widths);
-			fprintf(f,"  /FontDescriptor %d 0 R\n", fontdescriptor);
-			//fprintf(f,"  /Encoding %d\n", ***); //optional, name or dict
-			//fprintf(f,"  /ToUnicode %d\n", ***); //(Optional; PDF 1.2) A stream containing a CMap file that maps character codes to Unicode values
-			fprintf(f,">>\n");
+//! Append one utf16be hex code to str, for ToUnicode cmaps.
+static void pdfUtf16Hex(char *str, unsigned int ch)
+{
+	if (ch >= 0x10000 && ch <= 0x10ffff) {
+		ch -= 0x10000;
+		sprintf(str + strlen(str), "%04x%04x", 0xd800 + (ch >> 10), 0xdc00 + (ch & 0x3ff));
+	} else sprintf(str + strlen(str), "%04x", ch & 0xffff);
+}
 
+//! Start a new object at the end of obj, and return its number.
+static long pdfNewObject(FILE *f, PdfObjInfo *&obj, int &objectcount)
+{
+	obj->next = new PdfObjInfo;
+	obj = obj->next;
+	obj->byteoffset = ftell(f);
+	obj->number = objectcount++;
+	return obj->number;
+}
 
-			 //Add widths array object.
-			 // one value per character, LastChar-FirstChar+1 entries, in units 1/1000 of text unit
-			obj->next=new PdfObjInfo;
-			obj=obj->next;
-			obj->byteoffset = ftell(f);
-			obj->number = objectcount++;
+//! Write out the fonts found with pdfFindFont(), now that all the glyphs they need are known.
+/*! Sfnt fonts (TrueType and OpenType) become Identity-H Type0 fonts, with an embedded font program
+ * subset to just the glyphs used, and a ToUnicode cmap. Other fonts are written as simple fonts
+ * that are not embedded, as before.
+ *
+ * Should be called after all pages are processed, but before page dicts are written.
+ */
+static void pdfWriteFonts(FILE *f, PdfObjInfo *objs, PdfObjInfo *&obj, int &objectcount, ErrorLog &log, int &warning)
+{
+	for (PdfObjInfo *o = objs; o; o = o->next) {
+		PdfFontInfo *fontinfo = dynamic_cast<PdfFontInfo*>(o);
+		if (!fontinfo) continue;
+		FT_Face ft_face = fontinfo->ft_face;
 
-			fprintf(f,"%ld 0 obj\n",obj->number);
-			fprintf(f,"<<\n [ ");
-			for (int c=firstchar; c<=lastchar; c++) {
-				gindex = FT_Get_Char_Index(ft_face, c);
-				if (gindex==0) {
-					fprintf(f, "0 ");
-					continue;
+		if (!ft_face) {
+			 //can't find font file, just use Helvetica
+			fontinfo->byteoffset = ftell(f);
+			fprintf(f,"%ld 0 obj\n",fontinfo->number);
+			fprintf(f,"<<\n"
+					  "  /Type /Font\n"
+					  "  /Subtype /Type1\n"
+					  "  /BaseFont /Helvetica\n"
+					  ">>\n"
+					  "endobj\n");
+			continue;
+		}
+
+		double scale = 1000. / (ft_face->units_per_EM > 0 ? ft_face->units_per_EM : 1000);
+		unsigned char *program = NULL;
+		unsigned long programlen = 0;
+		bool truetype = false;
+		char basefont[200];
+
+		if (fontinfo->cid) {
+			program = pdfSubsetFont(fontinfo, programlen);
+			if (!program) {
+				long len = 0;
+				program = pdfReadWholeFile(fontinfo->file, len);
+				programlen = len;
+
+				 //a whole font collection is not a font program for just one of its faces
+				bool collection = (program && programlen >= 4 && !memcmp(program, "ttcf", 4));
+				if (collection) {
+					delete[] program;
+					program = NULL;
+					programlen = 0;
 				}
 
-				FT_Load_Glyph( ft_face, gindex, FT_LOAD_NO_SCALE );
-				fprintf(f, "%d ", (int)ft_face->glyph->advance.x);
+				UseCLocale(false);
+				const char *msg = (collection ? _("Could not subset font %s, not embedding it.")
+											  : _("Could not subset font %s, embedding all of it."));
+				char buffer[strlen(msg)+strlen(fontinfo->file)+1];
+				sprintf(buffer, msg, fontinfo->file);
+				log.AddMessage(buffer, ERROR_Warning);
+				UseCLocale(true);
+				warning++;
 			}
-			fprintf(f," ]\n");
-			fprintf(f,">>\n");
 
+			FT_ULong glyflen = 0;
+			truetype = (FT_Load_Sfnt_Table(ft_face, TTAG_glyf, 0, NULL, &glyflen) == 0 && glyflen > 0);
+
+			 //subsets get a tag made from the glyphs in them
+			uint64_t hash = 14695981039346656037ULL;
+			for (auto &glyph : fontinfo->glyphs) hash = pdfHashBytes((const unsigned char *)&glyph.first, sizeof(glyph.first), hash);
+			char tag[7];
+			for (int c=0; c<6; c++) { tag[c] = 'A' + hash % 26; hash /= 26; }
+			tag[6] = '\0';
+			snprintf(basefont, sizeof(basefont), "%s+%s", tag, fontinfo->psname);
+
+		} else snprintf(basefont, sizeof(basefont), "%s", fontinfo->psname);
+
+		 //objects after the font dict are written in this order
+		long descendant = -1, tounicode = -1, widths = -1;
+		if (fontinfo->cid) {
+			descendant = objectcount;
+			tounicode  = objectcount+1;
+		} else widths = objectcount;
+		long descriptor = objectcount + (fontinfo->cid ? 2 : 1);
+		long fontfile   = (program ? descriptor+1 : -1);
+
+		int firstchar = 0, lastchar = 0;
+		if (fontinfo->glyphs.size()) {
+			firstchar = fontinfo->glyphs.begin()->first;
+			lastchar  = fontinfo->glyphs.rbegin()->first;
+		}
+
+		 //font dict, whose number was reserved in pdfFindFont()
+		fontinfo->byteoffset = ftell(f);
+		fprintf(f,"%ld 0 obj\n",fontinfo->number);
+		fprintf(f,"<<\n"
+				  "  /Type /Font\n");
+		if (fontinfo->cid) {
+			fprintf(f,"  /Subtype /Type0\n"
+					  "  /BaseFont /%s\n"
+					  "  /Encoding /Identity-H\n"
+					  "  /DescendantFonts [ %ld 0 R ]\n"
+					  "  /ToUnicode %ld 0 R\n",
+					  basefont, descendant, tounicode);
+		} else {
+			const char *format = FT_Get_Font_Format(ft_face);
+			fprintf(f,"  /Subtype /%s\n", (format && !strcmp(format, "TrueType")) ? "TrueType" : "Type1");
+			fprintf(f,"  /BaseFont /%s\n", basefont);
+			fprintf(f,"  /FirstChar %d\n", firstchar);
+			fprintf(f,"  /LastChar %d\n", lastchar);
+			fprintf(f,"  /Widths %ld 0 R\n", widths);
+			fprintf(f,"  /FontDescriptor %ld 0 R\n", descriptor);
+		}
+		fprintf(f,">>\nendobj\n");
 
-			 //Add FontDescriptor object
-			obj->next=new PdfObjInfo;
-			obj=obj->next;
-			obj->byteoffset = ftell(f);
-			obj->number = objectcount++;
 
+		if (fontinfo->cid) {
+			 //descendant CIDFont, with widths of only the glyphs used
+			pdfNewObject(f, obj, objectcount);
 			fprintf(f,"%ld 0 obj\n",obj->number);
 			fprintf(f,"<<\n"
-					  "  /Type /FontDescriptor\n"
-					  "  /FontName /%s\n", font->PostscriptName());
-			// /FontFamily    optional, pdf 1.5
-			// /FontStretch   optional, pdf 1.5, must be one of UltraCondensed , ExtraCondensed ,
-			//                   Condensed , SemiCondensed , Normal , SemiExpanded , Expanded , ExtraExpanded or UltraExpanded
-			// /FontWeight    optional, pdf 1.5, must be one of 100, 200, 300, 400, 500, 600, 700, 800, or 900. 400 is normal, 700 is bold
-
-			// /Flags         required. Used as hints for possible substitution.
-			//                   or'd Bits: 1=Fixed pitch, 2=serif, 3=symbolic (any chars outside Adobe standard latin)
-			//                              4=script, 6=nonsymbolic (3 or 6 MUST be set), 7=italic, 17=all cap, 18=small cap, 19=force bold
-			unsigned int flags=0;
-			if (FT_IS_FIXED_WIDTH(ft_face)) flags|=(1<<1);
-			if (ft_face->style_flags & FT_STYLE_FLAG_ITALIC) flags|=(1<<7);
-			fprintf(f,"  /Flags %u\n", flags);
-
-			// /FontBBox      required except for Type3 fonts
-			fprintf(f,"  /Flags [ %d %d %d %d ]\n",
-					(int)ft_face->bbox.xMin, (int)ft_face->bbox.yMin,
-					(int)ft_face->bbox.xMax, (int)ft_face->bbox.yMax);
-
-			// /ItalicAngle   required. degrees off vertical
-			fprintf(f,"  /ItalicAngle 0\n"); // ***using 0 because all this meta gets me down
-
-			// /Ascent        required except for Type3 fonts.
-			fprintf(f,"  /Ascent %d\n", (int)ft_face->ascender);
-
-			// /Descent       required except for Type3 fonts.
-			fprintf(f,"  /Descent %d\n", (int)ft_face->descender);
-
-			// /Leading       optional (default 0)
-			if (ft_face->height!=ft_face->ascender-ft_face->descender)
-				fprintf(f,"  /Leading %d\n", (int)(ft_face->height - (ft_face->ascender-ft_face->descender)));
-
-			// /CapHeight     Required for fonts that have Latin characters, except for Type 3 fonts
-			DBG cerr <<" Warning! using totally made up value for CapHeight in pdf out!!"<<endl;
-			fprintf(f,"  /CapHeight 100\n"); // *** WARNING!! MADE UP VALUE!!
-
-			// /XHeight       optional
-			// /StemV         required except for Type3 fonts, thickness of vertical strokes
-			DBG cerr <<" Warning! using totally made up value for StemV in pdf out!!"<<endl;
-			fprintf(f,"  /StemV 100\n"); // *** WARNING!! MADE UP VALUE!!
-
-			// /StemH         optional
-			// /AvgWidth      (Optional) The average width of glyphs in the font. Default value: 0.
-			// /MaxWidth      (Optional) The maximum width of glyphs in the font. Default value: 0.
-			// /MissingWidth  (Optional) The width to use for chars not in widths array
-			// /FontFile      (Optional) A stream containing a Type 1 font program (see Section 5.8, “Embedded Font Programs”).
-			// /FontFile2     (Optional; PDF 1.1) A stream containing a TrueType font program (see Section 5.8, “Embedded Font Programs”).
-			// /FontFile3     (Optional; PDF 1.2) A stream containing a font program whose format is specified by the 
-			//                  Subtype entry in the stream dictionary (see Table 5.23 and implementation note 68 in Appendix H).
-			//                  At most, only one of the FontFile , FontFile2 , and FontFile3 entries may be present.
-			// /CharSet       (Optional; meaningful only in Type 1 fonts; PDF 1.1) An ascii or byte string listing the char-
-			//					 acter names defined in a font subset. The names in this string must be in PDF
-			// 					syntax—that is, each name preceded by a slash ( / ). The names can appear in
-			// 					any order. The name . notdef should be omitted; it is assumed to exist in the
-			// 					font subset. If this entry is absent, the only indication of a font subset is the
-			// 					subset tag in the FontName entry (see Section 5.5.3, “Font Subsets”).
-
-			fprintf(f,">>\n");
-
-
-			if (ft_face) {
-				FT_Done_Face(ft_face);
-				ft_face=NULL;
+					  "  /Type /Font\n"
+					  "  /Subtype /%s\n"
+					  "  /BaseFont /%s\n"
+					  "  /CIDSystemInfo << /Registry (Adobe) /Ordering (Identity) /Supplement 0 >>\n"
+					  "  /FontDescriptor %ld 0 R\n",
+					  truetype ? "CIDFontType2" : "CIDFontType0", basefont, descriptor);
+			if (truetype) fprintf(f,"  /CIDToGIDMap /Identity\n");
+			fprintf(f,"  /W [");
+			for (auto &glyph : fontinfo->glyphs) {
+				FT_Load_Glyph(ft_face, glyph.first, FT_LOAD_NO_SCALE);
+				fprintf(f," %u [%d]", glyph.first, (int)(ft_face->glyph->advance.x * scale + .5));
 			}
-		}
-	} //end creating new font dict
+			fprintf(f," ]\n"
+					  ">>\n"
+					  "endobj\n");
 
+			 //ToUnicode cmap, so text can be searched and copied
+			PdfStream cmap;
+			cmap.Append("/CIDInit /ProcSet findresource begin\n"
+						"12 dict begin\n"
+						"begincmap\n"
+						"/CIDSystemInfo << /Registry (Adobe) /Ordering (UCS) /Supplement 0 >> def\n"
+						"/CMapName /Adobe-Identity-UCS def\n"
+						"/CMapType 2 def\n"
+						"1 begincodespacerange\n"
+						"<0000> <ffff>\n"
+						"endcodespacerange\n");
+			 //glyphs with no text of their own, like the 2nd glyph of a cluster, are left out
+			std::vector<unsigned int> mapped;
+			for (auto &glyph : fontinfo->glyphs) if (glyph.second.size()) mapped.push_back(glyph.first);
+
+			int n = 0;
+			char line[20];
+			for (size_t c = 0; c < mapped.size(); c++) {
+				if (n == 0) cmap.Printf("%d beginbfchar\n", (int)std::min(mapped.size() - c, (size_t)100));
+				cmap.Printf("<%04x> <", mapped[c]);
+				 //pdf limits destination strings to 512 bytes, that is, 128 utf16 codes
+				const std::vector<unsigned int> &text = fontinfo->glyphs[mapped[c]];
+				for (size_t i = 0; i < text.size() && i < 64; i++) {
+					line[0] = '\0';
+					pdfUtf16Hex(line, text[i]);
+					cmap.Append(line);
+				}
+				cmap.Append(">\n");
+				n++;
+				if (n == 100) { cmap.Append("endbfchar\n"); n = 0; }
+			}
+			if (n) cmap.Append("endbfchar\n");
+			cmap.Append("endcmap\n"
+						"CMapName currentdict /CMap defineresource pop\n"
+						"end\n"
+						"end\n");
 
+			pdfNewObject(f, obj, objectcount);
+			fprintf(f,"%ld 0 obj\n<<\n", obj->number);
+			pdfStreamData(f, (const unsigned char*)cmap.Data(), cmap.Len(), true, NULL);
 
-	 //append text object to stream
-	sprintf(scratch,"%.10g %.10g %.10g rg\n",  //set fill color
-				caption->red, caption->green, caption->blue);
-	appendstr(stream,scratch);
+		} else {
+			 //widths array, one value per character, LastChar-FirstChar+1 entries, in units 1/1000 of text unit
+			pdfNewObject(f, obj, objectcount);
+			fprintf(f,"%ld 0 obj\n[ ",obj->number);
+			for (int c=firstchar; c<=lastchar; c++) {
+				FT_UInt gindex = FT_Get_Char_Index(ft_face, c);
+				if (gindex==0) {
+					fprintf(f, "0 ");
+					continue;
+				}
 
-	appendstr(stream, "BT\n");
-	sprintf(scratch, " /font%ld %.10g Tf\n", caption->font->object_id, caption->fontsize);
-	appendstr(stream, scratch);
-	sprintf(scratch, " 1 0 0 -1 0 %.10g Tm\n", -caption->fontsize);
-	appendstr(stream, scratch);
-	
-	int i1,i2;
-	for (int c=0; c<caption->lines.n; c++) {
-		sprintf(scratch, "%.10g %.10g Td\n", 0., -(c==0 ? 2 : 1)*caption->fontsize*caption->linespacing);
-		appendstr(stream, scratch);
-
-		appendstr(stream, "(");
-		 //add a backslash to '(' and ')'
-		i1=i2=0;
-		while (caption->lines.e[c][i1]!='\0') {
-			if (caption->lines.e[c][i1]=='(') scratch[i2++]='\\';
-			else if (caption->lines.e[c][i1]==')') scratch[i2++]='\\';
-
-			scratch[i2++]=caption->lines.e[c][i1++];
-			if (i2>95 || caption->lines.e[c][i1]=='\0') {
-				scratch[i2]='\0';
-				appendstr(stream, scratch);
-				i2=0;
-			} 
+				FT_Load_Glyph( ft_face, gindex, FT_LOAD_NO_SCALE );
+				fprintf(f, "%d ", (int)(ft_face->glyph->advance.x * scale + .5));
+			}
+			fprintf(f,"]\nendobj\n");
 		}
-		//appendstr(stream, caption->lines.e[c]);
-		appendstr(stream, ") Tj\n");
-	}
-	appendstr(stream, "ET\n");
 
 
-	 //Add font to resources
-	Attribute *fonts=resources.find("/Font");
-	sprintf(scratch,"/font%ld %d 0 R\n",caption->font->object_id, fontdict);
-	if (fonts) {
-		if (!strstr(fonts->value, scratch)) appendstr(fonts->value,scratch);
-	} else {
-		resources.push("/Font",scratch);
+		 //FontDescriptor
+		pdfNewObject(f, obj, objectcount);
+		fprintf(f,"%ld 0 obj\n",obj->number);
+		fprintf(f,"<<\n"
+				  "  /Type /FontDescriptor\n"
+				  "  /FontName /%s\n", basefont);
+
+		// /Flags         required. Used as hints for possible substitution.
+		//                   Bits from 1: 1=Fixed pitch, 2=serif, 3=symbolic (any chars outside Adobe standard latin)
+		//                              4=script, 6=nonsymbolic (3 or 6 MUST be set), 7=italic, 17=all cap, 18=small cap, 19=force bold
+		unsigned int flags = (fontinfo->cid ? (1<<2) : (1<<5));
+		if (FT_IS_FIXED_WIDTH(ft_face)) flags |= (1<<0);
+		if (ft_face->style_flags & FT_STYLE_FLAG_ITALIC) flags |= (1<<6);
+		fprintf(f,"  /Flags %u\n", flags);
+
+		fprintf(f,"  /FontBBox [ %d %d %d %d ]\n",
+				(int)(ft_face->bbox.xMin * scale), (int)(ft_face->bbox.yMin * scale),
+				(int)(ft_face->bbox.xMax * scale), (int)(ft_face->bbox.yMax * scale));
+		fprintf(f,"  /ItalicAngle 0\n"); // ***using 0 because all this meta gets me down
+		fprintf(f,"  /Ascent %d\n",  (int)(ft_face->ascender * scale));
+		fprintf(f,"  /Descent %d\n", (int)(ft_face->descender * scale));
+		if (ft_face->height != ft_face->ascender - ft_face->descender)
+			fprintf(f,"  /Leading %d\n", (int)((ft_face->height - (ft_face->ascender - ft_face->descender)) * scale));
+
+		TT_OS2 *os2 = (TT_OS2*)FT_Get_Sfnt_Table(ft_face, FT_SFNT_OS2);
+		if (os2 && os2->version >= 2) fprintf(f,"  /CapHeight %d\n", (int)(os2->sCapHeight * scale));
+		else fprintf(f,"  /CapHeight %d\n", (int)(ft_face->ascender * scale));
+
+		fprintf(f,"  /StemV 80\n"); // *** WARNING!! MADE UP VALUE!!
+		if (program) fprintf(f,"  /%s %ld 0 R\n", truetype ? "FontFile2" : "FontFile3", fontfile);
+		fprintf(f,">>\nendobj\n");
+
+
+		 //embedded font program
+		if (program) {
+			pdfNewObject(f, obj, objectcount);
+			fprintf(f,"%ld 0 obj\n<<\n", obj->number);
+			if (truetype) fprintf(f,"  /Length1 %lu\n", programlen);
+			else fprintf(f,"  /Subtype /OpenType\n");
+			pdfStreamData(f, program, programlen, true, NULL);
+			delete[] program;
+		}
 	}
 }
 
@@ -1892,7 +2495,7 @@ static void pdfCaption(FILE *f,
 static void pdfGradient(FILE *f,
 					 	PdfObjInfo *objs, 
 						PdfObjInfo *&obj,
-						char *&stream,
+						PdfStream &stream,
 						int &objectcount,
 						Attribute &resources,
 						LaxInterfaces::GradientData *g,
@@ -2013,7 +2616,7 @@ static void pdfGradient(FILE *f,
 
 	 //insert gradient to the stream
 	sprintf(scratch,"/gradient%ld sh\n",g->object_id);
-	appendstr(stream,scratch);
+	stream.Append(scratch);
 
 
 	 //Add shading function to resources
@@ -2029,8 +2632,8 @@ static void pdfGradient(FILE *f,
 
 //--------------------------------------- pdfPaths() ----------------------------------------
 
-static int pdfaddpath(FILE *f, flatpoint *points,int n, char *&stream);
-static void pdfLineStyle(LineStyle *lstyle, char *&stream);
+static int pdfaddpath(FILE *f, flatpoint *points,int n, PdfStream &stream);
+static void pdfLineStyle(LineStyle *lstyle, PdfStream &stream);
 
 
 
@@ -2038,7 +2641,7 @@ static void pdfLineStyle(LineStyle *lstyle, char *&stream);
 static void pdfPaths(FILE *f,
 					 PdfObjInfo *objs, 
 					 PdfObjInfo *&obj,
-					 char *&stream,
+					 PdfStream &stream,
 					 int &objectcount,
 					 Attribute &resources,
 					 LaxInterfaces::PathsData *pdata,
@@ -2083,22 +2686,22 @@ static void pdfPaths(FILE *f,
 		if (fstyle && fstyle->hasFill() && lstyle && lstyle->hasStroke()) {
 			sprintf(buffer,"%.10g %.10g %.10g rg\n",  //set fill color
 						fstyle->color.red/65535.,fstyle->color.green/65535.,fstyle->color.blue/65535.);
-			appendstr(stream,buffer);
+			stream.Append(buffer);
 
-			if (fstyle->fillrule==LAXFILL_EvenOdd) appendstr(stream,"B*\n"); //fill and stroke
-			else appendstr(stream,"B\n"); //fill and stroke
+			if (fstyle->fillrule==LAXFILL_EvenOdd) stream.Append("B*\n"); //fill and stroke
+			else stream.Append("B\n"); //fill and stroke
 
 
 		} else if (fstyle && fstyle->hasFill()) {
 			sprintf(buffer,"%.10g %.10g %.10g rg\n",  //set fill color
 						fstyle->color.red/65535.,fstyle->color.green/65535.,fstyle->color.blue/65535.);
-			appendstr(stream,buffer);
+			stream.Append(buffer);
 
-			if (fstyle->fillrule==LAXFILL_EvenOdd) appendstr(stream,"f*\n"); //fill only
-			else appendstr(stream,"f\n"); //fill only
+			if (fstyle->fillrule==LAXFILL_EvenOdd) stream.Append("f*\n"); //fill only
+			else stream.Append("f\n"); //fill only
 
 		} else if (lstyle && lstyle->hasStroke()) {
-			appendstr(stream,"S\n"); //stroke only
+			stream.Append("S\n"); //stroke only
 		}
 
 
@@ -2111,7 +2714,7 @@ static void pdfPaths(FILE *f,
 			 //---write style for fill within centercache.. no stroke to that, as we apply artificial stroke
 			sprintf(buffer,"%.10g %.10g %.10g rg\n",  //set fill color
 						fstyle->color.red/65535.,fstyle->color.green/65535.,fstyle->color.blue/65535.);
-			appendstr(stream,buffer);
+			stream.Append(buffer);
 
 			Path *path;
 			for (int c=0; c<pdata->paths.n; c++) {
@@ -2123,8 +2726,8 @@ static void pdfPaths(FILE *f,
 				else pdfaddpath(f,path->path, stream);
 			}
 
-			if (fstyle->fillrule==LAXFILL_EvenOdd) appendstr(stream,"f*\n"); //fill only
-			else appendstr(stream,"f\n"); //fill only
+			if (fstyle->fillrule==LAXFILL_EvenOdd) stream.Append("f*\n"); //fill only
+			else stream.Append("f\n"); //fill only
 		}
 
 		if (lstyle) {
@@ -2136,7 +2739,7 @@ static void pdfPaths(FILE *f,
 
 			sprintf(buffer,"%.10g %.10g %.10g rg\n",  //set fill color
 						fillstyle.color.red/65535.,fillstyle.color.green/65535.,fillstyle.color.blue/65535.);
-			appendstr(stream,buffer);
+			stream.Append(buffer);
 
 
 			 //add outlinecache...
@@ -2148,25 +2751,25 @@ static void pdfPaths(FILE *f,
 				pdfaddpath(f,path->outlinecache.e,path->outlinecache.n, stream);
 			}
 
-			appendstr(stream,"f*\n"); //evenodd fill only
+			stream.Append("f*\n"); //evenodd fill only
 
 		}
 	} //end if weighted path
 }
 
-static void pdfLineStyle(LineStyle *lstyle, char *&stream)
+static void pdfLineStyle(LineStyle *lstyle, PdfStream &stream)
 {
 	if (!lstyle) return;
 
 	 //linecap
-	if (lstyle->capstyle==CapButt) appendstr(stream,"0 J\n");
-	else if (lstyle->capstyle==CapRound) appendstr(stream,"1 J\n");
-	else if (lstyle->capstyle==CapProjecting) appendstr(stream,"2 J\n");
+	if (lstyle->capstyle==CapButt) stream.Append("0 J\n");
+	else if (lstyle->capstyle==CapRound) stream.Append("1 J\n");
+	else if (lstyle->capstyle==CapProjecting) stream.Append("2 J\n");
 
 	 //linejoin
-	if (lstyle->joinstyle==JoinMiter) appendstr(stream,"0 j\n");
-	else if (lstyle->joinstyle==JoinRound) appendstr(stream,"1 j\n");
-	else if (lstyle->joinstyle==JoinBevel) appendstr(stream,"2 j\n");
+	if (lstyle->joinstyle==JoinMiter) stream.Append("0 j\n");
+	else if (lstyle->joinstyle==JoinRound) stream.Append("1 j\n");
+	else if (lstyle->joinstyle==JoinBevel) stream.Append("2 j\n");
 
 	//setmiterlimit
 	//setstrokeadjust
@@ -2174,24 +2777,24 @@ static void pdfLineStyle(LineStyle *lstyle, char *&stream)
 	 //line width
 	char buffer[255]; 
 	sprintf(buffer," %.10g w\n",lstyle->width);
-	appendstr(stream,buffer);
+	stream.Append(buffer);
 
 	 //dash pattern
 	if (!lstyle->use_dashes)
-		appendstr(stream," [] 0 d\n"); //clear dash array
+		stream.Append(" [] 0 d\n"); //clear dash array
 	else {
 		sprintf(buffer," [%.10g %.10g] 0 d\n",lstyle->width,2*lstyle->width); //set dash array
-		appendstr(stream,buffer);
+		stream.Append(buffer);
 	}
 
 	 //set stroke color
 	sprintf(buffer,"%.10g %.10g %.10g RG\n",
 				lstyle->color.red/65535.,lstyle->color.green/65535.,lstyle->color.blue/65535.);
-	appendstr(stream,buffer); 
+	stream.Append(buffer); 
 }
 
 
-static int pdfaddpath(FILE *f,Coordinate *path, char *&stream, const double *extra_m)
+static int pdfaddpath(FILE *f,Coordinate *path, PdfStream &stream, const double *extra_m)
 {
 	Coordinate *p,*p2,*start;
 	p=start=path->firstPoint(1);
@@ -2200,12 +2803,10 @@ static int pdfaddpath(FILE *f,Coordinate *path, char *&stream, const double *ext
 	 //build the path to draw
 	flatpoint c1,c2, fp;
 	int n=1; //number of points seen
-	char buffer[255];
 
 	fp = (extra_m ? transform_point(extra_m, start->p()) : start->p());
-	sprintf(buffer,"%.10f %.10f m ", fp.x,fp.y);
-	//sprintf(buffer,"%.10f %.10f m ",start->p().x,start->p().y);
-	appendstr(stream,buffer);
+	stream.Point(fp);
+	stream.Append("m ");
 
 	do { //one loop per vertex point
 		p2=p->next; //p points to a vertex
@@ -2237,33 +2838,30 @@ static int pdfaddpath(FILE *f,Coordinate *path, char *&stream, const double *ext
 			} else {
 				fp = p2->p();
 			}
-			sprintf(buffer,"%.10f %.10f %.10f %.10f %.10f %.10f c\n",
-					c1.x,c1.y,
-					c2.x,c2.y,
-					fp.x,fp.y);
-					//p2->p().x,p2->p().y);
-			appendstr(stream,buffer);
+			stream.Point(c1);
+			stream.Point(c2);
+			stream.Point(fp);
+			stream.Append("c\n");
 		} else {
 			 //we do not have control points, so is just a straight line segment
 			fp = (extra_m ? transform_point(extra_m, p2->p()) : p2->p());
-			sprintf(buffer,"%.10f %.10f l\n", fp.x,fp.y);
-			appendstr(stream,buffer);
+			stream.Point(fp);
+			stream.Append("l\n");
 		}
 		p = p2;
 
 	} while (p && p->next && p!=start);
 
-	if (p == start) appendstr(stream,"h "); //closes path
+	if (p == start) stream.Append("h "); //closes path
 
 	return n;
 }
 
-static int pdfaddpath(FILE *f, flatpoint *points,int n, char *&stream)
+static int pdfaddpath(FILE *f, flatpoint *points,int n, PdfStream &stream)
 {
 	if (n<=0) return 0;
 
 	 //build the path to draw
-	char buffer[255];
 	flatpoint c1,c2,p2;
 	int np=1; //number of points seen
 	bool onfirst=true;
@@ -2279,8 +2877,8 @@ static int pdfaddpath(FILE *f, flatpoint *points,int n, char *&stream)
 
 			ifirst=i;
 			while (i<n && (points[i].info&LINE_Bez)!=0 && (points[i].info&LINE_Vertex)==0) i++;
-			sprintf(buffer,"%.10f %.10f m ",points[i].x,points[i].y);
-			appendstr(stream,buffer);
+			stream.Point(points[i]);
+			stream.Append("m ");
 			i++;
 		}
 
@@ -2310,22 +2908,21 @@ static int pdfaddpath(FILE *f, flatpoint *points,int n, char *&stream)
 
 					if (ii>=0) i=ii;
 
-					sprintf(buffer,"%.10f %.10f %.10f %.10f %.10f %.10f c\n",
-							c1.x,c1.y,
-							c2.x,c2.y,
-							p2.x,p2.y);
-					appendstr(stream,buffer);
+					stream.Point(c1);
+					stream.Point(c2);
+					stream.Point(p2);
+					stream.Append("c\n");
 				}
 			}
 		} else {
 			 //we do not have control points, so is just a straight line segment
-			sprintf(buffer,"%.10f %.10f l\n", points[i].x,points[i].y);
-			appendstr(stream,buffer);
+			stream.Point(points[i]);
+			stream.Append("l\n");
 			//i++;
 		}
 
 		if (points[i].info&LINE_Closed) {
-			appendstr(stream,"h ");
+			stream.Append("h ");
 			onfirst=true;
 		} else if (points[i].info&LINE_Open) {
 			onfirst=true;
@@ -169,7 +169,7 @@ int PodofoImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog
         if (paperstyle) paperstyle = dynamic_cast<PaperStyle*>(paperstyle->duplicate());
         else paperstyle = new PaperStyle(_("Custom"), page_width, page_height, landscape, page_dpi, "in");
 
-		// generate previews for pages via gm
+		// previews are rendered in the background when the page is first drawn
         PdfPageProxy *page_image = new PdfPageProxy(file, c, paperstyle, preview_size);
         scratch.Sprintf("%s page %d", fname, c+1);
         page_image->Id(scratch.c_str());
@@ -165,7 +165,7 @@ int PodofoPlanOutFilter::Out(const char *filename, Laxkit::anObject *context, Er
 		return 3;
 	}
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	 //figure out paper size and orientation
 
@@ -265,7 +265,7 @@ int PodofoPlanOutFilter::Out(const char *filename, Laxkit::anObject *context, Er
 		
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	delete[] file;
 	return 0;
 }
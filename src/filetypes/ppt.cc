@@ -212,11 +212,11 @@ static void pptdumpobj(FILE *f,double *mm,SomeData *obj,int indent,ErrorLog &log
 		return;
 
 	} else {
-		setlocale(LC_ALL,"");
+		UseCLocale(false);
 		char buffer[strlen(_("Cannot export %s objects to passepartout."))+strlen(obj->whattype())+1];
 		sprintf(buffer,_("Cannot export %s objects to passepartout."),obj->whattype());
 		log.AddMessage(obj->object_id,NULL,NULL,buffer,ERROR_Warning);
-		setlocale(LC_ALL,"C");
+		UseCLocale(true);
 	}
 }
 
@@ -290,7 +290,7 @@ int PptoutFilter::Out(const char *filename, Laxkit::anObject *context, ErrorLog
 		return 3;
 	}
 	
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	
 	 //figure out paper size and orientation
 	const char *papersize=NULL, *landscape=NULL;
@@ -418,7 +418,7 @@ int PptoutFilter::Out(const char *filename, Laxkit::anObject *context, ErrorLog
 	fprintf(f,"</document>\n");
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	delete[] file;
 	return 0;
 	
@@ -14,6 +14,7 @@
 //
 
 #include "projecttemplate.h"
+#include "../core/utils.h"
 
 #include <filesystem>
 
@@ -115,11 +116,11 @@ bool ProjectTemplate::InitFromFile(const char *config_file)
 	export_filters.flush();
 	templates.flush();
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	dump_in(f, 0, 0, nullptr, nullptr);
 
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	return true;
 }
 
@@ -443,7 +443,7 @@ int ScribusExportFilter::Out(const char *filename, Laxkit::anObject *context, Er
 	}
 	
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	int warning = 0;
 	Group *g = nullptr;
@@ -1027,7 +1027,7 @@ int ScribusExportFilter::Out(const char *filename, Laxkit::anObject *context, Er
 			  "</SCRIBUSUTF8NEW>");
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	DBG cerr <<"-----Scribus export end success-------"<<endl;
 
@@ -1487,11 +1487,11 @@ static void scribusdumpobj(ScribusExportConfig *config, FILE *f,int &curobj,PtrS
 	} 
 
 	if (ptype==PTYPE_None) {
-		setlocale(LC_ALL,"");
+		UseCLocale(false);
 		char *tmp=new char[strlen(_("Warning: Cannot export %s to Scribus.\n"))+strlen(obj->whattype())+1];
 		sprintf(tmp,_("Warning: Cannot export %s to Scribus.\n"),obj->whattype());
 		log.AddMessage(obj->object_id, obj->Id(), NULL, tmp,ERROR_Warning);
-		setlocale(LC_ALL,"C");
+		UseCLocale(true);
 		warning++;
 		delete[] tmp;
 		psPopCtm();
@@ -1749,9 +1749,9 @@ static void scribusdumpobj(ScribusExportConfig *config, FILE *f,int &curobj,PtrS
 		if (text) {
 			fprintf(f, "    ALIGN=\"%d\" \n", (text->xcentering<25 ? 0 : (text->xcentering<75 ? 1 : 2)));
 			if (text->xcentering!=0 && text->xcentering!=50 && text->xcentering!=100) {
-				setlocale(LC_ALL,"");
+				UseCLocale(false);
 				log.AddMessage(text->object_id, text->Id(), NULL,  _("Warning: approximating non left/right/center alignment!"),ERROR_Warning);
-				setlocale(LC_ALL,"C");
+				UseCLocale(true);
 				warning++;
 			}
 
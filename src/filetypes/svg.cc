@@ -38,6 +38,11 @@
 #include "../core/drawdata.h"
 #include "../core/guides.h"
 #include "../impositions/netimposition.h"
+#include "xmlstream.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 
 #include <iostream>
@@ -56,9 +61,78 @@ double DEFAULT_PPINCH = 96;
 //double DEFAULT_PPINCH = 90;
 
 
+//------------------------------------- SvgIdTable ---------------------------------------
+
+/*! \class SvgIdTable
+ * Things that svg elements refer to by id during import, hashed by id.
+ */
+class SvgIdTable
+{
+  public:
+	Laxkit::RefPtrStack<anObject> gradients; //gradient and mesh fills, in order of definition
+	std::unordered_map<std::string, anObject*> fills;             //gradients by id
+	std::unordered_map<std::string, Attribute*> defs;             //def elements by id, for xlink:href
+	std::unordered_map<std::string, Attribute*> powerstrokes;     //powerstroke path effects by id
+	std::unordered_map<std::string, SomeData*> objects;           //imported objects by id, for use elements
+
+	void AddFill(anObject *fill);
+	anObject *FindFill(const char *id, int len = -1);
+	Attribute *FindDef(const char *id, int len = -1);
+	Attribute *FindPowerstroke(const char *id, int len = -1);
+	void AddObjects(SomeData *obj);
+	SomeData *FindObject(const char *id);
+};
+
+/*! Push fill, and index by its Id() if not already there.
+ */
+void SvgIdTable::AddFill(anObject *fill)
+{
+	gradients.push(fill);
+	if (fill->Id()) fills.emplace(fill->Id(), fill);
+}
+
+anObject *SvgIdTable::FindFill(const char *id, int len)
+{
+	if (!id) return nullptr;
+	auto it = fills.find(len < 0 ? std::string(id) : std::string(id, len));
+	return it == fills.end() ? nullptr : it->second;
+}
+
+Attribute *SvgIdTable::FindDef(const char *id, int len)
+{
+	if (!id) return nullptr;
+	auto it = defs.find(len < 0 ? std::string(id) : std::string(id, len));
+	return it == defs.end() ? nullptr : it->second;
+}
+
+Attribute *SvgIdTable::FindPowerstroke(const char *id, int len)
+{
+	if (!id) return nullptr;
+	auto it = powerstrokes.find(len < 0 ? std::string(id) : std::string(id, len));
+	return it == powerstrokes.end() ? nullptr : it->second;
+}
+
+/*! Index obj and all its descendents by id. The first object found with an id wins, as with FindObject().
+ */
+void SvgIdTable::AddObjects(SomeData *obj)
+{
+	if (obj->Id()) objects.emplace(obj->Id(), obj);
+
+	DrawableObject *dobj = dynamic_cast<DrawableObject*>(obj);
+	if (dobj) for (int c=0; c<dobj->n(); c++) AddObjects(dobj->e(c));
+}
+
+SomeData *SvgIdTable::FindObject(const char *id)
+{
+	if (!id) return nullptr;
+	auto it = objects.find(id);
+	return it == objects.end() ? nullptr : it->second;
+}
+
+
 //-------forward decs for helper funcs
 static int StyleToFillAndStroke(const char *inlinecss, LaxInterfaces::PathsData *paths,
-		RefPtrStack<anObject> &gradients, SomeData **fillobj_ret,
+		SvgIdTable &ids, SomeData **fillobj_ret,
 		ValueHash *extra = nullptr);
 
 
@@ -934,9 +1008,9 @@ int svgdumpobj(FILE *f,double *mm,SomeData *obj,int &warning, int indent, ErrorL
 		
 	} else if (!strcmp(obj->whattype(),"ColorPatchData")) {
 		if (!out->use_mesh) {
-			setlocale(LC_ALL,"");
+			UseCLocale(false);
 			log.AddMessage(obj->object_id,nullptr,nullptr,_("Warning: interpolating a color patch object\n"),ERROR_Warning);
-			setlocale(LC_ALL,"C");
+			UseCLocale(true);
 			warning++;
 
 			 //approximate gradient with svg elements.
@@ -1299,11 +1373,11 @@ int svgdumpobj(FILE *f,double *mm,SomeData *obj,int &warning, int indent, ErrorL
 
 		} else {
 
-			setlocale(LC_ALL,"");
+			UseCLocale(false);
 			char buffer[strlen(_("Cannot export %s objects into svg."))+strlen(obj->whattype())+1];
 			sprintf(buffer,_("Cannot export %s objects into svg."),obj->whattype());
 			log.AddMessage(obj->object_id,obj->nameid,nullptr, buffer,ERROR_Warning);
-			setlocale(LC_ALL,"C");
+			UseCLocale(true);
 			warning++;
 		}
 	}
@@ -1331,12 +1405,21 @@ void DumpClipPath(FILE *f, const char *clipid, PathsData *obj, const double *ext
 /*! Function to dump out any gradients to the defs section of an svg. Remember that
  * actual object dump is svgdumpobj().
  *
+ * If done is not null, it holds the object_id of objects whose defs have already been written,
+ * and obj is skipped if it is in there. This keeps objects that are reached more than once,
+ * like the sources of clones, from writing the same defs over and over.
+ *
  * Return nonzero for fatal errors encountered, else 0.
  *
  * \todo fix radial gradient output for inner circle empty
  */
-int svgdumpdef(FILE *f,double *mm,SomeData *obj,int &warning,ErrorLog &log, SvgExportConfig *out, bool ignore_filter=false)
+int svgdumpdef(FILE *f,double *mm,SomeData *obj,int &warning,ErrorLog &log, SvgExportConfig *out, bool ignore_filter=false,
+			   std::unordered_set<unsigned long> *done=nullptr)
 {
+	if (done) {
+		if (!done->insert(obj->object_id).second) return 0;
+	}
+
 	DrawableObject *dobj = dynamic_cast<DrawableObject*>(obj);
 	if (dobj && dobj->clip_path) {
 		 //not really sure why, but clip path has to be flipped vertically relative to the clipped object.
@@ -1352,7 +1435,7 @@ int svgdumpdef(FILE *f,double *mm,SomeData *obj,int &warning,ErrorLog &log, SvgE
 	// Group *g = dynamic_cast<Group *>(obj);
 	if (dobj && dobj->filter && !ignore_filter) {
 		obj = dobj->FinalObject();
-		if (obj) return svgdumpdef(f,mm,obj,warning,log,out, true);
+		if (obj) return svgdumpdef(f,mm,obj,warning,log,out, true, done);
 		return 0;
 	}
 
@@ -1611,12 +1694,17 @@ int svgdumpdef(FILE *f,double *mm,SomeData *obj,int &warning,ErrorLog &log, SvgE
 
 			fprintf(f, "%s    </meshgradient>\n", spc);
 		}
+
+	} else if (!strcmp(obj->whattype(),"SomeDataRef")) {
+		 //clones are written as <use>, but whatever they point to still needs its defs
+		SomeDataRef *ref = dynamic_cast<SomeDataRef*>(obj);
+		if (ref->thedata) svgdumpdef(f,nullptr,ref->thedata,warning,log, out, false, done);
 	}
 
 	//check for kids no matter what type it is
 	if (dobj) {
 		for (int c = 0; c < dobj->n(); c++) 
-			svgdumpdef(f,nullptr,dobj->e(c),warning,log, out);
+			svgdumpdef(f,nullptr,dobj->e(c),warning,log, out, false, done);
 	}
 
 
@@ -1691,7 +1779,7 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 		return 3;
 	}
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 	double PPINCH = DEFAULT_PPINCH;
 	PPINCH = out->pixels_per_inch;
@@ -1767,6 +1855,7 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	//----write out global defs section
 	//   ..gradients and such
 	fprintf(f,"  <defs>\n");
+	std::unordered_set<unsigned long> defs_done; //object_id of objects already checked for defs
 
 	// write out <view viewBox="..."> per page in papergroup
 	if (out->use_multipage && papergroup && papergroup->papers.n) {
@@ -1820,16 +1909,16 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 
 	 //dump out defs for limbo objects if any
 	if (limbo && limbo->n()) {
-		svgdumpdef(f,m,limbo,warning,log, out);
+		svgdumpdef(f,m,limbo,warning,log, out, false, &defs_done);
 	}
 
 	if (papergroup && papergroup->objs.n()) {
-		svgdumpdef(f,m,&papergroup->objs,warning,log, out);
+		svgdumpdef(f,m,&papergroup->objs,warning,log, out, false, &defs_done);
 	}
 
 
 	if (spread) {
-		if (spread->marks) svgdumpdef(f,m,spread->marks,warning,log, out);
+		if (spread->marks) svgdumpdef(f,m,spread->marks,warning,log, out, false, &defs_done);
 
 		 // for each page in spread..
 		for (c2=0; c2<spread->pagestack.n(); c2++) {
@@ -1863,7 +1952,7 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 						for (c3=0; c3<g->n(); c3++) {
 							transform_copy(m,spread->pagestack.e[c2]->outline->m());
 							transform_mult(mm, bleed->matrix, m);
-							svgdumpdef(f,mm,g->e(c3),warning,log, out);
+							svgdumpdef(f,mm,g->e(c3),warning,log, out, false, &defs_done);
 						}
 					}
 				}
@@ -1875,7 +1964,7 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 				g=dynamic_cast<Group *>(page->layers.e(l));
 				for (c3=0; c3<g->n(); c3++) {
 					transform_copy(m,spread->pagestack.e[c2]->outline->m());
-					svgdumpdef(f,m,g->e(c3),warning,log, out);
+					svgdumpdef(f,m,g->e(c3),warning,log, out, false, &defs_done);
 				}
 			}
 		}
@@ -1997,7 +2086,7 @@ int SvgOutputFilter::Out(const char *filename, Laxkit::anObject *context, ErrorL
 	fprintf(f,"</svg>\n");
 	
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	out->dec_count();
 	return 0;
 	
@@ -2111,13 +2200,13 @@ GridGuide *ParseGrid(Attribute *def)
 
 
 //forward declarations:
-int svgDumpInObjects(int top,Group *group, Attribute *element,
-					 PtrStack<Attribute> &powerstrokes, RefPtrStack<anObject> &gradients,
+int svgDumpInObjects(int top,Group *group, Attribute *element, SvgIdTable &ids,
 					 ErrorLog &log, const char *filedir, double docwidth,double docheight);
-GradientData *svgDumpInGradientDef(Attribute *att, Attribute *defs, RefPtrStack<anObject> &gradients, int depth);
+Group *svgNewGroup(Attribute *element);
+GradientData *svgDumpInGradientDef(Attribute *att, SvgIdTable &ids, int depth);
 ColorPatchData *svgDumpInMeshGradientDef(Attribute *att, Attribute *defs);
-void CompoundTransformForRef(SomeDataRef *ref, Group *top);
-void CompoundTransforms(Group *group, Group *top);
+void CompoundTransformForRef(SomeDataRef *ref, SvgIdTable &ids);
+void CompoundTransforms(Group *group, SvgIdTable &ids);
 
 
 /*! Parse a sodipodi:namedview block, and create a Singles multipage imposition from it.
@@ -2329,6 +2418,374 @@ Imposition *ParseInkscapeMultipage(Attribute *namedview, Attribute *defs, double
 	return imp;
 }
 
+/*! Figure out the document size from the attributes of the main "svg" element.
+ * width and height are returned in inches. scalex and scaley convert svg user units to inches.
+ * viewbox[0] is -1 if there is no usable viewBox.
+ *
+ * Return 0 for success, or nonzero for error.
+ */
+static int svgDocumentSize(Attribute *svgdoc, double *viewbox, double &width, double &height,
+							double &scalex, double &scaley, ErrorLog &log)
+{
+	width = height = 0;
+	scalex = scaley = 1;
+
+	viewbox[0] = -1;
+	Attribute *aatt = svgdoc->find("viewBox");
+	if (aatt) {
+		int n = DoubleListAttribute(aatt->value, viewbox, 4, nullptr);
+		if (n != 4) viewbox[0] = -1;
+		else if (fabs(viewbox[2] - viewbox[0]) < 1e-8) {
+			log.AddError(_("Bad viewbox!"));
+			return 8;
+		}
+	}
+
+	 // check width and height first since viewBox depends on them.
+	aatt = svgdoc->find("width");
+	if (aatt) {
+		char *endptr = nullptr;
+		DoubleAttribute(aatt->value, &width, &endptr);
+		if (*endptr) {
+			 //parse units 
+			UnitManager *unitm = GetUnitManager();
+			while (isspace(*endptr)) endptr++;
+			const char *ptr = endptr;
+			while (isalpha(*endptr)) endptr++;
+			int units = unitm->UnitId(ptr, endptr-ptr);
+			double raw_width = width;
+			if (units != UNITS_None) width = unitm->Convert(width, units, UNITS_Inches, UNITS_Length, nullptr);
+			scalex = width / raw_width;
+
+		} else {
+			width /= DEFAULT_PPINCH; //no specified units, assume svg pts
+			scalex = 1./DEFAULT_PPINCH;
+		}
+	}
+	aatt = svgdoc->find("height");
+	if (aatt) {
+		if (!strcmp_safe(aatt->value, "auto")) {
+			if (viewbox[0] != -1) {
+				height = width * (viewbox[3] - viewbox[1]) / (viewbox[2] - viewbox[0]);
+			} else height = width;
+
+		} else {
+			char *endptr = nullptr;
+			DoubleAttribute(aatt->value, &height, &endptr);
+			if (*endptr) {
+				 //parse units 
+				UnitManager *unitm = GetUnitManager();
+				while (isspace(*endptr)) endptr++;
+				const char *ptr = endptr;
+				while (isalpha(*endptr)) endptr++;
+				int units = unitm->UnitId(ptr, endptr-ptr);
+				double raw_height = height;
+				if (units != UNITS_None) height = unitm->Convert(height, units, UNITS_Inches, UNITS_Length, nullptr);
+				scaley = height / raw_height;
+
+			} else {
+				height /= DEFAULT_PPINCH; //no specified units, assume svg pts
+				scaley = 1./DEFAULT_PPINCH;
+			}
+		}
+	}
+
+	if (viewbox[0] != -1) {
+		scalex = width  / viewbox[2];
+		scaley = height / viewbox[3];
+	}
+
+	if (scalex <= 0 || scaley <= 0) {
+		log.AddError(_("Bad dimensions!")); 
+		return 3;
+	}
+
+	return 0;
+}
+
+/*! Recompute bounds of groups after their contents have changed.
+ */
+static void svgRefindBBoxes(DrawableObject *group)
+{
+	for (int c=0; c<group->n(); c++) {
+		DrawableObject *kid = dynamic_cast<DrawableObject*>(group->e(c));
+		if (kid && kid->n()) svgRefindBBoxes(kid);
+	}
+	group->FindBBox();
+}
+
+
+//------------------------------------- SvgStreamImporter ---------------------------------------
+
+/*! \class SvgStreamImporter
+ * Reads an svg file a piece at a time, turning each graphic element into Laidout objects
+ * as soon as the element is complete, so the whole file never needs to be in memory at once.
+ * What is kept as Attribute: the main "svg" element's attributes, defs, sodipodi:namedview,
+ * metadata, and whatever elements are currently open.
+ *
+ * Elements with fills or path effects referring to ids not yet seen are set aside with an empty
+ * placeholder group, and are converted by FinishDeferred() once the whole file has been read.
+ */
+class SvgStreamImporter : public XMLStreamReader
+{
+  public:
+	class Frame
+	{
+	  public:
+		int depth;
+		Group *group;
+		Frame(int d, Group *g) { depth = d; group = g; }
+	};
+
+	class Deferred
+	{
+	  public:
+		Attribute *element;
+		Group *parent;
+		Group *placeholder;
+		int top;
+	};
+
+	SvgIdTable ids;
+	Group *toplevel; //objects from direct children of the svg element
+	std::vector<Frame> frames;
+	std::vector<Deferred> deferred;
+	std::vector<Attribute*> defs;
+	ErrorLog *importlog;
+	const char *filedir;
+	int error;
+	int svg_depth;
+	int defs_depth;
+
+	double viewbox[4];
+	double width, height;
+	double scalex, scaley;
+
+	SvgStreamImporter(const char *dir, ErrorLog *nlog);
+	virtual ~SvgStreamImporter();
+	virtual int StartElement(Attribute *element, int depth);
+	virtual int EndElement(Attribute *element, int depth);
+	virtual void AddDefs(Attribute *defsatt);
+	virtual bool HasForwardRefs(Attribute *element);
+	virtual void FinishDeferred();
+};
+
+SvgStreamImporter::SvgStreamImporter(const char *dir, ErrorLog *nlog)
+{
+	toplevel   = new Group;
+	importlog  = nlog;
+	filedir    = dir;
+	error      = 0;
+	svg_depth  = 0;
+	defs_depth = 0;
+	width = height = 0;
+	scalex = scaley = 1;
+	viewbox[0] = -1;
+}
+
+SvgStreamImporter::~SvgStreamImporter()
+{
+	for (unsigned int c=0; c<deferred.size(); c++) {
+		deferred[c].placeholder->dec_count();
+		deferred[c].parent->dec_count();
+		delete deferred[c].element;
+	}
+	for (unsigned int c=0; c<frames.size(); c++) {
+		if (frames[c].group != toplevel) frames[c].group->dec_count();
+	}
+	for (unsigned int c=0; c<defs.size(); c++) delete defs[c];
+	toplevel->dec_count();
+}
+
+int SvgStreamImporter::StartElement(Attribute *element, int depth)
+{
+	if (!svg_depth) {
+		if (depth == 1 && !strcmp(element->name, "svg")) {
+			svg_depth = depth;
+			error = svgDocumentSize(element, viewbox, width, height, scalex, scaley, *importlog);
+			if (error) return 1;
+			frames.push_back(Frame(depth, toplevel));
+		}
+		return 0;
+	}
+
+	if (defs_depth) return 0;
+
+	if (depth == svg_depth+1 && !strcmp(element->name, "defs")) {
+		defs_depth = depth;
+
+	} else if (!strcmp(element->name, "g") && frames.size() && frames.back().depth == depth-1) {
+		 //groups are built up as their contents arrive
+		frames.push_back(Frame(depth, svgNewGroup(element)));
+	}
+
+	return 0;
+}
+
+int SvgStreamImporter::EndElement(Attribute *element, int depth)
+{
+	if (!svg_depth || depth <= svg_depth) {
+		if (depth == svg_depth) frames.clear();
+		return XMLSTREAM_Keep;
+	}
+
+	if (defs_depth) {
+		if (depth > defs_depth) return XMLSTREAM_Keep;
+		defs_depth = 0;
+		AddDefs(element);
+		defs.push_back(element);
+		return XMLSTREAM_Taken;
+	}
+
+	if (frames.size() && frames.back().depth == depth) {
+		 //a group is complete
+		Group *g = frames.back().group;
+		frames.pop_back();
+
+		 //do not add empty groups
+		if (g->n() != 0) {
+			g->FindBBox();
+			frames.back().group->push(g);
+		}
+		g->dec_count();
+		return XMLSTREAM_Discard;
+	}
+
+	if (depth == svg_depth+1 && (!strcmp(element->name, "sodipodi:namedview") || !strcmp(element->name, "metadata")))
+		return XMLSTREAM_Keep;
+
+	 //keep parts of bigger elements until those are complete
+	if (frames.empty() || frames.back().depth != depth-1) return XMLSTREAM_Keep;
+
+	Group *parent = frames.back().group;
+	int top = (depth == svg_depth+1);
+
+	if (HasForwardRefs(element)) {
+		Deferred d;
+		d.element     = element;
+		d.parent      = parent;
+		d.placeholder = new Group;
+		d.top         = top;
+		parent->push(d.placeholder);
+		parent->inc_count();
+		deferred.push_back(d);
+		return XMLSTREAM_Taken;
+	}
+
+	svgDumpInObjects(top, parent, element, ids, *importlog, filedir, width/scalex, height/scaley);
+	return XMLSTREAM_Discard;
+}
+
+/*! Index everything in a defs element by id, and read in gradients and path effects.
+ */
+void SvgStreamImporter::AddDefs(Attribute *defsatt)
+{
+	Attribute *content = defsatt->find("content:");
+	if (!content) return;
+
+	Attribute *def;
+	const char *id;
+	for (int c=0; c<content->attributes.n; c++) {
+		id = content->attributes.e[c]->findValue("id");
+		if (id) ids.defs.emplace(id, content->attributes.e[c]);
+	}
+
+	for (int c=0; c<content->attributes.n; c++) {
+		def = content->attributes.e[c];
+
+		if (!strcmp(def->name,"linearGradient") || !strcmp(def->name,"radialGradient")) {
+			svgDumpInGradientDef(def, ids, 0);
+
+		} else if (!strcmp(def->name,"meshgradient")) {
+			ColorPatchData *mesh = svgDumpInMeshGradientDef(def, content);
+			if (mesh) {
+				ids.AddFill(mesh);
+				mesh->dec_count();
+			}
+
+		} else if (!strcmp(def->name,"inkscape:path-effect")) {
+			id = def->findValue("id");
+			const char *effect = def->findValue("effect");
+			if (id && effect && !strcmp(effect,"powerstroke")) {
+				ids.powerstrokes.emplace(id, def);
+			}
+
+		//} else if (!strcmp(def->name,"clipPath")) {
+		//} else if (!strcmp(def->name,"mask")) {
+		//} else if (!strcmp(def->name,"filter")) {
+		//} else if (!strcmp(def->name,"pattern")) {
+		//} else if (!strcmp(def->name,"marker")) {
+		}
+	}
+}
+
+/*! Return true if element or anything in it uses url(#id) or path effects with ids not defined yet.
+ */
+bool SvgStreamImporter::HasForwardRefs(Attribute *element)
+{
+	for (int c=0; c<element->attributes.n; c++) {
+		Attribute *att = element->attributes.e[c];
+
+		if (!strcmp(att->name, "content:")) {
+			for (int c2=0; c2<att->attributes.n; c2++) {
+				if (HasForwardRefs(att->attributes.e[c2])) return true;
+			}
+			continue;
+		}
+
+		const char *value = att->value;
+		if (!value) continue;
+
+		if (!strcmp(att->name, "inkscape:path-effect")) {
+			while (*value) {
+				if (*value == '#') value++;
+				const char *endptr = lax_strchrnul(value, ';');
+				if (endptr != value && !ids.FindDef(value, endptr - value)) return true;
+				value = endptr;
+				if (*value == ';') value++;
+			}
+			continue;
+		}
+
+		const char *url = strstr(value, "url(#");
+		while (url) {
+			url += 5;
+			const char *endptr = strchr(url, ')');
+			if (!endptr) break;
+			if (!ids.FindFill(url, endptr - url) && !ids.FindDef(url, endptr - url)) return true;
+			url = strstr(endptr, "url(#");
+		}
+	}
+
+	return false;
+}
+
+/*! Convert elements that were waiting for later defs, putting the results where their placeholders are.
+ */
+void SvgStreamImporter::FinishDeferred()
+{
+	if (deferred.empty()) return;
+
+	for (unsigned int c=0; c<deferred.size(); c++) {
+		Deferred &d = deferred[c];
+		int oldn = d.parent->n();
+		svgDumpInObjects(d.top, d.parent, d.element, ids, *importlog, filedir, width/scalex, height/scaley);
+
+		int i = d.parent->findindex(d.placeholder);
+		for (int c2 = oldn; c2 < d.parent->n(); c2++) d.parent->slide(c2, i + c2 - oldn);
+		d.parent->popp(d.placeholder);
+
+		d.placeholder->dec_count(); //from parent
+		d.placeholder->dec_count(); //from deferred
+		d.parent->dec_count();
+		delete d.element;
+	}
+	deferred.clear();
+
+	svgRefindBBoxes(toplevel);
+}
+
+
 int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &log, const char *filecontents,int contentslen)
 {
 	ImportConfig *in = dynamic_cast<ImportConfig *>(context);
@@ -2336,16 +2793,26 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 
 	Document *doc = in->doc;
 
+	 //graphic elements become objects as they are read in, so only defs and such remain in att
+	char *filedir = lax_dirname(file, 1);
+	SvgStreamImporter importer(filedir, &log);
 	Attribute att;
-	if (!XMLFileToAttribute(&att,file,nullptr)) return 2;
+	int status = importer.Parse(file, &att, &log);
+	if (status == 1) {
+		delete[] filedir;
+		return 2;
+	}
+	if (importer.error) {
+		delete[] filedir;
+		return 1;
+	}
+	importer.FinishDeferred();
 	
 	 //create repository for hints if necessary
 	Attribute *svghints = nullptr,  // anything outside "svg" element, plus all "svg" attributes
 	          *svg      = nullptr;  // points to the "svg" lax attribute of svghints. Do not delete!!
 	// if (in->keepmystery) svghints=new Attribute(VersionName(),file);  ***disable svghints for now
 
-	char *filedir = lax_dirname(file, 1);
-
 	try {
 
 		 //add xml preamble, and anything not under "svg" to hints if it exists...
@@ -2369,67 +2836,12 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 			throw 3;
 		}
 
-		 // parse main "svg" attributes
-		double viewbox[4];
-		viewbox[0] = -1;
-		Attribute *aatt = svgdoc->find("viewBox");
-		if (aatt) {
-			int n = DoubleListAttribute(aatt->value, viewbox, 4, nullptr);
-			if (n != 4) viewbox[0] = -1;
-			else if (fabs(viewbox[2] - viewbox[0]) < 1e-8) {
-				log.AddError(_("Bad viewbox!"));
-				throw 8;
-			}
-		}
-
-		 // check width and height first since viewBox depends on them.
-		aatt = svgdoc->find("width");
-		if (aatt) {
-			char *endptr = nullptr;
-			DoubleAttribute(aatt->value, &width, &endptr);
-			if (*endptr) {
-				 //parse units 
-				UnitManager *unitm = GetUnitManager();
-				while (isspace(*endptr)) endptr++;
-				const char *ptr = endptr;
-				while (isalpha(*endptr)) endptr++;
-				int units = unitm->UnitId(ptr, endptr-ptr);
-				double raw_width = width;
-				if (units != UNITS_None) width = unitm->Convert(width, units, UNITS_Inches, UNITS_Length, nullptr);
-				scalex = width / raw_width;
-
-			} else {
-				width /= DEFAULT_PPINCH; //no specified units, assume svg pts
-				scalex = 1./DEFAULT_PPINCH;
-			}
-		}
-		aatt = svgdoc->find("height");
-		if (aatt) {
-			if (!strcmp_safe(aatt->value, "auto")) {
-				if (viewbox[0] != -1) {
-					height = width * (viewbox[3] - viewbox[1]) / (viewbox[2] - viewbox[0]);
-				} else height = width;
-
-			} else {
-				char *endptr = nullptr;
-				DoubleAttribute(aatt->value, &height, &endptr);
-				if (*endptr) {
-					 //parse units 
-					UnitManager *unitm = GetUnitManager();
-					while (isspace(*endptr)) endptr++;
-					const char *ptr = endptr;
-					while (isalpha(*endptr)) endptr++;
-					int units = unitm->UnitId(ptr, endptr-ptr);
-					double raw_height = height;
-					if (units != UNITS_None) height = unitm->Convert(height, units, UNITS_Inches, UNITS_Length, nullptr);
-					scaley = height / raw_height;
-
-				} else {
-					height /= DEFAULT_PPINCH; //no specified units, assume svg pts
-					scaley = 1./DEFAULT_PPINCH;
-				}
-			}
-		}
+		 // main "svg" attributes were parsed as the element was read
+		double *viewbox = importer.viewbox;
+		width  = importer.width;
+		height = importer.height;
+		scalex = importer.scalex;
+		scaley = importer.scaley;
 
 		for (c = 0; c < svgdoc->attributes.n; c++) {
 			name  = svgdoc->attributes.e[c]->name;
@@ -2439,28 +2851,17 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 			if (svghints) svg->push(svgdoc->attributes.e[c]->duplicateAtt(),-1);
 		}
 
-		// now svgdoc's subattributes should be a combination of 
-		// defs, sodipodi:namedview, metadata
-		//  PLUS any number of graphic elements, such as g, rect, image, text....
-
-		if (viewbox[0] != -1) {
-			scalex = width  / viewbox[2];
-			scaley = height / viewbox[3];
-		}
-
-		if (scalex <= 0 || scaley <= 0) {
-			log.AddError(_("Bad dimensions!")); 
-			throw 3;
-		}
+		// now svgdoc's subattributes are only sodipodi:namedview and metadata,
+		// and the graphic elements are in importer.toplevel
 
 		svgdoc = svgdoc->find("content:");
-		if (!svgdoc) {
+		if (!svgdoc && !importer.toplevel->n()) {
 			log.AddError(_("Empty svg tag!")); 
 			throw 4;
 		}
 
-		Attribute *namedview = svgdoc->find("sodipodi:namedview");
-		Attribute *defs = svgdoc->find("defs");
+		Attribute *namedview = svgdoc ? svgdoc->find("sodipodi:namedview") : nullptr;
+		Attribute *defs = importer.defs.size() ? importer.defs[0] : nullptr;
 		bool parsing_multipage = false; //only gets true when we are reading in whole brand new doc
 		
 		 //create a new document if necessary
@@ -2547,9 +2948,6 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 			group = dynamic_cast<Group *>(doc->pages.e[curdocpage]->layers.e(0));  // pick layer 0 of the page
 		}
 
-		RefPtrStack<anObject> gradients;
-		PtrStack<Attribute> powerstrokes;
-
 		if (namedview) {
 			for (c=0; c<namedview->attributes.n; c++) {
 				name  = namedview->attributes.e[c]->name;
@@ -2579,140 +2977,73 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 			}
 		}
 
-		 //first check for document level things like gradients in defs or metadata.
-		 //then check for drawable things
-		 //then push any other stuff unchanged
-		for (c=0; c<svgdoc->attributes.n; c++) {
-			name  = svgdoc->attributes.e[c]->name;
-			value = svgdoc->attributes.e[c]->value;
-
-			if (!strcmp(name,"metadata")
-				     || !strcmp(name,"sodipodi:namedview")) {
-				 //just copy over to svghints:
-				 //  "metadata"
-				 //  "sodipodi:namedview"
-				if (svghints) {
-					svg->push(svgdoc->attributes.e[c]->duplicateAtt(),-1);
-				}
-
-				continue;
-
-			} else if (!strcmp(name,"defs")) {
-				 //need to read in gradient and filter data...
-				Attribute *defsatt = svgdoc->attributes.e[c]->find("content:");
-				Attribute *def;
-				if (!defsatt || !defsatt->attributes.n) continue;
-
-				for (int c2=0; c2<defsatt->attributes.n; c2++) {
-					def   = defsatt->attributes.e[c2];
-					name  = def->name;
-					value = def->value;
-
-					if (!strcmp(name,"linearGradient") || !strcmp(name,"radialGradient")) {
-						svgDumpInGradientDef(def, defsatt, gradients, 0);
-
-					} else if (!strcmp(name,"meshgradient")) {
-						ColorPatchData *mesh = svgDumpInMeshGradientDef(def, defsatt);
-						if (mesh) {
-							gradients.push(mesh);
-							mesh->dec_count();
-						}
-
-					} else if (!strcmp(name,"inkscape:path-effect")) {
-						Attribute *power=def->find("effect");
-						if (power && power->value && !strcmp(power->value,"powerstroke")) {
-							powerstrokes.push(def,0);
-						}
-
-					} else if (!strcmp(name,"clipPath")) {
-					//} else if (!strcmp(name,"mask")) {
-					//} else if (!strcmp(name,"filter")) {
-					//} else if (!strcmp(name,"font")) {
-					//} else if (!strcmp(name,"font-face")) {
-					//} else if (!strcmp(name,"image")) {
-					//} else if (!strcmp(name,"pattern")) {
-					//} else if (!strcmp(name,"text")) {
-					//} else if (!strcmp(name,"a")) {
-					//} else if (!strcmp(name,"altGlyphDef")) {
-					//} else if (!strcmp(name,"color-profile")) {
-					//} else if (!strcmp(name,"cursor")) {
-					//} else if (!strcmp(name,"foreignObject")) {
-					//} else if (!strcmp(name,"marker")) {
-					//} else if (!strcmp(name,"script")) {
-					//} else if (!strcmp(name,"style")) {
-					//} else if (!strcmp(name,"switch")) {
-					//} else if (!strcmp(name,"view")) {
-						//svg2ish:
-					//} else if (!strcmp(name,"solidcolor")) {
-					}
-				}
-				continue;
+		 //copy over to svghints:
+		 //  "metadata"
+		 //  "sodipodi:namedview"
+		if (svghints && svgdoc) {
+			for (c=0; c<svgdoc->attributes.n; c++) {
+				svg->push(svgdoc->attributes.e[c]->duplicateAtt(),-1);
+			}
+		}
 
-			} 
+		 // move in drawable svg objects
+		int oldn = group->n();
+		while (importer.toplevel->n()) {
+			SomeData *obj = importer.toplevel->e(0);
+			importer.toplevel->popp(obj);
+			group->push(obj);
+			obj->dec_count();
+		}
+		if (group->n() > oldn) {
+			DrawableObject *obj;
+			SomeData test;
+			Affine a;
+			Affine aa;
 			
-			// read in any drawable svg objects
-			int oldn = group->n();
-			if (svgDumpInObjects(1,group,svgdoc->attributes.e[c],powerstrokes,gradients,log, filedir, width/scalex,height/scaley)) {
-				DrawableObject *obj;
-				SomeData test;
-				Affine a;
-				Affine aa;
-				
-				for (int c = group->n()-1; c >= oldn; c--) {
-					obj = dynamic_cast<DrawableObject*>(group->e(c));
-					if (scalex != 1 || scaley != 1) {
-						//obj->Scale(flatpoint(0,0), 1./DEFAULT_PPINCH);
-						obj->Scale(scalex, scaley);
-
-						obj->m(5, height-obj->m(5)); //flip in page
-						obj->m(2, -obj->m(2));
-						obj->m(3, -obj->m(3));
-					}
+			for (int c = group->n()-1; c >= oldn; c--) {
+				obj = dynamic_cast<DrawableObject*>(group->e(c));
+				if (scalex != 1 || scaley != 1) {
+					//obj->Scale(flatpoint(0,0), 1./DEFAULT_PPINCH);
+					obj->Scale(scalex, scaley);
+
+					obj->m(5, height-obj->m(5)); //flip in page
+					obj->m(2, -obj->m(2));
+					obj->m(3, -obj->m(3));
+				}
 
-					// If inkscape:groupmode == "layer" then we need to step through children and reparent to proper pages.
-					// If not "layer", then layer probably spans all the papers
-					if (parsing_multipage) { //we need to figure out what page the object needs to be on
-						if (obj->metadata && strEquals(obj->metadata->findValue("inkscape:groupmode"), "layer")) {
-							PaperBoxData *paper0 = doc->imposition->GetPaperGroup()->papers.e[0];
-							for (int c2 = obj->n()-1; c2 >= 0; c2--) {
-								DrawableObject *obj2 = dynamic_cast<DrawableObject*>(obj->e(c2));
-								int paperi = ObjOnPaperTest(obj2, doc->imposition->GetPaperGroup());
-								if (paperi > 0) { // if paper == 0, then we are already good, as everything starts on paper 0
-									// add object to appropriate page
-									PaperBoxData *paperdata = doc->imposition->GetPaperGroup()->papers.e[paperi];
-									Affine oldglobal = obj2->GetTransformToContext(false, 0);
-									Affine newm = oldglobal;
-									newm.Multiply(paper0->m());
-									newm.Multiply(paperdata->Inversion());
-									obj->popp(obj2);
-									dynamic_cast<Group *>(doc->pages[paperi]->layers.e(0))->push(obj2,0);
-									obj2->m(newm.m());
-									obj2->dec_count();
-								}
+				// If inkscape:groupmode == "layer" then we need to step through children and reparent to proper pages.
+				// If not "layer", then layer probably spans all the papers
+				if (parsing_multipage) { //we need to figure out what page the object needs to be on
+					if (obj->metadata && strEquals(obj->metadata->findValue("inkscape:groupmode"), "layer")) {
+						PaperBoxData *paper0 = doc->imposition->GetPaperGroup()->papers.e[0];
+						for (int c2 = obj->n()-1; c2 >= 0; c2--) {
+							DrawableObject *obj2 = dynamic_cast<DrawableObject*>(obj->e(c2));
+							int paperi = ObjOnPaperTest(obj2, doc->imposition->GetPaperGroup());
+							if (paperi > 0) { // if paper == 0, then we are already good, as everything starts on paper 0
+								// add object to appropriate page
+								PaperBoxData *paperdata = doc->imposition->GetPaperGroup()->papers.e[paperi];
+								Affine oldglobal = obj2->GetTransformToContext(false, 0);
+								Affine newm = oldglobal;
+								newm.Multiply(paper0->m());
+								newm.Multiply(paperdata->Inversion());
+								obj->popp(obj2);
+								dynamic_cast<Group *>(doc->pages[paperi]->layers.e(0))->push(obj2,0);
+								obj2->m(newm.m());
+								obj2->dec_count();
 							}
-							obj->FindBBox();
 						}
-						//  else {
-						// 	int paperi = ObjOnPaperTest(obj, doc->imposition->papergroup);
-						// 	if (paperi >= 0) {
-						// 		// *** apply group transforms? add new group for paper?
-						// 		//     add object to paper
-						// 	}
-						// }
+						obj->FindBBox();
 					}
+					//  else {
+					// 	int paperi = ObjOnPaperTest(obj, doc->imposition->papergroup);
+					// 	if (paperi >= 0) {
+					// 		// *** apply group transforms? add new group for paper?
+					// 		//     add object to paper
+					// 	}
+					// }
 				}
-
-				continue;
 			}
-
-
-			 //push any other blocks into svghints.. not expected, but you never know
-			if (svghints) {
-				Attribute *more = new Attribute("docContent",nullptr);
-				more->push(svgdoc->attributes.e[c]->duplicateAtt(),-1);
-				svghints->push(more,-1);
-			}
-		} // each svgdoc attribute
+		}
 		
 		// Make page labels correspond to inkscape page labels
 		if (parsing_multipage) {
@@ -2744,7 +3075,8 @@ int SvgImportFilter::In(const char *file, Laxkit::anObject *context, ErrorLog &l
 		}
 
 		//fix clone transform complications
-		CompoundTransforms(group, group);
+		importer.ids.AddObjects(group);
+		CompoundTransforms(group, importer.ids);
 		//laidout->project->ClarifyRefs(log);
 	
 	} catch (int error) {
@@ -2796,15 +3128,15 @@ int ObjOnPaperTest(DrawableObject *obj, PaperGroup *papergroup)
  * This is necessary because Laidout SomeDataRef overwrites referenced object transforms, but SVG
  * "use" objects multiplie them all together.
  */
-void CompoundTransformForRef(SomeDataRef *ref, Group *top)
+void CompoundTransformForRef(SomeDataRef *ref, SvgIdTable &ids)
 {
-	SomeData *found = top->FindObject(ref->thedata_id);
-	if (!found) return;
+	SomeData *found = ids.FindObject(ref->thedata_id);
+	if (!found || found == ref) return;
 
 	SomeDataRef *foundref = dynamic_cast<SomeDataRef*>(found);
 	if (foundref) {
 		if (!foundref->thedata) {
-			CompoundTransformForRef(foundref, top);
+			CompoundTransformForRef(foundref, ids);
 		}
 		if (!foundref->thedata) {
 			DBG cerr <<" *** WARNING! broken ref links!! No link for: "<<foundref->thedata_id<<endl;
@@ -2820,17 +3152,17 @@ void CompoundTransformForRef(SomeDataRef *ref, Group *top)
 /*! SVG use elements compound transforms, while Laidout SomeDataRef supercedes, so we need to step
  * through and compond where necessary.
  */
-void CompoundTransforms(Group *group, Group *top)
+void CompoundTransforms(Group *group, SvgIdTable &ids)
 {
 	for (int c=0; c<group->n(); c++) {
 		SomeDataRef *ref = dynamic_cast<SomeDataRef*>(group->e(c));
 		if (ref && !ref->thedata && ref->thedata_id) {
-			CompoundTransformForRef(ref, top);
+			CompoundTransformForRef(ref, ids);
 		}
 
 		DrawableObject *dobj = dynamic_cast<DrawableObject*>(group->e(c));
 		if (dobj && dobj->n()) {
-			CompoundTransforms(dobj, top);
+			CompoundTransforms(dobj, ids);
 		}
 	}
 }
@@ -2839,7 +3171,7 @@ void CompoundTransforms(Group *group, Group *top)
 /*! If gradient, then apply anything in the def to that existing gradient.
  * gradient will also be returned in this case, or nullptr for error.
  */
-GradientData *svgDumpInGradientDef(Attribute *def, Attribute *defs, RefPtrStack<anObject> &gradients, int depth)
+GradientData *svgDumpInGradientDef(Attribute *def, SvgIdTable &ids, int depth)
 {
 	if (!def) return nullptr;
 
@@ -2847,9 +3179,8 @@ GradientData *svgDumpInGradientDef(Attribute *def, Attribute *defs, RefPtrStack<
 
 	const char *id = def->findValue("id");
 	if (id && depth == 0) {  //check to see if we have already processed this gradient
-		for (int c=0; c<gradients.n; c++) {
-			if (!strcmp(gradients.e[c]->Id(), id)) return dynamic_cast<GradientData*>(gradients.e[c]);
-		}
+		anObject *existing = ids.FindFill(id);
+		if (existing) return dynamic_cast<GradientData*>(existing);
 	}
 
 	double      cx, cy, fx, fy, r;
@@ -2871,19 +3202,9 @@ GradientData *svgDumpInGradientDef(Attribute *def, Attribute *defs, RefPtrStack<
 		 // the link might contain the color spots, need to scan in the ref for them.
 		 // For instance, radialGradient often links to a linearGradient in inkscape docs
 
-		const char *xlinkid = xlink+1;
-
-		for (int c=0; c<defs->attributes.n; c++) {
-			Attribute *d = defs->attributes.e[c];
-			name = d->name;
-			if (strcmp(name,"linearGradient") && strcmp(name,"radialGradient"))
-				continue;
-
-			const char *did = d->findValue("id");
-			if (did && !strcmp(did, xlinkid)) {
-				gradient = svgDumpInGradientDef(d, defs, gradients, depth+1);
-				break;
-			}
+		Attribute *d = ids.FindDef(xlink+1);
+		if (d && depth < 20 && (!strcmp(d->name,"linearGradient") || !strcmp(d->name,"radialGradient"))) {
+			gradient = svgDumpInGradientDef(d, ids, depth+1);
 		}
 	}
 
@@ -3040,7 +3361,7 @@ GradientData *svgDumpInGradientDef(Attribute *def, Attribute *defs, RefPtrStack<
 	DBG gradient->dump_out(stderr, 2, 0, nullptr);
 
 	if (depth == 0) {
-		gradients.push(gradient);
+		ids.AddFill(gradient);
 		gradient->dec_count();
 	}
 
@@ -3383,44 +3704,56 @@ void InsertFillobj(SomeData *fillobj, SomeData *obj, Group *group)
 /*! If top!=0, then top is the height of the document. We need to flip elements up,
  * since down is positive y in svg. We also need to scale by .8/72 to convert svg units to Laidout units.
  */
-int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribute> &powerstrokes, RefPtrStack<anObject> &gradients,
-		ErrorLog &log, const char *filedir, double docwidth,double docheight)
+/*! Return a new Group with the attributes of a "g" element, but not its contents.
+ */
+Group *svgNewGroup(Attribute *element)
 {
 	char *name,*value;
-	ValueHash extra;
-	DrawableObject *obj = nullptr;
+	Group *g = new Group;
 
-	if (!strcmp(element->name,"g")) {
-		Group *g = new Group;
-		for (int c=0; c<element->attributes.n; c++) {
-			name  = element->attributes.e[c]->name;
-			value = element->attributes.e[c]->value;
+	for (int c=0; c<element->attributes.n; c++) {
+		name  = element->attributes.e[c]->name;
+		value = element->attributes.e[c]->value;
 
-			if (!strcmp(name,"id")) {
-				if (!isblank(value)) g->Id(value);
+		if (!strcmp(name,"id")) {
+			if (!isblank(value)) g->Id(value);
 
-			} else if (!strcmp(name,"transform")) {
-				double m[6];
-				svgtransform(value,m);
-				g->m(m);
+		} else if (!strcmp(name,"transform")) {
+			double m[6];
+			svgtransform(value,m);
+			g->m(m);
 
-			} else if (!strcmp(name,"sodipodi:insensitive")) {
-				bool locked = BooleanAttribute(value);
-				if (locked) g->Lock(OBJLOCK_Selectable);
+		} else if (!strcmp(name,"sodipodi:insensitive")) {
+			bool locked = BooleanAttribute(value);
+			if (locked) g->Lock(OBJLOCK_Selectable);
 
-			} else if (!strcmp(name,"style")) {
-				if (value && strstr(value, "display:none")) {
-					g->Visible(false);
-				}
+		} else if (!strcmp(name,"style")) {
+			if (value && strstr(value, "display:none")) {
+				g->Visible(false);
+			}
+
+		} else if (!strcmp(name,"inkscape:groupmode")) {
+			if (!g->metadata) g->metadata = new AttributeObject();
+			g->metadata->push("inkscape:groupmode", value); // is "layer" if it's an inkscape layer
+		}
+	}
 
-			} else if (!strcmp(name,"inkscape:groupmode")) {
-				if (!g->metadata) g->metadata = new AttributeObject();
-				g->metadata->push("inkscape:groupmode", value); // is "layer" if it's an inkscape layer
+	return g;
+}
 
-			} else if (!strcmp(name,"content:")) {
-				for (int c2=0; c2<element->attributes.e[c]->attributes.n; c2++) 
-					svgDumpInObjects(0,g,element->attributes.e[c]->attributes.e[c2],powerstrokes,gradients,log, filedir, docwidth,docheight);
-			}
+int svgDumpInObjects(int top,Group *group, Attribute *element, SvgIdTable &ids,
+		ErrorLog &log, const char *filedir, double docwidth,double docheight)
+{
+	char *name,*value;
+	ValueHash extra;
+	DrawableObject *obj = nullptr;
+
+	if (!strcmp(element->name,"g")) {
+		Group *g = svgNewGroup(element);
+		Attribute *content = element->find("content:");
+		if (content) {
+			for (int c2=0; c2<content->attributes.n; c2++) 
+				svgDumpInObjects(0,g,content->attributes.e[c2],ids,log, filedir, docwidth,docheight);
 		}
 
 		 //do not add empty groups
@@ -3516,7 +3849,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 				paths->m(m);
 
 			} else if (!strcmp(name,"style")) {
-				StyleToFillAndStroke(value, paths, gradients, &fillobj, &extra);
+				StyleToFillAndStroke(value, paths, ids, &fillobj, &extra);
 
 			} else if (!strcmp(name,"sodipodi:insensitive")) {
 				bool locked = BooleanAttribute(value);
@@ -3530,16 +3863,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 					if (*value=='#') value++;
 
 					char *endptr=lax_strchrnul(value, ';');
-					const char *id;
-
-					for (int c2=0; c2<powerstrokes.n; c2++) {
-						id = powerstrokes.e[c2]->findValue("id");
-						if (!id) continue;
-						if (!strncmp(value, id, endptr - value)) {
-							powerstroke = powerstrokes.e[c2];
-							break;
-						}
-					}
+					powerstroke = ids.FindPowerstroke(value, endptr - value);
 					if (powerstroke) break;
 					value=endptr;
 					if (*value==';') value++;
@@ -3667,7 +3991,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 				paths->m(m);
 
 			} else if (!strcmp(name,"style")) {
-				StyleToFillAndStroke(value, paths, gradients, &fillobj, &extra);
+				StyleToFillAndStroke(value, paths, ids, &fillobj, &extra);
 
 			} else if (!strcmp(name,"sodipodi:insensitive")) {
 				bool locked = BooleanAttribute(value);
@@ -3758,7 +4082,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 				paths->m(m);
 
 			} else if (!strcmp(name,"style")) {
-				StyleToFillAndStroke(value, paths, gradients, &fillobj, &extra);
+				StyleToFillAndStroke(value, paths, ids, &fillobj, &extra);
 			
 			} else if (!strcmp(name,"sodipodi:insensitive")) {
 				bool locked = BooleanAttribute(value);
@@ -3833,7 +4157,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 				paths->m(m);
 
 			} else if (!strcmp(name,"style")) {
-				StyleToFillAndStroke(value, paths, gradients, &fillobj, &extra);
+				StyleToFillAndStroke(value, paths, ids, &fillobj, &extra);
 
 			} else if (!strcmp(name,"sodipodi:insensitive")) {
 				bool locked = BooleanAttribute(value);
@@ -3886,7 +4210,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
 				paths->m(m);
 
 			} else if (!strcmp(name,"style")) {
-				StyleToFillAndStroke(value, paths, gradients, &fillobj, &extra);
+				StyleToFillAndStroke(value, paths, ids, &fillobj, &extra);
 
 			} else if (!strcmp(name,"sodipodi:insensitive")) {
 				bool locked = BooleanAttribute(value);
@@ -4157,7 +4481,7 @@ int svgDumpInObjects(int top,Group *group, Attribute *element, PtrStack<Attribut
  * linestyle and fillstyle must not be nullptr.
  */
 int StyleToFillAndStroke(const char *inlinecss, LaxInterfaces::PathsData *paths,
-		RefPtrStack<anObject> &gradients, SomeData **fillobj_ret,
+		SvgIdTable &ids, SomeData **fillobj_ret,
 		ValueHash *extra)
 {
 	LineStyle *linestyle = paths->linestyle;
@@ -4227,23 +4551,18 @@ int StyleToFillAndStroke(const char *inlinecss, LaxInterfaces::PathsData *paths,
 				char *id = newstr(value+5);
 				if (id[strlen(id)-1] == ')') id[strlen(id)-1] = '\0';
 
-				SomeData *fillobj = nullptr;
-				for (int c=0; c<gradients.n; c++) {
-					if (!strcmp(gradients.e[c]->Id(), id)) {
-						fillobj = dynamic_cast<SomeData*>(gradients.e[c]);
-						if (fillobj) {
-							//DBG cerr << "-----------fillobj pre"<<endl;
-							//fillobj->dump_out(stdout, 2, 0, nullptr);
-							const char *id = fillobj->Id();
-							fillobj = fillobj->duplicateData(nullptr);
-							fillobj->Id(id);
-							fillobj->FindBBox();
-							//DBG cerr << "-----------fillobj post"<<endl;
-							//fillobj->dump_out(stdout, 2, 0, nullptr);
-						}
-						break;
-					}
+				SomeData *fillobj = dynamic_cast<SomeData*>(ids.FindFill(id));
+				if (fillobj) {
+					//DBG cerr << "-----------fillobj pre"<<endl;
+					//fillobj->dump_out(stdout, 2, 0, nullptr);
+					const char *fid = fillobj->Id();
+					fillobj = fillobj->duplicateData(nullptr);
+					fillobj->Id(fid);
+					fillobj->FindBBox();
+					//DBG cerr << "-----------fillobj post"<<endl;
+					//fillobj->dump_out(stdout, 2, 0, nullptr);
 				}
+				delete[] id;
 
 				foundfill = -1;
 
@@ -0,0 +1,368 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/strmanip.h>
+#include <lax/utf8utils.h>
+
+#include "xmlstream.h"
+#include "../language.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace std;
+
+
+namespace Laidout {
+
+
+#define XMLSTREAM_BUFFER_SIZE 65536
+
+
+//------------------------------------- XMLStreamReader ---------------------------------------
+
+/*! \class XMLStreamReader
+ * Read an xml file a bit at a time, building Attribute elements in the same layout as
+ * Laxkit's XMLFileToAttribute(): each element is an Attribute with its xml attributes as
+ * subattributes, and any child elements under a "content:" subattribute. Text between
+ * child elements becomes "cdata:" attributes in "content:", or if there are no child
+ * elements, the value of "content:".
+ *
+ * Subclasses see each element in StartElement() when its start tag has been read, and in
+ * EndElement() when it is complete. EndElement() decides whether the element is kept
+ * in its parent, so that memory use depends on what the subclass keeps, rather than
+ * on the size of the file.
+ *
+ * Comments, processing instructions, and DOCTYPE are skipped. CDATA sections become text.
+ */
+
+
+XMLStreamReader::XMLStreamReader()
+{
+	f = nullptr;
+	buffer = nullptr;
+	buffer_len = buffer_pos = 0;
+	line = 1;
+	aborted = false;
+	log = nullptr;
+	root = nullptr;
+}
+
+XMLStreamReader::~XMLStreamReader()
+{
+	for (unsigned int c=0; c<open.size(); c++) delete open[c].element;
+	delete[] buffer;
+	if (f) fclose(f);
+}
+
+/*! Read file, putting top level elements that EndElement() keeps into att.
+ *
+ * Return 0 for success, 1 for could not open, 2 for aborted by StartElement().
+ * Malformed xml produces warnings in nlog, but is read as well as possible.
+ */
+int XMLStreamReader::Parse(const char *file, Laxkit::Attribute *att, Laxkit::ErrorLog *nlog)
+{
+	f = fopen(file, "r");
+	if (!f) return 1;
+
+	log = nlog;
+	root = att;
+	line = 1;
+	aborted = false;
+	if (!buffer) buffer = new char[XMLSTREAM_BUFFER_SIZE];
+	buffer_len = buffer_pos = 0;
+
+	int ch;
+	while (!aborted && (ch = Next()) != EOF) {
+		if (ch == '&') { ReadEntity(text); continue; }
+		if (ch != '<') { text += (char)ch; continue; }
+
+		ch = Next();
+		if (ch == '/') {
+			FlushText();
+			ParseEndTag();
+
+		} else if (ch == '?') {
+			SkipPast("?>");
+
+		} else if (ch == '!') {
+			if (Peek() == '-') {
+				SkipPast("-->");
+
+			} else if (Peek() == '[') {
+				 //read in <![CDATA[ ... ]]> as plain text
+				if (!SkipPast("[")) break;
+				while ((ch = Next()) != EOF && ch != '[') ;
+				int n = 0;
+				while ((ch = Next()) != EOF) {
+					if (ch == ']') { n++; continue; }
+					if (ch == '>' && n >= 2) { text.append(n-2, ']'); break; }
+					text.append(n, ']');
+					n = 0;
+					text += (char)ch;
+				}
+
+			} else {
+				 //<!DOCTYPE ...>, possibly with [ internal subset ]
+				int depth = 0;
+				while ((ch = Next()) != EOF) {
+					if (ch == '[') depth++;
+					else if (ch == ']') depth--;
+					else if (ch == '>' && depth <= 0) break;
+				}
+			}
+
+		} else if (ch != EOF) {
+			FlushText();
+			ParseStartTag(ch);
+		}
+	}
+
+	if (aborted) {
+		for (unsigned int c=0; c<open.size(); c++) delete open[c].element;
+		open.clear();
+
+	} else {
+		if (open.size()) Warning(_("Unexpected end of file"));
+		FlushText();
+		while (open.size()) CloseElement();
+	}
+
+	text.clear();
+	fclose(f);
+	f = nullptr;
+	root = nullptr;
+	return aborted ? 2 : 0;
+}
+
+/*! Read more of the file. Return number of bytes available.
+ */
+int XMLStreamReader::Fill()
+{
+	if (!f) return 0;
+	buffer_pos = 0;
+	buffer_len = fread(buffer, 1, XMLSTREAM_BUFFER_SIZE, f);
+	return buffer_len;
+}
+
+void XMLStreamReader::Warning(const char *message)
+{
+	if (!log) return;
+	 //the translated format may be any length, so size the buffer from it
+	const char *format = _("%s, line %ld");
+	int len = snprintf(nullptr, 0, format, message, line);
+	if (len < 0) return;
+	std::string scratch(len, '\0');
+	snprintf(&scratch[0], len+1, format, message, line);
+	log->AddMessage(scratch.c_str(), ERROR_Warning);
+}
+
+/*! Skip past the next occurrence of end. Return false if end of file reached first.
+ */
+bool XMLStreamReader::SkipPast(const char *end)
+{
+	int n = strlen(end);
+	int matched = 0;
+	int ch;
+	while ((ch = Next()) != EOF) {
+		if (ch == end[matched]) {
+			matched++;
+			if (matched == n) return true;
+		} else matched = (ch == end[0] ? 1 : 0);
+	}
+	return false;
+}
+
+/*! Read a tag or attribute name starting with ch. Returns the first character after the name.
+ */
+int XMLStreamReader::ReadName(std::string &name, int ch)
+{
+	name.clear();
+	while (ch != EOF && !isspace(ch) && ch != '>' && ch != '/' && ch != '=') {
+		name += (char)ch;
+		ch = Next();
+	}
+	return ch;
+}
+
+/*! Just read '&'. Decode an entity into str. Unknown entities are passed through.
+ */
+void XMLStreamReader::ReadEntity(std::string &str)
+{
+	char ent[12];
+	int n = 0;
+	int ch;
+	while (n < 10 && (ch = Peek()) != EOF && ch != ';' && ch != '<' && ch != '&' && !isspace(ch)) {
+		ent[n++] = Next();
+	}
+	ent[n] = '\0';
+
+	if (Peek() != ';') {
+		str += '&';
+		str.append(ent, n);
+		return;
+	}
+	Next();
+
+	if      (!strcmp(ent, "lt"))   str += '<';
+	else if (!strcmp(ent, "gt"))   str += '>';
+	else if (!strcmp(ent, "amp"))  str += '&';
+	else if (!strcmp(ent, "quot")) str += '"';
+	else if (!strcmp(ent, "apos")) str += '\'';
+	else if (ent[0] == '#') {
+		long code = (ent[1] == 'x' || ent[1] == 'X') ? strtol(ent+2, nullptr, 16) : strtol(ent+1, nullptr, 10);
+		char utf8[10];
+		int len = utf8encode(code, utf8);
+		str.append(utf8, len);
+
+	} else {
+		str += '&';
+		str += ent;
+		str += ';';
+	}
+}
+
+/*! Add any pending non-whitespace text to the current element.
+ */
+void XMLStreamReader::FlushText()
+{
+	if (text.empty()) return;
+
+	bool blank = true;
+	for (unsigned int c=0; c<text.size(); c++) if (!isspace(text[c])) { blank = false; break; }
+
+	if (!blank && open.size()) {
+		OpenElement &current = open.back();
+		if (!current.content) {
+			current.content = new Attribute("content:", nullptr);
+			current.element->push(current.content, -1);
+		}
+		current.content->push(new Attribute("cdata:", text.c_str()), -1);
+	}
+
+	text.clear();
+}
+
+/*! Just read "<" and ch, the first character of the tag name.
+ */
+void XMLStreamReader::ParseStartTag(int ch)
+{
+	std::string name, value;
+	ch = ReadName(name, ch);
+	Attribute *element = new Attribute(name.c_str(), nullptr);
+
+	bool selfclosing = false;
+	while (ch != EOF) {
+		while (ch != EOF && isspace(ch)) ch = Next();
+		if (ch == '>') break;
+		if (ch == '/') { selfclosing = true; ch = Next(); continue; }
+
+		ch = ReadName(name, ch);
+		while (ch != EOF && isspace(ch)) ch = Next();
+
+		value.clear();
+		if (ch == '=') {
+			ch = Next();
+			while (ch != EOF && isspace(ch)) ch = Next();
+			int quote = ch;
+			if (quote == '"' || quote == '\'') {
+				while ((ch = Next()) != EOF && ch != quote) {
+					if (ch == '&') ReadEntity(value);
+					else value += (char)ch;
+				}
+				ch = Next();
+
+			} else {
+				Warning(_("Unquoted attribute value"));
+				while (ch != EOF && !isspace(ch) && ch != '>' && ch != '/') { value += (char)ch; ch = Next(); }
+			}
+		}
+
+		if (!name.empty()) element->push(new Attribute(name.c_str(), value.c_str()), -1);
+	}
+
+	open.push_back(OpenElement(element));
+	if (StartElement(element, open.size())) {
+		aborted = true;
+		return;
+	}
+
+	if (selfclosing) CloseElement();
+}
+
+/*! Just read "</". Close the matching open element, along with any unclosed elements within it.
+ */
+void XMLStreamReader::ParseEndTag()
+{
+	std::string name;
+	int ch = ReadName(name, Next());
+	while (ch != EOF && ch != '>') ch = Next();
+
+	int i = open.size()-1;
+	while (i >= 0 && strcmp(open[i].element->name, name.c_str())) i--;
+	if (i < 0) {
+		Warning(_("Unmatched end tag"));
+		return;
+	}
+
+	if (i != (int)open.size()-1) Warning(_("Unclosed element"));
+	while ((int)open.size() > i) CloseElement();
+}
+
+/*! Pass the innermost open element to EndElement(), and add to its parent if kept.
+ */
+void XMLStreamReader::CloseElement()
+{
+	OpenElement current = open.back();
+	int depth = open.size();
+
+	 //content with only text becomes the value of "content:"
+	Attribute *content = current.content;
+	if (content && content->attributes.n == 1 && !strcmp(content->attributes.e[0]->name, "cdata:")) {
+		content->value = content->attributes.e[0]->value;
+		content->attributes.e[0]->value = nullptr;
+		content->attributes.remove(0);
+	}
+
+	int action = EndElement(current.element, depth);
+	open.pop_back();
+
+	if (action == XMLSTREAM_Taken) return;
+	if (action == XMLSTREAM_Discard) {
+		delete current.element;
+		return;
+	}
+
+	if (open.empty()) {
+		root->push(current.element, -1);
+		return;
+	}
+
+	OpenElement &parent = open.back();
+	if (!parent.content) {
+		parent.content = new Attribute("content:", nullptr);
+		parent.element->push(parent.content, -1);
+	}
+	parent.content->push(current.element, -1);
+}
+
+
+} //namespace Laidout
+
@@ -0,0 +1,83 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef XMLSTREAM_H
+#define XMLSTREAM_H
+
+#include <lax/attributes.h>
+#include <lax/errorlog.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace Laidout {
+
+
+//------------------------------------- XMLStreamReader ---------------------------------------
+
+enum XMLStreamEndAction {
+	XMLSTREAM_Keep,    //!< Add the element to its parent
+	XMLSTREAM_Discard, //!< Delete the element
+	XMLSTREAM_Taken    //!< The handler has taken ownership of the element
+};
+
+class XMLStreamReader
+{
+  protected:
+	class OpenElement
+	{
+	  public:
+		Laxkit::Attribute *element;
+		Laxkit::Attribute *content;
+		OpenElement(Laxkit::Attribute *el) { element = el; content = nullptr; }
+	};
+
+	FILE *f;
+	char *buffer;
+	size_t buffer_len;
+	size_t buffer_pos;
+	long line;
+	bool aborted;
+	Laxkit::ErrorLog *log;
+	Laxkit::Attribute *root;
+	std::vector<OpenElement> open;
+	std::string text;
+
+	int Fill();
+	int Next() { if (buffer_pos >= buffer_len && !Fill()) return EOF; int ch = (unsigned char)buffer[buffer_pos++]; if (ch == '\n') line++; return ch; }
+	int Peek() { if (buffer_pos >= buffer_len && !Fill()) return EOF; return (unsigned char)buffer[buffer_pos]; }
+	bool SkipPast(const char *end);
+	int ReadName(std::string &name, int ch);
+	void ReadEntity(std::string &str);
+	void FlushText();
+	void ParseStartTag(int ch);
+	void ParseEndTag();
+	void CloseElement();
+	void Warning(const char *message);
+
+	virtual int StartElement(Laxkit::Attribute *element, int depth) { return 0; }
+	virtual int EndElement(Laxkit::Attribute *element, int depth) { return XMLSTREAM_Keep; }
+
+  public:
+	XMLStreamReader();
+	virtual ~XMLStreamReader();
+	virtual int Parse(const char *file, Laxkit::Attribute *att, Laxkit::ErrorLog *nlog);
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -16,6 +16,7 @@
 
 
 #include "netinterface.h"
+#include "../core/utils.h"
 
 #include <lax/language.h>
 #include <lax/strmanip.h>
@@ -58,7 +59,7 @@ int PanoramaInfo::SavePolyptych(const char *saveto)
 		return 1;
 	}
 	
-	setlocale(LC_ALL, "C");
+	UseCLocale(true);
 
 	if (polyhedronfile && *polyhedronfile) fprintf(f,"polyhedronfile %s\n",polyhedronfile);
 	if (spherefile && *spherefile) fprintf(f,"spherefile %s\n",spherefile);
@@ -82,7 +83,7 @@ int PanoramaInfo::SavePolyptych(const char *saveto)
 		}
 	}
 
-	setlocale(LC_ALL, "");
+	UseCLocale(false);
 	fclose(f);
 	touch_recently_used_xbel(saveto, "application/x-polyptych-doc", nullptr,nullptr, "Polyptych", true,true, nullptr);
 	return 0;
@@ -25,6 +25,7 @@
 #include "version.h"
 #include "language.h"
 #include "core/importimage.h"
+#include "core/utils.h"
 
 #ifndef LAIDOUT_NOGL
 #include "impositions/polyptychwindow.h"
@@ -106,12 +107,22 @@ const char *TreeChangeEvent::Message() const
 
 //! Tell all ViewWindow, SpreadEditor, and other main windows that the doc has changed.
 /*! Sends a TreeChangeEvent to all SpreadEditor and ViewWindow panes in each top level HeadWindow.
+ * Removals drop objects nothing else holds from the project's object id index, and additions
+ * mark it as possibly incomplete. See Project::FindObject().
  *
  * \todo *** should probably replace s and e with a FieldPlace: doc,page,obj,obj,...
  */
 void LaidoutApp::notifyDocTreeChanged(Laxkit::anXWindow *callfrom,TreeChangeType change,int s,int e)
 {
 	DBG cerr<<"notifyDocTreeChanged sending.."<<endl;
+
+	if (project) {
+		if (change==TreeObjectDeleted || change==TreePagesDeleted || change==TreeDocGone)
+			project->objectindex.Prune();
+		else if (change==TreeObjectAdded || change==TreeObjectReorder || change==TreeObjectDiffPage || change==TreePagesAdded)
+			project->objectindex.MarkIncomplete();
+	}
+
 	HeadWindow *h;
 	PlainWinBox *pwb;
 	// ViewWindow *view;
@@ -239,7 +250,7 @@ int LaidoutApp::dump_out_file_format(const char *file, int nooverwrite)
 	}
 	if (!f) return 1;
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	fprintf(f,"#Laidout %s File Formats\n\n",LAIDOUT_VERSION);
 
 	fprintf(f," # This file describes:\n"
@@ -295,7 +306,7 @@ int LaidoutApp::dump_out_file_format(const char *file, int nooverwrite)
 	dumpOutImageListFormat(f);
 	
 	if (strcmp(file,"-")) fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	return 0;
 }
@@ -43,6 +43,10 @@
 #include "configured.h"
 #include "core/stylemanager.h"
 #include "core/utils.h"
+#include "core/importimage.h"
+#include "dataobjects/pdfpageproxy.h"
+#include "core/workerpool.h"
+#include "core/drawdata.h"
 #include "dataobjects/datafactory.h"
 #include "filetypes/filters.h"
 #include "impositions/impositioneditor.h"
@@ -192,6 +196,8 @@ LaidoutApp::LaidoutApp()
 	ImageLoader::GetPreviewFileList_func = GetDefaultPreviewLocations;
 
 	autosave_timerid = 0;
+	autosave_collect_timerid = 0;
+	imageimport_timerid = 0;
 	force_new_dialog = false;
 
 	icons=IconManager::GetDefault();
@@ -287,9 +293,34 @@ int LaidoutApp::Idle(int tid, double delta)
 {
 	if (tid==autosave_timerid) { Autosave(); return 0; }
 
+	if (tid==autosave_collect_timerid) {
+		ErrorLog log;
+		if (autosaver.Collect(log)>0) notifyPrefsChanged(nullptr, PrefsJustAutosaved);
+		if (autosaver.NumPending()) return 0;
+		autosave_collect_timerid=0;
+		return 1;
+	}
+
+	if (tid==imageimport_timerid) {
+		ImageImportQueue *queue = ImageImportQueue::Shared();
+		PdfPreviewCache *previews = PdfPreviewCache::Shared();
+		if (queue->Collect() + previews->Collect() > 0) notifyDocTreeChanged(nullptr, TreeObjectRepositioned, 0,0);
+		if (queue->NumPending() || previews->NumPending()) return 0;
+		imageimport_timerid=0;
+		return 1;
+	}
+
 	return 1;
 }
 
+/*! Make sure images loading in ImageImportQueue::Shared() and pdf previews rendering in
+ * PdfPreviewCache::Shared() get installed and drawn when ready.
+ */
+void LaidoutApp::BackgroundImportsStarted()
+{
+	if (!imageimport_timerid) imageimport_timerid=addtimer(this, 100,100, -1);
+}
+
 /*! Call this when autosave settings are updated.
  * It will remove old autosave timer and add a new one. Note this starts the timer clock at 0 again.
  */
@@ -328,6 +359,7 @@ int LaidoutApp::Autosave()
 	Document *doc;
 	ErrorLog log;
 
+	autosaver.BeginRound();
 	for (int c=0; c<project->docs.n; c++) {
 		doc=project->docs.e[c]->doc;
 		if (!doc) continue;
@@ -380,13 +412,13 @@ int LaidoutApp::Autosave()
 			}
 		}
 
-		status=doc->SaveACopy(fname, true,true,log, false);
+		 //snapshot now, the actual write happens in the background, see Idle()
+		status=autosaver.Save(doc, fname, log);
 
-		if (status==0) {
-			cerr <<" .... autosaved to: "<<fname<<endl;
-			notifyPrefsChanged(nullptr, PrefsJustAutosaved);
+		if (status>0) {
+			if (!autosave_collect_timerid) autosave_collect_timerid=addtimer(this, 200,200, -1);
 
-		} else {
+		} else if (status<0) {
 			cerr <<" .... ERROR trying to autosave to: "<<fname<<endl;
 		}
 
@@ -394,6 +426,8 @@ int LaidoutApp::Autosave()
 		delete[] fname; fname=nullptr;
 	}
 
+	autosaver.EndRound();
+
 	//DBG cerr <<" *** need to finish implementing autosave!!"<<endl;
 
 	return 1;
@@ -527,9 +561,13 @@ int LaidoutApp::init(int argc,char **argv)
 		theme->UpdateFontSizes();
 	}
 
+	WorkerPool::SetSharedThreads(prefs.max_threads);
+	NodeGroup::threaded_updates = prefs.threaded_node_updates;
+
 	DBG cerr <<"---interfaces pool init"<<endl;
 	PushBuiltinPathops(); // this must be called before getinterfaces because of pathops...
 	GetBuiltinInterfaces(&interfacepool);
+	PrepareWorkerDrawing(); //worker threads draw with their own copies of the interface pool
 
 	if (shortcutsfile) {
 		InitializeShortcuts();
@@ -717,12 +755,12 @@ void LaidoutApp::dumpOutResources()
 	char configfile[strlen(config_dir)+20];
 	sprintf(configfile,"%s/autolaidoutrc",config_dir);
 	
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	int fd=open(configfile,O_CREAT|O_WRONLY|O_TRUNC,S_IREAD|S_IWRITE);
-	if (fd<0) { setlocale(LC_ALL,""); return; }
+	if (fd<0) { UseCLocale(false); return; }
 	flock(fd,LOCK_EX);
 	FILE *f=fdopen(fd,"w");
-	if (!f) { setlocale(LC_ALL,""); ::close(fd); return; }
+	if (!f) { UseCLocale(false); ::close(fd); return; }
 
 	fprintf(f,"## THIS FILE IS AUTOMATICALLY GENERATED BY LAIDOUT\n");
 	fprintf(f,"## It is read when Laidout starts, and rewritten when Laidout exits.\n\n");
@@ -730,7 +768,7 @@ void LaidoutApp::dumpOutResources()
 
 	flock(fd,LOCK_UN);
 	fclose(f);// this closes fd too
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 }
 
 //! Return 1 if saving as a single project, or 0 if saving as individual documents.
@@ -769,7 +807,7 @@ int LaidoutApp::createlaidoutrc()
 		 // create "~/.config/laidout/(version)/laidoutrc"
 		char path[strlen(config_dir)+20];
 		sprintf(path,"%s/laidoutrc",config_dir);
-		setlocale(LC_ALL,"C");
+		UseCLocale(true);
 		FILE *f=fopen(path,"w");
 		if (f) {
 			fprintf(f,"#Laidout %s laidoutrc\n",LAIDOUT_VERSION);
@@ -815,6 +853,20 @@ int LaidoutApp::createlaidoutrc()
 					  "                             #%%f is filename, %%b is name without extension\n"
 					  "                             #%%e is extension, # or ### is autosave number (or padded number)\n"
 					  "autosave_num 0  #number of autosave files to maintain. 0 means no limit. Ignored if no '#' in autosave_path.\n"
+					  "\n"
+
+					   //threads
+					  " #Number of worker threads for background work. 0 means one per processor core.\n"
+					  "#max_threads 0\n"
+					  " #Whether to update independent nodes in parallel\n"
+					  "#threaded_node_updates false\n"
+					  " #Whether to render page contents in edit windows on worker threads\n"
+					  "#background_render false\n"
+					  " #Save documents with at least this many pages with page contents in separate files.\n"
+					  " #0 means never.\n"
+					  "#external_pages_threshold 0\n"
+					  " #Most pages from such files to keep in memory at once. 0 means no limit.\n"
+					  "#max_loaded_pages 0\n"
 					  "\n"
 
 					   //default exported file name
@@ -892,7 +944,7 @@ int LaidoutApp::createlaidoutrc()
 
 
 			fclose(f);
-			setlocale(LC_ALL,"");
+			UseCLocale(false);
 		}
 
 		 // create the other relevant directories
@@ -930,7 +982,7 @@ int LaidoutApp::readinLaidoutDefaults(char **shortcutsfile)
 	if (!readable_file(configfile, &f)) return 0;
 
 	// now f is open, must read in...
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 	Attribute att;
 	att.dump_in(f,0,nullptr);
 	char *name,*value;
@@ -1064,6 +1116,24 @@ int LaidoutApp::readinLaidoutDefaults(char **shortcutsfile)
 		} else if (!strcmp(name,"autosave")) {
 			prefs.autosave = BooleanAttribute(value);
 
+		} else if (!strcmp(name,"max_threads")) {
+			IntAttribute(value, &prefs.max_threads);
+			if (prefs.max_threads < 0) prefs.max_threads = 0;
+
+		} else if (!strcmp(name,"threaded_node_updates")) {
+			prefs.threaded_node_updates = BooleanAttribute(value);
+
+		} else if (!strcmp(name,"background_render")) {
+			prefs.background_render = BooleanAttribute(value);
+
+		} else if (!strcmp(name,"external_pages_threshold")) {
+			IntAttribute(value, &prefs.external_pages_threshold);
+			if (prefs.external_pages_threshold < 0) prefs.external_pages_threshold = 0;
+
+		} else if (!strcmp(name,"max_loaded_pages")) {
+			IntAttribute(value, &prefs.max_loaded_pages);
+			if (prefs.max_loaded_pages < 0) prefs.max_loaded_pages = 0;
+
 
 		 //--------------preview related options:
 		} else if (!strcmp(name,"auto_generate_previews")) {
@@ -1090,7 +1160,7 @@ int LaidoutApp::readinLaidoutDefaults(char **shortcutsfile)
 	}
 
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 	DBG cerr <<"-------------Done with $HOME/.laidout/(version)/laidoutrc----------"<<endl;
 
 	if (! *shortcutsfile) {
@@ -1250,6 +1320,7 @@ enum LaidoutOptions {
 	OPT_export_formats,
 	OPT_list_export_options,
 	OPT_export,
+	OPT_jobs,
 	OPT_template,
 	OPT_no_template,
 	OPT_new,
@@ -1286,6 +1357,7 @@ void InitOptions()
 	options.Add("export-formats",     'X', 0, "List all the available export formats",       OPT_export_formats, nullptr);
 	options.Add("list-export-options",'O', 1, "List all the options for the given format",   OPT_list_export_options, "format");
 	options.Add("export"             ,'e', 1, "Export a document based on the given options",OPT_export, "\"format=EPS start=3\"");
+	options.Add("jobs",               'j', 1, "With --export, how many files to export at once, if the format allows. 0 means one per core.",OPT_jobs, "4");
 	options.Add("template",           't', 1, "Start laidout from this template in ~/.laidout/(version)/templates",OPT_template,"templatename");
 	options.Add("no-template",        'N', 0, "Do not use a default template or load from last", OPT_no_template, nullptr);
 	options.Add("new",                'n', 1, "Create new document",                         OPT_new, "\"letter,portrait,3pgs\"");
@@ -1321,6 +1393,7 @@ void LaidoutApp::parseargs(int argc,char **argv)
 	//c=options.Parse(argc,argv, &index); <- now down in main also
 	
 	char *exprt = nullptr;
+	int export_jobs = -1;
 	bool pipein = false;
 	const char *pipeinarg = nullptr;
 
@@ -1433,6 +1506,11 @@ void LaidoutApp::parseargs(int argc,char **argv)
 					exprt = newstr(o->arg());
 				} break;
 
+			case OPT_jobs: { // how many files to export at the same time
+					export_jobs = strtol(o->arg(), nullptr, 10);
+					if (export_jobs < 0) export_jobs = 0;
+				} break;
+
 			case OPT_list_export_options: { // list export options for a given format
 					if (!o->arg()) {
 						//cerr << "Must specify one of:"<<endl;
@@ -1572,6 +1650,7 @@ void LaidoutApp::parseargs(int argc,char **argv)
 		config->doc=doc;
 		config->doc->inc_count();
 		config->filter=filter;
+		if (export_jobs >= 0) config->jobs = export_jobs;
 		config->dump_in_atts(&att,0,nullptr);//second time with doc!
 		if (config->range.NumRanges() == 0) config->range.AddRange(0,-1);
 
@@ -24,6 +24,7 @@
 #include "core/papersizes.h"
 #include "core/document.h"
 #include "core/project.h"
+#include "core/autosaver.h"
 #include "ui/interfaces.h"
 #include "calculator/calculator.h"
 #include "impositions/imposition.h"
@@ -97,6 +98,9 @@ class LaidoutApp : public Laxkit::anXApp, public Value, public Laxkit::EventRece
 	bool force_new_dialog;
 
 	int autosave_timerid;
+	int autosave_collect_timerid;
+	Autosaver autosaver;
+	int imageimport_timerid;
 	virtual int  Idle(int tid, double delta);
 	virtual int Autosave();
 
@@ -165,6 +169,7 @@ class LaidoutApp : public Laxkit::anXApp, public Value, public Laxkit::EventRece
 	int dump_out_shortcuts(FILE *f, int indent, int how);
 	void InitializeShortcuts();
 	int DumpWindows(FILE *f,int indent,Document *doc);
+	void BackgroundImportsStarted();
 	int IsProject();
 
 	 //for Value:
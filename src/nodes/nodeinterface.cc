@@ -18,6 +18,7 @@
 #include "nodes.h"
 #include "../core/utils.h"
 #include "../core/stylemanager.h"
+#include "../core/workerpool.h"
 #include "../version.h"
 
 #include <lax/interfaces/interfacemanager.h>
@@ -31,6 +32,7 @@
 #include <lax/language.h>
 
 #include <string>
+#include <unordered_map>
 
 
 #include <iostream>
@@ -748,6 +750,9 @@ NodeBase::NodeBase()
 	collapsedwidth = 0;
 	deletable = true; //often at least one node will not be deletable, like group output/inputs
 	modtime   = 0;
+	dirty     = true; //never been updated
+	thread_safe = false;
+	defer_ui_updates = false;
 	muted     = 0;
 	manual_update = false;
 	resource_proxy = nullptr;
@@ -1023,11 +1028,14 @@ void NodeBase::PropagateUpdate()
 	}
 }
 
-/*! Set node modtime to 0, and do the same for any connected outs.
+/*! Set node modtime to 0, flag as dirty, and do the same for any connected outs.
+ * Nodes downstream that are already dirty are not descended into again, since
+ * their own downstream will have been marked when they became dirty.
  */
 void NodeBase::MarkMustUpdate()
 {
 	modtime = 0;
+	dirty = true;
 	for (int c=0; c<properties.n; c++) {
 		NodeProperty *property = properties.e[c];
 
@@ -1038,9 +1046,10 @@ void NodeBase::MarkMustUpdate()
 		} else if (property->IsOutput()) {
 			property->modtime = 0;
 			for (int c2=0; c2<property->connections.n; c2++) {
-				if (!property->connections.e[c2]->to) continue;
-				property->connections.e[c2]->toprop->Touch(); //is an input, make modtime now
-				property->connections.e[c2]->to->MarkMustUpdate();
+				NodeConnection *connection = property->connections.e[c2];
+				if (!connection->to) continue;
+				connection->toprop->Touch(); //is an input, make modtime now
+				if (!connection->to->dirty) connection->to->MarkMustUpdate();
 			}
 		}
 	}
@@ -1652,6 +1661,14 @@ int NodeBase::SetPropertyFromAtt(const char *propname, Laxkit::Attribute *att, L
 			if (val) val->dump_in_atts(att, 0, context);
 		}
 	}
+	if (!val) {
+		 //types without a bare creation function, like NumericArrayValue, can read into a copy of the default
+		Value *current = prop->GetData();
+		if (current && !strcmp(current->whattype(), att->name)) {
+			val = current->duplicateValue();
+			if (val) val->dump_in_atts(att, 0, context);
+		}
+	}
 	if (val) {
 		if (!prop->SetData(val, true)) {
 			val->dec_count();
@@ -1885,6 +1902,12 @@ Laxkit::SingletonKeeper NodeGroup::factorykeeper;
  */
 Laxkit::RefPtrStack<ObjectIO> NodeGroup::loaders;
 
+/*! If true, UpdateDirty() runs Update() of independent nodes that have NodeBase::thread_safe set,
+ * and whose NodeBase::CanUpdateThreaded() is true, concurrently on WorkerPool::Shared(). Other nodes
+ * are always updated on the calling thread.
+ */
+bool NodeGroup::threaded_updates = false;
+
 int NodeGroup::InstallLoader(ObjectIO *loader, int absorb_count)
 {
 	int status = loaders.push(loader);
@@ -1945,6 +1968,7 @@ NodeGroup::NodeGroup()
 	background.rgbf(0,0,0,.5);
 	output= NULL;
 	input = NULL;
+	update_order_valid = false;
 	makestr(type, "NodeGroup");
 }
 
@@ -2050,6 +2074,7 @@ void NodeGroup::InitializeBlank()
 	outs->x = ins->x + ins->width*1.1;
 	nodes.push(ins);
 	nodes.push(outs);
+	InvalidateUpdateOrder();
 
 	if (output) output->dec_count();
 	output = outs;
@@ -2072,6 +2097,7 @@ NodeProperty *NodeGroup::AddGroupInput(const char *pname, const char *plabel, co
 		input->InstallColors(colors, 0);
 		input->Wrap();
 		nodes.push(input);
+		InvalidateUpdateOrder();
 		//ins->AddNewOut(0, "NewIn", _("(new in)"), NULL);
 	}
 
@@ -2101,6 +2127,7 @@ NodeProperty *NodeGroup::AddGroupOutput(const char *pname, const char *plabel, c
 		output->Wrap();
 		//output->AddNewIn(0, "NewOut", _("(new out)"), NULL);
 		nodes.push(output);
+		InvalidateUpdateOrder();
 	}
 
 	NodeProperty *outsprop = new NodeProperty(NodeProperty::PROP_Input, true, pname, NULL,1, plabel, ptooltip);
@@ -2186,6 +2213,7 @@ int NodeGroup::DeleteNodes(Laxkit::RefPtrStack<NodeBase> &selected)
 		numdel++;
 	}
 
+	if (numdel) InvalidateUpdateOrder();
 	return numdel;
 }
 
@@ -2421,6 +2449,8 @@ int NodeGroup::UngroupNodes(Laxkit::RefPtrStack<NodeBase> &selected, bool update
 		nodes.remove(nodes.findindex(group)); 
 	}
 
+	if (n) InvalidateUpdateOrder();
+
 	 //have the ungrouped nodes be selected
 	selected.flush();
 	if (update_selected) for (int c=0; c<nselected.n; c++) selected.push(nselected.e[0]);
@@ -2471,6 +2501,7 @@ NodeConnection *NodeGroup::Connect(NodeConnection *newcon, int absorb)
 	newcon->from->Connected(newcon);
 	newcon->to  ->Connected(newcon);
 
+	InvalidateUpdateOrder();
 	return newcon;
 }
 
@@ -2523,7 +2554,8 @@ int NodeGroup::Disconnect(NodeConnection *connection, bool from_will_be_replaced
 		to->properties.remove(i);
 		to->Wrap();
 	}
-	
+
+	InvalidateUpdateOrder();
 	return 0;
 }
 
@@ -2543,47 +2575,305 @@ void NodeGroup::SoftUpdate(int reason)
 }
 
 /*! 
- * Update all the nodes in the group, starting from leftmost. ****THIS IS EXTREMELY INEFFICIENT
+ * Mark all the nodes in the group as needing updating, then update them all
+ * in one pass over the cached topological order (see UpdateDirty()).
  * 
  * If successful,  returns the number of nodes updated.
  * If any nodes fail to update, return -1.
  */
 int NodeGroup::ForceUpdates()
 {
-	PtrStack<NodeBase> starts;
-	for (int c=0; c<nodes.n; c++) {
-		nodes.e[c]->modtime = 0;
-		if (nodes.e[c]->NumInputs(true, true) == 0) starts.push(nodes.e[c], 0);
-	}
+	if (!update_order_valid || update_order.n != nodes.n) RebuildUpdateOrder();
 
-	for (int c=0; c<starts.n; c++) {
-		DBG cerr << "ForceUpdates, found initial: "<<(starts.e[c]->Label()?starts.e[c]->Label():"?")<<endl;
-		starts.e[c]->MarkMustUpdate();
+	for (int c=0; c<update_order.n; c++) update_order.e[c]->dirty = false;
+	for (int c=0; c<update_order.n; c++) {
+		update_order.e[c]->MarkMustUpdate();
 	}
 
-	return UpdateAllRecursively();
+	return UpdateDirty();
 }
 
-/*! Find all rightmost nodes and step leftward, updating as necessary.
+/*! Update any nodes that need it. This used to step leftward recursively from the rightmost nodes,
+ * but now is the same as UpdateDirty().
  */
 int NodeGroup::UpdateAllRecursively()
 {
-	PtrStack<NodeBase> ends;
+	return UpdateDirty();
+}
+
+/*! Flag the cached update order as stale. This must be called whenever nodes or connections
+ * are added or removed. Connect(), Disconnect(), AddNode() and friends do this already.
+ */
+void NodeGroup::InvalidateUpdateOrder()
+{
+	update_order_valid = false;
+}
+
+/*! Rebuild update_order so that every node comes after all the nodes connected to its inputs.
+ * Nodes that are part of a cycle are appended at the end in their nodes order.
+ *
+ * Returns the number of nodes that could not be properly sorted, that is, 0 for a clean graph.
+ */
+int NodeGroup::RebuildUpdateOrder()
+{
+	update_order.flush();
+
+	std::unordered_map<NodeBase*, int> indexof;
+	int *indegree = new int[nodes.n > 0 ? nodes.n : 1];
+	for (int c=0; c<nodes.n; c++) {
+		indexof[nodes.e[c]] = c;
+		indegree[c] = 0;
+	}
+
+	 //count incoming data connections from within this group
 	for (int c=0; c<nodes.n; c++) {
-		if (nodes.e[c]->NumOutputs(true) == 0) ends.push(nodes.e[c], 0);
+		NodeBase *node = nodes.e[c];
+		for (int c2=0; c2<node->properties.n; c2++) {
+			NodeProperty *prop = node->properties.e[c2];
+			if (!prop->IsOutput()) continue;
+			for (int c3=0; c3<prop->connections.n; c3++) {
+				NodeConnection *con = prop->connections.e[c3];
+				if (!con->to || !con->toprop || !con->toprop->IsInput()) continue;
+				auto it = indexof.find(con->to);
+				if (it != indexof.end()) indegree[it->second]++;
+			}
+		}
 	}
 
+	 //Kahn's algorithm, update_order doubles as the queue.
+	 //Each pass over the queue is one level of nodes that do not depend on each other.
+	update_levels.flush();
+	for (int c=0; c<nodes.n; c++) {
+		if (indegree[c] == 0) update_order.push(nodes.e[c], 0);
+	}
+
+	int level_start = 0;
+	while (level_start < update_order.n) {
+		int level_end = update_order.n;
+		update_levels.push(level_start);
+
+		for (int i=level_start; i<level_end; i++) {
+			NodeBase *node = update_order.e[i];
+			for (int c2=0; c2<node->properties.n; c2++) {
+				NodeProperty *prop = node->properties.e[c2];
+				if (!prop->IsOutput()) continue;
+				for (int c3=0; c3<prop->connections.n; c3++) {
+					NodeConnection *con = prop->connections.e[c3];
+					if (!con->to || !con->toprop || !con->toprop->IsInput()) continue;
+					auto it = indexof.find(con->to);
+					if (it == indexof.end()) continue;
+					indegree[it->second]--;
+					if (indegree[it->second] == 0) update_order.push(con->to, 0);
+				}
+			}
+		}
+
+		level_start = level_end;
+	}
+
+	int num_unsorted = nodes.n - update_order.n;
+	if (num_unsorted) {
+		DBG cerr << " *** warning: node cycle detected in "<<(Label() ? Label() : "group")<<", "<<num_unsorted<<" nodes unsorted"<<endl;
+		for (int c=0; c<nodes.n; c++) {
+			if (indegree[c] > 0) {
+				update_levels.push(update_order.n); //these might depend on each other, so one per level
+				update_order.push(nodes.e[c], 0);
+			}
+		}
+	}
+
+	delete[] indegree;
+	update_order_valid = true;
+	return num_unsorted;
+}
+
+/*! Return true if any node connected to node's inputs is still dirty.
+ * During UpdateDirty(), this means an upstream node failed to update.
+ */
+bool NodeGroup::UpstreamPending(NodeBase *node)
+{
+	for (int c=0; c<node->properties.n; c++) {
+		NodeProperty *prop = node->properties.e[c];
+		if (!prop->IsInput() || !prop->IsConnected()) continue;
+		NodeBase *from = prop->connections.e[0]->from;
+		if (from && from != node && from->dirty) return true;
+	}
+	return false;
+}
+
+/*! If node is a NodeGroup, bring its insides up to date, and flag it dirty if anything inside changed.
+ * Returns the subgroup's UpdateDirty(), or 0 if node is not a group.
+ */
+int NodeGroup::UpdateSubgroup(NodeBase *node)
+{
+	NodeGroup *group = dynamic_cast<NodeGroup*>(node);
+	if (!group) return 0;
+
+	if (group->dirty && group->input) group->input->MarkMustUpdate();
+	int status = group->UpdateDirty();
+	if (status > 0) group->dirty = true;
+	return status;
+}
+
+/*! Decide if node needs an Update() in the current update pass.
+ * Return 1 if it does, 0 for nothing to do (node is clean afterwards), or -1 for
+ * node cannot be updated (node stays dirty).
+ */
+int NodeGroup::PrepareNodeUpdate(NodeBase *node)
+{
+	if (!node->dirty && node->GetStatus() != 1) return 0;
+
+	if (UpstreamPending(node)) {
+		DBG cerr << "UpdateDirty skipping "<<(node->Label()?node->Label():"?")<<", upstream not updated"<<endl;
+		node->dirty = true;
+		return -1;
+	}
+
+	int status = node->GetStatus();
+	if (status == -1) return -1;
+	if (status == 0) {
+		node->dirty = false;
+		return 0;
+	}
+	return 1;
+}
+
+/*! Bookkeeping after node->Update() returned status.
+ * On success, nodes directly connected to node's outputs become dirty, to be checked later
+ * in the same pass, and node is marked clean.
+ *
+ * Returns -1 if the update failed, else 1.
+ */
+int NodeGroup::FinishNodeUpdate(NodeBase *node, int status)
+{
+	if (status == -1) {
+		DBG cerr << "  warning, update fail at "<<(node->Label()?node->Label():"?")<<endl;
+		return -1; //stays dirty
+	}
+
+	for (int c2=0; c2<node->properties.n; c2++) {
+		NodeProperty *prop = node->properties.e[c2];
+		if (!prop->IsOutput()) continue;
+		for (int c3=0; c3<prop->connections.n; c3++) {
+			if (prop->connections.e[c3]->to) prop->connections.e[c3]->to->dirty = true;
+		}
+	}
+
+	node->dirty = false;
+	return 1;
+}
+
+/*! Single pass update of only the nodes that need it, in the cached topological order.
+ * A node needs updating if it is dirty (see NodeBase::MarkMustUpdate()), or if GetStatus()
+ * says so. When a node updates, nodes directly connected to its outputs become dirty, so
+ * they are caught later in the same pass. Each node is visited exactly once.
+ *
+ * Nodes downstream of a node in an error state are left dirty, to be tried on a later pass.
+ *
+ * If threaded_updates, this defers to UpdateDirtyThreaded().
+ *
+ * Returns the number of nodes updated, or -1 if any nodes failed to update.
+ */
+int NodeGroup::UpdateDirty()
+{
+	if (!update_order_valid || update_order.n != nodes.n) RebuildUpdateOrder();
+	if (threaded_updates && !WorkerPool::IsWorkerThread()) return UpdateDirtyThreaded();
+
 	int err = 0;
-	for (int c=0; c<ends.n; c++) {
-		DBG cerr << "UpdateRecursively, with: "<<(ends.e[c]->Label()?ends.e[c]->Label():"?")<<endl;
-		if (ends.e[c]->UpdateRecursively() == -1) {
+	int num_updated = 0;
+
+	for (int c=0; c<update_order.n; c++) {
+		NodeBase *node = update_order.e[c];
+
+		if (UpdateSubgroup(node) < 0) err = 1;
+
+		int status = PrepareNodeUpdate(node);
+		if (status == 0) continue;
+		if (status < 0) {
 			err = 1;
-			DBG cerr << "  warning, fail!"<<endl;
-			// return -1;
+			continue;
 		}
+
+		if (FinishNodeUpdate(node, node->Update()) < 0) err = 1;
+		else num_updated++;
 	}
 
-	return err ? -1 : 0;
+	return err ? -1 : num_updated;
+}
+
+/*! Like UpdateDirty(), but go level by level through update_order. Within each level,
+ * nodes do not depend on each other, so any that are NodeBase::thread_safe, and say so with
+ * their current data in CanUpdateThreaded(), have their Update() run concurrently on
+ * WorkerPool::Shared(). Other nodes, including subgroups,
+ * are updated on the calling thread. Each level is finished before the next starts.
+ *
+ * Threaded nodes have defer_ui_updates set during Update(), and get UpdateUI() called
+ * on the calling thread afterwards.
+ *
+ * Returns the number of nodes updated, or -1 if any nodes failed to update.
+ */
+int NodeGroup::UpdateDirtyThreaded()
+{
+	if (!update_order_valid || update_order.n != nodes.n) RebuildUpdateOrder();
+
+	WorkerPool *pool = WorkerPool::Shared();
+
+	int err = 0;
+	int num_updated = 0;
+	NumStack<int> threaded, pinned;
+	NumStack<int> statuses;
+
+	for (int l=0; l<update_levels.n; l++) {
+		int start = update_levels.e[l];
+		int end   = (l < update_levels.n-1 ? update_levels.e[l+1] : update_order.n);
+
+		threaded.flush();
+		pinned.flush();
+
+		for (int c=start; c<end; c++) {
+			NodeBase *node = update_order.e[c];
+			if (UpdateSubgroup(node) < 0) err = 1;
+
+			int status = PrepareNodeUpdate(node);
+			if (status < 0) err = 1;
+			if (status <= 0) continue;
+
+			if (node->thread_safe && node->CanUpdateThreaded()) threaded.push(c);
+			else pinned.push(c);
+		}
+
+		if (threaded.n == 1) { //no point in handing off just one
+			pinned.push(threaded.e[0]);
+			threaded.flush();
+		}
+
+		statuses.Allocate(threaded.n);
+		statuses.flush();
+		for (int c=0; c<threaded.n; c++) {
+			statuses.push(0);
+			update_order.e[threaded.e[c]]->defer_ui_updates = true;
+		}
+
+		pool->Run(threaded.n, [this, &threaded, &statuses](int i) {
+				statuses.e[i] = update_order.e[threaded.e[i]]->Update();
+			});
+
+		for (int c=0; c<threaded.n; c++) {
+			NodeBase *node = update_order.e[threaded.e[c]];
+			node->defer_ui_updates = false;
+			if (statuses.e[c] != -1) node->UpdateUI();
+			if (FinishNodeUpdate(node, statuses.e[c]) < 0) err = 1;
+			else num_updated++;
+		}
+
+		for (int c=0; c<pinned.n; c++) {
+			NodeBase *node = update_order.e[pinned.e[c]];
+			if (FinishNodeUpdate(node, node->Update()) < 0) err = 1;
+			else num_updated++;
+		}
+	}
+
+	return err ? -1 : num_updated;
 }
 
 /*! Set same for all contained nodes.
@@ -2963,6 +3253,7 @@ void NodeGroup::dump_in_atts(Attribute *att,int flag,DumpContext *context)
 		}
 	}
 
+	InvalidateUpdateOrder();
 	ForceUpdates();
 }
 
@@ -3004,6 +3295,7 @@ int NodeGroup::AddNode(NodeBase *node)
 			break;
 		}
 	}
+	InvalidateUpdateOrder();
 	return nodes.push(node);
 }
 
@@ -4476,7 +4768,7 @@ int NodeInterface::Refresh()
 	if (num_need_updating && try_refresh) {
 	// if (num_need_updating) {
 		DBG cerr << "Num need updating: "<<num_need_updating<<endl;
-		nodes->ForceUpdates();
+		nodes->UpdateDirty();
 		needtodraw = 1;
 		try_refresh = false;
 	}
@@ -7331,7 +7623,7 @@ bool NodeInterface::AddRerouteAt(NodeBase *node, int prop_slot, int connection_s
 	reroute->properties.e[1]->AddConnection(connection, 1);
 	toprop->AddConnection(connection,0);
 	reroute->Update();
-	nodes->AddNode(reroute);
+	nodes->AddNode(reroute); //note: this also invalidates update order for the connection changes above
 	reroute->dec_count();
 	needtodraw = 1;
 	return true;
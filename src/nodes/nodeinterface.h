@@ -295,6 +295,10 @@ class NodeBase : virtual public Laxkit::anObject,
 
 	Laxkit::PtrStack<NodeProperty> properties; //includes inputs and outputs
 	std::clock_t modtime; //time of last update
+	bool dirty; //set by MarkMustUpdate(), cleared when an owning NodeGroup's update pass deals with this node
+	bool thread_safe; //if true, Update() may be run on a worker thread when CanUpdateThreaded(), see NodeGroup::threaded_updates.
+	                  //Such updates must not allocate or ref count Values or objects.
+	bool defer_ui_updates; //true while Update() may be off the main thread. Do ui work in UpdateUI() instead.
 
 	NodeFrame *frame;
 	NodeColors *colors;
@@ -326,6 +330,8 @@ class NodeBase : virtual public Laxkit::anObject,
 	virtual void MarkMustUpdate();
 	virtual void PropagateUpdate();
 	virtual int UpdatePreview();
+	virtual void UpdateUI() {}
+	virtual bool CanUpdateThreaded() { return thread_safe; } //whether Update() with the current data can go on a worker thread
 	virtual void ManualUpdate(bool yes);
 	virtual Value *PreviewFrom() { return nullptr; }
 	virtual void PreviewSample(double w, double h, bool is_shift);
@@ -383,11 +389,21 @@ class NodeGroup : public NodeBase, public Laxkit::DumpUtility
 	static Laxkit::SingletonKeeper factorykeeper;
 
   protected:
+	Laxkit::PtrStack<NodeBase> update_order; //cached topological order of nodes, see RebuildUpdateOrder()
+	Laxkit::NumStack<int> update_levels; //index in update_order where each level of independent nodes starts
+	bool update_order_valid;
+
 	virtual int CheckForward(NodeBase *node, NodeConnection *connection);
 	virtual int CheckBackward(NodeBase *node, NodeConnection *connection);
+	virtual bool UpstreamPending(NodeBase *node);
+	virtual int UpdateSubgroup(NodeBase *node);
+	virtual int PrepareNodeUpdate(NodeBase *node);
+	virtual int FinishNodeUpdate(NodeBase *node, int status);
+	virtual int UpdateDirtyThreaded();
 
   public:
 	static Laxkit::RefPtrStack<ObjectIO> loaders;
+	static bool threaded_updates;
 	static int InstallLoader(ObjectIO *loader, int absorb_count);
 	static int RemoveLoader(ObjectIO *loader);
 	static Laxkit::ObjectFactory *NodeFactory(bool create=true);
@@ -435,6 +451,9 @@ class NodeGroup : public NodeBase, public Laxkit::DumpUtility
 	virtual int Disconnect(NodeConnection *connection, bool from_will_be_replaced, bool to_will_be_replaced);
 	virtual int ForceUpdates();
 	virtual int UpdateAllRecursively();
+	virtual int UpdateDirty();
+	virtual void InvalidateUpdateOrder();
+	virtual int RebuildUpdateOrder();
 	virtual void ManualUpdate(bool yes);
 	virtual void SoftUpdate(int reason);
 
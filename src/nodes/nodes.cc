@@ -25,6 +25,7 @@
 #include "nodes-dataobjects.h"
 #include "../calculator/calculator.h"
 #include "../calculator/curvevalue.h"
+#include "../calculator/arrayvalue.h"
 #include "../dataobjects/lsomedataref.h"
 #include "../dataobjects/objectfilter.h"
 #include "../dataobjects/bboxvalue.h"
@@ -1099,6 +1100,242 @@ enum MathNodeOps {
 	OP_MAX
 };
 
+
+//------------ Array kernels
+
+/*! \class ArrayArg
+ * One input to an array operation: either all the elements of a NumericArrayValue, or one number
+ * used for every element.
+ *
+ * The ArrayApply() functions loop over plain contiguous memory with the operation inlined,
+ * so the compiler can vectorize them. The loops are marked with "omp simd", which nodes/Makefile
+ * enables with -fopenmp-simd (no OpenMP runtime is used). The default DEBUGFLAGS have no -O,
+ * so they only actually vectorize in optimized builds, such as: ./configure --extra-cppflags -O2
+ */
+class ArrayArg
+{
+  public:
+	bool is_array = false;
+	const double *p = nullptr;
+	double v = 0;
+	std::vector<double> scratch; //for converting float or int arrays
+};
+
+class ArrayIn  { public: const double *p; double operator[](long i) const { return p[i]; } };
+class ScalarIn { public: double v;        double operator[](long i) const { return v; } };
+
+template <class F, class A>
+static void ArrayLoop(double *r, long n, F f, A a)
+{
+	#pragma omp simd
+	for (long i = 0; i < n; i++) r[i] = f(a[i]);
+}
+
+template <class F, class A, class B>
+static void ArrayLoop(double *r, long n, F f, A a, B b)
+{
+	#pragma omp simd
+	for (long i = 0; i < n; i++) r[i] = f(a[i], b[i]);
+}
+
+template <class F, class A, class B, class C>
+static void ArrayLoop(double *r, long n, F f, A a, B b, C c)
+{
+	#pragma omp simd
+	for (long i = 0; i < n; i++) r[i] = f(a[i], b[i], c[i]);
+}
+
+template <class F>
+static void ArrayApply(double *r, long n, F f, const ArrayArg &a)
+{
+	if (a.is_array) ArrayLoop(r,n,f, ArrayIn{a.p});
+	else            ArrayLoop(r,n,f, ScalarIn{a.v});
+}
+
+template <class F>
+static void ArrayApply(double *r, long n, F f, const ArrayArg &a, const ArrayArg &b)
+{
+	if (a.is_array) {
+		if (b.is_array) ArrayLoop(r,n,f, ArrayIn{a.p}, ArrayIn{b.p});
+		else            ArrayLoop(r,n,f, ArrayIn{a.p}, ScalarIn{b.v});
+	} else {
+		if (b.is_array) ArrayLoop(r,n,f, ScalarIn{a.v}, ArrayIn{b.p});
+		else            ArrayLoop(r,n,f, ScalarIn{a.v}, ScalarIn{b.v});
+	}
+}
+
+template <class F, class A, class B>
+static void ArrayApplyLast(double *r, long n, F f, A a, B b, const ArrayArg &c)
+{
+	if (c.is_array) ArrayLoop(r,n,f, a, b, ArrayIn{c.p});
+	else            ArrayLoop(r,n,f, a, b, ScalarIn{c.v});
+}
+
+template <class F>
+static void ArrayApply(double *r, long n, F f, const ArrayArg &a, const ArrayArg &b, const ArrayArg &c)
+{
+	if (a.is_array) {
+		if (b.is_array) ArrayApplyLast(r,n,f, ArrayIn{a.p}, ArrayIn{b.p}, c);
+		else            ArrayApplyLast(r,n,f, ArrayIn{a.p}, ScalarIn{b.v}, c);
+	} else {
+		if (b.is_array) ArrayApplyLast(r,n,f, ScalarIn{a.v}, ArrayIn{b.p}, c);
+		else            ArrayApplyLast(r,n,f, ScalarIn{a.v}, ScalarIn{b.v}, c);
+	}
+}
+
+/*! Return whether any of the n values is nonzero. Used to check domains after filling
+ * the output with 0 or 1 per element, which keeps the checks vectorizable too.
+ */
+static bool ArrayAny(const double *r, long n)
+{
+	bool any = false;
+	for (long i = 0; i < n; i++) any |= (r[i] != 0);
+	return any;
+}
+
+/*! Fill args from ins. Returns 1 if any of ins is a NumericArrayValue, with width and height set to its size.
+ * Returns 0 if there are no arrays, or -1 if arrays have different sizes, or other ins are not numbers.
+ */
+static int DetermineArrayIns(int num_ins, Value **ins, ArrayArg *args, int &width, int &height)
+{
+	bool found = false;
+	for (int c=0; c<num_ins; c++) {
+		NumericArrayValue *array = dynamic_cast<NumericArrayValue*>(ins[c]);
+		if (!array) continue;
+		if (found && (array->width != width || array->height != height)) return -1;
+		width  = array->width;
+		height = array->height;
+		found  = true;
+		args[c].is_array = true;
+		args[c].p = array->AsDoubles(args[c].scratch);
+	}
+	if (!found) return 0;
+
+	for (int c=0; c<num_ins; c++) {
+		if (args[c].is_array) continue;
+		int isnum = 0;
+		args[c].v = getNumberValue(ins[c], &isnum);
+		if (!isnum) return -1;
+	}
+	return 1;
+}
+
+/*! Return prop's data as a Double array of the given size, replacing the data if it is not already an array.
+ */
+static NumericArrayValue *ArrayOut(NodeProperty *prop, int width, int height)
+{
+	NumericArrayValue *out = dynamic_cast<NumericArrayValue*>(prop->GetData());
+	if (!out) {
+		out = new NumericArrayValue();
+		prop->SetData(out, 1);
+	}
+	out->Resize(NumericArrayValue::Double, width, height);
+	return out;
+}
+
+/*! For CanUpdateThreaded() of nodes with whole array paths. True when any of node's properties
+ * first..first+n-1 hold arrays, and property out already holds an array, so Update() only writes
+ * numbers into existing values.
+ */
+static bool ArrayUpdateInPlace(NodeBase *node, int first, int n, int out)
+{
+	if (!dynamic_cast<NumericArrayValue*>(node->properties.e[out]->GetData())) return false;
+	for (int c = first; c < first+n; c++) {
+		if (dynamic_cast<NumericArrayValue*>(node->properties.e[c]->GetData())) return true;
+	}
+	return false;
+}
+
+/*! Apply a 1 argument MathNodeOps to n elements of a, putting results in r.
+ * Returns an error message, or nullptr for success.
+ */
+static const char *MathArray1(int operation, const ArrayArg &a, double *r, long n)
+{
+	if        (operation == OP_AbsoluteValue || operation == OP_Norm) { ArrayApply(r,n, [](double a) { return fabs(a); }, a);
+	} else if (operation == OP_Norm2            ) { ArrayApply(r,n, [](double a) { return a*a; }, a);
+	} else if (operation == OP_Negative || operation == OP_Flip) { ArrayApply(r,n, [](double a) { return -a; }, a);
+	} else if (operation == OP_Sqrt             ) {
+		ArrayApply(r,n, [](double a) { return a < 0 ? 1. : 0.; }, a);
+		if (ArrayAny(r,n)) return _("Sqrt needs nonnegative number");
+		ArrayApply(r,n, [](double a) { return sqrt(a); }, a);
+	} else if (operation == OP_Sgn              )  { ArrayApply(r,n, [](double a) { return a > 0 ? 1. : a < 0 ? -1. : 0.; }, a);
+	} else if (operation == OP_Not              )  { ArrayApply(r,n, [](double a) { return (double)!(int)a; }, a);
+	} else if (operation == OP_Radians_To_Degrees) { ArrayApply(r,n, [](double a) { return a *180/M_PI; }, a);
+	} else if (operation == OP_Degrees_To_Radians) { ArrayApply(r,n, [](double a) { return a * M_PI/180; }, a);
+	} else if (operation == OP_Sin              )  { ArrayApply(r,n, [](double a) { return sin(a); }, a);
+	} else if (operation == OP_Cos              )  { ArrayApply(r,n, [](double a) { return cos(a); }, a);
+	} else if (operation == OP_Tan              )  { ArrayApply(r,n, [](double a) { return tan(a); }, a);
+	} else if (operation == OP_Asin || operation == OP_Acos) {
+		ArrayApply(r,n, [](double a) { return a > 1 || a < -1 ? 1. : 0.; }, a);
+		if (ArrayAny(r,n)) return _("Argument needs to be in range [-1, 1]");
+		if (operation == OP_Asin) ArrayApply(r,n, [](double a) { return asin(a); }, a);
+		else ArrayApply(r,n, [](double a) { return acos(a); }, a);
+	} else if (operation == OP_Atan             )  { ArrayApply(r,n, [](double a) { return atan(a); }, a);
+	} else if (operation == OP_Sinh             )  { ArrayApply(r,n, [](double a) { return sinh(a); }, a);
+	} else if (operation == OP_Cosh             )  { ArrayApply(r,n, [](double a) { return cosh(a); }, a);
+	} else if (operation == OP_Tanh             )  { ArrayApply(r,n, [](double a) { return tanh(a); }, a);
+	} else if (operation == OP_Asinh            )  { ArrayApply(r,n, [](double a) { return asinh(a); }, a);
+	} else if (operation == OP_Acosh            )  {
+		ArrayApply(r,n, [](double a) { return a < 1 ? 1. : 0.; }, a);
+		if (ArrayAny(r,n)) return _("Argument needs to be >= 1");
+		ArrayApply(r,n, [](double a) { return acosh(a); }, a);
+	} else if (operation == OP_Atanh            )  {
+		ArrayApply(r,n, [](double a) { return a <= -1 || a >= 1 ? 1. : 0.; }, a);
+		if (ArrayAny(r,n)) return _("Argument needs to be -1 > a > 1");
+		ArrayApply(r,n, [](double a) { return atanh(a); }, a);
+	} else if (operation == OP_Ceiling          )  { ArrayApply(r,n, [](double a) { return ceil(a); }, a);
+	} else if (operation == OP_Floor            )  { ArrayApply(r,n, [](double a) { return floor(a); }, a);
+	} else if (operation == OP_Clamp_To_1       )  { ArrayApply(r,n, [](double a) { return a > 1 ? 1. : a < 0 ? 0. : a; }, a);
+	} else if (operation == OP_Clamp_To_pm_1    )  { ArrayApply(r,n, [](double a) { return a > 1 ? 1. : a < -1 ? -1. : a; }, a);
+	} else return _("Operation can't use that argument");
+
+	return nullptr;
+}
+
+/*! Apply a 2 argument MathNodeOps to n elements of a and b, putting results in r.
+ * Returns an error message, or nullptr for success.
+ */
+static const char *MathArray2(int operation, const ArrayArg &a, const ArrayArg &b, double *r, long n)
+{
+	if      (operation==OP_Add)      ArrayApply(r,n, [](double a, double b) { return a+b; }, a,b);
+	else if (operation==OP_Subtract) ArrayApply(r,n, [](double a, double b) { return a-b; }, a,b);
+	else if (operation==OP_Multiply) ArrayApply(r,n, [](double a, double b) { return a*b; }, a,b);
+	else if (operation==OP_Divide || operation==OP_Mod) {
+		ArrayApply(r,n, [](double b) { return b == 0 ? 1. : 0.; }, b);
+		if (ArrayAny(r,n)) return _("Can't divide by 0");
+		if (operation==OP_Divide) ArrayApply(r,n, [](double a, double b) { return a/b; }, a,b);
+		else ArrayApply(r,n, [](double a, double b) { return a-b*int(a/b); }, a,b);
+
+	} else if (operation==OP_Power) {
+		ArrayApply(r,n, [](double a, double b) { return a==0 || (a<0 && fabs(b)-fabs(int(b))<1e-10) ? 1. : 0.; }, a,b);
+		if (ArrayAny(r,n)) return _("Power must be positive");
+		ArrayApply(r,n, [](double a, double b) { return pow(a,b); }, a,b);
+
+	} else if (operation==OP_Greater_Than_Or_Equal) { ArrayApply(r,n, [](double a, double b) { return (double)(a>=b); }, a,b);
+	} else if (operation==OP_Greater_Than)     { ArrayApply(r,n, [](double a, double b) { return (double)(a>b); }, a,b);
+	} else if (operation==OP_Less_Than)        { ArrayApply(r,n, [](double a, double b) { return (double)(a<b); }, a,b);
+	} else if (operation==OP_Less_Than_Or_Equal) { ArrayApply(r,n, [](double a, double b) { return (double)(a<=b); }, a,b);
+	} else if (operation==OP_Equals)           { ArrayApply(r,n, [](double a, double b) { return (double)(a==b); }, a,b);
+	} else if (operation==OP_Not_Equal)        { ArrayApply(r,n, [](double a, double b) { return (double)(a!=b); }, a,b);
+	} else if (operation==OP_Minimum)          { ArrayApply(r,n, [](double a, double b) { return a<b ? a : b; }, a,b);
+	} else if (operation==OP_Maximum)          { ArrayApply(r,n, [](double a, double b) { return a>b ? a : b; }, a,b);
+	} else if (operation==OP_Average)          { ArrayApply(r,n, [](double a, double b) { return (a+b)/2; }, a,b);
+	} else if (operation==OP_Atan2)            { ArrayApply(r,n, [](double a, double b) { return atan2(a,b); }, a,b);
+
+	} else if (operation==OP_And       )       { ArrayApply(r,n, [](double a, double b) { return (double)(int(a) & int(b)); }, a,b);
+	} else if (operation==OP_Or        )       { ArrayApply(r,n, [](double a, double b) { return (double)(int(a) | int(b)); }, a,b);
+	} else if (operation==OP_Xor       )       { ArrayApply(r,n, [](double a, double b) { return (double)(int(a) ^ int(b)); }, a,b);
+	} else if (operation==OP_ShiftLeft )       { ArrayApply(r,n, [](double a, double b) { return (double)(int(a) << int(b)); }, a,b);
+	} else if (operation==OP_ShiftRight)       { ArrayApply(r,n, [](double a, double b) { return (double)(int(a) >> int(b)); }, a,b);
+
+	} else if (operation==OP_RandomRange)      {
+		 //reseeds per element like the scalar version, so this one is not vectorized
+		ArrayApply(r,n, [](double a, double b) { srandom(a); return b * (double)random()/RAND_MAX; }, a,b);
+	} else return _("Operation can't use those arguments");
+
+	return nullptr;
+}
+
 /*! Create and return a fresh instance of the def for a 1 arg MathNode2 op.
  */
 ObjectDef *DefineMathNode1Def()
@@ -1197,6 +1434,7 @@ class MathNode1 : public NodeBase
 	virtual ~MathNode1();
 	virtual int UpdateThisOnly();
 	virtual int Update();
+	virtual bool CanUpdateThreaded() { return ArrayUpdateInPlace(this, 1,1, 2); }
 	virtual int GetStatus();
 	virtual NodeBase *Duplicate();
 	virtual const char *Label();
@@ -1209,6 +1447,7 @@ SingletonKeeper MathNode1::mathnodekeeper(DefineMathNode1Def(), true);
 MathNode1::MathNode1(int op, double aa)
 {
 	type = newstr("Math1");
+	thread_safe = true; //for whole arrays, see CanUpdateThreaded()
 
 	last_status = 1;
 	status_time = 0;
@@ -1300,6 +1539,24 @@ int MathNode1::UpdateThisOnly()
 	SetValue *setin = nullptr;;
 	Value *valuea = properties.e[1]->GetData();
 
+	 //whole arrays at once
+	ArrayArg arrayin;
+	int width = 0, height = 0;
+	if (DetermineArrayIns(1, &valuea, &arrayin, width, height) == 1) {
+		EnumValue *ev = dynamic_cast<EnumValue*>(properties.e[0]->GetData());
+		int operation = OP_None;
+		ev->GetObjectDef()->getEnumInfo(ev->value, NULL, NULL, NULL, &operation);
+
+		NumericArrayValue *outarray = ArrayOut(properties.e[2], width, height);
+		const char *error = MathArray1(operation, arrayin, outarray->Doubles(), outarray->n());
+		if (error) {
+			Error(error);
+			return -1;
+		}
+		properties.e[2]->Touch();
+		return 0;
+	}
+
 	if (DetermineSetIns(1, &valuea, &setin, max, dosets) == -1) return -1;
 
 	Value *out = properties.e[2]->GetData();
@@ -1545,6 +1802,7 @@ class MathNode2 : public NodeBase
 	virtual ~MathNode2();
 	virtual int UpdateThisOnly();
 	virtual int Update();
+	virtual bool CanUpdateThreaded() { return ArrayUpdateInPlace(this, 1,2, 3); }
 	virtual int GetStatus();
 	virtual NodeBase *Duplicate();
 	virtual const char *Label();
@@ -1560,6 +1818,7 @@ Laxkit::anObject *newMathNode2(int p, Laxkit::anObject *ref)
 MathNode2::MathNode2(int op, double aa, double bb)
 {
 	type = newstr("Math2");
+	thread_safe = true; //for whole arrays, see CanUpdateThreaded()
 	// Name = newstr(_("Math 2"));
 
 	last_status = 1;
@@ -1676,6 +1935,29 @@ int MathNode2::UpdateThisOnly()
 	SetValue *setins[2];
 	setins[0] = setins[1] = nullptr;
 
+	 //whole arrays at once, with arrays of the same size or single numbers
+	ArrayArg arrayins[2];
+	int width = 0, height = 0;
+	int arrays = DetermineArrayIns(2, ins, arrayins, width, height);
+	if (arrays == -1) {
+		Error(_("Arrays need numbers or arrays of the same size"));
+		return -1;
+
+	} else if (arrays == 1) {
+		EnumValue *ev = dynamic_cast<EnumValue*>(properties.e[0]->GetData());
+		int operation = OP_None;
+		ev->GetObjectDef()->getEnumInfo(ev->value, NULL, NULL, NULL, &operation);
+
+		NumericArrayValue *outarray = ArrayOut(properties.e[3], width, height);
+		const char *error = MathArray2(operation, arrayins[0], arrayins[1], outarray->Doubles(), outarray->n());
+		if (error) {
+			Error(error);
+			return -1;
+		}
+		properties.e[3]->Touch();
+		return 0;
+	}
+
 	if (DetermineSetIns(2, ins, setins, max, dosets) == -1) return -1;
 
 	Value *out = properties.e[3]->GetData();
@@ -2288,6 +2570,7 @@ int ExpressionNode::Update()
 	Value *ret = nullptr;
 	tms tms_;
 	last_eval = times(&tms_);
+	 //the calculator keeps the compiled expression for our parameter names, so this is only parsed once
 	status = laidout->calculator->EvaluateWithParams(expression,-1, nullptr, &params, &ret, &log);
 	if (status != 0 || !ret) {
 		char *er = log.FullMessageStr();
@@ -4392,6 +4675,7 @@ class LerpNode : public NodeBase
 	LerpNode(double a=0, double b=1, double r=0);
 	virtual ~LerpNode();
 	virtual int Update();
+	virtual bool CanUpdateThreaded() { return ArrayUpdateInPlace(this, 0,3, 3); }
 	virtual int GetStatus();
 	virtual NodeBase *Duplicate();
 };
@@ -4400,6 +4684,7 @@ LerpNode::LerpNode(double a, double b, double r)
 {
 	makestr(Name, _("Lerp"));
 	makestr(type, "Lerp");
+	thread_safe = true; //for whole arrays, see CanUpdateThreaded()
 	//makestr(description, _("Linear interpolation"));
 
 	AddProperty(new NodeProperty(NodeProperty::PROP_Input, true, "A", new DoubleValue(a),1,    _("A"))); 
@@ -4428,6 +4713,14 @@ NodeBase *LerpNode::Duplicate()
 
 int LerpNode::GetStatus()
 {
+	for (int c=0; c<3; c++) {
+		if (dynamic_cast<NumericArrayValue*>(properties.e[c]->GetData())) {
+			 //array sizes are checked in Update()
+			if (!properties.e[3]->data) return 1;
+			return NodeBase::GetStatus();
+		}
+	}
+
 	if (!isNumberType(properties.e[2]->GetData(), NULL)) return -1;
 
 	int avn = isVectorType(properties.e[0]->GetData(), NULL);
@@ -4443,6 +4736,25 @@ int LerpNode::GetStatus()
 
 int LerpNode::Update()
 {
+	ClearError();
+
+	Value *ins[3];
+	for (int c=0; c<3; c++) ins[c] = properties.e[c]->GetData();
+	ArrayArg arrayins[3];
+	int width = 0, height = 0;
+	int arrays = DetermineArrayIns(3, ins, arrayins, width, height);
+	if (arrays == -1) {
+		Error(_("Arrays need numbers or arrays of the same size"));
+		return -1;
+
+	} else if (arrays == 1) {
+		NumericArrayValue *out = ArrayOut(properties.e[3], width, height);
+		ArrayApply(out->Doubles(), out->n(), [](double a, double b, double r) { return a + (b-a)*r; },
+				   arrayins[0], arrayins[1], arrayins[2]);
+		properties.e[3]->Touch();
+		return NodeBase::Update();
+	}
+
 	int isnum=0;
 	double r = getNumberValue(properties.e[2]->GetData(), &isnum);
 	if (!isnum) return -1;
@@ -4503,6 +4815,7 @@ class MapRangeNode : public NodeBase
 	MapRangeNode(bool map_to, double min, double max, bool clamp);
 	virtual ~MapRangeNode();
 	virtual int Update();
+	virtual bool CanUpdateThreaded() { return ArrayUpdateInPlace(this, 0,3, properties.n-1); }
 	virtual int GetStatus();
 	virtual NodeBase *Duplicate();
 };
@@ -4510,6 +4823,7 @@ class MapRangeNode : public NodeBase
 MapRangeNode::MapRangeNode(bool map_to, double min, double max, bool clamp)
 {
 	mapto = map_to;
+	thread_safe = true; //for whole arrays, see CanUpdateThreaded()
 
 	if (mapto) {
 		makestr(Name, _("0..1 to range"));
@@ -4548,16 +4862,16 @@ NodeBase *MapRangeNode::Duplicate()
 int MapRangeNode::GetStatus()
 {
 	Value *v = properties.e[0]->GetData();
-	if (!isNumberType(v, NULL) && !(v && v->type() == VALUE_Set)) return -1;
+	if (!isNumberType(v, NULL) && !(v && (v->type() == VALUE_Set || dynamic_cast<NumericArrayValue*>(v)))) return -1;
 
 	int isnum;
 	v = properties.e[1]->GetData();
 	getNumberValue(v, &isnum);
-	if (!isnum && !(v && v->type() == VALUE_Set)) return -1;
+	if (!isnum && !(v && (v->type() == VALUE_Set || dynamic_cast<NumericArrayValue*>(v)))) return -1;
 
 	v = properties.e[2]->GetData();
 	getNumberValue(v, &isnum);
-	if (!isnum && !(v && v->type() == VALUE_Set)) return -1;
+	if (!isnum && !(v && (v->type() == VALUE_Set || dynamic_cast<NumericArrayValue*>(v)))) return -1;
 
 	return NodeBase::GetStatus(); //default checks mod times
 }
@@ -4569,6 +4883,42 @@ int MapRangeNode::Update()
 	int num_ins = 3;
 	Value *ins[num_ins];
 	for (int c=0; c<num_ins; c++) ins[c] = properties.e[c]->GetData();
+
+	 //whole arrays at once
+	ArrayArg arrayins[3];
+	int width = 0, height = 0;
+	int arrays = DetermineArrayIns(num_ins, ins, arrayins, width, height);
+	if (arrays == -1) {
+		Error(_("Arrays need numbers or arrays of the same size"));
+		return -1;
+
+	} else if (arrays == 1) {
+		bool clamp = dynamic_cast<BooleanValue*>(properties.e[3]->GetData())->i;
+		NumericArrayValue *out = ArrayOut(properties.e[properties.n-1], width, height);
+		double *r = out->Doubles();
+		long n = out->n();
+
+		if (mapto) {
+			if (clamp) ArrayApply(r,n, [](double in, double min, double max) {
+						double num = min + (max-min)*in;
+						if (max > min) return num < min ? min : num > max ? max : num;
+						return num < max ? max : num > min ? min : num;
+					}, arrayins[0], arrayins[1], arrayins[2]);
+			else ArrayApply(r,n, [](double in, double min, double max) { return min + (max-min)*in; },
+					arrayins[0], arrayins[1], arrayins[2]);
+		} else {
+			if (clamp) ArrayApply(r,n, [](double in, double min, double max) {
+						if (max == min) return 0.;
+						double num = (in-min) / (max-min);
+						return num < 0 ? 0. : num > 1 ? 1. : num;
+					}, arrayins[0], arrayins[1], arrayins[2]);
+			else ArrayApply(r,n, [](double in, double min, double max) { return max == min ? 0. : (in-min) / (max-min); },
+					arrayins[0], arrayins[1], arrayins[2]);
+		}
+
+		properties.e[properties.n-1]->Touch();
+		return NodeBase::Update();
+	}
 	
 	SetValue *setins[num_ins];
 	SetValue *outset = nullptr;
@@ -5297,6 +5647,8 @@ NumberListNode::NumberListNode()
 	AddProperty(new NodeProperty(NodeProperty::PROP_Input,  true, "Start", new DoubleValue(1),1,  _("Start"), NULL));
 	AddProperty(new NodeProperty(NodeProperty::PROP_Input,  true, "End",   new DoubleValue(10),1, _("End"),   NULL));
 	AddProperty(new NodeProperty(NodeProperty::PROP_Input,  true, "Step",  new DoubleValue(1),1,  _("Step"),  NULL));
+	AddProperty(new NodeProperty(NodeProperty::PROP_Block,  false,"Array", new BooleanValue(false),1, _("Array"),
+				_("Output a numeric array instead of a set, for very long lists")));
 
 	AddProperty(new NodeProperty(NodeProperty::PROP_Output, true, "out",  nullptr,1, _("out"),  NULL, 0, false));
 }
@@ -5334,6 +5686,22 @@ int NumberListNode::Update()
 		return -1;
 	}
 
+	bool as_array = dynamic_cast<BooleanValue*>(properties.e[3]->GetData())->i;
+	if (as_array) {
+		if (fabs((end-start)/step) > 10000000) {
+			Error(_("Too many values!"));
+			return -1;
+		}
+
+		int num = (start == end ? 0 : (int)ceil((end-start)/step));
+		NumericArrayValue *out = ArrayOut(properties.e[properties.n-1], num, 1);
+		double *r = out->Doubles();
+		for (int c = 0; c < num; c++) r[c] = start + c*step;
+
+		properties.e[properties.n-1]->Touch();
+		return NodeBase::Update();
+	}
+
 	if (fabs((end-start)/step) > 2000) {
 		Error(_("Too many values!"));
 		return -1;
@@ -5362,6 +5730,92 @@ int NumberListNode::Update()
 }
 
 
+//------------------------ ArrayConvertNode ------------------------
+
+/*! \class ArrayConvertNode
+ * Convert a set of numbers to a NumericArrayValue, or a NumericArrayValue to a set.
+ */
+
+class ArrayConvertNode : public NodeBase
+{
+  public:
+	bool to_array;
+
+	ArrayConvertNode(bool nto_array);
+	virtual ~ArrayConvertNode();
+	virtual NodeBase *Duplicate();
+	virtual int Update();
+	virtual int GetStatus();
+
+	static Laxkit::anObject *NewToArray(int p, Laxkit::anObject *ref) { return new ArrayConvertNode(true); }
+	static Laxkit::anObject *NewToSet  (int p, Laxkit::anObject *ref) { return new ArrayConvertNode(false); }
+};
+
+ArrayConvertNode::ArrayConvertNode(bool nto_array)
+{
+	to_array = nto_array;
+
+	if (to_array) {
+		makestr(Name, _("Set to array"));
+		makestr(type,   "Lists/SetToArray");
+		AddProperty(new NodeProperty(NodeProperty::PROP_Input, true, "in", nullptr,1, _("Set"),
+					_("Set of numbers, or set of sets of numbers all the same size")));
+	} else {
+		makestr(Name, _("Array to set"));
+		makestr(type,   "Lists/ArrayToSet");
+		AddProperty(new NodeProperty(NodeProperty::PROP_Input, true, "in", nullptr,1, _("Array"), NULL));
+	}
+
+	AddProperty(new NodeProperty(NodeProperty::PROP_Output, true, "out", nullptr,1, _("out"), NULL, 0, false));
+}
+
+ArrayConvertNode::~ArrayConvertNode()
+{
+}
+
+NodeBase *ArrayConvertNode::Duplicate()
+{
+	ArrayConvertNode *newnode = new ArrayConvertNode(to_array);
+	newnode->DuplicateBase(this);
+	return newnode;
+}
+
+int ArrayConvertNode::GetStatus()
+{
+	Value *v = properties.e[0]->GetData();
+	if (to_array) {
+		if (!dynamic_cast<SetValue*>(v)) return -1;
+	} else if (!dynamic_cast<NumericArrayValue*>(v)) return -1;
+
+	if (!properties.e[1]->GetData()) return 1;
+	return NodeBase::GetStatus(); //default checks mod times
+}
+
+int ArrayConvertNode::Update()
+{
+	Error(nullptr);
+
+	Value *out = nullptr;
+	if (to_array) {
+		SetValue *set = dynamic_cast<SetValue*>(properties.e[0]->GetData());
+		if (!set) return -1;
+		out = NumericArrayValue::FromSet(set);
+		if (!out) {
+			Error(_("Set must contain only numbers, or sets of numbers of the same size"));
+			return -1;
+		}
+
+	} else {
+		NumericArrayValue *array = dynamic_cast<NumericArrayValue*>(properties.e[0]->GetData());
+		if (!array) return -1;
+		out = array->ToSet();
+	}
+
+	properties.e[1]->SetData(out, 1);
+	return NodeBase::Update();
+}
+
+
 //----------------------- ShuffleNode ------------------------
 
 /*! \class ShuffleNode
@@ -8263,6 +8717,8 @@ int SetupDefaultNodeTypes(Laxkit::ObjectFactory *factory)
 	factory->DefineNewObject(getUniqueNumber(), "Lists/JoinSets",    JoinSetsNode::NewNode,  NULL, 0);
 	factory->DefineNewObject(getUniqueNumber(), "Lists/MakeSet",     MakeSetNode::NewNode,  NULL, 0);
 	factory->DefineNewObject(getUniqueNumber(), "Lists/NumberList",  NumberListNode::NewNode,  NULL, 0);
+	factory->DefineNewObject(getUniqueNumber(), "Lists/SetToArray",  ArrayConvertNode::NewToArray,  NULL, 0);
+	factory->DefineNewObject(getUniqueNumber(), "Lists/ArrayToSet",  ArrayConvertNode::NewToSet,  NULL, 0);
 	factory->DefineNewObject(getUniqueNumber(), "Lists/Shuffle",     ShuffleNode::NewNode,  NULL, 0);
 	factory->DefineNewObject(getUniqueNumber(), "Lists/Switch",      SwitchNode::NewNode,  NULL, 0);
 	//special duplication of GetElement
@@ -37,6 +37,8 @@
 #include "pspathsdata.h"
 #include "pseps.h"
 
+#include <unordered_set>
+
 #include <iostream>
 using namespace std;
 #define DBG 
@@ -151,6 +153,104 @@ void psFlushCtms()
 
 
 
+//----------------------------- ps forms ---------------------------------------
+
+//! object_id of objects that have a form defined in the current file, named LaidoutForm[object_id].
+static std::unordered_set<unsigned long> psforms;
+
+//! Return whether obj can be drawn from a form's PaintProc.
+/*! Images and EPS read their data inline from currentfile, so cannot be inside procedures.
+ */
+static bool psCanBeForm(SomeData *obj)
+{
+	if (!obj) return false;
+	if (!strcmp(obj->whattype(),"ImageData")
+	 || !strcmp(obj->whattype(),"ImagePatchData")
+	 || !strcmp(obj->whattype(),"EpsData")) return false;
+
+	if (!strcmp(obj->whattype(),"SomeDataRef"))
+		return psCanBeForm(dynamic_cast<SomeDataRef*>(obj)->GetFinalObject());
+
+	Group *g = dynamic_cast<Group *>(obj);
+	if (g) {
+		for (int c=0; c<g->n(); c++) if (!psCanBeForm(g->e(c))) return false;
+	}
+	return true;
+}
+
+//! Define forms for the objects referenced by any SomeDataRef in obj.
+/*! Each referenced object is defined only once per file, and psdumpobj() then draws each ref
+ * to it with execform instead of the whole object. This must be called outside of
+ * any page's save and restore, such as in the setup section.
+ */
+static void psDefineForms(FILE *f, SomeData *obj)
+{
+	if (!obj) return;
+
+	Group *g = dynamic_cast<Group *>(obj);
+	if (g) {
+		for (int c=0; c<g->n(); c++) psDefineForms(f, g->e(c));
+		return;
+	}
+
+	SomeDataRef *ref = dynamic_cast<SomeDataRef *>(obj);
+	if (!ref) return;
+	SomeData *refed = ref->GetFinalObject();
+	if (!refed || !refed->validbounds() || psforms.count(refed->object_id)) return;
+	if (!psCanBeForm(refed)) return;
+
+	psDefineForms(f, refed); //refs within refs need to be defined first
+
+	 //the ref's transform replaces the referenced object's, so the form undoes refed->m()
+	double m[6];
+	transform_invert(m, refed->m());
+	double pad = (refed->boxwidth() > refed->boxheight() ? refed->boxwidth() : refed->boxheight()) + 1;
+
+	fprintf(f,"/LaidoutForm%lu <<\n"
+			  "  /FormType 1\n"
+			  "  /BBox [%.10g %.10g %.10g %.10g]\n"
+			  "  /Matrix [1 0 0 1 0 0]\n"
+			  "  /PaintProc { pop\n"
+			  "[%.10g %.10g %.10g %.10g %.10g %.10g] concat\n",
+			refed->object_id,
+			refed->minx-pad, refed->miny-pad, refed->maxx+pad, refed->maxy+pad,
+			m[0], m[1], m[2], m[3], m[4], m[5]);
+	psPushCtm();
+	psConcat(m);
+	psdumpobj(f, refed);
+	psPopCtm();
+	fprintf(f,"  } bind\n"
+			  ">> def\n\n");
+
+	psforms.insert(refed->object_id);
+}
+
+//! Define forms for everything that might be printed for spread number index.
+static void psDefineSpreadForms(FILE *f, DocumentExportConfig *out, int index)
+{
+	Document *doc = out->doc;
+	Spread *spread = (doc ? doc->imposition->Layout(out->layout, index) : NULL);
+
+	if (out->limbo) psDefineForms(f, out->limbo);
+
+	PaperGroup *papergroup = out->papergroup;
+	if (!papergroup && spread) papergroup = spread->papergroup;
+	if (papergroup) psDefineForms(f, &papergroup->objs);
+
+	if (spread) {
+		if (spread->mask&SPREAD_PRINTERMARKS && spread->marks) psDefineForms(f, spread->marks);
+
+		for (int c2=0; c2<spread->pagestack.n(); c2++) {
+			int pg = spread->pagestack.e[c2]->index;
+			if (pg<0 || pg>=doc->pages.n) continue;
+			Page *page = doc->pages.e[pg];
+			for (int l=0; l<page->layers.n(); l++) psDefineForms(f, page->layers.e(l));
+		}
+		delete spread;
+	}
+}
+
+
 //----------------------------- ps out ---------------------------------------
 
 //! Internal function to dump out the obj in postscript. Called by psout().
@@ -198,6 +298,20 @@ void psdumpobj(FILE *f,LaxInterfaces::SomeData *obj)
 	} else if (!strcmp(obj->whattype(),"EpsData")) {
 		psEps(f,dynamic_cast<EpsData *>(obj));
 
+	} else if (!strcmp(obj->whattype(),"SomeDataRef")) {
+		 //the ref's transform replaces the referenced object's
+		SomeData *refed = dynamic_cast<SomeDataRef *>(obj)->GetFinalObject();
+		if (refed && psforms.count(refed->object_id)) {
+			fprintf(f,"LaidoutForm%lu execform\n", refed->object_id);
+
+		} else if (refed) {
+			double m[6];
+			transform_invert(m, refed->m());
+			fprintf(f,"[%.10g %.10g %.10g %.10g %.10g %.10g] concat\n ",
+					m[0], m[1], m[2], m[3], m[4], m[5]); 
+			psConcat(m);
+			psdumpobj(f, refed);
+		}
 	}
 	
 	 // pop axes
@@ -296,9 +410,6 @@ int psSetClipToPath(FILE *f,LaxInterfaces::SomeData *outline,int iscontinuing)//
  * \todo *** this does not currently handle pages that bleed their contents
  *   onto other pages correctly. it bleeds here by paper spread, rather than page spread
  * \todo *** ps doc tag For: ????
- * \todo *** for tiled pages, or multiples of same object each instance is
- *   rendered independently right now. should make a function to display such
- *   things, thus reduce ps file size substantially..
  * \todo for embedded EPS that include specific resources, extensions, or language level, these must be
  *   mentioned in the postscript file's comments...
  * \todo *** fix non-paper layout media/paper type
@@ -389,7 +500,7 @@ int psout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 		return 3;
 	}
 
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 
 	 //Basically, postscript documents following the ps document structure 
@@ -502,8 +613,15 @@ int psout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 			  
 	fprintf(f,"%%%%EndProlog\n"
 			  "\n"
-			  "%%%%BeginSetup\n"
-			  "%%%%EndSetup\n"
+			  "%%%%BeginSetup\n");
+
+	 //shared forms for clones
+	psforms.clear();
+	for (c = out->range.Start(); c >= 0; c = out->range.Next()) {
+		psDefineSpreadForms(f, out, c);
+	}
+
+	fprintf(f,"%%%%EndSetup\n"
 			  "\n");
 	
 	 // Write out paper spreads....
@@ -661,7 +779,7 @@ int psout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 	fclose(f);
 	delete[] file;
 	//papergroup->dec_count();
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 	return 0;
 }
@@ -675,9 +793,6 @@ int psout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
  * 
  * \todo *** this does not currently handle pages that bleed their contents
  *   onto other pages correctly. it bleeds here by paper spread, rather than page spread
- * \todo *** for tiled pages, or multiples of same object each instance is
- *   rendered independently right now. should make a function to display such
- *   things, thus reduce ps file size substantially..
  * \todo *** bounding box should more accurately reflect the drawn extent.. just does paper bounds here
  */
 int epsout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
@@ -766,7 +881,7 @@ int epsout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 		return 1;
 	}
 	
-	setlocale(LC_ALL,"C");
+	UseCLocale(true);
 
 
 	 // print out header
@@ -813,6 +928,12 @@ int epsout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 	//}
 			  
 	fprintf(f,"%%%%EndProlog\n");
+
+	 //shared forms for clones
+	fprintf(f,"%%%%BeginSetup\n");
+	psforms.clear();
+	psDefineSpreadForms(f, out, out->range.Start());
+	fprintf(f,"%%%%EndSetup\n");
 		
 	 //print paper header
 	fprintf(f, "%%%%Page: %d 1\n", out->range.Start()+1);//%%Page (label) (ordinal starting at 1)
@@ -907,7 +1028,7 @@ int epsout(const char *filename, Laxkit::anObject *context, ErrorLog &log)
 	fprintf(f, "\n%%%%EOF\n");
 
 	fclose(f);
-	setlocale(LC_ALL,"");
+	UseCLocale(false);
 
 
 	DBG cerr <<"=================== end printing eps ========================\n";
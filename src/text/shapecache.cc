@@ -0,0 +1,278 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include "shapecache.h"
+
+#include <lax/anxapp.h>
+
+#include <cstring>
+#include <cstdio>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace std;
+
+
+namespace Laidout {
+
+
+#define SHAPECACHE_DEFAULT_BYTES (16*1024*1024)
+
+
+//------------------------------------- ShapeCache ---------------------------------------
+
+/*! \class ShapeCache
+ * \brief Least recently used cache of text shaped with HarfBuzz.
+ *
+ * Runs are keyed by font file, face index, size, font variations, OpenType features, and
+ * the utf8 text. Features and variations are comma separated strings in HarfBuzz's syntax,
+ * such as "liga=0,smcp" or "wght=700". Memory use is kept under MaxBytes(), discarding
+ * runs that were used least recently.
+ *
+ * Runs are returned as shared pointers, so callers can keep using a run that gets discarded
+ * from the cache, and shaping can happen from worker threads.
+ */
+
+
+static ShapeCache *shared_cache = nullptr;
+static std::mutex shared_cache_mutex;
+
+
+/*! Return a process wide cache, created on first use. This is never deleted before exit.
+ */
+ShapeCache *ShapeCache::Shared()
+{
+	std::lock_guard<std::mutex> lock(shared_cache_mutex);
+	if (!shared_cache) shared_cache = new ShapeCache();
+	return shared_cache;
+}
+
+/*! nmax_bytes <= 0 means use a default of 16 megabytes.
+ */
+ShapeCache::ShapeCache(size_t nmax_bytes)
+{
+	max_bytes = (nmax_bytes > 0 ? nmax_bytes : SHAPECACHE_DEFAULT_BYTES);
+	bytes = 0;
+	hits = misses = evictions = 0;
+}
+
+ShapeCache::~ShapeCache()
+{
+	DBG cerr << "ShapeCache hits: "<<hits<<"  misses: "<<misses<<"  evictions: "<<evictions<<endl;
+
+	for (auto &face : faces) if (face.second.font) hb_font_destroy(face.second.font);
+}
+
+/*! Return an immutable hb_font_t for the file, made once per file, face, and variations.
+ * Returns nullptr if the font can't be loaded. Must be called with mutex locked.
+ */
+ShapeCache::FontFace *ShapeCache::GetFace(const char *file, int face_index, const char *variations)
+{
+	char scratch[30];
+	sprintf(scratch, "\n%d\n", face_index);
+	std::string key = std::string(file) + scratch + (variations ? variations : "");
+
+	auto found = faces.find(key);
+	if (found != faces.end()) return found->second.font ? &found->second : nullptr;
+
+	 //failures are remembered too, so bad files are not read over and over
+	FontFace &face = faces[key];
+
+	hb_blob_t *blob = hb_blob_create_from_file(file);
+	if (!blob || hb_blob_get_length(blob) == 0) {
+		DBG cerr << " *** ShapeCache can't load font "<<file<<endl;
+		hb_blob_destroy(blob);
+		return nullptr;
+	}
+	hb_face_t *hbface = hb_face_create(blob, face_index);
+	hb_blob_destroy(blob);
+	face.units_per_em = hb_face_get_upem(hbface);
+	face.font = hb_font_create(hbface);
+	hb_face_destroy(hbface);
+
+	if (variations && *variations) {
+		std::vector<hb_variation_t> vars;
+		const char *s = variations;
+		while (*s) {
+			const char *e = strchr(s, ',');
+			if (!e) e = s + strlen(s);
+			hb_variation_t var;
+			if (hb_variation_from_string(s, e - s, &var)) vars.push_back(var);
+			s = (*e ? e+1 : e);
+		}
+		if (vars.size()) hb_font_set_variations(face.font, vars.data(), vars.size());
+	}
+
+	hb_font_make_immutable(face.font);
+	return &face;
+}
+
+/*! Return the shaped glyphs for text, which is len bytes of utf8, or the whole string if len < 0.
+ * Glyph metrics are in font units, see ShapedRun::Scale().
+ * Returns an empty pointer if the font can't be loaded.
+ */
+std::shared_ptr<const ShapedRun> ShapeCache::Shape(const char *file, int face_index, double size,
+									const char *variations, const char *features, const char *text, int len)
+{
+	if (!file || !text) return nullptr;
+	if (len < 0) len = strlen(text);
+
+	char scratch[50];
+	sprintf(scratch, "\n%d\n%.10g\n", face_index, size);
+	std::string key = file;
+	key += scratch;
+	if (variations) key += variations;
+	key += '\n';
+	if (features) key += features;
+	key += '\n';
+	key.append(text, len);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto found = index.find(key);
+	if (found != index.end()) {
+		hits++;
+		entries.splice(entries.begin(), entries, found->second);
+		return found->second->run;
+	}
+
+	misses++;
+	FontFace *face = GetFace(file, face_index, variations);
+	if (!face) return nullptr;
+
+	std::vector<hb_feature_t> feats;
+	if (features) {
+		const char *s = features;
+		while (*s) {
+			const char *e = strchr(s, ',');
+			if (!e) e = s + strlen(s);
+			hb_feature_t feature;
+			if (hb_feature_from_string(s, e - s, &feature)) feats.push_back(feature);
+			s = (*e ? e+1 : e);
+		}
+	}
+
+	hb_buffer_t *buffer = hb_buffer_create();
+	hb_buffer_add_utf8(buffer, text, len, 0, len);
+	hb_buffer_guess_segment_properties(buffer);
+	hb_shape(face->font, buffer, feats.size() ? feats.data() : nullptr, feats.size());
+
+	unsigned int n = 0;
+	hb_glyph_info_t     *info      = hb_buffer_get_glyph_infos(buffer, &n);
+	hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(buffer, nullptr);
+
+	ShapedRun *run = new ShapedRun;
+	run->units_per_em = face->units_per_em;
+	run->size = size;
+	run->glyphs.resize(n);
+	for (unsigned int c = 0; c < n; c++) {
+		ShapedGlyph &glyph = run->glyphs[c];
+		glyph.glyph     = info[c].codepoint;
+		glyph.cluster   = info[c].cluster;
+		glyph.x_advance = positions[c].x_advance;
+		glyph.y_advance = positions[c].y_advance;
+		glyph.x_offset  = positions[c].x_offset;
+		glyph.y_offset  = positions[c].y_offset;
+		run->x_advance += glyph.x_advance;
+	}
+	hb_buffer_destroy(buffer);
+
+	Entry entry;
+	entry.key = key;
+	entry.run = std::shared_ptr<const ShapedRun>(run);
+	entry.bytes = run->Bytes() + 2 * key.size() + sizeof(Entry);
+	entries.push_front(entry);
+	index[key] = entries.begin();
+	bytes += entry.bytes;
+	Trim();
+
+	return entries.front().run;
+}
+
+/*! Shape with font's file, face, and size. Returns an empty pointer if font has no file.
+ */
+std::shared_ptr<const ShapedRun> ShapeCache::Shape(Laxkit::LaxFont *font, double size, const char *features, const char *text, int len)
+{
+	if (!font || !font->FontFile()) return nullptr;
+	return Shape(font->FontFile(), FaceIndex(font), size, nullptr, features, text, len);
+}
+
+/*! Return which face of its file font is, for font files with more than one face, like .ttc
+ * collections. This is looked up in the font manager by file, family, and style.
+ * Returns 0 if not found.
+ */
+int ShapeCache::FaceIndex(Laxkit::LaxFont *font)
+{
+	if (!font || !font->FontFile() || !anXApp::app || !anXApp::app->fontmanager) return 0;
+
+	const char *file = font->FontFile();
+	FontManager *fontmanager = anXApp::app->fontmanager;
+	int first = -1;
+	for (int c=0; c<fontmanager->fonts.n; c++) {
+		FontDialogFont *face = fontmanager->fonts.e[c];
+		if (!face->file || strcmp(face->file, file)) continue;
+		if (first < 0) first = face->index;
+		if (font->Family() && face->family && !strcmp(font->Family(), face->family)
+				&& font->Style() && face->style && !strcmp(font->Style(), face->style))
+			return face->index;
+	}
+	return first > 0 ? first : 0;
+}
+
+/*! Discard least recently used runs until under max_bytes. The most recent run is always kept.
+ * Must be called with mutex locked.
+ */
+void ShapeCache::Trim()
+{
+	while (bytes > max_bytes && entries.size() > 1) {
+		Entry &entry = entries.back();
+		bytes -= entry.bytes;
+		index.erase(entry.key);
+		entries.pop_back();
+		evictions++;
+	}
+}
+
+void ShapeCache::SetMaxBytes(size_t nmax_bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	max_bytes = (nmax_bytes > 0 ? nmax_bytes : SHAPECACHE_DEFAULT_BYTES);
+	Trim();
+}
+
+/*! Discard all runs and loaded fonts, for instance when font files have changed.
+ */
+void ShapeCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	index.clear();
+	entries.clear();
+	bytes = 0;
+	for (auto &face : faces) if (face.second.font) hb_font_destroy(face.second.font);
+	faces.clear();
+}
+
+void ShapeCache::ResetCounters()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	hits = misses = evictions = 0;
+}
+
+
+} //namespace Laidout
+
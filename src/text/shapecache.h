@@ -0,0 +1,118 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef SHAPECACHE_H
+#define SHAPECACHE_H
+
+#include <lax/fontmanager.h>
+
+#include <hb.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Laidout {
+
+
+//------------------------------------- ShapedRun ---------------------------------------
+
+class ShapedGlyph
+{
+  public:
+	unsigned int glyph;   //glyph id in the font
+	unsigned int cluster; //byte offset into the shaped text of the first character of this glyph
+	int x_advance, y_advance; //in font units
+	int x_offset,  y_offset;
+};
+
+class ShapedRun
+{
+  public:
+	std::vector<ShapedGlyph> glyphs;
+	unsigned int units_per_em = 1000;
+	double size = 1; //font size glyphs were shaped for
+	long x_advance = 0; //sum of glyph x_advance, in font units
+
+	double Scale() const { return size / units_per_em; } //font units to size units
+	double Advance() const { return x_advance * Scale(); }
+	size_t Bytes() const { return sizeof(ShapedRun) + glyphs.capacity() * sizeof(ShapedGlyph); }
+};
+
+
+//------------------------------------- ShapeCache ---------------------------------------
+
+class ShapeCache
+{
+  protected:
+	class Entry
+	{
+	  public:
+		std::string key;
+		std::shared_ptr<const ShapedRun> run;
+		size_t bytes;
+	};
+
+	class FontFace
+	{
+	  public:
+		hb_font_t *font = nullptr;
+		unsigned int units_per_em = 1000;
+	};
+
+	std::list<Entry> entries; //most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	std::unordered_map<std::string, FontFace> faces; //by file, face index, and variations
+	std::mutex mutex;
+
+	size_t max_bytes;
+	size_t bytes;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+
+	virtual FontFace *GetFace(const char *file, int face_index, const char *variations);
+	virtual void Trim();
+
+  public:
+	static ShapeCache *Shared();
+	static int FaceIndex(Laxkit::LaxFont *font);
+
+	ShapeCache(size_t nmax_bytes = 0);
+	virtual ~ShapeCache();
+
+	virtual std::shared_ptr<const ShapedRun> Shape(const char *file, int face_index, double size,
+									const char *variations, const char *features, const char *text, int len);
+	virtual std::shared_ptr<const ShapedRun> Shape(Laxkit::LaxFont *font, double size, const char *features, const char *text, int len);
+
+	virtual void SetMaxBytes(size_t nmax_bytes);
+	virtual void Clear();
+
+	size_t Bytes()           { std::lock_guard<std::mutex> lock(mutex); return bytes; }
+	size_t MaxBytes()        { std::lock_guard<std::mutex> lock(mutex); return max_bytes; }
+	unsigned long Hits()     { std::lock_guard<std::mutex> lock(mutex); return hits; }
+	unsigned long Misses()   { std::lock_guard<std::mutex> lock(mutex); return misses; }
+	unsigned long Evictions(){ std::lock_guard<std::mutex> lock(mutex); return evictions; }
+	virtual void ResetCounters();
+};
+
+
+} //namespace Laidout
+
+#endif
+
@@ -0,0 +1,739 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include "streamlayout.h"
+#include "lengthvalue.h"
+#include "shapecache.h"
+#include "../language.h"
+#include "../dataobjects/drawableobject.h"
+#include "../dataobjects/fontvalue.h"
+
+#include <lax/anxapp.h>
+#include <lax/units.h>
+
+#include <sys/times.h>
+#include <cctype>
+#include <cmath>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- StreamLayout ----------------------------------
+
+/*! \class StreamLayout
+ * \brief Break a Stream into lines within a chain of StreamAttachment areas, storing lines in StreamCache.
+ *
+ * Each line is one or more StreamCache objects, the first of which has line_start set.
+ * All caches of a line have y() set to the top of the line, and h() to the line height, in
+ * the coordinates of the inset path of StreamAttachment::owner. x() and w() are the horizontal
+ * extent of each piece. Lines fill each area from the top down, then continue in the next
+ * attachment.
+ *
+ * Layout() is incremental. Previous caches are checked against the chunks they came from, using
+ * StreamChunk::revision, and against the computed style of the chunk's element. Only attachments
+ * that may have changed are checked: those with chunks touched since the last layout (see
+ * StreamChunk::Touch()), a changed area, or changed styles, and one attachment on either side.
+ * Layout is redone starting at the paragraph of the first changed line, and stops as soon as a
+ * new line starts at the same place in the stream, in the same attachment and at the same height,
+ * as an old line past the last change. From there on, the old lines are kept as is, so attachments
+ * beyond that point are not touched at all.
+ *
+ * Lines are filled greedily, word by word. Word widths come from ShapeCache when the font has a
+ * file, so unchanged words are not shaped again. Areas are the bounding box of the inset path.
+ */
+
+
+StreamLayout::StreamLayout()
+{
+}
+
+StreamLayout::~StreamLayout()
+{
+}
+
+/*! Number of layout units in chunk: words for text, and the whole chunk for anything else.
+ */
+long StreamLayout::Units(StreamChunk *chunk)
+{
+	StreamText *text = dynamic_cast<StreamText*>(chunk);
+	if (text) {
+		if (!text->text) return 0;
+		if (text->num_breaks < 0) text->DetectBreaks();
+		return text->num_breaks;
+	}
+	return 1;
+}
+
+/*! Move chunk and offset past ends of chunks, so that chunk is null or offset is a unit in it.
+ */
+void StreamLayout::Normalize(StreamChunk *&chunk, long &offset)
+{
+	while (chunk && offset >= Units(chunk)) {
+		chunk = chunk->next;
+		offset = 0;
+	}
+}
+
+/*! Font metrics for text of element, from its computed style.
+ */
+StreamLayout::FontInfo *StreamLayout::GetFont(StreamElement *element)
+{
+	auto found = fonts.find(element);
+	if (found != fonts.end()) return &found->second;
+
+	FontInfo &info = fonts[element];
+	Style *style = (element ? element->ComputedStyle() : nullptr);
+	info.style = style;
+	if (style) {
+		FontValue *fontv = dynamic_cast<FontValue*>(style->find("font"));
+		if (fontv) info.font = fontv->font;
+
+		LengthValue *size = dynamic_cast<LengthValue*>(style->find("font-size"));
+		if (!size) size = dynamic_cast<LengthValue*>(style->find("fontsize"));
+		if (size && size->value > 0) {
+			if (size->type == CSS_Physical)
+				info.size = LengthValue::unit_manager.Convert(size->value, size->units, UNITS_Points, UNITS_Length);
+			else if (size->type == CSS_Percent) info.size *= size->value / 100;
+			else if (size->type == CSS_em) info.size *= size->value;
+		}
+	}
+	if (!info.font && anXApp::app) info.font = anXApp::app->defaultlaxfont;
+
+	double msize = (info.font ? info.font->Msize() : 0);
+	info.scale = (msize > 0 ? info.size / msize * units_per_point : 0);
+	info.file = (info.font ? info.font->FontFile() : nullptr);
+	info.face_index = ShapeCache::FaceIndex(info.font);
+
+	std::shared_ptr<const ShapedRun> run;
+	if (info.file) run = ShapeCache::Shared()->Shape(info.file, info.face_index, info.size, nullptr, nullptr, " ", 1);
+	if (run) info.space = run->Advance() * units_per_point;
+	else info.space = (info.scale > 0 ? info.font->Extent(" ", 1) * info.scale : info.size * units_per_point / 4);
+	return &info;
+}
+
+/*! Byte start and end of each word in text, the same words that StreamText::DetectBreaks() counts.
+ */
+std::vector<int> *StreamLayout::WordStarts(StreamText *text)
+{
+	auto found = words.find(text);
+	if (found != words.end()) return &found->second;
+
+	std::vector<int> &starts = words[text];
+	const char *s = text->text;
+	if (!s) return &starts;
+	while (*s) {
+		while (*s && isspace(*s)) s++;
+		if (!*s) break;
+		starts.push_back(s - text->text);
+		while (*s && !isspace(*s)) s++;
+		starts.push_back(s - text->text);
+	}
+	return &starts;
+}
+
+double StreamLayout::WordWidth(StreamText *text, long word, FontInfo *info)
+{
+	std::vector<int> *starts = WordStarts(text);
+	if (2*word+1 >= (long)starts->size()) return 0;
+	int start = (*starts)[2*word];
+	int end   = (*starts)[2*word+1];
+
+	if (info->file) {
+		std::shared_ptr<const ShapedRun> run = ShapeCache::Shared()->Shape(info->file, info->face_index, info->size, nullptr, nullptr, text->text + start, end - start);
+		if (run) return run->Advance() * units_per_point;
+	}
+	if (info->scale > 0) return info->font->Extent(text->text + start, end - start) * info->scale;
+	return (end - start) * info->size * units_per_point / 2;
+}
+
+/*! Rectangle to lay lines into. This is the bounds of the owner's inset path, or the owner's
+ * own bounds if there is no inset path.
+ *
+ * \todo remove wrap paths of other objects on the page, once PathBooleanSubtract() works
+ */
+void StreamLayout::GetArea(StreamAttachment *attachment, Area &area)
+{
+	DrawableObject *owner = attachment->owner;
+	area = Area();
+	if (!owner) return;
+
+	DoubleBBox *box = owner;
+	PathsData *path = owner->GetInsetPath();
+	if (path) {
+		path->FindBBox();
+		box = path;
+	}
+	if (!box->validbounds()) return;
+	area.minx = box->minx;
+	area.maxx = box->maxx;
+	area.miny = box->miny;
+	area.maxy = box->maxy;
+}
+
+/*! Whether cache is out of date for the live chunk it came from, because the chunk's content
+ * or the computed style of its element changed since layout.
+ */
+bool StreamLayout::Stale(StreamCache *cache, StreamChunk *chunk)
+{
+	if (cache->chunk_revision != chunk->revision) return true;
+	return GetFont(chunk->parent)->style != cache->style;
+}
+
+/*! Check one old cache against the live stream at chunk and offset, and advance past it.
+ * Returns true if the cache still matches the stream.
+ *
+ * Old caches may refer to deleted chunks, so cache->chunk is only dereferenced after it is
+ * found in the live chunk list. skipping is a chunk whose remaining caches are out of date.
+ */
+bool StreamLayout::CheckCache(StreamCache *cache, StreamChunk *&chunk, long &offset, StreamChunk *&skipping)
+{
+	if (skipping) {
+		if (cache->chunk == skipping) return false;
+		chunk = skipping->next;
+		offset = 0;
+		skipping = nullptr;
+	}
+
+	Normalize(chunk, offset);
+	if (cache->chunk == chunk) {
+		if (Stale(cache, chunk)) {
+			skipping = chunk;
+			return false;
+		}
+		bool ok = (cache->offset == offset);
+		offset = cache->offset + cache->len;
+		return ok;
+	}
+
+	 //either new chunks were added before cache->chunk, or cache->chunk is gone
+	StreamChunk *found = chunk;
+	while (found && found != cache->chunk) found = found->next;
+	if (!found) return false;
+
+	chunk = found;
+	if (Stale(cache, chunk)) skipping = chunk;
+	else offset = cache->offset + cache->len;
+	return false;
+}
+
+/*! True if any style that the lines of attachment were laid out with has been modified since.
+ */
+bool StreamLayout::StylesChanged(StreamAttachment *attachment)
+{
+	for (auto &style : attachment->styles) {
+		if (style.first->ModCount() != style.second) return true;
+	}
+	return false;
+}
+
+/*! Remember the styles of the elements of all the lines in attachment, along with parent
+ * styles, and styles of enclosing elements, so StylesChanged() can tell if any were modified.
+ * Code that gives an element a different style, rather than modifying its style, must Touch()
+ * the element's chunks.
+ */
+void StreamLayout::RecordStyles(StreamAttachment *attachment)
+{
+	for (auto &style : attachment->styles) style.first->dec_count();
+	attachment->styles.clear();
+
+	StreamElement *last = nullptr;
+	for (StreamCache *cache = attachment->cache; cache; cache = cache->next) {
+		if (cache->element == last) continue;
+		last = cache->element;
+
+		for (StreamElement *el = cache->element; el; el = el->treeparent) {
+			for (Style *style = el->style; style; style = style->parent) {
+				bool found = false;
+				for (auto &s : attachment->styles) if (s.first == style) { found = true; break; }
+				if (found) continue;
+
+				style->inc_count();
+				attachment->styles.push_back(std::pair<Style*, unsigned long>(style, style->ModCount()));
+			}
+		}
+	}
+}
+
+/*! Add the old lines of attachments[collect_end] to lines, marking which are out of date,
+ * and advance collect_end. This continues from collect_chunk and collect_offset, the live
+ * stream position just after the old lines collected so far.
+ */
+void StreamLayout::CollectLines(StreamAttachment **attachments)
+{
+	int a = collect_end++;
+	StreamAttachment *attachment = attachments[a];
+	if (!attachment->cache) {
+		collect_gap = true;
+		return;
+	}
+
+	 //an area that changed since its layout invalidates all its lines
+	DrawableObject *owner = attachment->owner;
+	bool area_changed = (owner && owner->modtime != 0 && owner->modtime >= attachment->cache->modtime);
+
+	for (StreamCache *cache = attachment->cache; cache; cache = cache->next) {
+		if (cache->line_start || cache == attachment->cache) {
+			if (collect_skipping && cache->chunk != collect_skipping) {
+				collect_chunk = collect_skipping->next;
+				collect_offset = 0;
+				collect_skipping = nullptr;
+			}
+			Normalize(collect_chunk, collect_offset);
+
+			LineInfo line;
+			line.attachment = a;
+			line.first  = cache;
+			line.chunk  = collect_chunk;
+			line.offset = collect_offset;
+			line.top    = cache->y();
+			line.paragraph_start = cache->paragraph_start;
+			line.clean  = !area_changed && !collect_gap;
+			lines.push_back(line);
+			collect_gap = false;
+		}
+
+		if (!CheckCache(cache, collect_chunk, collect_offset, collect_skipping)) lines.back().clean = false;
+	}
+}
+
+/*! Collect the old lines of the attachments that may have changed into lines, marking which are
+ * out of date. Returns the index of the first dirty line, or -1 if nothing needs layout. If only
+ * new content past the end of the old lines needs layout, lines.size() is returned.
+ *
+ * Attachments before the first one that may have changed are not looked at. Attachments past the
+ * last one that may have changed are collected later, as Layout() reaches them.
+ */
+int StreamLayout::FindOldLines(StreamAttachment **attachments, int n, StreamChunk *start, long start_offset, int *last_dirty_ret)
+{
+	lines.clear();
+	old_starts.clear();
+	if (last_dirty_ret) *last_dirty_ret = -1;
+
+	 //attachments with touched chunks
+	StreamElement *root = start->parent;
+	while (root && root->treeparent) root = root->treeparent;
+	int from = n, to = -1;
+	if (!root) {
+		from = 0;
+		to = n-1;
+	} else if (root->touched_first >= 0) {
+		from = (root->touched_first < n ? root->touched_first : n-1);
+		to   = (root->touched_last  < n ? root->touched_last  : n-1);
+	}
+
+	 //attachments with changed areas or styles, or that the stream newly flows into
+	for (int a = 0; a < n; a++) {
+		StreamAttachment *attachment = attachments[a];
+		DrawableObject *owner = attachment->owner;
+		bool changed;
+		if (!attachment->cache) changed = (a == 0 || attachments[a-1]->ending_chunk != nullptr);
+		else changed = (owner && owner->modtime != 0 && owner->modtime >= attachment->cache->modtime)
+						|| StylesChanged(attachment);
+		if (!changed) continue;
+		if (a < from) from = a;
+		if (a > to) to = a;
+	}
+	if (to < 0) return -1;
+
+	 //one more on either side, for lines that an edit pulls back, and for finding where layout converges
+	collect_end = (from > 0 ? from-1 : 0);
+	if (collect_end == 0) {
+		collect_chunk  = start;
+		collect_offset = start_offset;
+	} else {
+		collect_chunk  = attachments[collect_end]->starting_chunk;
+		collect_offset = attachments[collect_end]->starting_offset;
+	}
+	collect_skipping = nullptr;
+	collect_gap = false;
+	int last = (to+1 < n ? to+1 : n-1);
+	while (collect_end <= last) CollectLines(attachments);
+
+	int first_dirty = -1, last_dirty = -1;
+	for (int c = 0; c < (int)lines.size(); c++) {
+		if (lines[c].clean) continue;
+		if (first_dirty < 0) first_dirty = c;
+		last_dirty = c;
+	}
+
+	 //stream content left over, but there was room for it
+	if (collect_end == n) {
+		StreamChunk *chunk = collect_chunk;
+		long offset = collect_offset;
+		if (collect_skipping) {
+			chunk = collect_skipping->next;
+			offset = 0;
+		}
+		Normalize(chunk, offset);
+
+		int last_with_lines = n-1;
+		while (last_with_lines >= 0 && !attachments[last_with_lines]->cache) last_with_lines--;
+		if (chunk && (last_with_lines < n-1 || attachments[n-1]->ending_chunk == nullptr)) {
+			if (first_dirty < 0) first_dirty = lines.size();
+			last_dirty = lines.size();
+		}
+	}
+
+	for (int c = last_dirty + 1; c < (int)lines.size(); c++) {
+		old_starts[std::pair<StreamChunk*,long>(lines[c].chunk, lines[c].offset)] = c;
+	}
+
+	if (last_dirty_ret) *last_dirty_ret = last_dirty;
+	return first_dirty;
+}
+
+/*! Fill one line starting at chunk and offset, at most width wide, advancing chunk and offset past
+ * the line. Returns the chain of new caches for the line, with y() and h() set for all.
+ * break_ret gets the StreamBreakTypes of an explicit break ending the line, or -1.
+ *
+ * At least one unit is always put in the line, even if it is wider than width.
+ */
+StreamCache *StreamLayout::LayLine(StreamChunk *&chunk, long &offset, double x, double width, double top,
+								   bool paragraph_start, double *height_ret, int *break_ret)
+{
+	StreamCache *head = nullptr, *tail = nullptr;
+	double cx = 0;
+	double height = 0;
+	bool empty = true;
+	bool full = false;
+	*break_ret = -1;
+
+	auto append = [&](StreamCache *piece) {
+		piece->chunk_revision = piece->chunk->revision;
+		piece->style = GetFont(piece->chunk->parent)->style;
+		if (piece->style) piece->style->inc_count();
+		if (tail) { tail->next = piece; piece->prev = tail; }
+		else head = piece;
+		tail = piece;
+	};
+
+	while (!full) {
+		Normalize(chunk, offset);
+		if (!chunk) break;
+
+		if (chunk->Type() == CHUNK_Break) {
+			StreamBreak *brk = dynamic_cast<StreamBreak*>(chunk);
+			FontInfo *info = GetFont(chunk->parent);
+			if (info->size * units_per_point * line_spacing > height) height = info->size * units_per_point * line_spacing;
+
+			StreamCache *piece = new StreamCache(chunk, offset, 1);
+			piece->x(x + cx);
+			append(piece);
+			offset++;
+
+			if (brk->break_type == (int)StreamBreakTypes::BREAK_Tab) {
+				cx += 4 * info->space;
+				continue;
+			}
+			if (brk->break_type == (int)StreamBreakTypes::BREAK_Weak || brk->break_type == (int)StreamBreakTypes::BREAK_Hyphen) continue;
+
+			*break_ret = brk->break_type;
+			break;
+
+		} else if (chunk->Type() == CHUNK_Image) {
+			StreamImage *image = dynamic_cast<StreamImage*>(chunk);
+			double iw = 0, ih = 0;
+			if (image->img && image->img->validbounds()) {
+				iw = image->img->boxwidth();
+				ih = image->img->boxheight();
+			}
+			if (!empty && cx + iw > width) break;
+
+			StreamCache *piece = new StreamCache(chunk, offset, 1);
+			piece->image = image->img;
+			piece->x(x + cx);
+			piece->w(iw);
+			append(piece);
+			cx += iw;
+			if (ih > height) height = ih;
+			offset++;
+			empty = false;
+
+		} else {
+			StreamText *text = dynamic_cast<StreamText*>(chunk);
+			FontInfo *info = GetFont(chunk->parent);
+			long units = Units(chunk);
+			StreamCache *piece = nullptr;
+
+			 //words in different chunks are only separate if there is actually space between them
+			bool spaced = (offset > 0 || isspace(text->text[0]));
+			if (!spaced && chunk->prev && chunk->prev->Type() == CHUNK_Text) {
+				StreamText *prev = dynamic_cast<StreamText*>(chunk->prev);
+				spaced = (prev->len > 0 && prev->text && isspace(prev->text[prev->len-1]));
+			}
+
+			while (offset < units) {
+				double ww = WordWidth(text, offset, info);
+				double gap = (empty || !spaced ? 0 : info->space);
+				if (!empty && cx + gap + ww > width) { full = true; break; }
+
+				if (!piece) {
+					piece = new StreamCache(chunk, offset, 0);
+					piece->font = info->font;
+					piece->x(x + cx + gap);
+					append(piece);
+				}
+				cx += gap + ww;
+				piece->len++;
+				piece->w(x + cx - piece->x());
+				offset++;
+				empty = false;
+				spaced = true;
+			}
+			if (info->size * units_per_point * line_spacing > height) height = info->size * units_per_point * line_spacing;
+		}
+	}
+
+	for (StreamCache *piece = head; piece; piece = piece->next) {
+		piece->y(top);
+		piece->h(height);
+	}
+	if (head) {
+		head->line_start = true;
+		head->paragraph_start = paragraph_start;
+	}
+
+	*height_ret = height;
+	return head;
+}
+
+/*! Replace old caches of attachment from old_first up to but not including old_stop with
+ * new_head..new_tail, following keep_tail, which is the last old cache to keep before them.
+ * Any of these may be null.
+ */
+void StreamLayout::Splice(StreamAttachment *attachment, StreamCache *keep_tail, StreamCache *old_first, StreamCache *old_stop,
+						  StreamCache *new_head, StreamCache *new_tail)
+{
+	if (old_first && old_first != old_stop) {
+		StreamCache *last = (old_stop ? old_stop->prev : nullptr);
+		if (!last) {
+			last = old_first;
+			while (last->next) last = last->next;
+		}
+		last->next = nullptr;
+		old_first->prev = nullptr;
+		old_first->dec_count();
+	}
+
+	StreamCache *before = keep_tail;
+	if (new_head) {
+		if (before) before->next = new_head;
+		else attachment->cache = new_head;
+		new_head->prev = before;
+		before = new_tail;
+	}
+	if (before) before->next = old_stop;
+	else attachment->cache = old_stop;
+	if (old_stop) old_stop->prev = before;
+
+	if (attachment->cache) {
+		tms tms_;
+		attachment->cache->prev = nullptr;
+		attachment->cache->modtime = times(&tms_);
+	}
+	RecordStyles(attachment);
+}
+
+/*! Update the layout of the stream flowing through attachments, in order. The stream starts at
+ * attachments[0]->starting_chunk, or the start of its stream if that is null.
+ *
+ * Only the part of the layout that changed since the last call is recomputed. lines_laid_out
+ * is set to how many lines actually had to be computed.
+ *
+ * Returns 0 for success, or 1 for nothing to lay out.
+ */
+int StreamLayout::Layout(StreamAttachment **attachments, int n, Laxkit::ErrorLog *log)
+{
+	lines_laid_out = 0;
+	if (!attachments || n <= 0) return 1;
+
+	StreamChunk *start = attachments[0]->starting_chunk;
+	long start_offset = attachments[0]->starting_offset;
+	if (!start && attachments[0]->stream) {
+		start = attachments[0]->stream->chunk_start;
+		start_offset = 0;
+	}
+	if (!start) {
+		if (log) log->AddWarning(_("Nothing to lay out"));
+		return 1;
+	}
+
+	fonts.clear();
+	words.clear();
+
+	int last_dirty = -1;
+	int first_dirty = FindOldLines(attachments, n, start, start_offset, &last_dirty);
+
+	 //touched chunks are all taken care of after this
+	StreamElement *root = start->parent;
+	while (root && root->treeparent) root = root->treeparent;
+	if (root) root->touched_first = root->touched_last = -1;
+
+	if (first_dirty < 0) return 0; //already up to date
+
+	 //back up to the start of the paragraph containing the first change
+	int a = 0;
+	StreamChunk *chunk = start;
+	long offset = start_offset;
+	bool paragraph_start = true;
+	StreamCache *keep_tail = nullptr; //last old cache to keep in current attachment
+	StreamCache *old_first = attachments[0]->cache; //first old cache that may be replaced in current attachment
+	double top = 0;
+	bool use_old_top = false;
+
+	if (lines.size()) {
+		int r = (first_dirty < (int)lines.size() ? first_dirty : lines.size() - 1);
+		while (r > 0 && !lines[r].paragraph_start) r--;
+
+		LineInfo &line = lines[r];
+		a = line.attachment;
+		chunk  = line.chunk;
+		offset = line.offset;
+		paragraph_start = line.paragraph_start;
+		old_first = line.first;
+		keep_tail = (line.first == attachments[a]->cache ? nullptr : line.first->prev);
+		top = line.top;
+		use_old_top = (keep_tail != nullptr);
+	}
+
+	Area area;
+	GetArea(attachments[a], area);
+	if (!use_old_top) top = area.maxy;
+	if (!keep_tail) {
+		attachments[a]->starting_chunk = chunk;
+		attachments[a]->starting_offset = offset;
+	}
+
+	StreamCache *new_head = nullptr, *new_tail = nullptr;
+	bool first_in_area = (keep_tail == nullptr);
+
+	 //stream ends in attachment a, remaining attachments get nothing
+	auto clear_after = [&](int a) {
+		attachments[a]->ending_chunk = nullptr;
+		for (int c = a+1; c < n; c++) {
+			Splice(attachments[c], nullptr, attachments[c]->cache, nullptr, nullptr, nullptr);
+			attachments[c]->starting_chunk = nullptr;
+			attachments[c]->starting_offset = 0;
+			attachments[c]->ending_chunk = nullptr;
+		}
+	};
+
+	while (true) {
+		Normalize(chunk, offset);
+
+		if (!chunk) {
+			Splice(attachments[a], keep_tail, old_first, nullptr, new_head, new_tail);
+			clear_after(a);
+			break;
+		}
+
+		 //if we are back in step with an unchanged old line, keep the rest of the old layout
+		auto found = old_starts.find(std::pair<StreamChunk*,long>(chunk, offset));
+		if (found != old_starts.end()) {
+			LineInfo &old = lines[found->second];
+			if (old.attachment == a && fabs(old.top - top) < 1e-6 && old.paragraph_start == paragraph_start) {
+				Splice(attachments[a], keep_tail, old_first, old.first, new_head, new_tail);
+				DBG cerr << "StreamLayout converged after "<<lines_laid_out<<" lines"<<endl;
+				break;
+			}
+		}
+
+		StreamChunk *line_chunk = chunk;
+		long line_offset = offset;
+		double height = 0;
+		int break_type = -1;
+		StreamCache *line = LayLine(chunk, offset, area.minx, area.maxx - area.minx, top, paragraph_start, &height, &break_type);
+
+		bool next_area = false;
+		if (top - height < area.miny && !first_in_area) {
+			 //line does not fit, put it in the next area instead
+			line->dec_count();
+			line = nullptr;
+			chunk = line_chunk;
+			offset = line_offset;
+			next_area = true;
+
+		} else {
+			StreamCache *line_tail = line;
+			while (line_tail->next) line_tail = line_tail->next;
+			for (StreamCache *piece = line; piece; piece = piece->next) {
+				if (piece->offset == 0) piece->chunk->attachment_index = a;
+			}
+			if (new_tail) { new_tail->next = line; line->prev = new_tail; }
+			else new_head = line;
+			new_tail = line_tail;
+
+			lines_laid_out++;
+			top -= height;
+			first_in_area = false;
+			paragraph_start = (break_type >= 0);
+			if (break_type == (int)StreamBreakTypes::BREAK_Column
+					|| break_type == (int)StreamBreakTypes::BREAK_Section
+					|| break_type == (int)StreamBreakTypes::BREAK_Page)
+				next_area = true;
+		}
+
+		if (next_area) {
+			Splice(attachments[a], keep_tail, old_first, nullptr, new_head, new_tail);
+			Normalize(chunk, offset);
+			if (!chunk) {
+				clear_after(a);
+				break;
+			}
+			attachments[a]->ending_chunk = chunk;
+
+			a++;
+			if (a >= n) break; //overflow, the rest of the stream does not fit
+
+			 //old lines of attachments not collected yet, to find where layout converges
+			if (collect_end <= a) {
+				int first_new = lines.size();
+				while (collect_end <= a+1 && collect_end < n) CollectLines(attachments);
+				for (int c = first_new; c < (int)lines.size(); c++) {
+					if (!lines[c].clean) break;
+					old_starts[std::pair<StreamChunk*,long>(lines[c].chunk, lines[c].offset)] = c;
+				}
+			}
+
+			attachments[a]->starting_chunk = chunk;
+			attachments[a]->starting_offset = offset;
+			GetArea(attachments[a], area);
+			top = area.maxy;
+			keep_tail = nullptr;
+			old_first = attachments[a]->cache;
+			new_head = new_tail = nullptr;
+			first_in_area = true;
+		}
+	}
+
+	DBG cerr << "StreamLayout laid out "<<lines_laid_out<<" lines, old layout had "<<lines.size()<<endl;
+
+	lines.clear();
+	old_starts.clear();
+	return 0;
+}
+
+
+} // namespace Laidout
+
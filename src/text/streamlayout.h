@@ -0,0 +1,109 @@
+//
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef STREAMLAYOUT_H
+#define STREAMLAYOUT_H
+
+
+#include <lax/errorlog.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "streams.h"
+
+
+namespace Laidout {
+
+
+//------------------------------------- StreamLayout ----------------------------------
+
+class StreamLayout
+{
+  protected:
+	class FontInfo
+	{
+	  public:
+		Laxkit::LaxFont *font = nullptr;
+		const char *file = nullptr; //font file, for shaping with ShapeCache
+		int face_index = 0; //which face of file
+		double size = 12; //in points
+		double scale = 1; //multiply font extents by this to get target units
+		double space = 0; //width of a space in target units
+		Style *style = nullptr; //computed style of the element, not counted
+	};
+
+	class LineInfo
+	{
+	  public:
+		int attachment = 0;     //index into attachments
+		StreamCache *first = nullptr;
+		StreamChunk *chunk = nullptr; //live position at start of line, only valid when clean or before first dirty line
+		long offset = 0;
+		double top = 0;
+		bool paragraph_start = false;
+		bool clean = true;
+	};
+
+	class Area
+	{
+	  public:
+		double minx = 0, maxx = 0, miny = 0, maxy = 0;
+	};
+
+	std::vector<LineInfo> lines; //old layout, for the current Layout()
+	std::unordered_map<StreamElement*, FontInfo> fonts;
+	std::unordered_map<StreamChunk*, std::vector<int>> words; //pairs of byte start and end of each word
+	std::map<std::pair<StreamChunk*,long>, int> old_starts; //clean old lines past the last dirty line, by start position
+
+	 //old lines are collected one attachment at a time, see CollectLines()
+	int collect_end = 0; //attachments before this have been collected
+	StreamChunk *collect_chunk = nullptr; //live stream position after the collected lines
+	long collect_offset = 0;
+	StreamChunk *collect_skipping = nullptr;
+	bool collect_gap = false;
+
+	virtual long Units(StreamChunk *chunk);
+	virtual void Normalize(StreamChunk *&chunk, long &offset);
+	virtual FontInfo *GetFont(StreamElement *element);
+	virtual std::vector<int> *WordStarts(StreamText *text);
+	virtual double WordWidth(StreamText *text, long word, FontInfo *info);
+	virtual void GetArea(StreamAttachment *attachment, Area &area);
+	virtual bool Stale(StreamCache *cache, StreamChunk *chunk);
+	virtual bool CheckCache(StreamCache *cache, StreamChunk *&chunk, long &offset, StreamChunk *&skipping);
+	virtual bool StylesChanged(StreamAttachment *attachment);
+	virtual void RecordStyles(StreamAttachment *attachment);
+	virtual void CollectLines(StreamAttachment **attachments);
+	virtual int FindOldLines(StreamAttachment **attachments, int n, StreamChunk *start, long start_offset, int *last_dirty_ret);
+	virtual StreamCache *LayLine(StreamChunk *&chunk, long &offset, double x, double width, double top,
+								 bool paragraph_start, double *height_ret, int *break_ret);
+	virtual void Splice(StreamAttachment *attachment, StreamCache *keep_tail, StreamCache *old_first, StreamCache *old_stop,
+						StreamCache *new_head, StreamCache *new_tail);
+
+  public:
+	double units_per_point = 1./72; //target units per point of font size
+	double line_spacing = 1.2; //multiple of font size
+	int lines_laid_out = 0; //how many lines the last Layout() actually computed
+
+	StreamLayout();
+	virtual ~StreamLayout();
+	virtual int Layout(StreamAttachment **attachments, int n, Laxkit::ErrorLog *log);
+};
+
+
+} // namespace Laidout
+
+#endif
+
@@ -14,12 +14,14 @@
 //
 
 #include "streams.h"
+#include "streamlayout.h"
 #include "cssparse.h"
 #include "lengthvalue.h"
 #include "../language.h"
 #include "../dataobjects/drawableobject.h"
 #include "../dataobjects/fontvalue.h"
 #include "../laidout.h"
+#include "../core/utils.h"
 
 #include <lax/units.h>
 #include <lax/utf8utils.h>
@@ -259,6 +261,16 @@ StreamElement::~StreamElement()
 	if (style) style->dec_count();
 }
 
+/*! Return the shared computed style for this element, from style cascaded with the computed
+ * style of treeparent. See Style::Resolve() for how long the result is valid.
+ */
+Style *StreamElement::ComputedStyle()
+{
+	Style *inherited = (treeparent ? treeparent->ComputedStyle() : nullptr);
+	if (!style) return inherited;
+	return style->Resolve(inherited);
+}
+
 //TODO: this should probably be more flexible for the future, not hard coded for three cases.
 StreamChunk *NewStreamChunk(const char *type, StreamElement *parent)
 {
@@ -330,6 +342,8 @@ StreamChunk::StreamChunk(StreamElement *nparent)
 {
 	parent = nparent;
 	next = prev = nullptr;
+	attachment_index = -1;
+	Touch();
 }
 
 /* Default do nothing.
@@ -339,6 +353,31 @@ StreamChunk::~StreamChunk()
 	//if (next) delete next; no deleting, as chunks must ALWAYS be owned somewhere by a single StreamElement.
 }
 
+/*! Call whenever content changes, so that layouts referring to this chunk know to redo it.
+ * Revisions are unique across all chunks, so a new chunk at the address of a deleted one
+ * is not mistaken for it.
+ *
+ * The attachment this chunk was laid out in, or for new chunks the one prev was laid out in,
+ * is also added to the touched range of the root of the element tree, so StreamLayout can
+ * start from there instead of checking the whole stream. Code that removes chunks must
+ * Touch() a neighbor.
+ */
+void StreamChunk::Touch()
+{
+	static unsigned long revisions = 0;
+	revision = ++revisions;
+
+	StreamElement *root = parent;
+	while (root && root->treeparent) root = root->treeparent;
+	if (!root) return;
+
+	int index = attachment_index;
+	if (index < 0 && prev) index = prev->attachment_index;
+	if (index < 0) index = 0;
+	if (root->touched_first < 0 || index < root->touched_first) root->touched_first = index;
+	if (index > root->touched_last) root->touched_last = index;
+}
+
 /*! Insert a currently unstyled list of chunks after ourself.
  * 
  * Assumes chunk->prev == nullptr. Ok for chunk->next to not be nullptr.
@@ -381,6 +420,7 @@ StreamChunk *StreamChunk::AddAfter(StreamChunk *chunk)
 			}
 			if (el->treeparent == nullptr) el->treeparent = new_tree_parent;
 		}
+		ch->Touch(); //now that it is in the tree
 
 		ch = ch->next;
 	} while (ch != chunkend->next);
@@ -419,6 +459,7 @@ void StreamChunk::AddBefore(StreamChunk *chunk)
 			}
 			if (el->treeparent == nullptr) el->treeparent = new_tree_parent;
 		}
+		ch->Touch(); //now that it is in the tree
 
 		ch = ch->next;
 	} while (ch != chunkend->next);
@@ -452,6 +493,7 @@ void StreamBreak::dump_in_atts (Laxkit::Attribute *att,int flag,Laxkit::DumpCont
 	else if (!strcmp(att->value,"tab"    )) break_type = (int)StreamBreakTypes::BREAK_Tab;
 	else if (!strcmp(att->value,"weak"   )) break_type = (int)StreamBreakTypes::BREAK_Weak;
 	else if (!strcmp(att->value,"hyphen" )) break_type = (int)StreamBreakTypes::BREAK_Hyphen;
+	Touch();
 }
 
 
@@ -497,6 +539,7 @@ void StreamImage::dump_in_atts (Laxkit::Attribute *att,int flag,Laxkit::DumpCont
 
 	if (img) img->dec_count();
 	img = newimg;
+	Touch();
 }
 
 
@@ -553,6 +596,8 @@ int StreamText::SetText(const char *txt,int n)
 	delete[] text;
 	text = newnstr(txt, n);
 	len  = n;
+	num_breaks = -1;
+	Touch();
 	return 0;
 }
 
@@ -568,6 +613,8 @@ int StreamText::SetFromEntities(const char *cdata, int cdata_len)
 	delete[] text;
 	text = new_text;
 	len = new_n;
+	num_breaks = -1;
+	Touch();
 	return new_n;
 }
 
@@ -618,6 +665,8 @@ void StreamText::dump_in_atts(Laxkit::Attribute *att,int flag,Laxkit::DumpContex
 	makestr(text, txt->value);
 	if (text) len = strlen(text);
 	else len = 0;
+	num_breaks = -1;
+	Touch();
 }
 
 
@@ -1013,9 +1062,9 @@ int Stream::ImportXMLAtt(Attribute *att, StreamChunk *&last_chunk, StreamElement
 
 			} else {
 				if (log) {
-					setlocale(LC_ALL, "");
+					UseCLocale(false);
 					log->AddWarning(0,0,0, _("Unknown break %s"), value);
-					setlocale(LC_ALL, "C");
+					UseCLocale(true);
 				}
 			}
 			continue;
@@ -1243,6 +1292,7 @@ StreamAttachment::~StreamAttachment()
 	if (stream) stream->dec_count();
 	if (cache)  cache ->dec_count();
 	if (baseline_grid) baseline_grid->dec_count();
+	for (auto &style : styles) style.first->dec_count();
 }
 
 
@@ -1272,6 +1322,7 @@ StreamCache::StreamCache()
 
 StreamCache::~StreamCache()
 {
+	if (style) style->dec_count();
 	if (next) delete next;
 }
 
@@ -1295,75 +1346,19 @@ LaxInterfaces::PathsData *PathBooleanSubtract(LaxInterfaces::PathsData *area, La
  * affect wrapping.
  *
  * Overwrites anything in cache chain, adding more nodes if necessary, and deleting unused ones.
- * or create and return a new one if cache == nullptr.
+ * or create and return a new one if cache == nullptr. Only parts that changed since the last
+ * layout are redone, see StreamLayout.
+ *
+ * For streams threaded through several objects, use StreamLayout::Layout() with all the attachments.
  */
 StreamCache *RemapAreaStream(DrawableObject *target, StreamAttachment *attachment)
 {
 	if (!attachment) return nullptr;
-	
-	Stream      *stream = attachment->stream;
-	StreamCache *cache  = attachment->cache;
-	StreamChunk *start_chunk = attachment->starting_chunk;
-	// StreamChunk *end_chunk   = attachment->ending_chunk;
-
-	if (cache && cache->modtime > 0 && stream->modtime < cache->modtime && target->modtime < cache->modtime)
-		return cache; //probably set ok
-
-
-	//-------- compute possible breaks if necessary
-	StreamChunk *chunk = start_chunk;
-	if (!chunk) return nullptr;
-	while (chunk) {
-		chunk->DetectBreaks();
-		chunk = chunk->next;
-	}
-	chunk = start_chunk;
-
-
-	//----------compute layout area:
-	//  start with target inset path
-	//  We need to remove the wrap path of any lesser siblings and aunts/uncles from that path
-	LaxInterfaces::PathsData *area = dynamic_cast<LaxInterfaces::PathsData*>(target->GetInsetPath()->duplicateData(nullptr));
-
-	DrawableObject *so = target;
-	DrawableObject *o = target->GetDrawableParent();
-	while (o) {
-		for (int c = 0; c < o->n(); c++) {
-			if (o->e(c) == so) continue;
-			DrawableObject *dro = dynamic_cast<DrawableObject*>(o->e(c));
-			PathBooleanSubtract(area, dro->GetWrapPath(), true);
-			//area->CutOut(dro->GetWrapPath());
-		}
-		so = o;
-		o = o->GetDrawableParent();
-	}
-
-
-	//--------------compute actual breaks within area
-	
-	// determine baseline
-	flatvector baseline = attachment->baseline_dir;
-	flatvector baseline_offset;
-	if (attachment->baseline_grid) {
-		Affine trn = target->GetTransformToContext(true, 0);
-		baseline = trn.transformVector(attachment->baseline_grid->direction);
-		baseline_offset = trn.transformPoint(attachment->baseline_grid->offset);
-	}
-	
-	// intersect baseline with area path
-	// *** there may be many intersections, need to break down in-out segments
-	
-	// add chunk pieces along trimmed baseline until max reached
-	// ***
-	
-	// next line... repeat until out of bounds for area..
-	// ***
-	
-	// compute chunks/cache for next area in chain if any
-	// ***
-
+	if (!attachment->owner) attachment->owner = target;
 
-	return cache;
+	StreamLayout layout;
+	layout.Layout(&attachment, 1, nullptr);
+	return attachment->cache;
 }
 
 
@@ -21,6 +21,8 @@
 #include <lax/boxarrange.h>
 #include <lax/transformmath.h>
 
+#include <vector>
+
 #include "../calculator/values.h"
 // #include "../dataobjects/drawableobject.h"
 #include "../core/plaintext.h"
@@ -162,10 +164,15 @@ class StreamElement //: public Laxkit::DumpUtility
 
 	Laxkit::PtrStack<StreamChunk> chunks; // has chunks only when we are a leaf element
 
+	 //only used on the root of the tree: range of StreamChunk::attachment_index of chunks
+	 //touched since the last StreamLayout::Layout(), or -1 for none
+	int touched_first = -1, touched_last = -1;
+
 	StreamElement(); //init with an empty new Style
 	StreamElement(StreamElement *nparent, Style *nstyle);
 	virtual ~StreamElement();
     virtual const char *whattype() { return "StreamElement"; }
+    virtual Style *ComputedStyle();
 
     bool dump_in_att_stream(Laxkit::Attribute *att, Laxkit::DumpContext *context);
 };
@@ -195,6 +202,8 @@ class StreamChunk
  public:
 	StreamElement *parent;
 	StreamChunk *next, *prev; //these are maintained by StreamElement
+	unsigned long revision; //changes whenever content changes, see Touch()
+	int attachment_index; //which attachment of the stream's chain this chunk starts in, or -1 if not laid out
 
 	StreamChunk(StreamElement *nparent);
 	virtual ~StreamChunk();
@@ -207,6 +216,7 @@ class StreamChunk
 
 	virtual StreamChunk *AddAfter(StreamChunk *chunk);
 	virtual void AddBefore(StreamChunk *chunk);
+	virtual void Touch();
 
 	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context) = 0;
 	virtual void dump_in_atts (Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context) = 0;
@@ -400,9 +410,11 @@ class StreamAttachment : public Laxkit::RefCounted
 	BaselineGrid *baseline_grid = nullptr; //overrides baseline_dir if not null. in page space.
 
 	StreamChunk *starting_chunk = nullptr;
-	StreamChunk *ending_chunk = nullptr;
+	long starting_offset = 0; //breaks into starting_chunk
+	StreamChunk *ending_chunk = nullptr; //where the next attachment starts, or nullptr if stream ends in this one
     Stream *stream = nullptr;
     StreamCache *cache = nullptr; //owned by *this, assume any other refs are for temporary rendering purposes
+	std::vector<std::pair<Style*, unsigned long>> styles; //source styles of the lines in cache, and their ModCount() then
 
     StreamAttachment(DrawableObject *nobject, Stream *nstream);
     ~StreamAttachment();
@@ -433,6 +445,11 @@ class StreamCache : public Laxkit::SquishyBox, public Laxkit::RefCounted
 	StreamChunk *chunk = nullptr;     // has content
 	long offset = 0; //how many breaks into chunk to start
 	long len = 0; //how many breaks long in chunk is this cache
+	unsigned long chunk_revision = 0; //chunk->revision when laid out
+	Style *style = nullptr; //counted computed style of element when laid out
+
+	bool line_start = false; //first cache of a line. Line caches have y() == line top, h() == line height
+	bool paragraph_start = false; //line_start, and line begins a paragraph
 
 	Laxkit::Affine transform; // additional tweak before render
 
@@ -32,32 +32,95 @@ namespace Laidout {
 Style::Style()
 {
     parent = nullptr;
+    superseded = false;
 }
 
 Style::Style(const char *new_name) //todo: *** name of what? instance? style type?
 {
     parent = nullptr;
+    superseded = false;
     Id(new_name);
 }
 
 Style::~Style()
 {
+    FlushResolved();
 }
 
 /*! Create and return a new Style cascaded upward from this.
  * Values in *this override values in parents.
+ * The returned Style is a copy the caller owns. Use Resolve() for a shared one.
  */
 Style *Style::Collapse()
 {
     Style *s = new Style();
-    Style *f = this;
-    while (f) {
-        s->MergeFromMissing(f);
-        f = f->parent;
-    }
+    s->MergeFrom(Resolve());
     return s;
 }
 
+/*! Return the computed style of this, cascaded upward through parent, and then from inherited,
+ * which should itself be a computed style, such as from an enclosing StreamElement, or null.
+ * Values in *this override values in parents, which override values in inherited.
+ *
+ * Computed styles are cached per inherited style, so everything sharing a style and inherited
+ * style shares one computed style, and finding it again is one hash lookup per parent.
+ * Computed styles must not be modified. The returned style is owned by this, and is replaced
+ * on the next call after this or a parent is modified, so inc_count() it to hold onto it
+ * past such changes.
+ */
+Style *Style::Resolve(Style *inherited)
+{
+    Style *based = (parent ? parent->Resolve(inherited) : inherited);
+
+    auto found = resolved.find(inherited);
+    if (found != resolved.end()) {
+        ResolvedStyle &r = found->second;
+        if (r.modcount == ModCount() && r.based == based) return r.style;
+
+         //stale, this or a parent changed
+        r.style->superseded = true;
+        r.style->dec_count();
+        if (r.based) r.based->dec_count();
+        if (inherited) inherited->dec_count();
+        resolved.erase(found);
+    }
+
+     //forget computations based on inherited styles that have since been replaced
+    for (auto it = resolved.begin(); it != resolved.end(); ) {
+        if (it->first && it->first->superseded) {
+            it->second.style->superseded = true;
+            it->second.style->dec_count();
+            if (it->second.based) it->second.based->dec_count();
+            it->first->dec_count();
+            it = resolved.erase(it);
+        } else ++it;
+    }
+
+    ResolvedStyle r;
+    r.style = new Style();
+    r.style->MergeFrom(this);
+    if (based) r.style->MergeFromMissing(based);
+    r.based = based;
+    if (based) based->inc_count();
+    if (inherited) inherited->inc_count();
+    r.modcount = ModCount();
+    resolved[inherited] = r;
+    return r.style;
+}
+
+/*! Drop all computed styles made with Resolve().
+ */
+void Style::FlushResolved()
+{
+    for (auto &it : resolved) {
+        it.second.style->superseded = true;
+        it.second.style->dec_count();
+        if (it.second.based) it.second.based->dec_count();
+        if (it.first) it.first->dec_count();
+    }
+    resolved.clear();
+}
+
 /*! Adds to *this any key+value in s that are not already included in this->values. It does not replace values.
  * Note ONLY checks against *this, NOT this->parent or this->kids.
  * Return number of items added.
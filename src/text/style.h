@@ -19,6 +19,8 @@
 #include <lax/resources.h>
 #include "../calculator/values.h"
 
+#include <unordered_map>
+
 
 namespace Laidout {
 
@@ -27,6 +29,17 @@ namespace Laidout {
 
 class Style : public ValueHash, public Laxkit::Resourceable
 {
+  protected:
+    class ResolvedStyle
+    {
+      public:
+        Style *style;   // the computed style
+        Style *based;   // what parent resolved to, or the inherited style when no parent
+        unsigned long modcount; // our ModCount() when style was computed
+    };
+    std::unordered_map<Style*, ResolvedStyle> resolved; // keyed by inherited computed style, may be null
+    bool superseded; // for computed styles, true when replaced by a newer computation
+
   public:
     Style *parent; // if non-null, this MUST be EITHER a project resource OR a temporary StreamElement owned Style
 
@@ -39,6 +52,8 @@ class Style : public ValueHash, public Laxkit::Resourceable
     virtual int MergeFromMissing(Style *s); //only from s not in *this
     virtual int MergeFrom(Style *s); //all in s override *this
     virtual Style *Collapse();
+    virtual Style *Resolve(Style *inherited = nullptr);
+    virtual void FlushResolved();
 
 	virtual void dump_in_atts (Laxkit::Attribute *att,int flag,Laxkit::DumpContext *context);
 	virtual Laxkit::Attribute *dump_out_atts(Laxkit::Attribute *att,int what,Laxkit::DumpContext *context);
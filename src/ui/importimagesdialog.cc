@@ -997,10 +997,13 @@ int ImportImagesDialog::send(int id)
 		return 0;
 	}
 
-	 //generate standard preview files to search for
+	 //generate standard preview files to search for.
+	 //Missing previews are made in the background while the images load.
 	LineInput *templi;
 	ImageInfo *info;
+	int *previewsizes = new int[n];
 	for (int c=0; c<n; c++) {
+		previewsizes[c] = 0;
 		if (!imagefiles[c]) continue;
 		if (file_exists(imagefiles[c],1,nullptr) != S_IFREG) {
 			delete[] imagefiles[c];
@@ -1019,12 +1022,9 @@ int ImportImagesDialog::send(int id)
 				templi=dynamic_cast<LineInput *>(findWindow("MinSize"));			
 				str_to_byte_size(templi->GetCText(), &si);
 				if (s>si) {
-					DBG cerr <<"-=-=-=--=-==-==-=-==-- Generate preview at: "<<previewfiles[c]<<endl;
 					si=dynamic_cast<LineInput *>(findWindow("PreviewWidth"))->GetLineEdit()->GetLong(nullptr);
 					if (si<10) si=128;
-					if (GeneratePreviewFile(imagefiles[c],previewfiles[c],"jpg",si,si,1)) {
-						DBG cerr <<"              ***generate preview failed....."<<endl;
-					}
+					previewsizes[c] = si;
 				}
 			} else {
 				delete[] previewfiles[c];
@@ -1054,9 +1054,10 @@ int ImportImagesDialog::send(int id)
 	if (perpage==0 || perpage<-2) perpage=-1;
 	settings->perpage=perpage;
 
-	dumpInImages(settings, doc, (const char **)imagefiles,(const char **)previewfiles,n);
+	dumpInImages(settings, doc, (const char **)imagefiles,(const char **)previewfiles,n, previewsizes);
 	deletestrs(imagefiles,n);
 	deletestrs(previewfiles,n);
+	delete[] previewsizes;
 
 	SimpleMessage *mes=new SimpleMessage(nullptr, n,0,0,0, win_sendthis);
 	app->SendMessage(mes,win_owner,win_sendthis,object_id);
@@ -0,0 +1,651 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+
+#include <lax/laxutils.h>
+
+#include <lax/transformmath.h>
+
+#include "layercache.h"
+#include "../core/drawdata.h"
+#include "../core/workerpool.h"
+
+#include <atomic>
+#include <cstring>
+#include <cmath>
+
+
+#include <iostream>
+#define DBG
+
+using namespace Laxkit;
+using namespace LaxInterfaces;
+using namespace std;
+
+
+namespace Laidout {
+
+
+//------------------------------------- LayerRasterCache ---------------------------------------
+
+/*! \class LayerRasterCache
+ * Keeps screen sized renderings of layers for LaidoutViewport::Refresh(), so that static
+ * content is not rasterized again on every redraw.
+ *
+ * DrawLayer() is told which range of a layer's kids is being edited. Those are drawn
+ * live, and the kids below and above them are each drawn from their own cached image.
+ * Layers with nothing being edited are cached whole.
+ *
+ * A cached image is used only when the view transform, window size, draw flags,
+ * and a Signature() of the contents all match. Touching an object also touches its
+ * parents, so the signature of a whole layer comes from the layer's modtime alone,
+ * and a range of kids from those kids' modtimes, only looked at when the layer's changes.
+ * Changes that do not touch, such as moving objects, applying colors, undo, or editing
+ * a clone's source, must be followed by Invalidate(), which LaidoutViewport does on
+ * object tree change events, selection changes, and new colors. Stale parts are only rendered into the cache after the view and contents
+ * have been the same for two consecutive frames, and at most renders_per_frame of them
+ * per frame, so zooming and dragging do not pay for images that would be thrown away.
+ * Until then, stale parts are drawn directly. NumStale() tells the viewport whether
+ * another refresh would make progress. If several frames go by with nothing rendered,
+ * something keeps changing, and NumStale() returns 0 until the next successful render.
+ *
+ * With background set, stale parts are instead rendered on WorkerPool::Shared() threads
+ * from a copy of their contents, first at 1/preview_reduction resolution, then in full.
+ * The copy is kept while the contents stay the same, so panning and zooming do not copy again.
+ * Meanwhile the viewport gets the low resolution pass, or the last image of the part moved
+ * to where the view is now, so the event loop never waits on rasterizing. When the view or
+ * contents change again, work in progress is abandoned between kids. Collect() must be
+ * called periodically to install finished images. As with PageThumbnailer, clones still read
+ * their live source objects while rendering.
+ *
+ * Blending is assumed to be plain over, which is the case for everything Laidout draws.
+ */
+
+
+//! What a cached image was rendered for.
+class RenderKey
+{
+  public:
+	double ctm[6];
+	int minx, miny; //screen offset of the image
+	int width, height;
+	unsigned int flags;
+	unsigned long signature;
+
+	RenderKey()
+	{
+		memset(ctm, 0, 6*sizeof(double));
+		minx = miny = width = height = 0;
+		flags = 0;
+		signature = 0;
+	}
+
+	bool operator==(const RenderKey &k) const
+	{
+		return width == k.width && height == k.height && minx == k.minx && miny == k.miny
+			&& flags == k.flags && signature == k.signature && !memcmp(ctm, k.ctm, 6*sizeof(double));
+	}
+	bool operator!=(const RenderKey &k) const { return !(*this == k); }
+};
+
+
+class LayerRasterCache::CachedPart
+{
+  public:
+	DrawableObject *layer; //not counted, only compared against
+	unsigned long layer_id;
+	int first, last; //range of kids, or first<0 for the whole layer
+	unsigned long last_used;
+
+	LaxImage *image;
+	RenderKey key;  //what image is of
+	LaxImage *preview;
+	RenderKey preview_key;
+	RenderKey seen; //what was wanted last time this part was drawn
+
+	RenderJob *job; //background render in progress, if any
+	LaxInterfaces::SomeData *content; //copy of what the part draws, kept for more background renders
+	unsigned long content_signature;
+
+	 //so Signature() only looks at kids when the layer has changed
+	clock_t signature_modtime;
+	unsigned long signature_generation;
+	unsigned long signature;
+
+	CachedPart(DrawableObject *nlayer, int nfirst, int nlast)
+	{
+		layer = nlayer;
+		layer_id = nlayer->object_id;
+		first = nfirst;
+		last = nlast;
+		last_used = 0;
+		image = nullptr;
+		preview = nullptr;
+		job = nullptr;
+		content = nullptr;
+		content_signature = 0;
+		signature_modtime = 0;
+		signature_generation = 0;
+		signature = 0;
+	}
+
+	~CachedPart()
+	{
+		if (image) image->dec_count();
+		if (preview) preview->dec_count();
+		if (content) content->dec_count();
+	}
+};
+
+
+/*! A background render of a CachedPart. Everything except preview, result, done and
+ * queued is only touched on the main thread. Those four are guarded by the cache mutex.
+ */
+class LayerRasterCache::RenderJob
+{
+  public:
+	CachedPart *part; //null once abandoned
+	std::atomic<bool> cancelled;
+	RenderKey key;
+	int reduction;
+	SomeData *content; //counted copy of the whole layer, or a group holding copies of the part's kids
+	bool whole;
+
+	LaxImage *preview;
+	LaxImage *result;
+	bool done;
+	bool queued; //is in finished
+
+	RenderJob()
+	{
+		part = nullptr;
+		cancelled = false;
+		reduction = 1;
+		content = nullptr;
+		whole = false;
+		preview = result = nullptr;
+		done = queued = false;
+	}
+
+	~RenderJob()
+	{
+		if (content) content->dec_count();
+		if (preview) preview->dec_count();
+		if (result) result->dec_count();
+	}
+};
+
+
+LayerRasterCache::LayerRasterCache()
+{
+	frame = 0;
+	generation = 1;
+	renders_left = 0;
+	num_stale = 0;
+	num_waiting = 0;
+	progress = false;
+	fruitless_frames = 0;
+	max_parts = 24;
+	renders_per_frame = 1;
+	background = false;
+	preview_reduction = 4;
+}
+
+/*! Waits for this cache's own background renders first, since they refer to this.
+ * Other jobs in WorkerPool::Shared() are not waited on.
+ */
+LayerRasterCache::~LayerRasterCache()
+{
+	Flush();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		job_done.wait(lock, [this] {
+			for (int c=0; c<jobs.n; c++) if (!jobs.e[c]->done) return false;
+			return true;
+		});
+	}
+	Collect();
+}
+
+//! Fold bytes into an FNV-1a hash.
+static unsigned long hash_bytes(unsigned long hash, const void *data, size_t n)
+{
+	const unsigned char *d = (const unsigned char *)data;
+	for (size_t c=0; c<n; c++) {
+		hash ^= d[c];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+/*! Return a hash of what part of layer is drawn from. This does not walk the layer's contents.
+ *
+ * For a whole layer, that is the layer's own state and modtime, which changes whenever anything
+ * in it is touched. For a range of kids, it is each kid's id and modtime, which are only looked
+ * at again when the layer's modtime has changed since last time. Both include generation, so
+ * Invalidate() makes every part stale.
+ */
+unsigned long LayerRasterCache::Signature(CachedPart *part, DrawableObject *layer)
+{
+	if (part->signature_modtime != layer->modtime || part->signature_generation != generation || !part->signature) {
+		unsigned long hash = hash_bytes(14695981039346656037UL, &generation, sizeof(generation));
+		hash = hash_bytes(hash, &layer->modtime, sizeof(layer->modtime));
+
+		if (part->first >= 0) {
+			for (int c=part->first; c<=part->last; c++) {
+				SomeData *kid = layer->e(c);
+				hash = hash_bytes(hash, &kid->object_id, sizeof(kid->object_id));
+				hash = hash_bytes(hash, &kid->modtime, sizeof(kid->modtime));
+			}
+		}
+
+		part->signature_modtime = layer->modtime;
+		part->signature_generation = generation;
+		part->signature = hash;
+	}
+
+	 //the layer's own state is cheap to check every time
+	unsigned long hash = hash_bytes(part->signature, layer->m(), 6*sizeof(double));
+	if (part->first < 0) {
+		int visible = layer->Visible();
+		hash = hash_bytes(hash, &visible, sizeof(visible));
+		hash = hash_bytes(hash, &layer->opacity, sizeof(layer->opacity));
+		hash = hash_bytes(hash, &layer->filter, sizeof(layer->filter));
+		hash = hash_bytes(hash, &layer->clip_path, sizeof(layer->clip_path));
+		int n = layer->n();
+		hash = hash_bytes(hash, &n, sizeof(n));
+	}
+	return hash;
+}
+
+/*! Call before drawing any layers for a refresh.
+ */
+void LayerRasterCache::BeginFrame()
+{
+	frame++;
+	renders_left = renders_per_frame;
+	num_stale = 0;
+	num_waiting = 0;
+	progress = false;
+}
+
+/*! Call after drawing all layers for a refresh. Drops parts that were not drawn this frame.
+ * Returns NumStale() + NumPending(), which is nonzero while the viewport should keep
+ * calling Collect() and refreshing.
+ */
+int LayerRasterCache::EndFrame()
+{
+	Evict();
+
+	if (progress || num_waiting) fruitless_frames = 0;
+	else if (num_stale) fruitless_frames++;
+	if (fruitless_frames > 3) num_stale = 0;
+
+	return num_stale + jobs.n;
+}
+
+void LayerRasterCache::Evict()
+{
+	for (int c=parts.n-1; c>=0; c--) {
+		if (parts.e[c]->last_used != frame) {
+			CancelJob(parts.e[c]);
+			parts.remove(c);
+		}
+	}
+}
+
+/*! Remove all cached images, and abandon background renders.
+ */
+void LayerRasterCache::Flush()
+{
+	for (int c=0; c<parts.n; c++) CancelJob(parts.e[c]);
+	parts.flush();
+	num_stale = 0;
+}
+
+/*! Abandon any background render for part. The job itself is deleted in Collect() once
+ * its worker is done with it.
+ */
+void LayerRasterCache::CancelJob(CachedPart *part)
+{
+	if (!part->job) return;
+	part->job->cancelled = true;
+	part->job->part = nullptr;
+	part->job = nullptr;
+}
+
+/*! Start a background render of part for the view in part->seen. Called on the main thread.
+ */
+void LayerRasterCache::StartJob(Displayer *dp, CachedPart *part, DrawableObject *layer)
+{
+	CancelJob(part);
+
+	RenderJob *job = new RenderJob;
+	job->part = part;
+	job->key = part->seen;
+	job->reduction = preview_reduction;
+	job->whole = (part->first < 0);
+
+	job->content = JobContent(part, layer);
+
+	part->job = job;
+	jobs.push(job);
+	WorkerPool::Shared()->Add([this, job]() { RunJob(job); });
+}
+
+/*! Return a counted copy of what part draws, so the worker never sees objects being edited.
+ * Called on the main thread.
+ *
+ * The copy only depends on the contents, not the view, so it is kept on the part and reused
+ * by later renders for other views, such as after panning or zooming, as long as the part's
+ * signature is the same. It is only shared with a new job once no job that was using it is
+ * still waiting to be collected, so two workers never draw the same objects at once.
+ */
+SomeData *LayerRasterCache::JobContent(CachedPart *part, DrawableObject *layer)
+{
+	if (part->content && part->content_signature == part->seen.signature) {
+		bool in_use = false;
+		for (int c=0; c<jobs.n; c++) {
+			if (jobs.e[c]->content == part->content) { in_use = true; break; }
+		}
+		if (!in_use) {
+			part->content->inc_count();
+			return part->content;
+		}
+	}
+
+	SomeData *content;
+	if (part->first < 0) content = layer->duplicateData(nullptr);
+	else {
+		Group *group = new Group;
+		group->m(layer->m());
+		for (int c=part->first; c<=part->last; c++) {
+			SomeData *kid = layer->e(c)->duplicateData(nullptr);
+			group->push(kid);
+			kid->dec_count();
+		}
+		content = group;
+	}
+
+	if (part->content) part->content->dec_count();
+	part->content = content;
+	part->content_signature = part->seen.signature;
+	content->inc_count();
+	return content;
+}
+
+/*! Called on a worker thread. Render job->content at reduced resolution, then in full,
+ * stopping early if the job is cancelled.
+ */
+void LayerRasterCache::RunJob(RenderJob *job)
+{
+	const RenderKey &key = job->key;
+
+	for (int pass = (job->reduction > 1 ? 0 : 1); pass < 2 && !job->cancelled; pass++) {
+		double scale = (pass == 0 ? 1./job->reduction : 1.);
+		int width  = ceil(key.width  * scale);
+		int height = ceil(key.height * scale);
+
+		Displayer *dp = newDisplayer(nullptr);
+		dp->CreateSurface(width, height);
+		dp->Minx = 0;  dp->Maxx = width;
+		dp->Miny = 0;  dp->Maxy = height;
+		dp->NewTransform(scale*key.ctm[0], scale*key.ctm[1], scale*key.ctm[2], scale*key.ctm[3],
+						 scale*(key.ctm[4] - key.minx), scale*(key.ctm[5] - key.miny));
+
+		if (job->whole) DrawData(dp, job->content, nullptr,nullptr, key.flags);
+		else {
+			DrawableObject *group = dynamic_cast<DrawableObject*>(job->content);
+			dp->PushAndNewTransform(group->m());
+			for (int c=0; c<group->n() && !job->cancelled; c++) {
+				DrawData(dp, group->e(c), nullptr,nullptr, key.flags);
+			}
+			dp->PopAxes();
+		}
+
+		LaxImage *image = dp->GetSurface();
+		dp->EndDrawing();
+		dp->dec_count();
+
+		if (job->cancelled) {
+			if (image) image->dec_count();
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pass == 0) job->preview = image;
+		else job->result = image;
+		if (!job->queued) { job->queued = true; finished.push_back(job); }
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job->done = true;
+		if (!job->queued) { job->queued = true; finished.push_back(job); }
+		 //notify while locked, since the destructor may return as soon as it sees done
+		job_done.notify_all();
+	}
+}
+
+/*! Install images from background renders into their parts, and clean up finished jobs.
+ * Must be called from the main thread. Returns the number of images installed, so
+ * the caller knows whether to redraw.
+ */
+int LayerRasterCache::Collect()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	int n = 0;
+	while (!finished.empty()) {
+		RenderJob *job = finished.front();
+		finished.pop_front();
+		job->queued = false;
+
+		CachedPart *part = job->part;
+		if (job->preview && part) {
+			if (part->preview) part->preview->dec_count();
+			part->preview = job->preview;
+			part->preview_key = job->key;
+			job->preview = nullptr;
+			n++;
+		}
+		if (job->result && part) {
+			if (part->image) part->image->dec_count();
+			part->image = job->result;
+			part->key = job->key;
+			job->result = nullptr;
+			n++;
+		}
+
+		if (job->done) {
+			if (part) part->job = nullptr;
+			jobs.remove(jobs.findindex(job)); //deletes job
+		}
+	}
+
+	return n;
+}
+
+/*! Return the part for the range, creating it if there is room. Returns null if there is no room.
+ */
+LayerRasterCache::CachedPart *LayerRasterCache::FindPart(DrawableObject *layer, int first, int last)
+{
+	for (int c=0; c<parts.n; c++) {
+		CachedPart *part = parts.e[c];
+		if (part->layer == layer && part->layer_id == layer->object_id && part->first == first && part->last == last)
+			return part;
+	}
+
+	if (parts.n >= max_parts) return nullptr;
+	CachedPart *part = new CachedPart(layer, first, last);
+	parts.push(part);
+	return part;
+}
+
+/*! Draw kids first through last of layer with layer's transform, or the whole layer if first<0.
+ * If editing, those kids are being edited, and may change without being touched, so they are
+ * not culled from the layer's spatial index by stale bounds, and nothing inside them is culled.
+ */
+void LayerRasterCache::DrawLive(Displayer *dp, DrawableObject *layer, int first, int last, unsigned int flags, bool editing)
+{
+	if (editing) flags &= ~DRAW_CULL;
+
+	if (first < 0) {
+		DrawData(dp, layer, nullptr,nullptr, flags);
+		return;
+	}
+
+	dp->PushAndNewTransform(layer->m());
+	if (flags & DRAW_CULL) {
+		DoubleBBox visible;
+		VisibleBounds(dp, visible);
+		NumStack<int> which;
+		layer->KidsInBox(visible, which);
+		for (int c=0; c<which.n; c++) {
+			if (which.e[c] >= first && which.e[c] <= last) DrawData(dp, layer->e(which.e[c]), nullptr,nullptr, flags);
+		}
+	} else {
+		for (int c=first; c<=last; c++) DrawData(dp, layer->e(c), nullptr,nullptr, flags);
+	}
+	dp->PopAxes();
+}
+
+/*! Draw something for a part that is not current: the low resolution pass if it is of the
+ * current view, else the last full image moved to where it belongs in the current view.
+ */
+void LayerRasterCache::DrawPreview(Displayer *dp, CachedPart *part)
+{
+	if (part->preview && part->preview_key == part->seen) {
+		dp->DrawScreen();
+		dp->imageout(part->preview, part->seen.minx, part->seen.miny, part->seen.width, part->seen.height);
+		dp->DrawReal();
+
+	} else if (part->image) {
+		double m[6];
+		transform_invert(m, part->key.ctm); //old screen space to real
+		dp->PushAndNewTransform(m);
+		dp->imageout(part->image, part->key.minx, part->key.miny, part->key.width, part->key.height);
+		dp->PopAxes();
+	}
+}
+
+/*! Draw a range of layer's kids (or whole layer if first<0) from the cache if possible.
+ */
+void LayerRasterCache::DrawPart(Displayer *dp, DrawableObject *layer, int first, int last, unsigned int flags)
+{
+	if (first >= 0 && last < first) return;
+
+	CachedPart *part = FindPart(layer, first, last);
+	if (!part) {
+		DrawLive(dp, layer, first, last, flags);
+		return;
+	}
+	part->last_used = frame;
+
+	RenderKey want;
+	memcpy(want.ctm, dp->Getctm(), 6*sizeof(double));
+	want.minx   = dp->Minx;
+	want.miny   = dp->Miny;
+	want.width  = dp->Maxx - dp->Minx;
+	want.height = dp->Maxy - dp->Miny;
+	want.flags  = flags;
+	if (want.width <= 0 || want.height <= 0) return;
+
+	want.signature = Signature(part, layer);
+
+	bool current = part->image && part->key == want;
+	bool settled = (part->seen == want);
+	part->seen = want;
+
+	if (!current && background) {
+		bool waiting = part->job && part->job->key == want;
+		if (!waiting && settled) {
+			StartJob(dp, part, layer);
+			waiting = true;
+			progress = true;
+		}
+		if (waiting) num_waiting++;
+		else {
+			CancelJob(part);
+			num_stale++;
+		}
+		DrawPreview(dp, part);
+		return;
+	}
+
+	if (!current && settled && renders_left > 0) {
+		renders_left--;
+		progress = true;
+
+		Displayer *cdp = newDisplayer(nullptr);
+		cdp->CreateSurface(want.width, want.height);
+		cdp->Minx = 0;  cdp->Maxx = want.width;
+		cdp->Miny = 0;  cdp->Maxy = want.height;
+		cdp->NewTransform(want.ctm[0],want.ctm[1],want.ctm[2],want.ctm[3], want.ctm[4] - want.minx, want.ctm[5] - want.miny);
+		DrawLive(cdp, layer, first, last, flags);
+
+		if (part->image) part->image->dec_count();
+		part->image = cdp->GetSurface();
+		cdp->EndDrawing();
+		cdp->dec_count();
+
+		part->key = want;
+		current = (part->image != nullptr);
+
+		DBG cerr << "LayerRasterCache rendered layer "<<layer->Id()<<" kids "<<first<<".."<<last<<endl;
+	}
+
+	if (!current) {
+		num_stale++;
+		DrawLive(dp, layer, first, last, flags);
+		return;
+	}
+
+	dp->DrawScreen();
+	dp->imageout(part->image, want.minx, want.miny);
+	dp->DrawReal();
+}
+
+/*! Draw layer, with kids edit_first through edit_last drawn live, and the rest
+ * from the cache when possible. Pass edit_first<0 when nothing in layer is being edited.
+ *
+ * Layers with their own clipping, opacity, or filter can only be cached whole, so they are
+ * drawn entirely live while anything in them is being edited.
+ */
+void LayerRasterCache::DrawLayer(Displayer *dp, DrawableObject *layer, int edit_first, int edit_last, unsigned int flags)
+{
+	if (!layer || !layer->Visible()) return;
+
+	bool plain = !layer->clip_path && layer->opacity == 1 && !layer->filter;
+	int n = layer->n();
+
+	if (!plain) {
+		if (edit_first >= 0) DrawLive(dp, layer, -1, -1, flags, true);
+		else DrawPart(dp, layer, -1, -1, flags);
+		return;
+	}
+
+	if (edit_first < 0 || edit_first >= n) {
+		DrawPart(dp, layer, 0, n-1, flags);
+		return;
+	}
+
+	if (edit_last >= n) edit_last = n-1;
+	DrawPart(dp, layer, 0, edit_first-1, flags);
+	DrawLive(dp, layer, edit_first, edit_last, flags, true);
+	DrawPart(dp, layer, edit_last+1, n-1, flags);
+}
+
+
+} //namespace Laidout
+
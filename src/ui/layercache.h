@@ -0,0 +1,88 @@
+//
+// Laidout, for laying out
+// Please consult http://www.laidout.org about where to send any
+// correspondence about this software.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 3 of the License, or (at your option) any later version.
+// For more details, consult the COPYING file in the top directory.
+//
+// Copyright (C) 2026 by Tom Lechner
+//
+#ifndef LAYERCACHE_H
+#define LAYERCACHE_H
+
+#include <lax/displayer.h>
+#include <lax/laximages.h>
+#include <lax/lists.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "../dataobjects/drawableobject.h"
+
+
+namespace Laidout {
+
+
+//------------------------------------- LayerRasterCache ---------------------------------------
+
+class LayerRasterCache
+{
+  protected:
+	class CachedPart;
+	class RenderJob;
+
+	Laxkit::PtrStack<CachedPart> parts;
+	unsigned long frame;
+	unsigned long generation; //bumped by Invalidate()
+	int renders_left; //how many parts can still be rendered into the cache this frame
+	int num_stale;
+	int num_waiting; //stale parts with a background render in progress
+	bool progress;
+	int fruitless_frames; //consecutive frames with stale parts that could not be rendered
+
+	Laxkit::PtrStack<RenderJob> jobs; //only touched on the main thread
+	std::deque<RenderJob*> finished;  //guarded by mutex
+	std::mutex mutex;
+	std::condition_variable job_done;
+
+	virtual CachedPart *FindPart(DrawableObject *layer, int first, int last);
+	virtual void DrawPart(Laxkit::Displayer *dp, DrawableObject *layer, int first, int last, unsigned int flags);
+	virtual void DrawLive(Laxkit::Displayer *dp, DrawableObject *layer, int first, int last, unsigned int flags, bool editing = false);
+	virtual void DrawPreview(Laxkit::Displayer *dp, CachedPart *part);
+	virtual void StartJob(Laxkit::Displayer *dp, CachedPart *part, DrawableObject *layer);
+	virtual void CancelJob(CachedPart *part);
+	virtual void RunJob(RenderJob *job);
+	virtual SomeData *JobContent(CachedPart *part, DrawableObject *layer);
+	virtual void Evict();
+	virtual unsigned long Signature(CachedPart *part, DrawableObject *layer);
+
+  public:
+
+	int max_parts;
+	int renders_per_frame;
+	bool background; //render stale parts on worker threads, drawing previews until done
+	int preview_reduction; //background renders first do a pass at 1/preview_reduction the resolution
+
+	LayerRasterCache();
+	virtual ~LayerRasterCache();
+
+	virtual void BeginFrame();
+	virtual int EndFrame();
+	virtual void DrawLayer(Laxkit::Displayer *dp, DrawableObject *layer, int edit_first, int edit_last, unsigned int flags);
+	virtual int NumStale() { return num_stale; }
+	virtual int NumPending() { return jobs.n; }
+	virtual int Collect();
+	virtual void Flush();
+	virtual void Invalidate() { generation++; }
+};
+
+
+} //namespace Laidout
+
+#endif
+
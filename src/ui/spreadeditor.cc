@@ -27,6 +27,7 @@
 #include "../laidout.h"
 #include "../core/drawdata.h"
 #include "../core/document.h"
+#include "../core/thumbnailer.h"
 #include "headwindow.h"
 #include "settingswindow.h"
 #include "viewwindow.h"
@@ -93,6 +94,7 @@ SpreadInterface::SpreadInterface(Laxkit::Displayer *ndp,Project *proj,Document *
 	maxmarkertype=8;
 	dragpage=-1;
 	drawthumbnails=1;
+	thumb_timer=0;
 
 	view=NULL;
 	GetSpreads();
@@ -106,11 +108,27 @@ SpreadInterface::~SpreadInterface()
 	 //for debugging:
 	DBG cerr<<"SpreadInterface destructor"<<endl;
 
+	if (thumb_timer) app->removetimer(this, thumb_timer);
 	if (view) view->dec_count();
 	if (doc) doc->dec_count();
 	if (sc) sc->dec_count();
 }
 
+/*! Pick up any thumbnails finished in the background, and redraw when there are some.
+ */
+int SpreadInterface::Idle(int tid, double delta)
+{
+	if (tid != thumb_timer) return 1;
+
+	PageThumbnailer *thumbnailer = PageThumbnailer::Shared();
+	if (thumbnailer->Collect() > 0) needtodraw=1;
+	if (thumbnailer->NumPending() == 0) {
+		thumb_timer=0;
+		return 1;
+	}
+	return 0;
+}
+
 const char *SpreadInterface::Name()
 { return _("Spread Tool"); }
 
@@ -376,18 +394,8 @@ int SpreadInterface::Refresh()
 		//((ViewportWindow *)curwindow)->syncrulers();
 	}
 
-	if (pagestorender.n) {
-		 //do one page render, to preserve some interactivity when having to render a ton of pages
-		if (drawthumbnails) {
-			pagestorender.e[0]->Thumbnail();
-			pagestorender.remove(0);
-			if (pagestorender.n) needtodraw=2;
-			else needtodraw=0;
-		}
-	} else needtodraw=0;
+	needtodraw=0;
 
-	DBG cerr <<"pagestorender.n: "<<pagestorender.n<<endl;
-	
 	if (!view) { return 1; }
 
 	int c,c2;
@@ -460,13 +468,11 @@ int SpreadInterface::Refresh()
 			} else if (drawthumbnails) {
 				if (pg>=0 && pg<doc->pages.n) {
 					if (pg>=0 && pg<doc->pages.n) {
+						 //thumbnails are rendered in the background, old ones are shown until new ones arrive
 						Page *page=doc->pages.e[pg];
-						if (page->thumbmodtime<page->modtime) {
-							 //need to regenerate page thumbnail, add to to-render stack
-							if (pagestorender.findindex(page)<0) pagestorender.push(page,0);
-							needtodraw|=2;
-							thumb=NULL;
-						} else thumb=doc->pages.e[pg]->Thumbnail();
+						if (PageThumbnailer::Shared()->Request(page, doc, pg) == 0 && !thumb_timer)
+							thumb_timer = app->addtimer(this, 100, 100, -1);
+						thumb = page->thumbnail;
 					}
 				}
 				if (thumb) {
@@ -82,7 +82,7 @@ class SpreadInterface : public LaxInterfaces::anInterface, virtual public Laxkit
 	Laxkit::PtrStack<LittleSpread> curspreads;
 	LittleSpread *curspread;
 
-	Laxkit::PtrStack<Page> pagestorender;
+	int thumb_timer;
 
 	Laxkit::ShortcutHandler *sc;
 	virtual int PerformAction(int action);
@@ -114,6 +114,7 @@ class SpreadInterface : public LaxInterfaces::anInterface, virtual public Laxkit
 	virtual int CharInput(unsigned int ch, const char *buffer,int len,unsigned int state,const Laxkit::LaxKeyboard *d);
 	virtual int KeyUp(unsigned int ch,unsigned int state,const Laxkit::LaxKeyboard *d);
 	virtual int Refresh();
+	virtual int Idle(int tid, double delta);
 //	//virtual int DrawData(Laxkit::anObject *ndata,int info=0);
 //	//virtual int UseThis(Laxkit::anObject *newdata,unsigned int); // assumes not use local
 //	//virtual void deletedata();
@@ -63,6 +63,8 @@
 #include "../ui/pluginwindow.h"
 #include "../dataobjects/objectfilter.h"
 
+#include <algorithm>
+
 
 #include <iostream>
 using namespace std;
@@ -517,6 +519,8 @@ LaidoutViewport::LaidoutViewport(Document *newdoc)
 	}
 
 	fakepointer = 0;  //***for lack of screen record for multipointer
+
+	layercache_timer = 0;
 }
 
 //! Delete spread, doc and page are assumed non-local.
@@ -527,6 +531,7 @@ LaidoutViewport::~LaidoutViewport()
 	DBG cerr <<"in LaidoutViewport destructor, obj "<<object_id<<endl;
 
 	delete[] pageviewlabel;
+	if (layercache_timer) app->removetimer(this, layercache_timer);
 
 	if (spread) delete spread;
 	if (papergroup) papergroup->dec_count();
@@ -791,12 +796,14 @@ int LaidoutViewport::Event(const Laxkit::EventData *data,const char *mes)
 		if (!te || (te->changer && te->changer==static_cast<anXWindow *>(this))) return 1;
 
 		if (te->changetype==TreeObjectRepositioned) {
+			InvalidateCaches(true);
 			needtodraw=1;
 
 		} else if (te->changetype==TreeObjectReorder ||
 				te->changetype==TreeObjectDiffPage ||
 				te->changetype==TreeObjectDeleted ||
 				te->changetype==TreeObjectAdded) {
+			InvalidateCaches(true);
 
 			 //for object only changes, just tell current interfaces to validate their refs.
 			 //Interfaces must intercept these messages in their Event() function.
@@ -815,6 +822,7 @@ int LaidoutViewport::Event(const Laxkit::EventData *data,const char *mes)
 			}
 			curobj.set(NULL, 1, 0); //setting to Limbo
 			clearCurobj();
+			layercache.Flush();
 			delete spread;
 			spread=NULL;
 			if (papergroup && !isDefaultPapergroup(1)) { papergroup->dec_count(); papergroup=NULL; }
@@ -822,6 +830,10 @@ int LaidoutViewport::Event(const Laxkit::EventData *data,const char *mes)
 			setupthings(spreadi,-1);
 			needtodraw=1;
 
+		} else if (te->changetype==TreeSelectionChange) {
+			 //tools may have changed what was selected without touching it
+			InvalidateCaches(false);
+
 		} else if (te->changetype==TreeDocGone) {
 			DBG cerr <<"  --LaidoutViewport::DataEvent -> TreeDocGone"<<endl;
 			if (doc) {
@@ -1402,6 +1414,12 @@ void LaidoutViewport::setupthings(int tospread, int topage)//tospread=-1
 		return;
 	}
 
+	 //read in pages kept in separate files, and let go of ones not used lately
+	NumStack<int> spreadpages;
+	doc->SpreadPages(spread, spreadpages);
+	doc->LoadPages(spreadpages, nullptr);
+	doc->EvictPages(laidout->prefs.max_loaded_pages);
+
 	 //find a good curpage
 	int curpagei=-1,    //index in doc->pages of the new curpage
 		spageindex=-1; //index in spread->pagestack that holds the new curpage
@@ -1518,6 +1536,7 @@ int LaidoutViewport::PlopDataAt(LaxInterfaces::SomeData *data, LaxInterfaces::Ob
 	if (clear_selection) SetSelection(nullptr);
 	if (add_to_selection) selection->AddNoDup(&noc, -1);
 
+	laidout->project->ObjectAdded(data);
 	laidout->notifyDocTreeChanged(this,TreeObjectAdded, curobjPage(), -1);
 	needtodraw=1;
 	
@@ -1544,6 +1563,7 @@ int LaidoutViewport::DeleteObject()
 	Group *o=dynamic_cast<Group*>(getanObject(curobj.context,0,curobj.context.n()-1));
 	if (!o && curobj.spread()==2) o=&papergroup->objs; // *** must find way to automate this!!
 	if (!o) return -1; //parent object not found!
+	laidout->project->ObjectRemoved(d);
 	o->remove(curobj.context.e(curobj.context.n()-1));
 	
 	 // clear d from interfaces and check in 
@@ -1596,6 +1616,7 @@ int LaidoutViewport::NewData(LaxInterfaces::SomeData *d,LaxInterfaces::ObjectCon
 
 	if (oc) *oc=&curobj;
 
+	laidout->project->ObjectAdded(d);
 	laidout->notifyDocTreeChanged(this,TreeObjectAdded, curobjPage(), -1);
 	needtodraw=1;
 	
@@ -1876,12 +1897,13 @@ int LaidoutViewport::FindObject(int x,int y,
 
 		if (pnt) {
 			pp = transform_point(m,p);
+			DoubleBBox pbox(pp.x,pp.x, pp.y,pp.y);
 			int found = -1;
 
 			for (int c = from; c < pnt->n(); c++) {
 				SomeData *obj = pnt->e(c);
 				if (!searchtype || (searchtype && strcmp(obj->whattype(), searchtype))) {
-					if (obj->pointin(pp)) {
+					if (pnt->KidMayIntersect(c, pbox) && obj->pointin(pp)) {
 						found = c;
 						break;
 					}
@@ -1891,7 +1913,7 @@ int LaidoutViewport::FindObject(int x,int y,
 				for (int c = 0; c < from; c++) {
 					SomeData *obj = pnt->e(c);
 					if (!searchtype || (searchtype && strcmp(obj->whattype(), searchtype))) {
-						if (obj->pointin(pp)) {
+						if (pnt->KidMayIntersect(c, pbox) && obj->pointin(pp)) {
 							found = c;
 							break;
 						}
@@ -1935,6 +1957,14 @@ int LaidoutViewport::FindObject(int x,int y,
 		DBG cerr <<"lov.FindObject pp: "<<pp.x<<','<<pp.y<<"  check on "
 		DBG		<<nextindex.obj->object_id<<" ("<<nextindex.obj->whattype()<<") "<<endl;
 
+		 //skip objects the parent's spatial index knows are nowhere near
+		DrawableObject *pnt = dynamic_cast<DrawableObject*>(nextindex.obj->GetParent());
+		if (pnt && nextindex.context.n()
+				&& !pnt->KidMayIntersect(nextindex.context.e(nextindex.context.n()-1), DoubleBBox(pp.x,pp.x, pp.y,pp.y))) {
+			nob = nextObject(&nextindex);
+			continue;
+		}
+
 		if (nextindex.obj->pointin(pp)) {
 			DBG cerr <<" -- found point in object"<<endl;
 			if (!foundobj.obj) foundobj=nextindex;
@@ -2004,7 +2034,26 @@ int LaidoutViewport::FindObjects(Laxkit::DoubleBBox *box, char real, char ascuro
 	int nob=1;
 	VObjContext *obj=NULL;
 	PtrStack<VObjContext> objects;
+	DrawableObject *lastparent = nullptr;
+	NumStack<int> candidates; //kids of lastparent that the parent's spatial index says may touch box
 	do {
+		 //skip objects the parent's spatial index knows are nowhere near
+		DrawableObject *pnt = dynamic_cast<DrawableObject*>(nextindex.obj->GetParent());
+		if (pnt && nextindex.context.n()) {
+			if (pnt != lastparent) {
+				transformToContext(mm,nextindex.context,1,nextindex.context.n()-1); //view to parent coords
+				DoubleBBox pbox;
+				pbox.addtobounds(mm, box);
+				pnt->KidsInBox(pbox, candidates);
+				lastparent = pnt;
+			}
+			int kid = nextindex.context.e(nextindex.context.n()-1);
+			if (!std::binary_search(candidates.e, candidates.e + candidates.n, kid)) {
+				nob=nextObject(&nextindex);
+				continue;
+			}
+		}
+
 		 //find transform from nextindex coords
 		transformToContext(mm,nextindex.context,0,-1);
 
@@ -2402,6 +2451,41 @@ void LaidoutViewport::setCurobj(VObjContext *voc)
 	}
 }
 
+/*! For when objects were changed somewhere without being touched. Cached layer images are
+ * rendered again. If kids_indexes, then the spatial indexes of everything on screen also look
+ * at their kids again, which is needed when objects may have moved. The document and pages on
+ * screen are marked with Document::Edited() and Page::Edited().
+ * See LayerRasterCache, SpatialIndex and DrawableObject::InvalidateKidsIndex().
+ */
+void LaidoutViewport::InvalidateCaches(bool kids_indexes)
+{
+	layercache.Invalidate();
+
+	 //these changes never touch anything, so let Autosaver know to look again
+	if (doc) {
+		doc->Edited();
+		if (spread) {
+			for (int c=0; c<spread->pagestack.n(); c++) {
+				if (spread->pagestack.e[c]->page) spread->pagestack.e[c]->page->Edited();
+			}
+		}
+	}
+	if (!kids_indexes) return;
+
+	if (limbo) limbo->InvalidateKidsIndex(true);
+	if (papergroup) papergroup->objs.InvalidateKidsIndex(true);
+	if (!spread) return;
+
+	for (int c=0; c<spread->pagestack.n(); c++) {
+		Page *page = spread->pagestack.e[c]->page;
+		if (!page) continue;
+		for (int c2=0; c2<page->layers.n(); c2++) {
+			DrawableObject *layer = dynamic_cast<DrawableObject*>(page->layers.e(c2));
+			if (layer) layer->InvalidateKidsIndex(true);
+		}
+	}
+}
+
 /*! Strip down curobj so that it points to only a context, not an object. Calls dec_count() on the old object if any.
  * Note that selection is not modified.
  */
@@ -2634,6 +2718,11 @@ LaxInterfaces::ObjectContext *LaidoutViewport::ObjectMoved(LaxInterfaces::Object
 
 	if (!oc || !oc->obj) return NULL;
 
+	 //moving doesn't touch the object, so make sure culling and cached layers see the new position
+	DrawableObject *pnt = dynamic_cast<DrawableObject*>(oc->obj->GetParent());
+	if (pnt) pnt->InvalidateKidsIndex(false);
+	InvalidateCaches(false);
+
 	if (oc->obj!=curobj.obj) {
 		if (!IsValidContext(oc)) return NULL;
 		setCurobj(dynamic_cast<VObjContext*>(oc));
@@ -3006,6 +3095,53 @@ void LaidoutViewport::TriggerFilterUpdates(int reason)
 }
 
 
+//! Find which kids of a layer are being worked on, so layercache can draw them live.
+/*! stacki is the index in spread->pagestack, and layeri the layer index of that page.
+ * Pass stacki<0 for limbo. Looks at curobj, the selection, and the contexts of all interfaces.
+ * Sets *first and *last to the range of kids at the top level of the layer containing any of those,
+ * or -1 if there are none.
+ */
+void LaidoutViewport::EditedKids(int stacki, int layeri, int *first, int *last)
+{
+	*first = *last = -1;
+
+	PtrStack<ObjectContext> contexts(LISTS_DELETE_None);
+	contexts.push(&curobj);
+	if (selection) for (int c=0; c<selection->n(); c++) contexts.push(selection->e(c));
+	for (int c=0; c<interfaces.n; c++) if (interfaces.e[c]->Context()) contexts.push(interfaces.e[c]->Context());
+
+	for (int c=0; c<contexts.n; c++) {
+		VObjContext *oc = dynamic_cast<VObjContext*>(contexts.e[c]);
+		if (!oc || !oc->obj) continue;
+
+		int kid;
+		if (stacki < 0) kid = oc->limboi();
+		else if (oc->spreadpage() == stacki && oc->layer() == layeri) kid = oc->layeri();
+		else continue;
+		if (kid < 0) continue;
+
+		if (*first < 0 || kid < *first) *first = kid;
+		if (kid > *last) *last = kid;
+	}
+}
+
+/*! Pick up layers rendered in the background, and keep redrawing while layercache
+ * has stale layers it can render.
+ */
+int LaidoutViewport::Idle(int tid, double delta)
+{
+	if (tid != layercache_timer) return ViewportWindow::Idle(tid, delta);
+
+	if (layercache.Collect() > 0) needtodraw = 1;
+
+	if (layercache.NumStale() > 0) needtodraw = 1;
+	else if (layercache.NumPending() == 0) {
+		layercache_timer = 0;
+		return 1;
+	}
+	return 0;
+}
+
 //! Draw the whole business.
 /*!
  * <pre>
@@ -3023,8 +3159,11 @@ void LaidoutViewport::TriggerFilterUpdates(int reason)
  *
  * </pre>
  *
- * \todo *** have choice about smart refreshing, and in diff.
- *   thread.. periodically check to see if more recent refresh requested?
+ * Layers are drawn through layercache, so only kids being edited and layers that
+ * changed are rasterized again. See LayerRasterCache. With the background_render
+ * preference, stale layers are rendered on worker threads, and only the kids being
+ * edited and the interfaces are drawn here.
+ *
  * \todo *** implement the 'whatever' page, which is basically just a big whiteboard
  */
 void LaidoutViewport::Refresh()
@@ -3072,9 +3211,12 @@ void LaidoutViewport::Refresh()
 
 	 // draw limbo objects
 	// DBG cerr <<"drawing limbo objects.."<<endl;
-	for (c=0; c<limbo->n(); c++) {
-		DrawData(dp,limbo->e(c),NULL,NULL,drawflags);
-	}
+	 //only kids near the screen are drawn, see DRAW_CULL, and static ones come from layercache
+	layercache.background = laidout->prefs.background_render;
+	layercache.BeginFrame();
+	int editfirst, editlast;
+	EditedKids(-1,-1, &editfirst, &editlast);
+	layercache.DrawLayer(dp, limbo, editfirst, editlast, drawflags | DRAW_CULL);
 
 	// DBGCAIROSTATUS(" LO viewport after  limbo, cairo status:  ")
 
@@ -3194,6 +3336,7 @@ void LaidoutViewport::Refresh()
 					page  = spread->pagestack.e[c]->page = doc->pages.e[pagei];
 				}
 			}
+			if (page && page->page_loaded == 0) doc->LoadPage(pagei); //was unloaded by some other view
 
 			if (!page) {
 				// if no page, then draw an x through the page stack outline
@@ -3242,11 +3385,12 @@ void LaidoutViewport::Refresh()
 					if (bleed->index < 0 || bleed->index >= doc->pages.n) continue;
 					Page *otherpage = doc->pages[bleed->index];
 					if (!otherpage) continue;
+					if (otherpage->page_loaded == 0) doc->LoadPage(bleed->index);
 					
 					dp->PushAndNewTransform(bleed->matrix);
 
 					for (c2 = 0; c2 < otherpage->layers.n(); c2++) {
-						DrawData(dp,otherpage->e(c2),NULL,NULL,drawflags);
+						layercache.DrawLayer(dp, otherpage->e(c2), -1,-1, drawflags | DRAW_CULL);
 					}
 
 					dp->PopAxes();
@@ -3283,7 +3427,8 @@ void LaidoutViewport::Refresh()
 			for (c2 = 0; c2 < page->layers.n(); c2++) {
 				// DBG cerr <<"  num objs in page: "<<page->n()<<endl;
 				// DBG cerr <<"  Layer "<<c2<<", objs.n="<<page->e(c2)->n()<<endl;
-				DrawData(dp,page->e(c2),NULL,NULL,drawflags);
+				EditedKids(c, c2, &editfirst, &editlast);
+				layercache.DrawLayer(dp, page->e(c2), editfirst, editlast, drawflags | DRAW_CULL);
 			}
 			
 			if (page->pagestyle->flags & PAGE_CLIPS) {
@@ -3295,6 +3440,9 @@ void LaidoutViewport::Refresh()
 		}
 	}
 	
+	 //keep refreshing while the cache has layers left to render
+	if (layercache.EndFrame() > 0 && !layercache_timer) layercache_timer = app->addtimer(this, 50, 50, -1);
+
 	if (papergroup) {
 		 //draw paper objects
 		ViewerWindow *vw = dynamic_cast<ViewerWindow *>(win_parent);
@@ -5023,6 +5171,10 @@ int ViewWindow::Event(const Laxkit::EventData *data,const char *mes)
 			}
 		}
 		
+		 //tools don't always touch objects they recolor
+		LaidoutViewport *lvp = dynamic_cast<LaidoutViewport*>(viewport);
+		if (lvp) lvp->InvalidateCaches(false);
+
 		return 0;
 
 	} else if (!strcmp(mes,"make curcolor")) {
@@ -5317,6 +5469,7 @@ int ViewWindow::Event(const Laxkit::EventData *data,const char *mes)
 			const char *v = doc->metadata->findValue("Name");
 			if (v) doc->Name(v);
 		}
+		doc->Touch();
 		SetParentTitle((doc && doc->Name(1)) ? doc->Name(1) :_("(no doc)"));
 		return 0;
 
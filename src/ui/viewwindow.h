@@ -24,6 +24,7 @@
 #include <lax/button.h>
 
 #include "../core/document.h"
+#include "layercache.h"
 
 
 
@@ -92,6 +93,10 @@ class LaidoutViewport : public LaxInterfaces::ViewportWindow,
 
 	char *pageviewlabel;
 
+	LayerRasterCache layercache;
+	int layercache_timer;
+	virtual void EditedKids(int stacki, int layeri, int *first, int *last);
+
 	virtual void setupthings(int tospread=-1,int topage=-1);
 	virtual void UpdateMarkers();
 	virtual void setCurobj(VObjContext *voc);
@@ -120,6 +125,7 @@ class LaidoutViewport : public LaxInterfaces::ViewportWindow,
 	virtual const char *whattype() { return "LaidoutViewport"; }
 	virtual Laxkit::ShortcutHandler *GetShortcuts();
 	virtual void Refresh();
+	virtual int Idle(int tid, double delta);
 	virtual int init();
 	virtual int CharInput(unsigned int ch,const char *buffer,int len,unsigned int state,const Laxkit::LaxKeyboard *d);
 	virtual int LBDown(int x,int y,unsigned int state,int count,const Laxkit::LaxMouse *mouse);
@@ -186,6 +192,7 @@ class LaidoutViewport : public LaxInterfaces::ViewportWindow,
 	virtual void ClearSelection();
 	virtual int wipeContext();
 	virtual void clearCurobj();
+	virtual void InvalidateCaches(bool kids_indexes);
 	virtual int locateObject(LaxInterfaces::SomeData *d,FieldPlace &place);
 	virtual int curobjPage();
 	virtual int isDefaultPapergroup(int yes_if_in_project);